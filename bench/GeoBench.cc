@@ -0,0 +1,430 @@
+// Micro-benchmarks of the parsers, query builders and geometry helpers which run on every request.
+//
+// Parsers run on the JSON fixtures in bench/fixtures, which have the layout and sizes of real API responses
+// (see make_fixtures.py). Set GEO_BENCH_FIXTURES to a directory with recorded responses of the same names
+// to run on them instead. Lookups of the offline city and name indexes run on small indexes of generated
+// places, written to temporary files.
+//
+// Every benchmark reports ops/s (items_per_second) and allocs/op, the number of operator new calls per
+// iteration; parsers also report MB/s (bytes_per_second). To compare two commits:
+//    geo_bench --benchmark_out=before.json --benchmark_out_format=json
+//    geo_bench --benchmark_out=after.json --benchmark_out_format=json
+//    compare.py benchmarks before.json after.json   (tools/compare.py of Google Benchmark)
+
+#include "search/CityIndex.h"
+#include "search/CityIndexBuilder.h"
+#include "search/NameIndex.h"
+#include "search/NameIndexBuilder.h"
+#include "search/NominatimApiUtils.h"
+#include "search/OpenMeteoApiUtils.h"
+#include "search/OverpassApiUtils.h"
+#include "search/SearchEngine.h"
+#include "utils/GeoUtils.h"
+#include "utils/TimeUtils.h"
+
+#include <benchmark/benchmark.h>
+
+#include <atomic>
+#include <cstdint>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <new>
+#include <numbers>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+namespace
+{
+
+std::atomic<std::uint64_t> s_numAllocations{0};  // Number of operator new calls since start
+
+}  // namespace
+
+// Global allocation functions count allocations of the whole process, the benchmarks run on a single thread.
+void* operator new(std::size_t size)
+{
+   s_numAllocations.fetch_add(1, std::memory_order_relaxed);
+   if (void* p = std::malloc(size != 0 ? size : 1))
+      return p;
+   throw std::bad_alloc();
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+   s_numAllocations.fetch_add(1, std::memory_order_relaxed);
+   return std::malloc(size != 0 ? size : 1);
+}
+
+void operator delete(void* p) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+   std::free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+   std::free(p);
+}
+
+namespace
+{
+
+using namespace geo;
+
+// Counts allocations of the timed loop of a benchmark and reports them per iteration
+class AllocationCounter
+{
+public:
+   explicit AllocationCounter(benchmark::State& state)
+      : m_state(state)
+      , m_start(s_numAllocations.load(std::memory_order_relaxed))
+   {
+   }
+
+   ~AllocationCounter()
+   {
+      const auto numAllocations = s_numAllocations.load(std::memory_order_relaxed) - m_start;
+      m_state.counters["allocs/op"] =
+         benchmark::Counter(static_cast<double>(numAllocations), benchmark::Counter::kAvgIterations);
+   }
+
+private:
+   benchmark::State& m_state;  // Benchmark which is measured
+   std::uint64_t m_start = 0;  // Number of allocations before the loop
+};
+
+// Reads a fixture file, throws std::runtime_error if it cannot be read
+std::string loadFixture(const char* name)
+{
+   const char* directory = std::getenv("GEO_BENCH_FIXTURES");
+   const std::string path = std::string(directory ? directory : GEO_BENCH_FIXTURES_DIR) + "/" + name;
+   std::ifstream file(path, std::ios::binary);
+   if (!file.is_open())
+      throw std::runtime_error("Failed to open fixture file: " + path);
+
+   std::stringstream buffer;
+   buffer << file.rdbuf();
+   return buffer.str();
+}
+
+// Index file in the temporary directory, removed when the benchmark ends
+class TemporaryFile
+{
+public:
+   // @param name Name of the file, made unique by the process ID
+   explicit TemporaryFile(const std::string& name)
+      : m_path(std::filesystem::temp_directory_path() / (name + "." + std::to_string(::getpid())))
+   {
+   }
+
+   ~TemporaryFile()
+   {
+      std::error_code error;
+      std::filesystem::remove(m_path, error);
+   }
+
+   TemporaryFile(const TemporaryFile&) = delete;
+   TemporaryFile& operator=(const TemporaryFile&) = delete;
+
+   // Returns path of the file
+   std::string GetPath() const { return m_path.string(); }
+
+private:
+   std::filesystem::path m_path;  // Path of the file
+};
+
+constexpr double sc_cellSize = 0.1;  // Size of a grid cell of generated places in degrees
+
+// Returns the center of a grid cell of generated places, the grid starts at (40, 0)
+// @param row Row of the cell
+// @param column Column of the cell
+CityIndexBuilder::Point getCellCenter(std::int64_t row, std::int64_t column)
+{
+   return {40 + (static_cast<double>(row) + 0.5) * sc_cellSize, (static_cast<double>(column) + 0.5) * sc_cellSize};
+}
+
+// Writes a city index of `side` x `side` cities on a grid, each bounded by a 64-gon inscribed in its cell,
+// and of states covering 8 x 8 cities each, so lookups check both kinds of places
+// @param side Number of cities in a row and in a column
+// @param path Path to the index file
+void writeCityIndex(std::int64_t side, const std::string& path)
+{
+   constexpr int numPoints = 64;
+   CityIndexBuilder builder;
+   for (std::int64_t row = 0; row < side; ++row)
+   {
+      for (std::int64_t column = 0; column < side; ++column)
+      {
+         const auto center = getCellCenter(row, column);
+         CityIndexBuilder::Ring ring;
+         for (int i = 0; i < numPoints; ++i)
+         {
+            const double angle = 2 * std::numbers::pi * i / numPoints;
+            ring.push_back({center.latitude + 0.45 * sc_cellSize * std::sin(angle),
+               center.longitude + 0.45 * sc_cellSize * std::cos(angle)});
+         }
+         builder.Add({row * side + column + 1, CityIndex::City, "City " + std::to_string(row * side + column), "",
+            center.latitude, center.longitude, {std::move(ring)}});
+      }
+   }
+
+   for (std::int64_t row = 0; row < side; row += 8)
+   {
+      for (std::int64_t column = 0; column < side; column += 8)
+      {
+         const double south = 40 + static_cast<double>(row) * sc_cellSize;
+         const double west = static_cast<double>(column) * sc_cellSize;
+         const double north = south + 8 * sc_cellSize;
+         const double east = west + 8 * sc_cellSize;
+         builder.Add({side * side + row * side + column + 1, CityIndex::State, "State", "", (south + north) / 2,
+            (west + east) / 2, {{{south, west}, {south, east}, {north, east}, {north, west}}}});
+      }
+   }
+   builder.Write(path);
+}
+
+// Writes a name index of `numPlaces` cities named "City <n>", with the other name "Stadt <n>"
+// @param numPlaces Number of places
+// @param path Path to the index file
+void writeNameIndex(std::int64_t numPlaces, const std::string& path)
+{
+   NameIndexBuilder builder;
+   for (std::int64_t i = 0; i < numPlaces; ++i)
+   {
+      const auto center = getCellCenter(i / 256, i % 256);
+      builder.Add({i + 1, CityIndex::City, "City " + std::to_string(i), "", center.latitude, center.longitude,
+         {"Stadt " + std::to_string(i)}});
+   }
+   builder.Write(path);
+}
+
+// Reports throughput of a parser in bytes and responses per second
+void setParserCounters(benchmark::State& state, const std::string& json)
+{
+   state.SetBytesProcessed(static_cast<std::int64_t>(state.iterations() * json.size()));
+   state.SetItemsProcessed(state.iterations());
+}
+
+void BM_OverpassExtractRelationIds(benchmark::State& state)
+{
+   const std::string json = loadFixture("overpass_relation_ids.json");
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         auto ids = overpass::ExtractRelationIds(json);
+         benchmark::DoNotOptimize(ids);
+      }
+   }
+   setParserCounters(state, json);
+}
+BENCHMARK(BM_OverpassExtractRelationIds);
+
+void BM_OverpassExtractCityDetails(benchmark::State& state)
+{
+   const std::string json = loadFixture("overpass_city_details.json");
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         auto features = overpass::ExtractCityDetails(json);
+         benchmark::DoNotOptimize(features);
+      }
+   }
+   setParserCounters(state, json);
+}
+BENCHMARK(BM_OverpassExtractCityDetails);
+
+void BM_OverpassExtractCityDetailsByRelation(benchmark::State& state)
+{
+   const std::string json = loadFixture("overpass_city_details.json");
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         GeoProtoArena arena;
+         auto details = overpass::ExtractCityDetailsByRelation(json, &arena);
+         benchmark::DoNotOptimize(details);
+      }
+   }
+   setParserCounters(state, json);
+}
+BENCHMARK(BM_OverpassExtractCityDetailsByRelation);
+
+void BM_NominatimParseLookupResponse(benchmark::State& state)
+{
+   const std::string json = loadFixture("nominatim_lookup.json");
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         nominatim::RelationInfos relations;
+         nominatim::ParseLookupResponse(json, relations);
+         benchmark::DoNotOptimize(relations);
+      }
+   }
+   setParserCounters(state, json);
+}
+BENCHMARK(BM_NominatimParseLookupResponse);
+
+void BM_OpenMeteoParseWeatherResponse(benchmark::State& state)
+{
+   const std::string json = loadFixture("openmeteo_weather.json");
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         auto weather = openmeteo::ParseWeatherResponse(json);
+         benchmark::DoNotOptimize(weather);
+      }
+   }
+   setParserCounters(state, json);
+}
+BENCHMARK(BM_OpenMeteoParseWeatherResponse);
+
+void BM_StringToDate(benchmark::State& state)
+{
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         auto date = StringToDate("2023-07-14");
+         benchmark::DoNotOptimize(date);
+      }
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_StringToDate);
+
+// Argument is a bit mask of the requested objects
+void BM_FormatRegionsRequest(benchmark::State& state)
+{
+   ISearchEngine::RegionPreferences prefs;
+   prefs.objects = static_cast<std::uint32_t>(state.range(0));
+   prefs.properties["minPeakHeight"] = "2500";
+   const BoundingBox bbox = CreateBoundingBox(46.5, 8.0, 100000);
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         auto request = FormatRegionsRequest(prefs, bbox);
+         benchmark::DoNotOptimize(request);
+      }
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FormatRegionsRequest)
+   ->Arg(geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_PEAKS)
+   ->Arg(geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_INTERNATIONAL_AIRPORTS |
+         geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_PEAKS |
+         geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_SEA_BEACHES |
+         geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_SALT_LAKES);
+
+// Argument is the search range in kilometers, boxes are limited to 2x2 degrees as in geo-config.json
+void BM_CreateBoundingBoxes(benchmark::State& state)
+{
+   const auto rangeMeters = static_cast<std::uint32_t>(state.range(0) * 1000);
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         auto boxes = CreateBoundingBoxes(46.5, 8.0, rangeMeters, 2, 2);
+         benchmark::DoNotOptimize(boxes);
+      }
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CreateBoundingBoxes)->Arg(100)->Arg(1000);
+
+void BM_GetBoundingBoxDimensionsKm(benchmark::State& state)
+{
+   const std::vector<BoundingBox> boxes = CreateBoundingBoxes(46.5, 8.0, 1000000, 2, 2);
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         for (const auto& bbox : boxes)
+         {
+            auto dimensions = GetBoundingBoxDimensionsKm(bbox);
+            benchmark::DoNotOptimize(dimensions);
+         }
+      }
+   }
+   state.SetItemsProcessed(static_cast<std::int64_t>(state.iterations() * boxes.size()));
+}
+BENCHMARK(BM_GetBoundingBoxDimensionsKm);
+
+// Argument is the number of cities in a row and in a column of the generated grid
+void BM_CityIndexFindByPosition(benchmark::State& state)
+{
+   const std::int64_t side = state.range(0);
+   const TemporaryFile file("geo_bench_cities.idx");
+   writeCityIndex(side, file.GetPath());
+   const CityIndex index(file.GetPath());
+
+   // Random positions in the grid, most of them inside a city and the others only inside a state
+   std::mt19937 random(1);
+   std::uniform_real_distribution<double> coordinate(0, static_cast<double>(side) * sc_cellSize);
+   std::vector<CityIndexBuilder::Point> positions(1024);
+   for (auto& position : positions)
+      position = {40 + coordinate(random), coordinate(random)};
+
+   std::size_t next = 0;
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         const auto& position = positions[next++ % positions.size()];
+         auto place = index.FindBest(position.latitude, position.longitude);
+         benchmark::DoNotOptimize(place);
+      }
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_CityIndexFindByPosition)->Arg(32)->Arg(256);
+
+// Argument is the number of places in the generated index
+void BM_NameIndexFind(benchmark::State& state)
+{
+   const std::int64_t numPlaces = state.range(0);
+   const TemporaryFile file("geo_bench_names.idx");
+   writeNameIndex(numPlaces, file.GetPath());
+   const NameIndex index(file.GetPath());
+
+   // Names as users type them, in both languages, and every eighth one missing from the index
+   std::mt19937 random(1);
+   std::uniform_int_distribution<std::int64_t> place(0, numPlaces - 1);
+   std::vector<std::string> names(1024);
+   for (std::size_t i = 0; i < names.size(); ++i)
+   {
+      const auto id = std::to_string(place(random));
+      names[i] = i % 8 == 7 ? "Town " + id : i % 2 == 0 ? "city  " + id : "STADT " + id;
+   }
+
+   std::size_t next = 0;
+   {
+      AllocationCounter counter(state);
+      for (auto _ : state)
+      {
+         auto places = index.Find(names[next++ % names.size()]);
+         benchmark::DoNotOptimize(places);
+      }
+   }
+   state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_NameIndexFind)->Arg(1024)->Arg(65536);
+
+}  // namespace
+
+BENCHMARK_MAIN();
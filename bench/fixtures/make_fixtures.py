@@ -0,0 +1,144 @@
+"""
+Writes the JSON fixtures of geo_bench.
+
+The fixtures follow the layout and the sizes of real Overpass, Nominatim and Open Meteo responses
+(a 2x2 degree region search, details of a few big cities, a full lookup chunk and a year of daily weather),
+but the values are generated from a fixed seed, so the files can be regenerated and compared between commits:
+
+    python3 bench/fixtures/make_fixtures.py bench/fixtures
+
+Recorded responses may be put in place of the generated files, the benchmarks only depend on the file names.
+"""
+
+import argparse
+import datetime
+import json
+import math
+import os
+import random
+
+OSM3S = {
+    "timestamp_osm_base": "2024-11-02T10:15:32Z",
+    "timestamp_areas_base": "2024-11-01T21:47:05Z",
+    "copyright": "The data included in this document is from www.openstreetmap.org. "
+                 "The data is made available under ODbL.",
+}
+
+SYLLABLES = ["ber", "lin", "mar", "ka", "sto", "ri", "vel", "na", "dor", "hei", "burg", "tal", "sen", "ro", "ma"]
+
+
+def make_name(rng, min_syllables=2, max_syllables=4):
+    name = "".join(rng.choice(SYLLABLES) for _ in range(rng.randint(min_syllables, max_syllables)))
+    return name.capitalize()
+
+
+def overpass_document(elements):
+    return {"version": 0.6, "generator": "Overpass API 0.7.62.1 084b4234", "osm3s": OSM3S, "elements": elements}
+
+
+def make_relation_ids(rng):
+    # Administrative relations of a 2x2 degree region search, output with "out ids"
+    return overpass_document([{"type": "relation", "id": rng.randint(10000, 17000000)} for _ in range(2500)])
+
+
+def make_city_details(rng):
+    # Hotels and museums of several cities, every city starts with its relation, see LoadCityDetailsByRelationIds
+    elements = []
+    for _ in range(4):
+        elements.append({"type": "relation", "id": rng.randint(10000, 17000000)})
+        lat, lon = rng.uniform(-60, 70), rng.uniform(-180, 180)
+        for _ in range(rng.randint(250, 400)):
+            tags = {"tourism": rng.choice(["hotel", "hotel", "hotel", "museum", "guest_house"]), "name": make_name(rng)}
+            if rng.random() < 0.4:
+                tags["name:en"] = make_name(rng)
+            if rng.random() < 0.6:
+                tags["addr:street"] = make_name(rng) + " Street"
+                tags["addr:housenumber"] = str(rng.randint(1, 300))
+            if rng.random() < 0.3:
+                tags["website"] = "https://www." + make_name(rng).lower() + ".example"
+            if rng.random() < 0.3:
+                tags["stars"] = str(rng.randint(1, 5))
+            elements.append({"type": "node", "id": rng.randint(10 ** 8, 10 ** 10),
+                             "lat": round(lat + rng.uniform(-0.2, 0.2), 7),
+                             "lon": round(lon + rng.uniform(-0.2, 0.2), 7), "tags": tags})
+    return overpass_document(elements)
+
+
+def make_nominatim_lookup(rng):
+    # A full lookup chunk of 50 relations
+    items = []
+    for i in range(50):
+        address_type = rng.choice(["city", "town", "state", "county", "municipality", "village"])
+        name, state, country = make_name(rng), make_name(rng), make_name(rng, 2, 3)
+        lat, lon = rng.uniform(-60, 70), rng.uniform(-180, 180)
+        address = {address_type: name, "ISO3166-2-lvl4": "XX-" + state[:3].upper(), "country": country,
+                   "country_code": country[:2].lower()}
+        if address_type != "state":
+            address["state"] = state
+        items.append({
+            "place_id": rng.randint(10 ** 7, 4 * 10 ** 8),
+            "licence": "Data © OpenStreetMap contributors, ODbL 1.0. http://osm.org/copyright",
+            "osm_type": "relation",
+            "osm_id": rng.randint(10000, 17000000),
+            "lat": "%.7f" % lat,
+            "lon": "%.7f" % lon,
+            "class": "boundary",
+            "type": "administrative",
+            "place_rank": rng.choice([8, 12, 16, 18]),
+            "importance": rng.random(),
+            "addresstype": address_type,
+            "name": name,
+            "display_name": ", ".join([name, state, country]),
+            "address": address,
+            "boundingbox": ["%.7f" % (lat - 0.2), "%.7f" % (lat + 0.2), "%.7f" % (lon - 0.3), "%.7f" % (lon + 0.3)],
+        })
+    return items
+
+
+def make_weather(rng):
+    # A year of daily temperatures, the last days are not published yet
+    first = datetime.date(2023, 1, 1)
+    days = [first + datetime.timedelta(days=i) for i in range(365)]
+    maxima, minima = [], []
+    for i in range(len(days)):
+        base = 12 - 12 * math.cos(2 * math.pi * i / 365)
+        maxima.append(round(base + rng.uniform(2, 8), 1))
+        minima.append(round(base - rng.uniform(2, 8), 1))
+    for i in range(1, 4):
+        maxima[-i] = None
+        minima[-i] = None
+    return {
+        "latitude": 52.52,
+        "longitude": 13.419998,
+        "generationtime_ms": 0.4259347915649414,
+        "utc_offset_seconds": 0,
+        "timezone": "GMT",
+        "timezone_abbreviation": "GMT",
+        "elevation": 38.0,
+        "daily_units": {"time": "iso8601", "temperature_2m_max": "°C", "temperature_2m_min": "°C"},
+        "daily": {"time": [day.isoformat() for day in days], "temperature_2m_max": maxima,
+                  "temperature_2m_min": minima},
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Writes the JSON fixtures of geo_bench")
+    parser.add_argument("directory", nargs="?", default=os.path.dirname(os.path.abspath(__file__)))
+    args = parser.parse_args()
+
+    rng = random.Random(20241102)
+    fixtures = {
+        "overpass_relation_ids.json": (make_relation_ids(rng), 2),
+        "overpass_city_details.json": (make_city_details(rng), 2),
+        "nominatim_lookup.json": (make_nominatim_lookup(rng), None),
+        "openmeteo_weather.json": (make_weather(rng), None),
+    }
+    for name, (document, indent) in fixtures.items():
+        # Overpass pretty-prints its responses, Nominatim and Open Meteo do not
+        with open(os.path.join(args.directory, name), "w", encoding="utf-8") as file:
+            json.dump(document, file, ensure_ascii=False, indent=indent,
+                      separators=(",", ": ") if indent else (",", ":"))
+
+
+if __name__ == "__main__":
+    main()
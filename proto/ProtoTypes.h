@@ -2,14 +2,24 @@
 
 #include "geo.pb.h"
 
+#include <google/protobuf/arena.h>
+#include <google/protobuf/repeated_ptr_field.h>
+
 #include <vector>
 
 namespace geo
 {
 
+// Repeated fields below allocate their elements on the arena they are created with, if any.
+// Fields on the same arena are swapped without copying, so results are built on the arena of the response.
+using GeoProtoArena = google::protobuf::Arena;
 using GeoProtoTaggedFeature = geoproto::Place::TaggedFeature;
-using GeoProtoTaggedFeatures = std::vector<GeoProtoTaggedFeature>;
+using GeoProtoTaggedFeatures = google::protobuf::RepeatedPtrField<GeoProtoTaggedFeature>;
 using GeoProtoPlace = geoproto::Place;
-using GeoProtoPlaces = std::vector<GeoProtoPlace>;
+using GeoProtoPlaces = google::protobuf::RepeatedPtrField<GeoProtoPlace>;
+using GeoProtoPoint = geoproto::Point;
+using GeoProtoPoints = std::vector<GeoProtoPoint>;
+using GeoProtoWeather = geoproto::Weather;
+using GeoProtoWeathers = std::vector<GeoProtoWeather>;
 
 }  // namespace geo
@@ -1,16 +1,25 @@
 #include "DebugHelpers.h"
 
 #include "ProtoTypes.h"
+#include "search/CityIndex.h"
+#include "search/LocalSearchEngine.h"
+#include "search/NameIndex.h"
 #include "search/SearchEngine.h"
 #include "search/SearchEngineItf.h"
 #include "utils/ConfigConstants.h"
 #include "utils/Configuration.h"
 #include "utils/WebClient.h"
+#include "utils/WebEventLoop.h"
 
 #include <absl/log/log.h>
 
+#include <chrono>
 #include <format>
+#include <future>
+#include <memory>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace geo::debug
 {
@@ -44,6 +53,16 @@ void printDetails(const WeatherInfoVector& weather)
    }
 }
 
+// Reads concurrency limits of the search engine from the configuration, caches are not used by debug helpers
+SearchEngine::Settings makeSearchEngineSettings(const Configuration& configuration)
+{
+   SearchEngine::Settings settings;
+   settings.maxOngoingWeatherRequests = configuration.GetInt64(sz_maxOngoingWeatherRequestsKey);
+   settings.maxOngoingOverpassRequests = configuration.GetInt64(sz_maxOngoingOverpassRequestsKey);
+   settings.maxOngoingNominatimRequests = configuration.GetInt64(sz_maxOngoingNominatimRequestsKey);
+   return settings;
+}
+
 }  // namespace
 
 void Search(const std::string& name, const std::string& configFilePath)
@@ -51,8 +70,11 @@ void Search(const std::string& name, const std::string& configFilePath)
    Configuration configuration(configFilePath.c_str());
    geo::WebClient overpassApiClient(configuration.GetString(sz_overpassEndpointKey));
    geo::WebClient nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey));
-   geo::SearchEngine engine(overpassApiClient, nominatimApiClient);
-   auto cities = engine.FindCitiesByName(name, true);
+   geo::WebClient openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey));
+   geo::SearchEngine engine(
+      overpassApiClient, nominatimApiClient, openMeteoApiClient, makeSearchEngineSettings(configuration));
+   GeoProtoPlaces cities;
+   engine.FindCitiesByName(name, true, cities);
    printDetails(cities);
 }
 
@@ -61,8 +83,11 @@ void Search(double latitude, double longitude, const std::string& configFilePath
    Configuration configuration(configFilePath.c_str());
    geo::WebClient overpassApiClient(configuration.GetString(sz_overpassEndpointKey));
    geo::WebClient nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey));
-   geo::SearchEngine engine(overpassApiClient, nominatimApiClient);
-   auto cities = engine.FindCitiesByPosition(latitude, longitude, true);
+   geo::WebClient openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey));
+   geo::SearchEngine engine(
+      overpassApiClient, nominatimApiClient, openMeteoApiClient, makeSearchEngineSettings(configuration));
+   GeoProtoPlaces cities;
+   engine.FindCitiesByPosition(latitude, longitude, true, cities);
    printDetails(cities);
 }
 
@@ -76,17 +101,16 @@ void Search(
    Configuration configuration(configFilePath.c_str());
    geo::WebClient overpassApiClient(configuration.GetString(sz_overpassEndpointKey));
    geo::WebClient nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey));
-   geo::SearchEngine engine(overpassApiClient, nominatimApiClient);
+   geo::WebClient openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey));
+   geo::SearchEngine engine(
+      overpassApiClient, nominatimApiClient, openMeteoApiClient, makeSearchEngineSettings(configuration));
    auto handler = engine.StartFindRegions();
 
    GeoProtoPlaces regions;
    auto maxBoxWidth = configuration.GetInt64(sz_maxBoxWidthKey);
    auto maxBoxHeight = configuration.GetInt64(sz_maxBoxHeightKey);
    for (auto& bbox : CreateBoundingBoxes(latitude, longitude, rangeKm * 1000, maxBoxWidth, maxBoxHeight))
-   {
-      auto iterationResult = handler(bbox, {filter, props});
-      regions.insert(regions.begin(), iterationResult.begin(), iterationResult.end());
-   }
+      handler(bbox, {filter, props}, regions);
    printDetails(regions);
 }
 
@@ -96,10 +120,139 @@ void RequestWeather(double latitude, double longitude, const std::string& fromDa
    Configuration configuration(configFilePath.c_str());
    geo::WebClient overpassApiClient(configuration.GetString(sz_overpassEndpointKey));
    geo::WebClient nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey));
-   geo::SearchEngine engine(overpassApiClient, nominatimApiClient);
+   geo::WebClient openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey));
+   geo::SearchEngine engine(
+      overpassApiClient, nominatimApiClient, openMeteoApiClient, makeSearchEngineSettings(configuration));
 
    const auto weather = engine.GetWeather(latitude, longitude, {StringToDate(fromDate), StringToDate(toDate)});
    printDetails(weather);
 }
 
+void LoadUrl(const std::string& url, std::uint32_t numRequests, const std::string& configFilePath)
+{
+   Configuration configuration(configFilePath.c_str());
+   const auto numThreads = configuration.GetInt64(sz_webClientThreadsKey);
+   WebClient::Options options;
+   options.eventLoop = std::make_shared<WebEventLoop>(numThreads);
+   geo::WebClient client(url, options);
+
+   const auto startTime = std::chrono::steady_clock::now();
+   std::vector<std::future<std::string>> responses;
+   for (std::uint32_t i = 0; i < numRequests; ++i)
+      responses.emplace_back(client.GetAsync(std::format("n={}", i)));
+
+   std::uint32_t numSucceeded = 0;
+   for (auto& r : responses)
+      numSucceeded += r.get().empty() ? 0 : 1;
+
+   const auto elapsed =
+      std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime);
+   const auto stats = client.GetStatistics();
+   LOG(INFO) << std::format("{} of {} requests succeeded in {} ms using {} event loop thread(s), {} reused connections",
+      numSucceeded, numRequests, elapsed.count(), numThreads, stats.numReusedConnections);
+}
+
+void CompareCitySearch(const std::string& cityIndexPath, const std::string& configFilePath)
+{
+   // Sample coordinates from README.md
+   const std::vector<std::pair<double, double>> positions = {
+      {14.594582,   -90.517661       },
+      {55.991893,   37.214390        },
+      {39.858014,   -4.029030        },
+      {39.019368,   125.754257       },
+      {11.552898,   104.865913       },
+      {30.050755,   31.246909        },
+      {22.563887,   88.345477        },
+      {50.450441,   30.523550        },
+      {39.739253,   -104.989117      },
+      {41.116525,   1.257839         },
+      {40.1777112,  44.5126233       },
+      {45.20842335, 58.52356612752623}
+   };
+
+   Configuration configuration(configFilePath.c_str());
+   geo::WebClient overpassApiClient(configuration.GetString(sz_overpassEndpointKey));
+   geo::WebClient nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey));
+   geo::WebClient openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey));
+   geo::SearchEngine remoteEngine(
+      overpassApiClient, nominatimApiClient, openMeteoApiClient, makeSearchEngineSettings(configuration));
+   geo::LocalSearchEngine localEngine(std::make_unique<CityIndex>(cityIndexPath), nullptr, overpassApiClient,
+      std::make_unique<geo::SearchEngine>(
+         overpassApiClient, nominatimApiClient, openMeteoApiClient, makeSearchEngineSettings(configuration)));
+
+   // Positions outside of the index are answered by the fallback, which is logged by the local engine.
+   auto search = [](ISearchEngine& engine, double latitude, double longitude, GeoProtoPlaces& cities)
+   {
+      const auto startTime = std::chrono::steady_clock::now();
+      engine.FindCitiesByPosition(latitude, longitude, false, cities);
+      return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+   };
+
+   std::chrono::microseconds totalLocalTime{0};
+   std::chrono::microseconds totalRemoteTime{0};
+   for (const auto& [latitude, longitude] : positions)
+   {
+      GeoProtoPlaces local;
+      GeoProtoPlaces remote;
+      const auto localTime = search(localEngine, latitude, longitude, local);
+      const auto remoteTime = search(remoteEngine, latitude, longitude, remote);
+      totalLocalTime += localTime;
+      totalRemoteTime += remoteTime;
+
+      LOG(INFO) << std::format("({},{}): local \"{}\" ({}) in {} us, remote \"{}\" ({}) in {} us", latitude, longitude,
+         local.empty() ? "" : local[0].name(), local.empty() ? "" : local[0].country(), localTime.count(),
+         remote.empty() ? "" : remote[0].name(), remote.empty() ? "" : remote[0].country(), remoteTime.count());
+   }
+   LOG(INFO) << std::format(
+      "Total time: local {} us, remote {} us", totalLocalTime.count(), totalRemoteTime.count());
+}
+
+void CompareCityNameSearch(const std::string& nameIndexPath, const std::string& configFilePath)
+{
+   // Names of the sample coordinates from README.md
+   const std::vector<std::string> names = {"Guatemala", "Zelenograd", "Toledo", "Pyongyang", "Phnom Penh", "Cairo",
+      "Kolkata", "Kiev", "Denver", "Tarragona", "Yerevan"};
+
+   Configuration configuration(configFilePath.c_str());
+   geo::WebClient overpassApiClient(configuration.GetString(sz_overpassEndpointKey));
+   geo::WebClient nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey));
+   geo::WebClient openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey));
+   geo::SearchEngine remoteEngine(
+      overpassApiClient, nominatimApiClient, openMeteoApiClient, makeSearchEngineSettings(configuration));
+   geo::LocalSearchEngine localEngine(nullptr, std::make_unique<NameIndex>(nameIndexPath), overpassApiClient,
+      std::make_unique<geo::SearchEngine>(
+         overpassApiClient, nominatimApiClient, openMeteoApiClient, makeSearchEngineSettings(configuration)));
+
+   // Names missing in the index are answered by the fallback, which is logged by the local engine.
+   auto search = [](ISearchEngine& engine, const std::string& name, GeoProtoPlaces& cities)
+   {
+      const auto startTime = std::chrono::steady_clock::now();
+      engine.FindCitiesByName(name, false, cities);
+      return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime);
+   };
+
+   std::chrono::microseconds totalLocalTime{0};
+   std::chrono::microseconds totalRemoteTime{0};
+   for (const auto& name : names)
+   {
+      GeoProtoPlaces local;
+      GeoProtoPlaces remote;
+      const auto localTime = search(localEngine, name, local);
+      const auto remoteTime = search(remoteEngine, name, remote);
+      totalLocalTime += localTime;
+      totalRemoteTime += remoteTime;
+
+      LOG(INFO) << std::format("\"{}\": local {} places in {} us, remote {} places in {} us", name, local.size(),
+         localTime.count(), remote.size(), remoteTime.count());
+      for (const auto& c : local)
+         LOG(INFO) << std::format("   local \"{}\" ({}) ({},{})", c.name(), c.country(), c.center().latitude(),
+            c.center().longitude());
+      for (const auto& c : remote)
+         LOG(INFO) << std::format("   remote \"{}\" ({}) ({},{})", c.name(), c.country(), c.center().latitude(),
+            c.center().longitude());
+   }
+   LOG(INFO) << std::format(
+      "Total time: local {} us, remote {} us", totalLocalTime.count(), totalRemoteTime.count());
+}
+
 }  // namespace geo::debug
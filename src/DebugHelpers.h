@@ -20,4 +20,15 @@ void Search(double latitude, double longitude, std::uint32_t rangeMeters, std::u
 void RequestWeather(double latitude, double longitude, const std::string& fromDate, const std::string& toDate,
    const std::string& configFilePath);
 
+// Send many concurrent GET requests to a URL (e.g. tests/mock_server.py) and report how long they took.
+void LoadUrl(const std::string& url, std::uint32_t numRequests, const std::string& configFilePath);
+
+// Find cities at the sample coordinates from README.md with the offline city index and with the remote APIs,
+// and compare the results and the time they took.
+void CompareCitySearch(const std::string& cityIndexPath, const std::string& configFilePath);
+
+// Find cities by the names of the sample coordinates from README.md with the offline name index and with the remote
+// APIs, and compare the results and the time they took.
+void CompareCityNameSearch(const std::string& nameIndexPath, const std::string& configFilePath);
+
 }  // namespace geo::debug
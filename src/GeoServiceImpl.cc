@@ -2,43 +2,224 @@
 
 #include "reactors/GetCitiesReactor.h"
 #include "reactors/GetRegionsReactor.h"
+#include "reactors/GetWeatherReactor.h"
+#include "search/CityIndex.h"
+#include "search/LocalSearchEngine.h"
+#include "search/NameIndex.h"
+#include "search/NominatimApiUtils.h"
+#include "search/OpenMeteoApiUtils.h"
+#include "search/OverpassApiUtils.h"
 #include "search/SearchEngine.h"
 #include "utils/ConfigConstants.h"
 #include "utils/Configuration.h"
 
+#include <absl/strings/str_split.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace
+{
+
+// Reads settings shared by all API clients, and the limits of an API, from the configuration
+// @param isCacheable Check of the responses of the API before they are stored in the response cache
+// @param name Name of the API in metrics
+// @param requestsPerSecondKey Configuration key of the rate limit of the API
+// @param maxConcurrencyKey Configuration key of the upper bound of the concurrency limit of the API
+geo::WebClient::Options makeWebClientOptions(const geo::Configuration& configuration, geo::WebEventLoopPtr eventLoop,
+   geo::ResponseCache* responseCache, geo::ResponseCache::Validator isCacheable, const char* name,
+   const char* requestsPerSecondKey, const char* maxConcurrencyKey)
+{
+   geo::WebClient::Options options;
+   options.name = name;
+   options.connectionPoolSize = configuration.GetInt64(geo::sz_connectionPoolSizeKey);
+   options.connectionIdleTimeout =
+      std::chrono::seconds{configuration.GetInt64(geo::sz_connectionIdleTimeoutSecondsKey)};
+   options.eventLoop = std::move(eventLoop);
+   options.responseCache = responseCache;
+   options.isCacheable = std::move(isCacheable);
+   options.limits.maxRequestsPerSecond = static_cast<std::uint32_t>(configuration.GetInt64(requestsPerSecondKey));
+   options.limits.maxConcurrency = static_cast<std::uint32_t>(configuration.GetInt64(maxConcurrencyKey));
+   return options;
+}
+
+// Reads settings of the Overpass API client, which hedges slow requests to other instances if they are configured
+geo::WebClient::Options makeOverpassClientOptions(
+   const geo::Configuration& configuration, geo::WebEventLoopPtr eventLoop, geo::ResponseCache* responseCache)
+{
+   auto options = makeWebClientOptions(configuration, std::move(eventLoop), responseCache,
+      geo::overpass::IsCompleteResponse, "overpass", geo::sz_overpassRequestsPerSecondKey,
+      geo::sz_overpassMaxConcurrencyKey);
+   const std::string hedgeEndpoints = configuration.GetString(geo::sz_overpassHedgeEndpointsKey);
+   for (const auto url : absl::StrSplit(hedgeEndpoints, ',', absl::SkipEmpty()))
+      options.hedgeUrls.emplace_back(url);
+   options.hedgePercentile = static_cast<std::uint32_t>(configuration.GetInt64(geo::sz_hedgePercentileKey));
+   options.hedgeBudgetPercent = static_cast<std::uint32_t>(configuration.GetInt64(geo::sz_hedgeBudgetPercentKey));
+   return options;
+}
+
+// Opens the persistent response cache, if it is configured
+std::unique_ptr<geo::ResponseCache> makeResponseCache(const geo::Configuration& configuration)
+{
+   geo::ResponseCache::Settings settings;
+   settings.directory = configuration.GetString(geo::sz_responseCachePathKey);
+   if (settings.directory.empty())
+      return nullptr;
+
+   settings.maxSizeBytes = configuration.GetInt64(geo::sz_responseCacheMaxMBKey) * 1024 * 1024;
+   settings.ttl = std::chrono::seconds{configuration.GetInt64(geo::sz_responseCacheTtlSecondsKey)};
+   settings.compactionInterval =
+      std::chrono::seconds{configuration.GetInt64(geo::sz_responseCacheCompactionSecondsKey)};
+   return std::make_unique<geo::ResponseCache>(settings);
+}
+
+// Reads sampling and output settings of RPC traces from the configuration
+geo::Tracer::Settings makeTracerSettings(const geo::Configuration& configuration)
+{
+   geo::Tracer::Settings settings;
+   settings.samplingPercent = static_cast<std::uint32_t>(configuration.GetInt64(geo::sz_traceSamplingPercentKey));
+   settings.slowThreshold = std::chrono::milliseconds{configuration.GetInt64(geo::sz_slowTraceThresholdMsKey)};
+   settings.slowTracePath = configuration.GetString(geo::sz_slowTracePathKey);
+   return settings;
+}
+
+// Starts the metrics endpoint, if it is configured
+std::unique_ptr<geo::MetricsServer> makeMetricsServer(const geo::Configuration& configuration)
+{
+   const auto port = configuration.GetInt64(geo::sz_metricsPortKey);
+   if (port <= 0)
+      return nullptr;
+   return std::make_unique<geo::MetricsServer>(geo::MetricsRegistry::GetDefault(), static_cast<std::uint16_t>(port));
+}
+
+// Reads settings of the Nominatim lookup cache from the configuration
+geo::nominatim::RelationCache::Settings makeRelationCacheSettings(const geo::Configuration& configuration)
+{
+   geo::nominatim::RelationCache::Settings settings;
+   settings.maxMemoryBytes = configuration.GetInt64(geo::sz_relationCacheMaxMemoryMBKey) * 1024 * 1024;
+   settings.ttl = std::chrono::seconds{configuration.GetInt64(geo::sz_relationCacheTtlSecondsKey)};
+   settings.negativeTtl = std::chrono::seconds{configuration.GetInt64(geo::sz_relationCacheNegativeTtlSecondsKey)};
+   return settings;
+}
+
+// Reads settings of the Overpass region tile cache from the configuration
+geo::RegionTileCache::Settings makeRegionTileCacheSettings(const geo::Configuration& configuration)
+{
+   geo::RegionTileCache::Settings settings;
+   settings.tileSizeDegrees = configuration.GetDouble(geo::sz_regionTileSizeDegreesKey);
+   settings.maxTiles = configuration.GetInt64(geo::sz_regionTileCacheMaxTilesKey);
+   settings.ttl = std::chrono::seconds{configuration.GetInt64(geo::sz_regionTileCacheTtlSecondsKey)};
+   return settings;
+}
+
+// Reads settings of the store of daily temperatures from the configuration
+geo::WeatherStore::Settings makeWeatherStoreSettings(const geo::Configuration& configuration)
+{
+   geo::WeatherStore::Settings settings;
+   settings.cellsPerDegree = static_cast<std::int32_t>(configuration.GetInt64(geo::sz_weatherCellsPerDegreeKey));
+   settings.maxMemoryBytes = configuration.GetInt64(geo::sz_weatherStoreMaxMemoryMBKey) * 1024 * 1024;
+   return settings;
+}
+
+// Reads concurrency limits of the search engine from the configuration and attaches shared caches
+geo::SearchEngine::Settings makeSearchEngineSettings(const geo::Configuration& configuration,
+   geo::nominatim::RelationCache& relationCache, geo::RegionTileCache& regionTileCache,
+   geo::WeatherStore& weatherStore)
+{
+   geo::SearchEngine::Settings settings;
+   settings.maxOngoingWeatherRequests = configuration.GetInt64(geo::sz_maxOngoingWeatherRequestsKey);
+   settings.maxOngoingOverpassRequests = configuration.GetInt64(geo::sz_maxOngoingOverpassRequestsKey);
+   settings.maxOngoingNominatimRequests = configuration.GetInt64(geo::sz_maxOngoingNominatimRequestsKey);
+   settings.relationCache = &relationCache;
+   settings.regionTileCache = &regionTileCache;
+   if (configuration.GetInt64(geo::sz_weatherStoreMaxMemoryMBKey) > 0)
+      settings.weatherStore = &weatherStore;
+   return settings;
+}
+
+// Creates the search engine. If the city or name index is configured, positions or names are looked up
+// in the index first.
+std::unique_ptr<geo::ISearchEngine> makeSearchEngine(const geo::Configuration& configuration,
+   geo::WebClient& overpassApiClient, geo::WebClient& nominatimApiClient, geo::WebClient& openMeteoApiClient,
+   geo::nominatim::RelationCache& relationCache, geo::RegionTileCache& regionTileCache,
+   geo::WeatherStore& weatherStore)
+{
+   auto searchEngine = std::make_unique<geo::SearchEngine>(overpassApiClient, nominatimApiClient, openMeteoApiClient,
+      makeSearchEngineSettings(configuration, relationCache, regionTileCache, weatherStore));
+
+   const std::string cityIndexPath = configuration.GetString(geo::sz_cityIndexPathKey);
+   const std::string nameIndexPath = configuration.GetString(geo::sz_nameIndexPathKey);
+   if (cityIndexPath.empty() && nameIndexPath.empty())
+      return searchEngine;
+
+   return std::make_unique<geo::LocalSearchEngine>(
+      cityIndexPath.empty() ? nullptr : std::make_unique<geo::CityIndex>(cityIndexPath),
+      nameIndexPath.empty() ? nullptr : std::make_unique<geo::NameIndex>(nameIndexPath), overpassApiClient,
+      std::move(searchEngine));
+}
+
+}  // namespace
+
 namespace geo
 {
 
 GeoServiceImpl::GeoServiceImpl(const Configuration& configuration)
-   : m_overpassApiClient(configuration.GetString(sz_overpassEndpointKey))    // Initialize Overpass API client
-   , m_nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey))  // Initialize Nominatim API client
-   , m_searchEngine(
-        std::make_unique<SearchEngine>(m_overpassApiClient, m_nominatimApiClient))  // Initialize search engine
+   : m_webEventLoop(std::make_shared<WebEventLoop>(configuration.GetInt64(sz_webClientThreadsKey)))
+   , m_responseCache(makeResponseCache(configuration))
+   , m_overpassApiClient(configuration.GetString(sz_overpassEndpointKey),
+        makeOverpassClientOptions(configuration, m_webEventLoop, m_responseCache.get()))
+   , m_nominatimApiClient(configuration.GetString(sz_nominatimEndpointKey),
+        makeWebClientOptions(configuration, m_webEventLoop, m_responseCache.get(), nominatim::IsLookupResponse,
+           "nominatim", sz_nominatimRequestsPerSecondKey, sz_nominatimMaxConcurrencyKey))
+   , m_openMeteoApiClient(configuration.GetString(sz_openMeteoEndpointKey),
+        makeWebClientOptions(configuration, m_webEventLoop, m_responseCache.get(), openmeteo::IsWeatherResponse,
+           "openmeteo", sz_openMeteoRequestsPerSecondKey, sz_openMeteoMaxConcurrencyKey))
+   , m_relationCache(makeRelationCacheSettings(configuration))
+   , m_regionTileCache(makeRegionTileCacheSettings(configuration))
+   , m_weatherStore(makeWeatherStoreSettings(configuration))
+   , m_searchEngine(makeSearchEngine(configuration, m_overpassApiClient, m_nominatimApiClient, m_openMeteoApiClient,
+        m_relationCache, m_regionTileCache, m_weatherStore))  // Initialize search engine
+   , m_regionsStreamSettings{static_cast<std::uint32_t>(configuration.GetInt64(sz_maxBoxWidthKey)),
+        static_cast<std::uint32_t>(configuration.GetInt64(sz_maxBoxHeightKey)),
+        static_cast<std::size_t>(configuration.GetInt64(sz_maxOngoingRegionTilesKey))}
+   , m_citiesMessageAllocator(configuration.GetInt64(sz_responseArenaInitialBlockKBKey) * 1024,
+        configuration.GetInt64(sz_responseArenaMaxBlockKBKey) * 1024)
+   , m_regionsMessageAllocator(configuration.GetInt64(sz_responseArenaInitialBlockKBKey) * 1024,
+        configuration.GetInt64(sz_responseArenaMaxBlockKBKey) * 1024)
+   , m_tracer(makeTracerSettings(configuration))
+   , m_executor(configuration.GetInt64(sz_executorThreadsKey), configuration.GetInt64(sz_executorQueueDepthKey))
+   , m_metricsServer(makeMetricsServer(configuration))
 {
+   // Responses of the unary RPCs are built directly on per-RPC arenas.
+   // GetWeather responses are small, and GetRegionsStream writes messages owned by its reactor.
+   SetMessageAllocatorFor_GetCities(&m_citiesMessageAllocator);
+   SetMessageAllocatorFor_GetRegions(&m_regionsMessageAllocator);
 }
 
 grpc::ServerUnaryReactor* GeoServiceImpl::GetCities(
    grpc::CallbackServerContext* context, const geoproto::CitiesRequest* request, geoproto::CitiesResponse* response)
 {
-   return new GetCitiesReactor(context, *request, *response, *m_searchEngine);
+   return new GetCitiesReactor(context, *request, *response, *m_searchEngine, m_executor, m_tracer);
 }
 
 grpc::ServerUnaryReactor* GeoServiceImpl::GetRegions(
    grpc::CallbackServerContext* context, const geoproto::RegionsRequest* request, geoproto::RegionsResponse* response)
 {
-   return new GetRegionsReactor(context, *request, *response, *m_searchEngine);
+   return new GetRegionsReactor(context, *request, *response, *m_searchEngine, m_executor, m_tracer);
 }
 
 grpc::ServerWriteReactor<geoproto::RegionsResponse>* GeoServiceImpl::GetRegionsStream(
    grpc::CallbackServerContext* context, const geoproto::RegionsRequest* request)
 {
-   return nullptr;  // gRPC sends grpc::StatusCode::UNIMPLEMENTED to Client
+   return new GetRegionsStreamReactor(
+      context, *request, *m_searchEngine, m_executor, m_regionsStreamSettings, m_tracer);
 }
 
 grpc::ServerUnaryReactor* GeoServiceImpl::GetWeather(
    grpc::CallbackServerContext* context, const geoproto::WeatherRequest* request, ::geoproto::WeatherResponse* response)
 {
-   return nullptr;  // gRPC sends grpc::StatusCode::UNIMPLEMENTED to Client
+   return new GetWeatherReactor(context, *request, *response, *m_searchEngine, m_executor, m_tracer);
 }
 
 }  // namespace geo
@@ -2,8 +2,18 @@
 
 #include "geo.grpc.pb.h"
 #include "geo.pb.h"
+#include "reactors/GetRegionsStreamReactor.h"
+#include "search/RegionTileCache.h"
+#include "search/RelationCache.h"
 #include "search/SearchEngineItf.h"
+#include "search/WeatherStore.h"
+#include "utils/ArenaMessageAllocator.h"
+#include "utils/Executor.h"
+#include "utils/MetricsServer.h"
+#include "utils/Tracing.h"
+#include "utils/ResponseCache.h"
 #include "utils/WebClient.h"
+#include "utils/WebEventLoop.h"
 
 #include <memory>
 
@@ -54,12 +64,49 @@ public:
       ::geoproto::WeatherResponse* response) override;
 
 private:
-   // WebClient instances to interact with the Overpass API and Nominatim API for geographic data.
+   // Event loop shared by all API clients. It performs HTTP transfers asynchronously on a few dedicated threads.
+   WebEventLoopPtr m_webEventLoop;
+
+   // Persistent cache of API responses shared by all API clients, so a restarted server does not start cold.
+   // It is nullptr if the cache is not configured.
+   std::unique_ptr<ResponseCache> m_responseCache;
+
+   // WebClient instances to interact with the Overpass API and Nominatim API for geographic data,
+   // and with the Open Meteo API for historical weather.
    WebClient m_overpassApiClient;
    WebClient m_nominatimApiClient;
+   WebClient m_openMeteoApiClient;
+
+   // Cache of Nominatim lookups shared by all searches.
+   nominatim::RelationCache m_relationCache;
+
+   // Cache of Overpass region searches snapped to a global tile grid, shared by all searches.
+   RegionTileCache m_regionTileCache;
+
+   // Store of daily temperatures received from Open Meteo, shared by all searches.
+   WeatherStore m_weatherStore;
 
-   // A search engine for handling location-based queries, uses Overpass and Nominatim APIs.
+   // A search engine for handling location-based queries, uses Overpass, Nominatim and Open Meteo APIs,
+   // and the offline city index if it is configured.
    std::unique_ptr<ISearchEngine> m_searchEngine;
+
+   // Tiling and concurrency settings for GetRegionsStream RPC.
+   GetRegionsStreamReactor::Settings m_regionsStreamSettings;
+
+   // Allocators placing messages of every GetCities and GetRegions RPC on its own arena.
+   ArenaMessageAllocator<geoproto::CitiesRequest, geoproto::CitiesResponse> m_citiesMessageAllocator;
+   ArenaMessageAllocator<geoproto::RegionsRequest, geoproto::RegionsResponse> m_regionsMessageAllocator;
+
+   // Tracer deciding which RPCs are traced and writing traces of slow ones.
+   Tracer m_tracer;
+
+   // Executor running searches of all the reactors. It is destroyed first, so queued searches
+   // can still use the search engine.
+   Executor m_executor;
+
+   // HTTP endpoint exposing latency histograms and counters of the RPCs and API clients to Prometheus.
+   // It is nullptr if the metrics port is not configured.
+   std::unique_ptr<MetricsServer> m_metricsServer;
 };
 
 }  // namespace geo
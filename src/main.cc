@@ -1,6 +1,7 @@
 #include "DebugHelpers.h"
 #include "GeoServiceImpl.h"
 #include "utils/Configuration.h"
+#include "utils/Logging.h"
 
 #include <absl/flags/commandlineflag.h>
 #include <absl/flags/flag.h>
@@ -55,6 +56,10 @@ ABSL_FLAG(std::uint32_t, filter, 0, "[Debug] Bitmask to specify which features t
 ABSL_FLAG(std::string, name, "", "[Debug] Search for cities by name");
 ABSL_FLAG(std::string, fromDate, "", "[Debug] Start date for weather request");
 ABSL_FLAG(std::string, toDate, "", "[Debug] End date for weather request");
+ABSL_FLAG(std::string, url, "", "[Debug] Send concurrent GET requests to this URL");
+ABSL_FLAG(std::uint32_t, requests, 0, "[Debug] Number of concurrent GET requests to send");
+ABSL_FLAG(std::string, cityIndex, "", "[Debug] Compare city search with this city index against remote search");
+ABSL_FLAG(std::string, nameIndex, "", "[Debug] Compare city search with this name index against remote search");
 
 int main(int argc, char** argv)
 {
@@ -62,6 +67,9 @@ int main(int argc, char** argv)
    absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
    absl::InitializeLog();
 
+   // Messages are written to stderr by a background thread, so logging does not block RPCs
+   geo::AsyncLogSink logSink;
+
    const std::string configFilePath = absl::GetFlag(FLAGS_config);
    if (configFilePath.empty())
    {
@@ -77,8 +85,18 @@ int main(int argc, char** argv)
       std::string name = absl::GetFlag(FLAGS_name);
       std::string fromDate = absl::GetFlag(FLAGS_fromDate);
       std::string toDate = absl::GetFlag(FLAGS_toDate);
+      std::string url = absl::GetFlag(FLAGS_url);
+      std::uint32_t requests = absl::GetFlag(FLAGS_requests);
+      std::string cityIndex = absl::GetFlag(FLAGS_cityIndex);
+      std::string nameIndex = absl::GetFlag(FLAGS_nameIndex);
 
-      if (!name.empty())
+      if (!url.empty() && requests != 0)
+         geo::debug::LoadUrl(url, requests, configFilePath);
+      else if (!cityIndex.empty())
+         geo::debug::CompareCitySearch(cityIndex, configFilePath);
+      else if (!nameIndex.empty())
+         geo::debug::CompareCityNameSearch(nameIndex, configFilePath);
+      else if (!name.empty())
          geo::debug::Search(name, configFilePath);
       else if (lat != NAN && lon != NAN && !fromDate.empty() && !toDate.empty())
          geo::debug::RequestWeather(lat, lon, fromDate, toDate, configFilePath);
@@ -1,6 +1,7 @@
 #include "GetCitiesReactor.h"
 
 #include "../search/SearchEngineItf.h"
+#include "../utils/Executor.h"
 #include "../utils/GeoUtils.h"
 #include "../utils/grpcUtils.h"
 #include "RequestValidators.h"
@@ -9,40 +10,74 @@
 
 #include <format>
 
+namespace
+{
+
+// Returns metrics shared by all GetCities() RPCs
+geo::RpcMetrics& getRpcMetrics()
+{
+   static geo::RpcMetrics s_metrics("GetCities");
+   return s_metrics;
+}
+
+}  // namespace
+
 namespace geo
 {
 
 GetCitiesReactor::GetCitiesReactor(grpc::CallbackServerContext* context, const geoproto::CitiesRequest& request,
-   geoproto::CitiesResponse& response, ISearchEngine& searchEngine)
+   geoproto::CitiesResponse& response, ISearchEngine& searchEngine, Executor& executor, Tracer& tracer)
+   : m_metrics(getRpcMetrics(), *context, tracer)
 {
    if (auto errorString = ValidateCitiesRequest(request))
    {
       LOG(ERROR) << std::format("Bad request, client-id={}", geo::ExtractClientId(*context));
-      Finish(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString});
+      Finish(m_metrics.SetStatus(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString}));
       return;
    }
 
-   GeoProtoPlaces cities;  // Container to hold the search results.
+   // Request and response stay alive until the RPC is finished, so they can be used by the task.
+   const bool scheduled = executor.Submit(
+      [this, &request, &response, &searchEngine, queued = Trace::Clock::now()]
+      {
+         // Work of the RPC on executor and event loop threads is added to its trace and follows its deadline
+         Trace::Scope scope(m_metrics.GetTrace());
+         RpcContext::Scope rpcScope(m_metrics.GetRpcContext());
+         Trace::AddCurrentSpan("queue", queued);
+         process(request, response, searchEngine);
+      });
+   if (!scheduled)
+   {
+      LOG(ERROR) << std::format("Executor queue is full, client-id={}", geo::ExtractClientId(*context));
+      Finish(m_metrics.SetStatus(grpc::Status{grpc::StatusCode::RESOURCE_EXHAUSTED, "Server is overloaded"}));
+   }
+}
+
+void GetCitiesReactor::process(
+   const geoproto::CitiesRequest& request, geoproto::CitiesResponse& response, ISearchEngine& searchEngine)
+{
+   const auto start = Trace::Clock::now();
+
+   // The search populates the response directly, so the cities are allocated on the arena of the RPC.
+   GeoProtoPlaces& cities = *response.mutable_cities();
 
    // Check if the request includes a position (latitude/longitude) for the search.
    if (request.has_position())
    {
       // Find cities by their geographic position.
-      cities = searchEngine.FindCitiesByPosition(
-         request.position().latitude(), request.position().longitude(), request.include_details());
+      searchEngine.FindCitiesByPosition(
+         request.position().latitude(), request.position().longitude(), request.include_details(), cities);
    }
    // Check if the request includes a city name for the search.
    else if (request.has_name())
    {
       // Find cities by their name.
-      cities = searchEngine.FindCitiesByName(request.name(), request.include_details());
+      searchEngine.FindCitiesByName(request.name(), request.include_details(), cities);
    }
 
-   // Populate the response with the found cities.
-   *response.mutable_cities() = {std::make_move_iterator(cities.begin()), std::make_move_iterator(cities.end())};
-
    // Finish the RPC with a success status.
-   Finish(grpc::Status::OK);
+   Trace::AddCurrentSpan("search", start);
+   Finish(m_metrics.SetStatus(grpc::Status::OK));
 }
 
 }  // namespace geo
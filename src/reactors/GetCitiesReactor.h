@@ -1,5 +1,6 @@
 #pragma once
 
+#include "RpcMetrics.h"
 #include "geo.grpc.pb.h"
 
 #include <absl/log/log.h>
@@ -13,6 +14,7 @@ namespace geo
 
 class WebClient;
 class ISearchEngine;
+class Executor;
 
 // Reactor class for handling unary (non-streaming) responses for the GetCities RPC.
 // This class is responsible for processing a single request and returning a single response
@@ -25,10 +27,16 @@ public:
    // @param request: The incoming CitiesRequest from the client.
    // @param response: The CitiesResponse to be populated and sent back to the client.
    // @param searchEngine: Reference to the search engine used to find cities.
+   // @param executor: Executor which runs the search, so that gRPC callback threads are not blocked.
+   // @param tracer: Tracer deciding whether the RPC is traced.
    GetCitiesReactor(grpc::CallbackServerContext* context, const geoproto::CitiesRequest& request,
-      geoproto::CitiesResponse& response, ISearchEngine& searchEngine);
+      geoproto::CitiesResponse& response, ISearchEngine& searchEngine, Executor& executor, Tracer& tracer);
 
 private:
+   // Runs the search on an executor thread, populates the response and finishes the RPC.
+   void process(
+      const geoproto::CitiesRequest& request, geoproto::CitiesResponse& response, ISearchEngine& searchEngine);
+
    // Called when the RPC is completed. Logs the completion and cleans up the reactor.
    void OnDone() override
    {
@@ -36,8 +44,15 @@ private:
       delete this;
    }
 
-   // Called when the RPC is cancelled by the client. Logs the cancellation.
-   void OnCancel() override { LOG(ERROR) << std::format("GetCities() RPC cancelled"); }
+   // Called when the RPC is cancelled by the client. Logs the cancellation and aborts the upstream requests.
+   void OnCancel() override
+   {
+      LOG(ERROR) << std::format("GetCities() RPC cancelled");
+      m_metrics.SetCancelled();
+   }
+
+private:
+   RpcMetrics::Call m_metrics;  // Latency and status of the RPC
 };
 
 }  // namespace geo
\ No newline at end of file
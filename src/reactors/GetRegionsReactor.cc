@@ -1,26 +1,61 @@
 #include "GetRegionsReactor.h"
 
 #include "../search/SearchEngineItf.h"
+#include "../utils/Executor.h"
 #include "../utils/GeoUtils.h"
 #include "../utils/grpcUtils.h"
 #include "RequestValidators.h"
 
 #include <format>
-#include <iterator>
+
+namespace
+{
+
+// Returns metrics shared by all GetRegions() RPCs
+geo::RpcMetrics& getRpcMetrics()
+{
+   static geo::RpcMetrics s_metrics("GetRegions");
+   return s_metrics;
+}
+
+}  // namespace
 
 namespace geo
 {
 
 GetRegionsReactor::GetRegionsReactor(grpc::CallbackServerContext* context, const geoproto::RegionsRequest& request,
-   geoproto::RegionsResponse& response, ISearchEngine& searchEngine)
+   geoproto::RegionsResponse& response, ISearchEngine& searchEngine, Executor& executor, Tracer& tracer)
+   : m_metrics(getRpcMetrics(), *context, tracer)
 {
    if (auto errorString = ValidateRegionsRequest(request))
    {
       LOG(ERROR) << std::format("Bad request, client-id={}", geo::ExtractClientId(*context));
-      Finish(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString});
+      Finish(m_metrics.SetStatus(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString}));
       return;
    }
 
+   // Request and response stay alive until the RPC is finished, so they can be used by the task.
+   const bool scheduled = executor.Submit(
+      [this, &request, &response, &searchEngine, queued = Trace::Clock::now()]
+      {
+         // Work of the RPC on executor and event loop threads is added to its trace and follows its deadline
+         Trace::Scope scope(m_metrics.GetTrace());
+         RpcContext::Scope rpcScope(m_metrics.GetRpcContext());
+         Trace::AddCurrentSpan("queue", queued);
+         process(request, response, searchEngine);
+      });
+   if (!scheduled)
+   {
+      LOG(ERROR) << std::format("Executor queue is full, client-id={}", geo::ExtractClientId(*context));
+      Finish(m_metrics.SetStatus(grpc::Status{grpc::StatusCode::RESOURCE_EXHAUSTED, "Server is overloaded"}));
+   }
+}
+
+void GetRegionsReactor::process(
+   const geoproto::RegionsRequest& request, geoproto::RegionsResponse& response, ISearchEngine& searchEngine)
+{
+   const auto start = Trace::Clock::now();
+
    // Convert protocol buffer properties to search engine preferences
    const ISearchEngine::RegionPreferences::Properties props = {
       request.prefs().properties().begin(), request.prefs().properties().end()};
@@ -30,12 +65,12 @@ GetRegionsReactor::GetRegionsReactor(grpc::CallbackServerContext* context, const
    const auto box =
       CreateBoundingBox(request.position().latitude(), request.position().longitude(), request.distance_km() * 1000);
 
-   // Execute region search and populate response
-   auto regions = searchEngine.StartFindRegions()(box, prefs);
-   *response.mutable_regions() = {std::make_move_iterator(regions.begin()), std::make_move_iterator(regions.end())};
+   // Execute region search and populate response, on the arena of the RPC
+   searchEngine.StartFindRegions()(box, prefs, *response.mutable_regions());
 
    // Complete the RPC successfully
-   Finish(grpc::Status::OK);
+   Trace::AddCurrentSpan("search", start);
+   Finish(m_metrics.SetStatus(grpc::Status::OK));
 }
 
 }  // namespace geo
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "RpcMetrics.h"
 #include "geo.grpc.pb.h"
 
 #include <absl/log/log.h>
@@ -13,6 +14,7 @@ namespace geo
 
 class WebClient;
 class ISearchEngine;
+class Executor;
 
 // Reactor class for handling unary (non-streaming) responses for the GetRegions RPC.
 // This class processes a single request and returns region data matching the query.
@@ -24,10 +26,16 @@ public:
    // @param request: The incoming RegionsRequest containing search parameters.
    // @param response: The RegionsResponse to be populated with results.
    // @param searchEngine: Reference to the search engine used to find regions.
+   // @param executor: Executor which runs the search, so that gRPC callback threads are not blocked.
+   // @param tracer: Tracer deciding whether the RPC is traced.
    GetRegionsReactor(grpc::CallbackServerContext* context, const geoproto::RegionsRequest& request,
-      geoproto::RegionsResponse& response, ISearchEngine& searchEngine);
+      geoproto::RegionsResponse& response, ISearchEngine& searchEngine, Executor& executor, Tracer& tracer);
 
 private:
+   // Runs the search on an executor thread, populates the response and finishes the RPC.
+   void process(
+      const geoproto::RegionsRequest& request, geoproto::RegionsResponse& response, ISearchEngine& searchEngine);
+
    // Called when the RPC is completed. Logs completion and cleans up the reactor.
    void OnDone() override
    {
@@ -36,7 +44,14 @@ private:
    }
 
    // Called when the RPC is cancelled. Logs the cancellation.
-   void OnCancel() override { LOG(ERROR) << "GetRegions() RPC cancelled"; }
+   void OnCancel() override
+   {
+      LOG(ERROR) << "GetRegions() RPC cancelled";
+      m_metrics.SetCancelled();
+   }
+
+private:
+   RpcMetrics::Call m_metrics;  // Latency and status of the RPC
 };
 
 }  // namespace geo
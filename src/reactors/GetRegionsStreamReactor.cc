@@ -0,0 +1,171 @@
+#include "GetRegionsStreamReactor.h"
+
+#include "../utils/Executor.h"
+#include "../utils/grpcUtils.h"
+#include "RequestValidators.h"
+
+#include <algorithm>
+#include <format>
+#include <utility>
+
+namespace
+{
+
+// Returns metrics shared by all GetRegionsStream() RPCs
+geo::RpcMetrics& getRpcMetrics()
+{
+   static geo::RpcMetrics s_metrics("GetRegionsStream");
+   return s_metrics;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+GetRegionsStreamReactor::GetRegionsStreamReactor(grpc::CallbackServerContext* context,
+   const geoproto::RegionsRequest& request, ISearchEngine& searchEngine, Executor& executor, const Settings& settings,
+   Tracer& tracer)
+   : m_metrics(getRpcMetrics(), *context, tracer)
+   , m_executor(executor)
+   , m_maxOngoingTiles(std::max<std::size_t>(1, settings.maxOngoingTiles))
+{
+   if (auto errorString = ValidateRegionsRequest(request))
+   {
+      LOG(ERROR) << std::format("Bad request, client-id={}", geo::ExtractClientId(*context));
+      m_finished = true;
+      Finish(m_metrics.SetStatus(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString}));
+      return;
+   }
+
+   // Convert protocol buffer properties to search engine preferences
+   m_prefs.objects = request.prefs().mask();
+   m_prefs.properties = {request.prefs().properties().begin(), request.prefs().properties().end()};
+
+   // Split the box around requested position into tiles (converting km to meters)
+   m_tiles = CreateBoundingBoxes(request.position().latitude(), request.position().longitude(),
+      request.distance_km() * 1000, settings.maxBoxWidth, settings.maxBoxHeight);
+
+   // All the tiles share one incremental search, so regions found in several tiles are sent only once
+   m_handler = searchEngine.StartFindRegions();
+
+   step();
+}
+
+void GetRegionsStreamReactor::OnWriteDone(bool ok)
+{
+   {
+      std::lock_guard lock(m_mutex);
+      m_writing = false;
+      if (!ok && !m_error)
+         m_error = grpc::Status{grpc::StatusCode::UNAVAILABLE, "Cannot write regions to the stream"};
+   }
+   step();
+}
+
+void GetRegionsStreamReactor::OnCancel()
+{
+   LOG(ERROR) << "GetRegionsStream() RPC cancelled";
+   m_metrics.SetCancelled();
+   {
+      std::lock_guard lock(m_mutex);
+      m_error = grpc::Status::CANCELLED;
+   }
+   step();
+}
+
+void GetRegionsStreamReactor::searchTile(std::size_t index)
+{
+   bool cancelled = false;
+   {
+      std::lock_guard lock(m_mutex);
+      cancelled = m_error.has_value();
+   }
+
+   geoproto::RegionsResponse response;
+   if (!cancelled)
+   {
+      ScopedSpan span("tile");
+      m_handler(m_tiles[index], m_prefs, *response.mutable_regions());
+   }
+
+   {
+      std::lock_guard lock(m_mutex);
+      if (response.regions_size() > 0 && !m_error)
+         m_pendingWrites.push_back(std::move(response));
+   }
+   step(true);
+}
+
+void GetRegionsStreamReactor::step(bool tileDone)
+{
+   std::vector<std::size_t> tilesToSearch;
+   bool needWrite = false;
+   std::optional<grpc::Status> finishStatus;
+   {
+      std::lock_guard lock(m_mutex);
+      if (tileDone)
+         --m_numTilesInFlight;
+      if (m_finished)
+         return;
+
+      if (!m_error)
+      {
+         // Responses waiting for the client count against the limit too - this is the backpressure
+         while (m_nextTile < m_tiles.size() && m_numTilesInFlight + m_pendingWrites.size() < m_maxOngoingTiles)
+         {
+            tilesToSearch.push_back(m_nextTile++);
+            ++m_numTilesInFlight;
+         }
+
+         // Only one write may be in progress at a time
+         if (!m_writing && !m_pendingWrites.empty())
+         {
+            m_currentWrite = std::move(m_pendingWrites.front());
+            m_pendingWrites.pop_front();
+            m_writing = needWrite = true;
+         }
+      }
+
+      const bool allDone = m_nextTile == m_tiles.size() && m_pendingWrites.empty();
+      if (m_numTilesInFlight == 0 && !m_writing && (m_error || allDone))
+      {
+         m_finished = true;
+         finishStatus = m_error.value_or(grpc::Status::OK);
+      }
+   }
+
+   // Tiles which are not submitted yet are still in flight, so the RPC cannot be finished by another thread here
+   bool rejected = false;
+   for (const auto index : tilesToSearch)
+   {
+      if (rejected || !m_executor.Submit(
+                         [this, index]
+                         {
+                            Trace::Scope scope(m_metrics.GetTrace());
+                            RpcContext::Scope rpcScope(m_metrics.GetRpcContext());
+                            searchTile(index);
+                         }))
+      {
+         // The last rejected tile finishes the RPC if nothing else is in progress, in the same critical section
+         rejected = true;
+         std::lock_guard lock(m_mutex);
+         --m_numTilesInFlight;
+         if (!m_error)
+            m_error = grpc::Status{grpc::StatusCode::RESOURCE_EXHAUSTED, "Server is overloaded"};
+         if (m_numTilesInFlight == 0 && !m_writing && !m_finished)
+         {
+            m_finished = true;
+            finishStatus = m_error;
+         }
+      }
+   }
+
+   if (needWrite)
+      StartWrite(&m_currentWrite);
+
+   if (finishStatus)
+      Finish(m_metrics.SetStatus(*finishStatus));
+}
+
+}  // namespace geo
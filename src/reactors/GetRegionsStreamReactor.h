@@ -0,0 +1,93 @@
+#pragma once
+
+#include "../search/SearchEngineItf.h"
+#include "../utils/GeoUtils.h"
+#include "RpcMetrics.h"
+#include "geo.grpc.pb.h"
+
+#include <absl/log/log.h>
+#include <grpc/grpc.h>
+#include <grpcpp/support/server_callback.h>
+
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace geo
+{
+
+class Executor;
+
+// Reactor class for handling server-streaming responses for the GetRegionsStream RPC.
+// The requested square box is split into tiles which are searched in parallel on the executor.
+// Regions of every tile are written to the client as soon as the tile is finished.
+// Number of tiles being searched plus number of responses waiting for the client is limited,
+// so a slow client slows down the search instead of growing unbounded buffers.
+class GetRegionsStreamReactor : public grpc::ServerWriteReactor<geoproto::RegionsResponse>
+{
+public:
+   // Tiling and concurrency settings
+   struct Settings
+   {
+      std::uint32_t maxBoxWidth = 0;    // Maximum width of a tile in degrees
+      std::uint32_t maxBoxHeight = 0;   // Maximum height of a tile in degrees
+      std::size_t maxOngoingTiles = 1;  // Maximum number of tiles being searched or waiting for the client
+   };
+
+public:
+   // Constructor for the GetRegionsStreamReactor.
+   // @param context: Server context.
+   // @param request: The incoming RegionsRequest containing search parameters.
+   // @param searchEngine: Reference to the search engine used to find regions.
+   // @param executor: Executor which runs searches of the tiles.
+   // @param settings: Tiling and concurrency settings.
+   // @param tracer: Tracer deciding whether the RPC is traced.
+   GetRegionsStreamReactor(grpc::CallbackServerContext* context, const geoproto::RegionsRequest& request,
+      ISearchEngine& searchEngine, Executor& executor, const Settings& settings, Tracer& tracer);
+
+private:
+   // Called when a response is sent to the client. Starts the next write and more tile searches.
+   void OnWriteDone(bool ok) override;
+
+   // Called when the RPC is completed. Logs completion and cleans up the reactor.
+   void OnDone() override
+   {
+      LOG(INFO) << "GetRegionsStream() RPC completed";
+      delete this;
+   }
+
+   // Called when the RPC is cancelled. Stops searching remaining tiles.
+   void OnCancel() override;
+
+   // Searches a single tile on an executor thread.
+   // @param index: Index of the tile in m_tiles.
+   void searchTile(std::size_t index);
+
+   // Decides what to do next (search more tiles, write a response or finish the RPC) and does it.
+   // The RPC is finished by the thread which sees nothing in progress, and no thread touches the reactor after that:
+   // OnDone() may delete it at once. A tile is counted as in flight until the decision of its own step, so an executor
+   // thread never accesses the reactor after another thread could have finished the RPC.
+   // @param tileDone: True if called by a finished tile search, which is not in flight anymore.
+   void step(bool tileDone = false);
+
+private:
+   RpcMetrics::Call m_metrics;                            // Latency and status of the RPC
+   Executor& m_executor;                                  // Executor which runs searches of the tiles
+   const std::size_t m_maxOngoingTiles;                   // See Settings::maxOngoingTiles
+   ISearchEngine::IncrementalSearchHandler m_handler;     // Incremental search shared by all the tiles
+   ISearchEngine::RegionPreferences m_prefs;              // Search preferences from the request
+   std::vector<BoundingBox> m_tiles;                      // Tiles covering the requested square box
+
+   std::mutex m_mutex;                                    // Protects all the fields below
+   std::size_t m_nextTile = 0;                            // Index of the next tile to search
+   std::size_t m_numTilesInFlight = 0;                    // Number of tiles being searched
+   std::deque<geoproto::RegionsResponse> m_pendingWrites; // Responses waiting for the client
+   geoproto::RegionsResponse m_currentWrite;              // Response being written (must live until OnWriteDone)
+   bool m_writing = false;                                // True while a write is in progress
+   std::optional<grpc::Status> m_error;                   // Set when the RPC is cancelled or something failed
+   bool m_finished = false;                               // True when Finish() is called
+};
+
+}  // namespace geo
@@ -0,0 +1,74 @@
+#include "GetWeatherReactor.h"
+
+#include "../search/SearchEngineItf.h"
+#include "../utils/Executor.h"
+#include "../utils/TimeUtils.h"
+#include "../utils/grpcUtils.h"
+#include "RequestValidators.h"
+
+#include <format>
+#include <iterator>
+
+namespace
+{
+
+// Returns metrics shared by all GetWeather() RPCs
+geo::RpcMetrics& getRpcMetrics()
+{
+   static geo::RpcMetrics s_metrics("GetWeather");
+   return s_metrics;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+GetWeatherReactor::GetWeatherReactor(grpc::CallbackServerContext* context, const geoproto::WeatherRequest& request,
+   geoproto::WeatherResponse& response, ISearchEngine& searchEngine, Executor& executor, Tracer& tracer)
+   : m_metrics(getRpcMetrics(), *context, tracer)
+{
+   if (auto errorString = ValidateWeatherRequest(request))
+   {
+      LOG(ERROR) << std::format("Bad request, client-id={}", geo::ExtractClientId(*context));
+      Finish(m_metrics.SetStatus(grpc::Status{grpc::StatusCode::INVALID_ARGUMENT, errorString}));
+      return;
+   }
+
+   // Request and response stay alive until the RPC is finished, so they can be used by the task.
+   const bool scheduled = executor.Submit(
+      [this, &request, &response, &searchEngine, queued = Trace::Clock::now()]
+      {
+         // Work of the RPC on executor and event loop threads is added to its trace and follows its deadline
+         Trace::Scope scope(m_metrics.GetTrace());
+         RpcContext::Scope rpcScope(m_metrics.GetRpcContext());
+         Trace::AddCurrentSpan("queue", queued);
+         process(request, response, searchEngine);
+      });
+   if (!scheduled)
+   {
+      LOG(ERROR) << std::format("Executor queue is full, client-id={}", geo::ExtractClientId(*context));
+      Finish(m_metrics.SetStatus(grpc::Status{grpc::StatusCode::RESOURCE_EXHAUSTED, "Server is overloaded"}));
+   }
+}
+
+void GetWeatherReactor::process(
+   const geoproto::WeatherRequest& request, geoproto::WeatherResponse& response, ISearchEngine& searchEngine)
+{
+   const auto start = Trace::Clock::now();
+
+   const GeoProtoPoints locations = {request.locations().begin(), request.locations().end()};
+   const DateRange dateRange = {TimePointToDate(TimestampToTimePoint(request.from_date())),
+      TimePointToDate(TimestampToTimePoint(request.to_date()))};
+
+   // Load and aggregate historical weather, then populate response
+   auto weather = searchEngine.GetHistoricalWeather(locations, dateRange, request.num_years());
+   *response.mutable_historical_weather() = {
+      std::make_move_iterator(weather.begin()), std::make_move_iterator(weather.end())};
+
+   // Complete the RPC successfully
+   Trace::AddCurrentSpan("search", start);
+   Finish(m_metrics.SetStatus(grpc::Status::OK));
+}
+
+}  // namespace geo
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "RpcMetrics.h"
+#include "geo.grpc.pb.h"
+
+#include <absl/log/log.h>
+#include <grpc/grpc.h>
+#include <grpcpp/support/server_callback.h>
+
+#include <format>
+
+namespace geo
+{
+
+class ISearchEngine;
+class Executor;
+
+// Reactor class for handling unary (non-streaming) responses for the GetWeather RPC.
+// This class processes a single request and returns aggregated historical weather for every requested location.
+class GetWeatherReactor : public grpc::ServerUnaryReactor
+{
+public:
+   // Constructor for the GetWeatherReactor.
+   // @param context: Server context.
+   // @param request: The incoming WeatherRequest containing locations and dates.
+   // @param response: The WeatherResponse to be populated with results.
+   // @param searchEngine: Reference to the search engine used to load weather.
+   // @param executor: Executor which loads the weather, so that gRPC callback threads are not blocked.
+   // @param tracer: Tracer deciding whether the RPC is traced.
+   GetWeatherReactor(grpc::CallbackServerContext* context, const geoproto::WeatherRequest& request,
+      geoproto::WeatherResponse& response, ISearchEngine& searchEngine, Executor& executor, Tracer& tracer);
+
+private:
+   // Loads the weather on an executor thread, populates the response and finishes the RPC.
+   void process(
+      const geoproto::WeatherRequest& request, geoproto::WeatherResponse& response, ISearchEngine& searchEngine);
+
+   // Called when the RPC is completed. Logs completion and cleans up the reactor.
+   void OnDone() override
+   {
+      LOG(INFO) << "GetWeather() RPC completed";
+      delete this;
+   }
+
+   // Called when the RPC is cancelled. Logs the cancellation.
+   void OnCancel() override
+   {
+      LOG(ERROR) << "GetWeather() RPC cancelled";
+      m_metrics.SetCancelled();
+   }
+
+private:
+   RpcMetrics::Call m_metrics;  // Latency and status of the RPC
+};
+
+}  // namespace geo
@@ -55,4 +55,36 @@ const char* ValidateRegionsRequest(const geoproto::RegionsRequest& request)
    return nullptr;
 }
 
+const char* ValidateWeatherRequest(const geoproto::WeatherRequest& request)
+{
+   static const auto sc_maxDateRangeSeconds = 366 * 24 * 60 * 60;  // Dates are repeated yearly, so one year is enough
+   static const auto sc_maxNumYears = 50u;                          // A kind of safety check
+
+   if (request.locations().empty())
+      return "At least one location must be set in WeatherRequest";
+
+   for (const auto& location : request.locations())
+   {
+      if (!geo::IsValidLatitude(location.latitude()))
+         return "Wrong latitude in WeatherRequest";
+
+      if (!geo::IsValidLongitude(location.longitude()))
+         return "Wrong longitude in WeatherRequest";
+   }
+
+   if (!request.has_from_date() || !request.has_to_date())
+      return "Both from_date and to_date must be set in WeatherRequest";
+
+   if (request.from_date().seconds() > request.to_date().seconds())
+      return "from_date must not be later than to_date";
+
+   if (request.to_date().seconds() - request.from_date().seconds() > sc_maxDateRangeSeconds)
+      return "Date range is out-of-range";
+
+   if (request.num_years() > sc_maxNumYears)
+      return "num_years is out-of-range";
+
+   return nullptr;
+}
+
 }  // namespace geo
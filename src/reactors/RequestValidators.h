@@ -4,6 +4,7 @@ namespace geoproto
 {
 class CitiesRequest;
 class RegionsRequest;
+class WeatherRequest;
 }  // namespace geoproto
 
 namespace geo
@@ -19,4 +20,9 @@ const char* ValidateCitiesRequest(const geoproto::CitiesRequest& request);
 // Returns an error string or nullptr if a request is valid.
 const char* ValidateRegionsRequest(const geoproto::RegionsRequest& request);
 
+// Helper function to validate the WeatherRequest. Ensures that locations and dates are provided.
+// Validates the coordinates of every location, the order and length of the date range and the number of years.
+// Returns an error string or nullptr if a request is valid.
+const char* ValidateWeatherRequest(const geoproto::WeatherRequest& request);
+
 }  // namespace geo
@@ -0,0 +1,71 @@
+#include "RpcMetrics.h"
+
+#include <grpcpp/server_context.h>
+
+#include <iterator>
+#include <utility>
+
+namespace
+{
+
+// Names of gRPC status codes, as they are shown by grpc_cli and in the gRPC documentation
+const char* sz_statusCodeNames[] = {"OK", "CANCELLED", "UNKNOWN", "INVALID_ARGUMENT", "DEADLINE_EXCEEDED",
+   "NOT_FOUND", "ALREADY_EXISTS", "PERMISSION_DENIED", "RESOURCE_EXHAUSTED", "FAILED_PRECONDITION", "ABORTED",
+   "OUT_OF_RANGE", "UNIMPLEMENTED", "INTERNAL", "UNAVAILABLE", "DATA_LOSS", "UNAUTHENTICATED"};
+
+}  // namespace
+
+namespace geo
+{
+
+RpcMetrics::Call::Call(RpcMetrics& metrics, grpc::CallbackServerContext& context, Tracer& tracer)
+   : m_metrics(metrics)
+   , m_context(context)
+   , m_tracer(tracer)
+   , m_trace(tracer.Start(metrics.m_method, context.client_metadata().contains(sz_traceMetadataKey)))
+   , m_rpcContext(std::make_shared<RpcContext>(context.deadline()))
+{
+}
+
+RpcMetrics::Call::~Call()
+{
+   m_metrics.record(
+      std::chrono::steady_clock::now() - m_start, m_cancelled ? grpc::StatusCode::CANCELLED : m_code.load());
+   if (m_trace)
+      m_tracer.Finish(*m_trace);
+}
+
+const grpc::Status& RpcMetrics::Call::SetStatus(const grpc::Status& status)
+{
+   m_code = status.error_code();
+   if (m_trace)
+      m_context.AddTrailingMetadata("server-timing", m_trace->FormatServerTiming());
+   return status;
+}
+
+RpcMetrics::RpcMetrics(std::string method)
+   : m_method(std::move(method))
+   , m_duration(MetricsRegistry::GetDefault().GetHistogram("geo_rpc_duration_seconds",
+        "Time from the start of an RPC to its completion, including sending the response", {{"method", m_method}},
+        1e-6))
+{
+   static_assert(std::size(sz_statusCodeNames) == sc_numStatusCodes);
+}
+
+void RpcMetrics::record(std::chrono::steady_clock::duration latency, grpc::StatusCode code)
+{
+   m_duration.Record(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+
+   const auto index = code >= 0 && code < sc_numStatusCodes ? code : grpc::StatusCode::UNKNOWN;
+   auto* counter = m_calls[index].load(std::memory_order_acquire);
+   if (!counter)
+   {
+      // Concurrent calls get the same counter from the registry
+      counter = &MetricsRegistry::GetDefault().GetCounter("geo_rpc_total", "Finished RPCs by method and status code",
+         {{"method", m_method}, {"code", sz_statusCodeNames[index]}});
+      m_calls[index].store(counter, std::memory_order_release);
+   }
+   counter->Increment();
+}
+
+}  // namespace geo
@@ -0,0 +1,101 @@
+#pragma once
+
+#include "../utils/Metrics.h"
+#include "../utils/RpcContext.h"
+#include "../utils/Tracing.h"
+
+#include <grpcpp/support/status.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace grpc
+{
+class CallbackServerContext;
+}  // namespace grpc
+
+namespace geo
+{
+
+// Latency and status codes of the calls of an RPC method in the process-wide metrics registry
+class RpcMetrics
+{
+public:
+   static constexpr const char* sz_traceMetadataKey = "x-geo-trace";  // Metadata asking to trace a call
+
+   // Measures a single call; it is owned by the reactor, so the call is recorded when the reactor is deleted.
+   // The call is traced if the client sends the sz_traceMetadataKey metadata or the tracer samples it.
+   class Call
+   {
+   public:
+      // Constructor starting the measurement and the trace
+      // @param metrics Metrics of the RPC method
+      // @param context Server context of the call
+      // @param tracer Tracer deciding whether the call is traced
+      Call(RpcMetrics& metrics, grpc::CallbackServerContext& context, Tracer& tracer);
+
+      // Records latency and status of the call, and writes its trace if the call is slow
+      ~Call();
+
+      Call(const Call&) = delete;
+      Call& operator=(const Call&) = delete;
+
+      // Remembers the status the call is finished with, unless it is cancelled.
+      // A traced call returns durations of its stages in the "server-timing" trailing metadata.
+      // @param status Status passed to Finish()
+      // @return The same status, e.g. Finish(m_metrics.SetStatus(grpc::Status::OK))
+      const grpc::Status& SetStatus(const grpc::Status& status);
+
+      // Returns the trace of the call, nullptr if it is not traced. Work done for the call on other threads
+      // is traced within Trace::Scope.
+      const std::shared_ptr<Trace>& GetTrace() const { return m_trace; }
+
+      // Returns the deadline and cancellation of the call, which upstream requests made for it follow.
+      // Work done for the call on other threads runs within RpcContext::Scope.
+      const std::shared_ptr<RpcContext>& GetRpcContext() const { return m_rpcContext; }
+
+      // Marks the call as cancelled by the client, which overrides the status it is finished with
+      // and aborts the upstream requests made for it
+      void SetCancelled()
+      {
+         m_cancelled = true;
+         m_rpcContext->Cancel();
+      }
+
+   private:
+      RpcMetrics& m_metrics;                                            // Metrics of the RPC method
+      grpc::CallbackServerContext& m_context;                           // Server context of the call
+      Tracer& m_tracer;                                                 // Tracer which has started m_trace
+      const std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();  // Start time
+      std::atomic<grpc::StatusCode> m_code{grpc::StatusCode::UNKNOWN};  // Status set by SetStatus()
+      std::atomic<bool> m_cancelled{false};                              // Set by SetCancelled()
+      std::shared_ptr<Trace> m_trace;                                   // Trace of the call, nullptr if not traced
+      std::shared_ptr<RpcContext> m_rpcContext;                         // Deadline and cancellation of the call
+   };
+
+public:
+   // Constructor registering the latency histogram of the method
+   // @param method Name of the RPC method, e.g. "GetCities"
+   explicit RpcMetrics(std::string method);
+
+   RpcMetrics(const RpcMetrics&) = delete;
+   RpcMetrics& operator=(const RpcMetrics&) = delete;
+
+private:
+   // Records a finished call
+   void record(std::chrono::steady_clock::duration latency, grpc::StatusCode code);
+
+private:
+   static const int sc_numStatusCodes = grpc::StatusCode::UNAUTHENTICATED + 1;  // Number of gRPC status codes
+
+   const std::string m_method;              // Name of the RPC method
+   MetricsRegistry::Histogram& m_duration;  // Latency of calls
+
+   // Counters of calls by status code, registered when a code occurs for the first time
+   std::array<std::atomic<MetricsRegistry::Counter*>, sc_numStatusCodes> m_calls{};
+};
+
+}  // namespace geo
@@ -0,0 +1,196 @@
+#include "CityIndex.h"
+
+#include <absl/log/log.h>
+
+#include <cmath>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+namespace
+{
+
+using namespace geo;
+
+// Converts a coordinate in degrees to the fixed-point representation of the index
+std::int32_t toFixed(double degrees)
+{
+   return static_cast<std::int32_t>(std::lround(degrees * cityindex::sc_coordinateScale));
+}
+
+// Converts a fixed-point coordinate of the index to degrees
+double toDegrees(std::int32_t fixed)
+{
+   return fixed / cityindex::sc_coordinateScale;
+}
+
+// Checks if the point is inside the box
+bool isInBox(const cityindex::Box& box, const cityindex::Point& point)
+{
+   return point.lat >= box.minLat && point.lat <= box.maxLat && point.lon >= box.minLon && point.lon <= box.maxLon;
+}
+
+// Checks that an array of `count` records of type T at `offset` is inside of the file
+template <typename T>
+bool isValidSection(std::uint64_t offset, std::uint64_t count, std::size_t fileSize)
+{
+   return offset % alignof(T) == 0 && offset <= fileSize && count <= (fileSize - offset) / sizeof(T);
+}
+
+}  // namespace
+
+namespace geo
+{
+
+CityIndex::CityIndex(const std::string& path)
+   : m_file(path)
+{
+   const char* data = m_file.GetData();
+   const std::size_t size = m_file.GetSize();
+   m_header = reinterpret_cast<const cityindex::Header*>(data);
+
+   const bool isValid = size >= sizeof(cityindex::Header) &&
+      std::memcmp(m_header->magic, cityindex::sz_magic, sizeof(cityindex::sz_magic)) == 0 &&
+      m_header->version == cityindex::sc_version &&
+      isValidSection<cityindex::PlaceRecord>(m_header->placesOffset, m_header->numPlaces, size) &&
+      isValidSection<cityindex::Node>(m_header->nodesOffset, m_header->numNodes, size) &&
+      isValidSection<cityindex::Ring>(m_header->ringsOffset, m_header->numRings, size) &&
+      isValidSection<cityindex::Point>(m_header->pointsOffset, m_header->numPoints, size) &&
+      isValidSection<char>(m_header->stringsOffset, m_header->stringsSize, size);
+   if (!isValid)
+   {
+      LOG(ERROR) << std::format("Invalid city index file: {}", path);
+      throw std::runtime_error("Invalid city index file: " + path);
+   }
+
+   m_places = reinterpret_cast<const cityindex::PlaceRecord*>(data + m_header->placesOffset);
+   m_nodes = reinterpret_cast<const cityindex::Node*>(data + m_header->nodesOffset);
+   m_rings = reinterpret_cast<const cityindex::Ring*>(data + m_header->ringsOffset);
+   m_points = reinterpret_cast<const cityindex::Point*>(data + m_header->pointsOffset);
+   m_strings = data + m_header->stringsOffset;
+   if (!isConsistent())
+   {
+      LOG(ERROR) << std::format("Corrupted city index file: {}", path);
+      throw std::runtime_error("Corrupted city index file: " + path);
+   }
+
+   LOG(INFO) << std::format("Loaded city index {}: {} places, {} boundary points", path, m_header->numPlaces,
+      m_header->numPoints);
+}
+
+CityIndex::Places CityIndex::FindContaining(double latitude, double longitude) const
+{
+   Places result;
+   if (m_header->numNodes == 0)
+      return result;
+
+   const cityindex::Point point{toFixed(latitude), toFixed(longitude)};
+
+   // Depth of a packed tree is tiny, so a fixed stack is enough: every level adds at most sc_nodeCapacity nodes.
+   std::uint32_t stack[cityindex::sc_nodeCapacity * 16];
+   std::size_t stackSize = 0;
+   stack[stackSize++] = m_header->numNodes - 1;
+   while (stackSize > 0)
+   {
+      const cityindex::Node& node = m_nodes[stack[--stackSize]];
+      if (!isInBox(node.box, point))
+         continue;
+
+      for (std::uint32_t i = node.first; i < node.first + node.count; ++i)
+      {
+         if (!node.isLeaf)
+         {
+            if (stackSize < std::size(stack))
+               stack[stackSize++] = i;
+         }
+         else if (isInBox(m_places[i].box, point) && isInside(m_places[i], point))
+         {
+            result.push_back(toPlace(m_places[i]));
+         }
+      }
+   }
+   return result;
+}
+
+std::optional<CityIndex::Place> CityIndex::FindBest(double latitude, double longitude) const
+{
+   std::optional<Place> best;
+   for (const auto& place : FindContaining(latitude, longitude))
+   {
+      if (!best || place.type < best->type || (place.type == best->type && place.boxArea < best->boxArea))
+         best = place;
+   }
+   return best;
+}
+
+bool CityIndex::isInside(const cityindex::PlaceRecord& place, const cityindex::Point& point) const
+{
+   // Crossing number test: a ray from the point to the east crosses the boundary odd number of times
+   // if the point is inside. Holes and parts of multipolygons are handled by the same rule.
+   bool inside = false;
+   const double y = point.lat;
+   const double x = point.lon;
+   for (std::uint32_t r = place.firstRing; r < place.firstRing + place.numRings; ++r)
+   {
+      const cityindex::Ring& ring = m_rings[r];
+      const cityindex::Point* points = m_points + ring.firstPoint;
+      for (std::uint32_t i = 0, j = ring.numPoints - 1; i < ring.numPoints; j = i++)
+      {
+         const double yi = points[i].lat;
+         const double yj = points[j].lat;
+         if ((yi > y) != (yj > y))
+         {
+            const double xi = points[i].lon;
+            const double xj = points[j].lon;
+            if (x < xi + (y - yi) * (xj - xi) / (yj - yi))
+               inside = !inside;
+         }
+      }
+   }
+   return inside;
+}
+
+CityIndex::Place CityIndex::toPlace(const cityindex::PlaceRecord& record) const
+{
+   Place place;
+   place.osmId = record.osmId;
+   place.type = static_cast<PlaceType>(record.type);
+   place.name = {m_strings + record.nameOffset, record.nameSize};
+   place.country = {m_strings + record.countryOffset, record.countrySize};
+   place.latitude = toDegrees(record.center.lat);
+   place.longitude = toDegrees(record.center.lon);
+   place.boxArea = (toDegrees(record.box.maxLat) - toDegrees(record.box.minLat)) *
+      (toDegrees(record.box.maxLon) - toDegrees(record.box.minLon));
+   return place;
+}
+
+bool CityIndex::isConsistent() const
+{
+   for (std::uint32_t i = 0; i < m_header->numNodes; ++i)
+   {
+      const cityindex::Node& node = m_nodes[i];
+      const std::uint64_t numChildren = node.isLeaf ? m_header->numPlaces : i;  // Children precede their parent
+      if (node.count > cityindex::sc_nodeCapacity || std::uint64_t{node.first} + node.count > numChildren)
+         return false;
+   }
+
+   for (std::uint32_t i = 0; i < m_header->numPlaces; ++i)
+   {
+      const cityindex::PlaceRecord& place = m_places[i];
+      if (std::uint64_t{place.firstRing} + place.numRings > m_header->numRings ||
+         std::uint64_t{place.nameOffset} + place.nameSize > m_header->stringsSize ||
+         std::uint64_t{place.countryOffset} + place.countrySize > m_header->stringsSize)
+         return false;
+   }
+
+   for (std::uint32_t i = 0; i < m_header->numRings; ++i)
+   {
+      const cityindex::Ring& ring = m_rings[i];
+      if (ring.numPoints == 0 || ring.firstPoint > m_header->numPoints ||
+         ring.numPoints > m_header->numPoints - ring.firstPoint)
+         return false;
+   }
+   return true;
+}
+
+}  // namespace geo
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "../utils/MappedFile.h"
+#include "CityIndexFormat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace geo
+{
+
+// Offline reverse-geocoding index of city, town and state boundaries, built by tools/GeoImport.cc.
+// The index file is memory-mapped and used in place, see CityIndexFormat.h for its layout.
+// Lookups are thread-safe and do not allocate except for the returned vectors.
+class CityIndex
+{
+public:
+   // Kind of a place, in order of preference when several places contain a point
+   enum PlaceType : std::uint8_t
+   {
+      City,
+      Town,
+      State
+   };
+
+   // Place found in the index. Strings point into the mapped file and live as long as the index.
+   struct Place
+   {
+      std::int64_t osmId = 0;    // OSM ID of the relation
+      PlaceType type = City;     // Kind of the place
+      std::string_view name;     // Name in the native language
+      std::string_view country;  // Country name in the native language, may be empty
+      double latitude = 0;       // Latitude of the center
+      double longitude = 0;      // Longitude of the center
+      double boxArea = 0;        // Area of the bounding box in square degrees, a measure of the size of the place
+   };
+
+   using Places = std::vector<Place>;
+
+public:
+   // Maps and validates the index file, throws std::runtime_error if it is not a valid index
+   // @param path Path to the index file
+   explicit CityIndex(const std::string& path);
+
+   CityIndex(const CityIndex&) = delete;
+   CityIndex& operator=(const CityIndex&) = delete;
+
+   // Finds all the places whose boundaries contain the point
+   // @param latitude Latitude of the point
+   // @param longitude Longitude of the point
+   Places FindContaining(double latitude, double longitude) const;
+
+   // Finds the most relevant place containing the point: a city is preferred to a town, and a town to a state,
+   // like nominatim::Match::Best does. The smallest place is taken among places of the same kind.
+   // @param latitude Latitude of the point
+   // @param longitude Longitude of the point
+   std::optional<Place> FindBest(double latitude, double longitude) const;
+
+   // Returns number of places in the index
+   std::size_t GetNumPlaces() const { return m_header->numPlaces; }
+
+private:
+   // Checks if the point is inside the boundary of the place (even-odd rule over all the rings)
+   bool isInside(const cityindex::PlaceRecord& place, const cityindex::Point& point) const;
+
+   // Converts a record to a Place
+   Place toPlace(const cityindex::PlaceRecord& record) const;
+
+   // Checks that all the records refer to existing items, so lookups never read outside of the file
+   bool isConsistent() const;
+
+private:
+   MappedFile m_file;                                 // Mapped index file
+   const cityindex::Header* m_header = nullptr;       // Header of the file
+   const cityindex::PlaceRecord* m_places = nullptr;  // Places, ordered as leaves of the R-tree
+   const cityindex::Node* m_nodes = nullptr;          // R-tree nodes, the root is the last one
+   const cityindex::Ring* m_rings = nullptr;          // Rings of all the boundaries
+   const cityindex::Point* m_points = nullptr;        // Points of all the rings
+   const char* m_strings = nullptr;                   // Names of all the places
+};
+
+}  // namespace geo
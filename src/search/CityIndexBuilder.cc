@@ -0,0 +1,260 @@
+#include "CityIndexBuilder.h"
+
+#include "../utils/GeoUtils.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+
+using namespace geo;
+
+// Converts a coordinate in degrees to the fixed-point representation of the index
+std::int32_t toFixed(double degrees)
+{
+   return static_cast<std::int32_t>(std::lround(degrees * cityindex::sc_coordinateScale));
+}
+
+// Returns a box which contains nothing, so that any extension of it gives the extending box
+cityindex::Box emptyBox()
+{
+   return {std::numeric_limits<std::int32_t>::max(), std::numeric_limits<std::int32_t>::max(),
+      std::numeric_limits<std::int32_t>::min(), std::numeric_limits<std::int32_t>::min()};
+}
+
+void extend(cityindex::Box& box, const cityindex::Point& point)
+{
+   box.minLat = std::min(box.minLat, point.lat);
+   box.minLon = std::min(box.minLon, point.lon);
+   box.maxLat = std::max(box.maxLat, point.lat);
+   box.maxLon = std::max(box.maxLon, point.lon);
+}
+
+void extend(cityindex::Box& box, const cityindex::Box& other)
+{
+   extend(box, cityindex::Point{other.minLat, other.minLon});
+   extend(box, cityindex::Point{other.maxLat, other.maxLon});
+}
+
+// Center of a box, doubled to stay in integers
+std::int64_t getDoubledCenterLat(const cityindex::Box& box)
+{
+   return std::int64_t{box.minLat} + box.maxLat;
+}
+
+std::int64_t getDoubledCenterLon(const cityindex::Box& box)
+{
+   return std::int64_t{box.minLon} + box.maxLon;
+}
+
+// Orders items for a packed R-tree with the Sort-Tile-Recursive algorithm: items are sorted by longitude,
+// cut into vertical slices, and every slice is sorted by latitude. Consecutive groups of sc_nodeCapacity items
+// of the result are close to each other, so they make compact nodes.
+// @param boxes Bounding boxes of the items
+// @return Indices of the items in the packed order
+std::vector<std::uint32_t> sortTileRecursive(const std::vector<cityindex::Box>& boxes)
+{
+   std::vector<std::uint32_t> order(boxes.size());
+   std::iota(order.begin(), order.end(), 0);
+
+   const std::size_t numLeaves = (boxes.size() + cityindex::sc_nodeCapacity - 1) / cityindex::sc_nodeCapacity;
+   const auto numSlices = static_cast<std::size_t>(std::ceil(std::sqrt(static_cast<double>(numLeaves))));
+   const std::size_t sliceSize = std::max<std::size_t>(1, numSlices) * cityindex::sc_nodeCapacity;
+
+   std::sort(order.begin(), order.end(),
+      [&boxes](std::uint32_t a, std::uint32_t b)
+      {
+         return getDoubledCenterLon(boxes[a]) < getDoubledCenterLon(boxes[b]);
+      });
+   for (std::size_t first = 0; first < order.size(); first += sliceSize)
+   {
+      const auto last = order.begin() + std::min(order.size(), first + sliceSize);
+      std::sort(order.begin() + first, last,
+         [&boxes](std::uint32_t a, std::uint32_t b)
+         {
+            return getDoubledCenterLat(boxes[a]) < getDoubledCenterLat(boxes[b]);
+         });
+   }
+   return order;
+}
+
+// Groups consecutive items into nodes
+// @param boxes Bounding boxes of the items
+// @param firstItem Index of the first item in its section
+// @param isLeaf true if the items are places
+// @param nodes Receives the nodes
+void appendNodes(
+   const std::vector<cityindex::Box>& boxes, std::uint32_t firstItem, bool isLeaf, std::vector<cityindex::Node>& nodes)
+{
+   for (std::size_t first = 0; first < boxes.size(); first += cityindex::sc_nodeCapacity)
+   {
+      const std::size_t last = std::min(boxes.size(), first + cityindex::sc_nodeCapacity);
+      cityindex::Node node{emptyBox(), firstItem + static_cast<std::uint32_t>(first),
+         static_cast<std::uint32_t>(last - first), isLeaf ? 1u : 0u};
+      for (std::size_t i = first; i < last; ++i)
+         extend(node.box, boxes[i]);
+      nodes.push_back(node);
+   }
+}
+
+// Rounds an offset up to the alignment of the sections
+std::uint64_t alignOffset(std::uint64_t offset)
+{
+   return (offset + 7) / 8 * 8;
+}
+
+// Appends a string to the strings section, sharing equal strings
+// @return Offset of the string in the section
+std::uint32_t addString(
+   const std::string& value, std::string& strings, std::unordered_map<std::string, std::uint32_t>& offsets)
+{
+   const auto [it, inserted] = offsets.try_emplace(value, static_cast<std::uint32_t>(strings.size()));
+   if (inserted)
+      strings += value;
+   return it->second;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+bool CityIndexBuilder::Add(Place place)
+{
+   if (!IsValidLatitude(place.latitude) || !IsValidLongitude(place.longitude))
+      return false;
+
+   Entry entry{};
+   entry.record.osmId = place.osmId;
+   entry.record.type = place.type;
+   entry.record.center = {toFixed(place.latitude), toFixed(place.longitude)};
+   entry.record.box = emptyBox();
+   for (const auto& ring : place.rings)
+   {
+      // Points which are equal in the fixed-point representation, and the closing point, are not stored.
+      std::vector<cityindex::Point> points;
+      points.reserve(ring.size());
+      for (const auto& p : ring)
+      {
+         if (!IsValidLatitude(p.latitude) || !IsValidLongitude(p.longitude))
+            return false;
+
+         const cityindex::Point point{toFixed(p.latitude), toFixed(p.longitude)};
+         if (points.empty() || points.back().lat != point.lat || points.back().lon != point.lon)
+            points.push_back(point);
+      }
+      while (points.size() > 1 && points.front().lat == points.back().lat && points.front().lon == points.back().lon)
+         points.pop_back();
+      if (points.size() < 3)
+         continue;
+
+      for (const auto& point : points)
+         extend(entry.record.box, point);
+      entry.rings.push_back(std::move(points));
+   }
+
+   if (entry.rings.empty())
+      return false;
+
+   entry.name = std::move(place.name);
+   entry.country = std::move(place.country);
+   m_places.push_back(std::move(entry));
+   return true;
+}
+
+void CityIndexBuilder::Write(const std::string& path) const
+{
+   // Places are stored in the order of the leaves of the R-tree.
+   std::vector<cityindex::Box> boxes;
+   boxes.reserve(m_places.size());
+   for (const auto& place : m_places)
+      boxes.push_back(place.record.box);
+   const std::vector<std::uint32_t> order = sortTileRecursive(boxes);
+
+   std::vector<cityindex::PlaceRecord> places;
+   std::vector<cityindex::Ring> rings;
+   std::vector<cityindex::Point> points;
+   std::string strings;
+   std::unordered_map<std::string, std::uint32_t> stringOffsets;
+   places.reserve(m_places.size());
+   for (std::size_t i = 0; i < order.size(); ++i)
+   {
+      const Entry& entry = m_places[order[i]];
+      cityindex::PlaceRecord record = entry.record;
+      record.firstRing = static_cast<std::uint32_t>(rings.size());
+      record.numRings = static_cast<std::uint32_t>(entry.rings.size());
+      for (const auto& ring : entry.rings)
+      {
+         rings.push_back({points.size(), static_cast<std::uint32_t>(ring.size()), 0});
+         points.insert(points.end(), ring.begin(), ring.end());
+      }
+      record.nameOffset = addString(entry.name, strings, stringOffsets);
+      record.nameSize = static_cast<std::uint32_t>(entry.name.size());
+      record.countryOffset = addString(entry.country, strings, stringOffsets);
+      record.countrySize = static_cast<std::uint32_t>(entry.country.size());
+      places.push_back(record);
+      boxes[i] = record.box;
+   }
+
+   // The tree is built bottom-up, every level groups consecutive nodes of the level below.
+   std::vector<cityindex::Node> nodes;
+   appendNodes(boxes, 0, true, nodes);
+   std::size_t levelStart = 0;
+   while (nodes.size() - levelStart > 1)
+   {
+      std::vector<cityindex::Box> levelBoxes;
+      for (std::size_t i = levelStart; i < nodes.size(); ++i)
+         levelBoxes.push_back(nodes[i].box);
+      const std::size_t levelEnd = nodes.size();
+      appendNodes(levelBoxes, static_cast<std::uint32_t>(levelStart), false, nodes);
+      levelStart = levelEnd;
+   }
+
+   cityindex::Header header{};
+   std::copy(std::begin(cityindex::sz_magic), std::end(cityindex::sz_magic), header.magic);
+   header.version = cityindex::sc_version;
+   header.numPlaces = static_cast<std::uint32_t>(places.size());
+   header.numNodes = static_cast<std::uint32_t>(nodes.size());
+   header.numRings = static_cast<std::uint32_t>(rings.size());
+   header.numPoints = points.size();
+   header.placesOffset = alignOffset(sizeof(header));
+   header.nodesOffset = alignOffset(header.placesOffset + places.size() * sizeof(cityindex::PlaceRecord));
+   header.ringsOffset = alignOffset(header.nodesOffset + nodes.size() * sizeof(cityindex::Node));
+   header.pointsOffset = alignOffset(header.ringsOffset + rings.size() * sizeof(cityindex::Ring));
+   header.stringsOffset = alignOffset(header.pointsOffset + points.size() * sizeof(cityindex::Point));
+   header.stringsSize = strings.size();
+
+   std::ofstream file(path, std::ios::binary | std::ios::trunc);
+   auto writeSection = [&file](std::uint64_t offset, const void* data, std::size_t size)
+   {
+      static const char sc_padding[8] = {};
+      file.write(sc_padding, static_cast<std::streamsize>(offset - static_cast<std::uint64_t>(file.tellp())));
+      file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+   };
+   file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+   writeSection(header.placesOffset, places.data(), places.size() * sizeof(cityindex::PlaceRecord));
+   writeSection(header.nodesOffset, nodes.data(), nodes.size() * sizeof(cityindex::Node));
+   writeSection(header.ringsOffset, rings.data(), rings.size() * sizeof(cityindex::Ring));
+   writeSection(header.pointsOffset, points.data(), points.size() * sizeof(cityindex::Point));
+   writeSection(header.stringsOffset, strings.data(), strings.size());
+   file.close();
+   if (!file)
+   {
+      LOG(ERROR) << std::format("Failed to write city index file: {}", path);
+      throw std::runtime_error("Failed to write city index file: " + path);
+   }
+
+   LOG(INFO) << std::format("Written city index {}: {} places, {} rings, {} points, {} tree nodes", path,
+      places.size(), rings.size(), points.size(), nodes.size());
+}
+
+}  // namespace geo
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "CityIndex.h"
+#include "CityIndexFormat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace geo
+{
+
+// Collects places with their boundaries and writes them as a CityIndex file.
+// Used by the offline importer, so it keeps everything in memory until Write() is called.
+class CityIndexBuilder
+{
+public:
+   // Point of a boundary ring in degrees
+   struct Point
+   {
+      double latitude = 0;   // Latitude in degrees
+      double longitude = 0;  // Longitude in degrees
+   };
+
+   using Ring = std::vector<Point>;  // Closed ring, the last point may repeat the first one
+
+   // Place to add to the index
+   struct Place
+   {
+      std::int64_t osmId = 0;                       // OSM ID of the relation
+      CityIndex::PlaceType type = CityIndex::City;  // Kind of the place
+      std::string name;                             // Name in the native language
+      std::string country;                          // Country name in the native language, may be empty
+      double latitude = 0;                          // Latitude of the center
+      double longitude = 0;                         // Longitude of the center
+      std::vector<Ring> rings;                      // Outer rings and holes of all the polygons of the boundary
+   };
+
+public:
+   // Adds a place, places without valid rings are ignored
+   // @param place Place to add
+   // @return false if the place is ignored
+   bool Add(Place place);
+
+   // Returns number of added places
+   std::size_t GetNumPlaces() const { return m_places.size(); }
+
+   // Builds the R-tree and writes the index, throws std::runtime_error if the file cannot be written
+   // @param path Path to the index file
+   void Write(const std::string& path) const;
+
+private:
+   // Added place in the fixed-point representation of the index
+   struct Entry
+   {
+      cityindex::PlaceRecord record;                     // Record without ring and string offsets
+      std::vector<std::vector<cityindex::Point>> rings;  // Rings of the boundary
+      std::string name;                                  // Name of the place
+      std::string country;                               // Country of the place
+   };
+
+private:
+   std::vector<Entry> m_places;  // Added places
+};
+
+}  // namespace geo
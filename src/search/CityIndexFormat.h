@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+// Layout of the city index file written by CityIndexBuilder and memory-mapped by CityIndex.
+// All the sections are arrays of the records below in native byte order, aligned to 8 bytes.
+// Places are ordered as the leaves of a packed R-tree, so a leaf node refers to a range of places.
+namespace geo::cityindex
+{
+
+inline constexpr char sz_magic[8] = {'G', 'E', 'O', 'C', 'I', 'T', 'Y', '\0'};  // First bytes of the file
+inline constexpr std::uint32_t sc_version = 1;                                  // Version of the layout
+inline constexpr double sc_coordinateScale = 1e7;     // Coordinates are stored in 1e-7 degrees (OSM precision)
+inline constexpr std::uint32_t sc_nodeCapacity = 16;  // Maximum number of children of an R-tree node
+
+// Point in fixed-point coordinates
+struct Point
+{
+   std::int32_t lat;  // Latitude in 1e-7 degrees
+   std::int32_t lon;  // Longitude in 1e-7 degrees
+};
+
+// Bounding box in fixed-point coordinates
+struct Box
+{
+   std::int32_t minLat;  // Minimum latitude in 1e-7 degrees
+   std::int32_t minLon;  // Minimum longitude in 1e-7 degrees
+   std::int32_t maxLat;  // Maximum latitude in 1e-7 degrees
+   std::int32_t maxLon;  // Maximum longitude in 1e-7 degrees
+};
+
+// Beginning of the file
+struct Header
+{
+   char magic[8];                // sz_magic
+   std::uint32_t version;        // sc_version
+   std::uint32_t numPlaces;      // Number of PlaceRecord items
+   std::uint32_t numNodes;       // Number of Node items, the root is the last one
+   std::uint32_t numRings;       // Number of Ring items
+   std::uint64_t numPoints;      // Number of Point items
+   std::uint64_t placesOffset;   // Offset of the places section
+   std::uint64_t nodesOffset;    // Offset of the R-tree section
+   std::uint64_t ringsOffset;    // Offset of the rings section
+   std::uint64_t pointsOffset;   // Offset of the points section
+   std::uint64_t stringsOffset;  // Offset of the strings section (UTF-8, not terminated)
+   std::uint64_t stringsSize;    // Size of the strings section
+};
+
+// City, town or state with its boundary
+struct PlaceRecord
+{
+   std::int64_t osmId;           // OSM ID of the relation
+   Box box;                      // Bounding box of the boundary
+   Point center;                 // Center of the place
+   std::uint32_t firstRing;      // Index of the first ring of the boundary
+   std::uint32_t numRings;       // Number of rings; outer rings and holes are not distinguished (even-odd rule)
+   std::uint32_t nameOffset;     // Offset of the name in the strings section
+   std::uint32_t nameSize;       // Size of the name
+   std::uint32_t countryOffset;  // Offset of the country name in the strings section
+   std::uint32_t countrySize;    // Size of the country name
+   std::uint8_t type;            // CityIndex::PlaceType
+   std::uint8_t reserved[7];     // Padding, zero
+};
+
+// Closed ring of a boundary, the last point is not repeated
+struct Ring
+{
+   std::uint64_t firstPoint;  // Index of the first point
+   std::uint32_t numPoints;   // Number of points
+   std::uint32_t reserved;    // Padding, zero
+};
+
+// Node of the R-tree
+struct Node
+{
+   Box box;               // Bounding box of all the children
+   std::uint32_t first;   // Index of the first child: a place for a leaf, a node otherwise
+   std::uint32_t count;   // Number of children
+   std::uint32_t isLeaf;  // Non-zero if children are places
+};
+
+static_assert(std::is_trivially_copyable_v<Header> && sizeof(Header) == 80);
+static_assert(std::is_trivially_copyable_v<PlaceRecord> && sizeof(PlaceRecord) == 64);
+static_assert(std::is_trivially_copyable_v<Ring> && sizeof(Ring) == 16);
+static_assert(std::is_trivially_copyable_v<Node> && sizeof(Node) == 28);
+
+}  // namespace geo::cityindex
@@ -0,0 +1,105 @@
+#include "LocalSearchEngine.h"
+
+#include "../utils/WebClient.h"
+#include "NominatimApiUtils.h"
+#include "SearchEngine.h"
+
+#include <absl/log/log.h>
+
+#include <format>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <utility>
+
+namespace
+{
+
+using namespace geo;
+
+// Converts a place of an index to Nominatim relation info, as if it was looked up remotely
+// @param place Place of CityIndex or NameIndex
+template <typename TPlace>
+nominatim::RelationInfo toRelationInfo(const TPlace& place)
+{
+   constexpr const char* sc_addressTypes[] = {"city", "town", "state"};  // Indexed by CityIndex::PlaceType
+
+   nominatim::RelationInfo info;
+   info.osmId = place.osmId;
+   info.name = place.name;
+   info.country = place.country;
+   info.latitude = place.latitude;
+   info.longitude = place.longitude;
+   info.addressType = place.type < std::size(sc_addressTypes) ? sc_addressTypes[place.type] : "";
+   return info;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+LocalSearchEngine::LocalSearchEngine(std::unique_ptr<CityIndex> cityIndex, std::unique_ptr<NameIndex> nameIndex,
+   WebClient& overpassApiClient, std::unique_ptr<ISearchEngine> fallback)
+   : m_cityIndex(std::move(cityIndex))
+   , m_nameIndex(std::move(nameIndex))
+   , m_overpassApiClient(overpassApiClient)
+   , m_fallback(std::move(fallback))
+{
+}
+
+void LocalSearchEngine::FindCitiesByName(const std::string& name, bool includeDetails, GeoProtoPlaces& cities)
+{
+   const auto places = m_nameIndex ? m_nameIndex->Find(name) : NameIndex::Places{};
+   if (places.empty())
+   {
+      if (m_nameIndex)
+         LOG(INFO) << std::format("No city named \"{}\" in the local index, using remote search", name);
+      m_fallback->FindCitiesByName(name, includeDetails, cities);
+      return;
+   }
+
+   // Places with the name are filtered like the remote search filters the relations found by Overpass API.
+   nominatim::RelationInfos infos;
+   for (const auto& place : places)
+      infos.push_back(toRelationInfo(place));
+   nominatim::RelationInfos selected;
+   nominatim::SelectCities(infos, nominatim::Match::Any, selected);
+
+   // Names are known, but hotels and museums are still loaded from Overpass API.
+   AppendCities(selected, m_overpassApiClient, includeDetails, cities);
+}
+
+void LocalSearchEngine::FindCitiesByPosition(
+   double latitude, double longitude, bool includeDetails, GeoProtoPlaces& cities)
+{
+   const auto place = m_cityIndex ? m_cityIndex->FindBest(latitude, longitude) : std::nullopt;
+   if (!place)
+   {
+      if (m_cityIndex)
+         LOG(INFO) << std::format("No city in the local index at ({},{}), using remote search", latitude, longitude);
+      m_fallback->FindCitiesByPosition(latitude, longitude, includeDetails, cities);
+      return;
+   }
+
+   // Boundaries are known, but hotels and museums are still loaded from Overpass API.
+   AppendCities({toRelationInfo(*place)}, m_overpassApiClient, includeDetails, cities);
+}
+
+ISearchEngine::IncrementalSearchHandler LocalSearchEngine::StartFindRegions()
+{
+   return m_fallback->StartFindRegions();
+}
+
+WeatherInfoVector LocalSearchEngine::GetWeather(double latitude, double longitude, const DateRange& dateRange)
+{
+   return m_fallback->GetWeather(latitude, longitude, dateRange);
+}
+
+GeoProtoWeathers LocalSearchEngine::GetHistoricalWeather(
+   const GeoProtoPoints& locations, const DateRange& dateRange, std::uint32_t numYears)
+{
+   return m_fallback->GetHistoricalWeather(locations, dateRange, numYears);
+}
+
+}  // namespace geo
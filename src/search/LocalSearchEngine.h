@@ -0,0 +1,55 @@
+#pragma once
+
+#include "../../proto/ProtoTypes.h"
+#include "CityIndex.h"
+#include "NameIndex.h"
+#include "SearchEngineItf.h"
+
+#include <memory>
+#include <string>
+
+namespace geo
+{
+
+class WebClient;
+
+// Search engine answering city queries from the offline indexes.
+// A point-in-polygon lookup in the memory-mapped city index replaces the Overpass "is_in" query and the Nominatim
+// lookup, and a lookup in the memory-mapped name index replaces the Overpass name query and the Nominatim lookup.
+// Everything else, and queries the indexes have no answer for, are delegated to the fallback engine.
+class LocalSearchEngine : public ISearchEngine
+{
+public:
+   // Constructor
+   // @param cityIndex Index of city boundaries, may be nullptr
+   // @param nameIndex Index of city names, may be nullptr
+   // @param overpassApiClient Client used to load details (hotels and museums) of the found cities
+   // @param fallback Engine which answers queries the indexes cannot answer
+   LocalSearchEngine(std::unique_ptr<CityIndex> cityIndex, std::unique_ptr<NameIndex> nameIndex,
+      WebClient& overpassApiClient, std::unique_ptr<ISearchEngine> fallback);
+
+   // See ISearchEngine::FindCitiesByName for documentation
+   void FindCitiesByName(const std::string& name, bool includeDetails, GeoProtoPlaces& cities) override;
+
+   // See ISearchEngine::FindCitiesByPosition for documentation
+   void FindCitiesByPosition(
+      double latitude, double longitude, bool includeDetails, GeoProtoPlaces& cities) override;
+
+   // See ISearchEngine::StartFindRegions for documentation
+   IncrementalSearchHandler StartFindRegions() override;
+
+   // See ISearchEngine::GetWeather for documentation
+   WeatherInfoVector GetWeather(double latitude, double longitude, const DateRange& dateRange) override;
+
+   // See ISearchEngine::GetHistoricalWeather for documentation
+   GeoProtoWeathers GetHistoricalWeather(
+      const GeoProtoPoints& locations, const DateRange& dateRange, std::uint32_t numYears) override;
+
+private:
+   std::unique_ptr<CityIndex> m_cityIndex;     // Index of city boundaries, may be nullptr
+   std::unique_ptr<NameIndex> m_nameIndex;     // Index of city names, may be nullptr
+   WebClient& m_overpassApiClient;             // Client for Overpass API requests
+   std::unique_ptr<ISearchEngine> m_fallback;  // Engine for queries which are not answered locally
+};
+
+}  // namespace geo
@@ -0,0 +1,149 @@
+#include "NameIndex.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+
+namespace
+{
+
+using namespace geo;
+
+// Converts a fixed-point coordinate of the index to degrees
+double toDegrees(std::int32_t fixed)
+{
+   return fixed / cityindex::sc_coordinateScale;
+}
+
+// Checks that an array of `count` records of type T at `offset` is inside of the file
+template <typename T>
+bool isValidSection(std::uint64_t offset, std::uint64_t count, std::size_t fileSize)
+{
+   return offset % alignof(T) == 0 && offset <= fileSize && count <= (fileSize - offset) / sizeof(T);
+}
+
+}  // namespace
+
+namespace geo
+{
+
+NameIndex::NameIndex(const std::string& path)
+   : m_file(path)
+{
+   const char* data = m_file.GetData();
+   const std::size_t size = m_file.GetSize();
+   m_header = reinterpret_cast<const nameindex::Header*>(data);
+
+   const bool isValid = size >= sizeof(nameindex::Header) &&
+      std::memcmp(m_header->magic, nameindex::sz_magic, sizeof(nameindex::sz_magic)) == 0 &&
+      m_header->version == nameindex::sc_version &&
+      isValidSection<nameindex::Key>(m_header->keysOffset, m_header->numKeys, size) &&
+      isValidSection<std::uint32_t>(m_header->postingsOffset, m_header->numPostings, size) &&
+      isValidSection<nameindex::PlaceRecord>(m_header->placesOffset, m_header->numPlaces, size) &&
+      isValidSection<char>(m_header->stringsOffset, m_header->stringsSize, size);
+   if (!isValid)
+   {
+      LOG(ERROR) << std::format("Invalid name index file: {}", path);
+      throw std::runtime_error("Invalid name index file: " + path);
+   }
+
+   m_keys = reinterpret_cast<const nameindex::Key*>(data + m_header->keysOffset);
+   m_postings = reinterpret_cast<const std::uint32_t*>(data + m_header->postingsOffset);
+   m_places = reinterpret_cast<const nameindex::PlaceRecord*>(data + m_header->placesOffset);
+   m_strings = data + m_header->stringsOffset;
+   if (!isConsistent())
+   {
+      LOG(ERROR) << std::format("Corrupted name index file: {}", path);
+      throw std::runtime_error("Corrupted name index file: " + path);
+   }
+
+   LOG(INFO) << std::format("Loaded name index {}: {} names of {} places", path, m_header->numKeys,
+      m_header->numPlaces);
+}
+
+NameIndex::Places NameIndex::Find(std::string_view name) const
+{
+   Places result;
+   const std::string key = Normalize(name);
+   const nameindex::Key* end = m_keys + m_header->numKeys;
+   const nameindex::Key* it = std::lower_bound(m_keys, end, key,
+      [this](const nameindex::Key& k, const std::string& value)
+      {
+         return getString(k.stringOffset, k.stringSize) < value;
+      });
+   if (it == end || getString(it->stringOffset, it->stringSize) != key)
+      return result;
+
+   result.reserve(it->numPostings);
+   for (std::uint32_t i = it->firstPosting; i < it->firstPosting + it->numPostings; ++i)
+   {
+      const nameindex::PlaceRecord& record = m_places[m_postings[i]];
+      Place& place = result.emplace_back();
+      place.osmId = record.osmId;
+      place.type = static_cast<CityIndex::PlaceType>(record.type);
+      place.name = getString(record.nameOffset, record.nameSize);
+      place.country = getString(record.countryOffset, record.countrySize);
+      place.latitude = toDegrees(record.center.lat);
+      place.longitude = toDegrees(record.center.lon);
+   }
+   return result;
+}
+
+std::string NameIndex::Normalize(std::string_view name)
+{
+   std::string result;
+   result.reserve(name.size());
+   bool isSpace = false;
+   for (const char c : name)
+   {
+      if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f')
+      {
+         isSpace = true;
+         continue;
+      }
+      if (isSpace && !result.empty())
+         result += ' ';
+      isSpace = false;
+      result += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+   }
+   return result;
+}
+
+std::string_view NameIndex::getString(std::uint32_t offset, std::uint32_t size) const
+{
+   return {m_strings + offset, size};
+}
+
+bool NameIndex::isConsistent() const
+{
+   for (std::uint32_t i = 0; i < m_header->numKeys; ++i)
+   {
+      const nameindex::Key& key = m_keys[i];
+      if (std::uint64_t{key.stringOffset} + key.stringSize > m_header->stringsSize ||
+         std::uint64_t{key.firstPosting} + key.numPostings > m_header->numPostings)
+         return false;
+      if (i > 0 &&
+         getString(m_keys[i - 1].stringOffset, m_keys[i - 1].stringSize) >= getString(key.stringOffset, key.stringSize))
+         return false;
+   }
+
+   for (std::uint64_t i = 0; i < m_header->numPostings; ++i)
+   {
+      if (m_postings[i] >= m_header->numPlaces)
+         return false;
+   }
+
+   for (std::uint32_t i = 0; i < m_header->numPlaces; ++i)
+   {
+      const nameindex::PlaceRecord& place = m_places[i];
+      if (std::uint64_t{place.nameOffset} + place.nameSize > m_header->stringsSize ||
+         std::uint64_t{place.countryOffset} + place.countrySize > m_header->stringsSize)
+         return false;
+   }
+   return true;
+}
+
+}  // namespace geo
@@ -0,0 +1,75 @@
+#pragma once
+
+#include "../utils/MappedFile.h"
+#include "CityIndex.h"
+#include "NameIndexFormat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace geo
+{
+
+// Offline index of city, town and state names, built by tools/GeoImport.cc from the same extract as CityIndex.
+// Every place is indexed by its "name", "name:en" and other "name:*" tags, so a lookup by any of them
+// returns the place with the data which the remote search gets from Nominatim.
+// The index file is memory-mapped and used in place, see NameIndexFormat.h for its layout.
+// Lookups are thread-safe and do not allocate except for the returned vectors.
+class NameIndex
+{
+public:
+   // Place found in the index. Strings point into the mapped file and live as long as the index.
+   struct Place
+   {
+      std::int64_t osmId = 0;                       // OSM ID of the relation
+      CityIndex::PlaceType type = CityIndex::City;  // Kind of the place
+      std::string_view name;                        // Name in the native language
+      std::string_view country;                     // Country name in the native language, may be empty
+      double latitude = 0;                          // Latitude of the center
+      double longitude = 0;                         // Longitude of the center
+   };
+
+   using Places = std::vector<Place>;
+
+public:
+   // Maps and validates the index file, throws std::runtime_error if it is not a valid index
+   // @param path Path to the index file
+   explicit NameIndex(const std::string& path);
+
+   NameIndex(const NameIndex&) = delete;
+   NameIndex& operator=(const NameIndex&) = delete;
+
+   // Finds all the places with the name, names are compared after normalization
+   // @param name Name of a place in any language
+   // @return Places in ascending order of OSM IDs
+   Places Find(std::string_view name) const;
+
+   // Returns number of places in the index
+   std::size_t GetNumPlaces() const { return m_header->numPlaces; }
+
+   // Normalizes a name for the index: ASCII letters are lowercased, whitespace is trimmed and collapsed
+   // to single spaces. Other characters are kept as is, so names in other scripts have to match exactly.
+   // @param name Name to normalize
+   static std::string Normalize(std::string_view name);
+
+private:
+   // Returns a string of the strings section
+   std::string_view getString(std::uint32_t offset, std::uint32_t size) const;
+
+   // Checks that all the records refer to existing items and keys are sorted, so lookups never read outside
+   // of the file
+   bool isConsistent() const;
+
+private:
+   MappedFile m_file;                                 // Mapped index file
+   const nameindex::Header* m_header = nullptr;       // Header of the file
+   const nameindex::Key* m_keys = nullptr;            // Sorted keys
+   const std::uint32_t* m_postings = nullptr;         // Indices of places of all the keys
+   const nameindex::PlaceRecord* m_places = nullptr;  // Places, ordered by OSM IDs
+   const char* m_strings = nullptr;                   // Keys, names and countries of all the places
+};
+
+}  // namespace geo
@@ -0,0 +1,153 @@
+#include "NameIndexBuilder.h"
+
+#include "../utils/GeoUtils.h"
+#include "NameIndex.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace
+{
+
+using namespace geo;
+
+// Converts a coordinate in degrees to the fixed-point representation of the index
+std::int32_t toFixed(double degrees)
+{
+   return static_cast<std::int32_t>(std::lround(degrees * cityindex::sc_coordinateScale));
+}
+
+// Rounds an offset up to the alignment of the sections
+std::uint64_t alignOffset(std::uint64_t offset)
+{
+   return (offset + 7) / 8 * 8;
+}
+
+// Appends a string to the strings section, sharing equal strings
+// @return Offset of the string in the section
+std::uint32_t addString(
+   const std::string& value, std::string& strings, std::unordered_map<std::string, std::uint32_t>& offsets)
+{
+   const auto [it, inserted] = offsets.try_emplace(value, static_cast<std::uint32_t>(strings.size()));
+   if (inserted)
+      strings += value;
+   return it->second;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+bool NameIndexBuilder::Add(Place place)
+{
+   if (!IsValidLatitude(place.latitude) || !IsValidLongitude(place.longitude))
+      return false;
+
+   Entry entry{};
+   entry.record.osmId = place.osmId;
+   entry.record.type = place.type;
+   entry.record.center = {toFixed(place.latitude), toFixed(place.longitude)};
+
+   place.names.push_back(place.name);
+   for (const auto& name : place.names)
+   {
+      std::string key = NameIndex::Normalize(name);
+      if (!key.empty() && std::find(entry.keys.begin(), entry.keys.end(), key) == entry.keys.end())
+         entry.keys.push_back(std::move(key));
+   }
+   if (entry.keys.empty())
+      return false;
+
+   entry.name = std::move(place.name);
+   entry.country = std::move(place.country);
+   m_places.push_back(std::move(entry));
+   return true;
+}
+
+void NameIndexBuilder::Write(const std::string& path) const
+{
+   // Places are stored in the order of OSM IDs, like the remote search returns them.
+   std::vector<const Entry*> order;
+   order.reserve(m_places.size());
+   for (const auto& place : m_places)
+      order.push_back(&place);
+   std::stable_sort(order.begin(), order.end(),
+      [](const Entry* a, const Entry* b)
+      {
+         return a->record.osmId < b->record.osmId;
+      });
+
+   std::vector<nameindex::PlaceRecord> places;
+   std::map<std::string, std::vector<std::uint32_t>> postingsByKey;  // Sorted by bytes, like NameIndex looks up
+   std::string strings;
+   std::unordered_map<std::string, std::uint32_t> stringOffsets;
+   places.reserve(order.size());
+   for (const Entry* entry : order)
+   {
+      if (!places.empty() && places.back().osmId == entry->record.osmId)
+         continue;
+
+      nameindex::PlaceRecord record = entry->record;
+      record.nameOffset = addString(entry->name, strings, stringOffsets);
+      record.nameSize = static_cast<std::uint32_t>(entry->name.size());
+      record.countryOffset = addString(entry->country, strings, stringOffsets);
+      record.countrySize = static_cast<std::uint32_t>(entry->country.size());
+      for (const auto& key : entry->keys)
+         postingsByKey[key].push_back(static_cast<std::uint32_t>(places.size()));
+      places.push_back(record);
+   }
+
+   std::vector<nameindex::Key> keys;
+   std::vector<std::uint32_t> postings;
+   keys.reserve(postingsByKey.size());
+   for (const auto& [key, keyPostings] : postingsByKey)
+   {
+      keys.push_back({addString(key, strings, stringOffsets), static_cast<std::uint32_t>(key.size()),
+         static_cast<std::uint32_t>(postings.size()), static_cast<std::uint32_t>(keyPostings.size())});
+      postings.insert(postings.end(), keyPostings.begin(), keyPostings.end());
+   }
+
+   nameindex::Header header{};
+   std::copy(std::begin(nameindex::sz_magic), std::end(nameindex::sz_magic), header.magic);
+   header.version = nameindex::sc_version;
+   header.numKeys = static_cast<std::uint32_t>(keys.size());
+   header.numPlaces = static_cast<std::uint32_t>(places.size());
+   header.numPostings = postings.size();
+   header.keysOffset = alignOffset(sizeof(header));
+   header.postingsOffset = alignOffset(header.keysOffset + keys.size() * sizeof(nameindex::Key));
+   header.placesOffset = alignOffset(header.postingsOffset + postings.size() * sizeof(std::uint32_t));
+   header.stringsOffset = alignOffset(header.placesOffset + places.size() * sizeof(nameindex::PlaceRecord));
+   header.stringsSize = strings.size();
+
+   std::ofstream file(path, std::ios::binary | std::ios::trunc);
+   auto writeSection = [&file](std::uint64_t offset, const void* data, std::size_t size)
+   {
+      static const char sc_padding[8] = {};
+      file.write(sc_padding, static_cast<std::streamsize>(offset - static_cast<std::uint64_t>(file.tellp())));
+      file.write(static_cast<const char*>(data), static_cast<std::streamsize>(size));
+   };
+   file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+   writeSection(header.keysOffset, keys.data(), keys.size() * sizeof(nameindex::Key));
+   writeSection(header.postingsOffset, postings.data(), postings.size() * sizeof(std::uint32_t));
+   writeSection(header.placesOffset, places.data(), places.size() * sizeof(nameindex::PlaceRecord));
+   writeSection(header.stringsOffset, strings.data(), strings.size());
+   file.close();
+   if (!file)
+   {
+      LOG(ERROR) << std::format("Failed to write name index file: {}", path);
+      throw std::runtime_error("Failed to write name index file: " + path);
+   }
+
+   LOG(INFO) << std::format("Written name index {}: {} names of {} places, {} bytes of strings", path, keys.size(),
+      places.size(), strings.size());
+}
+
+}  // namespace geo
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "CityIndex.h"
+#include "NameIndexFormat.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace geo
+{
+
+// Collects places with their names and writes them as a NameIndex file.
+// Used by the offline importer, so it keeps everything in memory until Write() is called.
+class NameIndexBuilder
+{
+public:
+   // Place to add to the index
+   struct Place
+   {
+      std::int64_t osmId = 0;                       // OSM ID of the relation
+      CityIndex::PlaceType type = CityIndex::City;  // Kind of the place
+      std::string name;                             // Name in the native language
+      std::string country;                          // Country name in the native language, may be empty
+      double latitude = 0;                          // Latitude of the center
+      double longitude = 0;                         // Longitude of the center
+      std::vector<std::string> names;               // Other names ("name:en", "name:*"), may repeat the name
+   };
+
+public:
+   // Adds a place, places with invalid centers are ignored
+   // @param place Place to add
+   // @return false if the place is ignored
+   bool Add(Place place);
+
+   // Returns number of added places
+   std::size_t GetNumPlaces() const { return m_places.size(); }
+
+   // Sorts the names and writes the index, throws std::runtime_error if the file cannot be written
+   // @param path Path to the index file
+   void Write(const std::string& path) const;
+
+private:
+   // Added place in the representation of the index
+   struct Entry
+   {
+      nameindex::PlaceRecord record;  // Record without string offsets
+      std::string name;               // Name of the place
+      std::string country;            // Country of the place
+      std::vector<std::string> keys;  // Normalized names of the place
+   };
+
+private:
+   std::vector<Entry> m_places;  // Added places
+};
+
+}  // namespace geo
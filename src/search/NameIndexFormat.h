@@ -0,0 +1,62 @@
+#pragma once
+
+#include "CityIndexFormat.h"
+
+#include <cstdint>
+#include <type_traits>
+
+// Layout of the name index file written by NameIndexBuilder and memory-mapped by NameIndex.
+// All the sections are arrays of the records below in native byte order, aligned to 8 bytes.
+// Keys are normalized names (see NameIndex::Normalize) sorted by bytes, so a name is found by a binary search.
+// Every key refers to a range of postings, and every posting is an index of a place.
+namespace geo::nameindex
+{
+
+inline constexpr char sz_magic[8] = {'G', 'E', 'O', 'N', 'A', 'M', 'E', '\0'};  // First bytes of the file
+inline constexpr std::uint32_t sc_version = 1;                                  // Version of the layout
+
+using Point = cityindex::Point;  // Coordinates are stored like in the city index, in 1e-7 degrees
+
+// Beginning of the file
+struct Header
+{
+   char magic[8];                 // sz_magic
+   std::uint32_t version;         // sc_version
+   std::uint32_t numKeys;         // Number of Key items
+   std::uint32_t numPlaces;       // Number of PlaceRecord items
+   std::uint32_t reserved;        // Padding, zero
+   std::uint64_t numPostings;     // Number of postings (std::uint32_t indices of places)
+   std::uint64_t keysOffset;      // Offset of the keys section
+   std::uint64_t postingsOffset;  // Offset of the postings section
+   std::uint64_t placesOffset;    // Offset of the places section
+   std::uint64_t stringsOffset;   // Offset of the strings section (UTF-8, not terminated)
+   std::uint64_t stringsSize;     // Size of the strings section
+};
+
+// Normalized name with the places which have it
+struct Key
+{
+   std::uint32_t stringOffset;  // Offset of the normalized name in the strings section
+   std::uint32_t stringSize;    // Size of the normalized name
+   std::uint32_t firstPosting;  // Index of the first posting
+   std::uint32_t numPostings;   // Number of postings, places are in ascending order of OSM IDs
+};
+
+// City, town or state, ordered by OSM IDs
+struct PlaceRecord
+{
+   std::int64_t osmId;           // OSM ID of the relation
+   Point center;                 // Center of the place
+   std::uint32_t nameOffset;     // Offset of the name in the strings section
+   std::uint32_t nameSize;       // Size of the name
+   std::uint32_t countryOffset;  // Offset of the country name in the strings section
+   std::uint32_t countrySize;    // Size of the country name
+   std::uint8_t type;            // CityIndex::PlaceType
+   std::uint8_t reserved[7];     // Padding, zero
+};
+
+static_assert(std::is_trivially_copyable_v<Header> && sizeof(Header) == 72);
+static_assert(std::is_trivially_copyable_v<Key> && sizeof(Key) == 16);
+static_assert(std::is_trivially_copyable_v<PlaceRecord> && sizeof(PlaceRecord) == 40);
+
+}  // namespace geo::nameindex
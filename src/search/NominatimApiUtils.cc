@@ -2,8 +2,15 @@
 
 #include "NominatimApiUtils.h"
 
+#include "../utils/BufferPool.h"
+#include "../utils/ConcurrencyUtils.h"
+#include "../utils/JsonArena.h"
 #include "../utils/JsonUtils.h"
+#include "../utils/Logging.h"
+#include "../utils/Metrics.h"
+#include "../utils/Tracing.h"
 #include "../utils/WebClient.h"
+#include "RelationCache.h"
 
 #include <absl/log/log.h>
 #include <rapidjson/document.h>
@@ -12,7 +19,13 @@
 #include <charconv>
 #include <cmath>
 #include <format>
+#include <functional>
+#include <optional>
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace
 {
@@ -64,6 +77,7 @@ TObject jsonToObject(TJsonValue& value, const std::string& addressType)
    result.country = json::GetString(json::Get(value, "address", "country"));
    result.latitude = getDoubleFromString(json::GetString(json::Get(value, "lat")));
    result.longitude = getDoubleFromString(json::GetString(json::Get(value, "lon")));
+   result.addressType = addressType;
    return result;
 }
 
@@ -80,26 +94,95 @@ void forEachChunk(const OsmIds& relationIds, THandler fn)
    }
 }
 
-// Splits the list of OSM IDs into chunks, sends requests to the Nominatim API, and processes the responses.
-// @param relationIds: List of OSM IDs to process.
+// Requests the Nominatim API for relations which are not cached yet. Chunks are requested concurrently.
+// Responses are stored in the cache, including negative entries for ids the API did not return.
+// @param relationIds: List of OSM IDs to look up.
 // @param client: WebClient instance to interact with the Nominatim API.
-// @param responseHandler: Handler function to process each API response.
-template <typename THandler>
-void splitInChunksAndParseResponses(const OsmIds& relationIds, WebClient& client, THandler responseHandler)
+// @param options: Optional cache of previous lookups and concurrency limit.
+// @return: Found relations by OSM ID.
+std::unordered_map<OsmId, RelationInfo> lookupRelations(
+   const OsmIds& relationIds, WebClient& client, const LookupOptions& options)
 {
-   forEachChunk(relationIds,
-      [&client, responseHandler](const auto& itBegin, const auto& itEnd)
-      {
-         const std::string request = formatRelationLookupRequest(itBegin, itEnd);
-         const std::string response = client.Get(request);
-         if (response.empty())
-            return;
+   ScopedSpan span("nominatim.lookup");
+   std::unordered_map<OsmId, RelationInfo> relations;
+   RelationCache* cache = options.cache;
+
+   OsmIds idsToLoad;
+   for (const auto id : relationIds)
+   {
+      std::optional<RelationInfo> cached;
+      if (!cache || !cache->Find(id, cached))
+         idsToLoad.push_back(id);
+      else if (cached)
+         relations.emplace(id, std::move(*cached));
+   }
+
+   if (cache)
+   {
+      const auto statistics = cache->GetStatistics();
+      LOG_EVERY_N_SEC(INFO, 60) << std::format(
+         "Nominatim relation cache: hit ratio {:.3f}, {} entries, {} bytes, {} evictions", statistics.GetHitRatio(),
+         statistics.numEntries, statistics.memoryBytes, statistics.numEvictions);
+   }
 
-         rapidjson::Document document;
-         document.Parse(response.c_str());
+   std::vector<std::pair<OsmIds::const_iterator, OsmIds::const_iterator>> chunks;
+   forEachChunk(idsToLoad,
+      [&chunks](const auto& itBegin, const auto& itEnd)
+      {
+         chunks.emplace_back(itBegin, itEnd);
+      });
 
-         responseHandler(document);
+   // Responses are only stored by event loop threads and parsed here, as callbacks must not block the loop.
+   std::vector<std::string> responses(chunks.size());
+   ForEachConcurrently(chunks.size(), options.maxOngoingRequests,
+      [&client, &chunks, &responses](std::size_t index, const std::function<void()>& done)
+      {
+         client.GetAsync(formatRelationLookupRequest(chunks[index].first, chunks[index].second),
+            [&responses, index, &done](std::string response)
+            {
+               responses[index] = std::move(response);
+               done();
+            });
       });
+
+   for (std::size_t i = 0; i < chunks.size(); ++i)
+   {
+      if (responses[i].empty())
+         continue;
+
+      RelationInfos chunk;
+      const bool isValid = ParseLookupResponse(responses[i], chunk);
+      BufferPool::GetDefault().Release(std::move(responses[i]));
+      if (!isValid)
+         continue;
+
+      std::set<OsmId> foundIds;
+      for (auto& info : chunk)
+      {
+         foundIds.insert(info.osmId);
+         if (cache)
+            cache->Put(info);
+         relations.emplace(info.osmId, std::move(info));
+      }
+
+      if (cache)
+      {
+         for (auto itID = chunks[i].first; itID != chunks[i].second; ++itID)
+            if (!foundIds.contains(*itID))
+               cache->PutMissing(*itID);
+      }
+   }
+
+   return relations;
+}
+
+// Returns the histogram of time spent on parsing Nominatim responses
+MetricsRegistry::Histogram& getParseDuration()
+{
+   static auto& s_parseDuration = MetricsRegistry::GetDefault().GetHistogram(
+      "geo_upstream_parse_seconds", "Time spent on parsing responses of upstream APIs",
+      {{"upstream", "nominatim"}}, 1e-6);
+   return s_parseDuration;
 }
 
 }  // namespace
@@ -107,81 +190,123 @@ void splitInChunksAndParseResponses(const OsmIds& relationIds, WebClient& client
 namespace geo::nominatim
 {
 
-RelationInfos LookupRelationInformation(const OsmIds& relationIds, WebClient& nominatimApiClient)
+bool IsLookupResponse(const std::string& response)
 {
-   RelationInfos regions;
-   splitInChunksAndParseResponses(relationIds, nominatimApiClient,
-      [&regions](const rapidjson::Document& document)
-      {
-         for (const auto& item : document.GetArray())
-            regions.emplace_back(
-               jsonToObject<RelationInfo>(item, json::GetString(json::Get(item, "addresstype")).data()));
-      });
-   return regions;
+   JsonArena::Lease arena;
+   auto document = arena.CreateDocument();
+   document.Parse(response.c_str());
+   return !document.HasParseError() && document.IsArray();
 }
 
-RelationInfos LookupRelationInformationForCities(const OsmIds& relationIds, Match match, WebClient& nominatimApiClient)
+bool ParseLookupResponse(const std::string& response, RelationInfos& relations)
 {
-   RelationInfos cities;
-   splitInChunksAndParseResponses(relationIds, nominatimApiClient,
-      [&cities, match](const rapidjson::Document& document)
+   ScopedLatency latency(getParseDuration());
+   ScopedSpan span("nominatim.parse");
+   JsonArena::Lease arena;
+   auto document = arena.CreateDocument();
+   document.Parse(response.c_str());
+   if (!document.IsArray())
+      return false;
+
+   relations.reserve(relations.size() + document.Size());
+   for (const auto& item : document.GetArray())
+      relations.push_back(
+         jsonToObject<RelationInfo>(item, std::string(json::GetString(json::Get(item, "addresstype")))));
+   return true;
+}
+
+void SelectCities(const RelationInfos& chunk, Match match, RelationInfos& cities)
+{
+   auto areCloseCoordinates = [](const RelationInfo& c1, const RelationInfo& c2)
+   {
+      return std::abs(c1.latitude - c2.latitude) < 1 && std::abs(c1.longitude - c2.longitude) < 1;
+   };
+
+   // Order is important when CitySearch.Match.Best is used.
+   // For example, latitude=41.1172364, longitude=1.2546057 is Tarragona "city",
+   // but it is also Catalonia "state". And "city" is the best match here.
+   // However, latitude=11.5730391, longitude=104.857807 is Phnom Penh "state",
+   // and there is no "city" at this point at all.
+   //
+   // When CitySearch.Match.Any is used we need to collect all matching things.
+   // But it is worth to apply some heuristic too - if "city" is already found then
+   // "state" with same (or close) coordinates is not needed.
+   //
+   // The list is probably incomplete as there is no any documentation on this API tricks.
+   constexpr std::array<const char*, 3> sc_types = {"city", "town", "state"};
+
+   for (auto type : sc_types)
+   {
+      for (const auto& item : chunk)
       {
-         auto areCloseCoordinates = [](const RelationInfo& c1, const RelationInfo& c2)
+         if (item.addressType == type)
          {
-            return std::abs(c1.latitude - c2.latitude) < 1 && std::abs(c1.longitude - c2.longitude) < 1;
-         };
-
-         // Order is important when CitySearch.Match.Best is used.
-         // For example, latitude=41.1172364, longitude=1.2546057 is Tarragona "city",
-         // but it is also Catalonia "state". And "city" is the best match here.
-         // However, latitude=11.5730391, longitude=104.857807 is Phnom Penh "state",
-         // and there is no "city" at this point at all.
-         //
-         // When CitySearch.Match.Any is used we need to collect all matching things.
-         // But it is worth to apply some heuristic too - if "city" is already found then
-         // "state" with same (or close) coordinates is not needed.
-         //
-         // The list is probably incomplete as there is no any documentation on this API tricks.
-         constexpr std::array<const char*, 3> sc_types = {"city", "town", "state"};
-
-         for (auto type : sc_types)
-         {
-            for (const auto& item : document.GetArray())
+            bool needAdd = true;
+            if (match == Match::Any)
             {
-               if (json::GetString(json::Get(item, "addresstype")) == type)
+               for (auto& c : cities)
                {
-                  auto newObject = jsonToObject<RelationInfo>(item, type);
-                  bool needAdd = true;
-                  if (match == Match::Any)
+                  if (areCloseCoordinates(c, item))
                   {
-                     for (auto& c : cities)
-                     {
-                        if (areCloseCoordinates(c, newObject))
-                        {
-                           needAdd = false;
-                           break;
-                        }
-                     }
+                     needAdd = false;
+                     break;
                   }
+               }
+            }
 
-                  if (needAdd)
-                  {
-                     cities.emplace_back(std::move(newObject));
+            if (needAdd)
+            {
+               cities.push_back(item);
 #ifndef NDEBUG
-                     LOG(INFO) << std::format("addresstype {}, osm_id {}, lat {}, lon {}", type,
-                        json::GetInt64(json::Get(item, "osm_id")), json::GetString(json::Get(item, "lat")),
-                        json::GetString(json::Get(item, "lon")));
+               GEO_LOG_RATE_LIMITED(INFO, 10) << LogFields("nominatim_place")
+                                                    .Add("addresstype", type)
+                                                    .Add("osm_id", item.osmId)
+                                                    .Add("lat", item.latitude)
+                                                    .Add("lon", item.longitude);
 #endif
-                  }
-               }
-               if (match == Match::Best && !cities.empty())
-                  break;
             }
-            if (match == Match::Best && !cities.empty())
-               break;
          }
+         if (match == Match::Best && !cities.empty())
+            break;
+      }
+      if (match == Match::Best && !cities.empty())
+         break;
+   }
+}
+
+RelationInfos LookupRelationInformation(
+   const OsmIds& relationIds, WebClient& nominatimApiClient, const LookupOptions& options)
+{
+   auto relations = lookupRelations(relationIds, nominatimApiClient, options);
+
+   RelationInfos regions;
+   for (const auto id : relationIds)
+   {
+      if (const auto it = relations.find(id); it != relations.end())
+         regions.emplace_back(std::move(it->second));
+      relations.erase(id);
+   }
+   return regions;
+}
+
+RelationInfos LookupRelationInformationForCities(
+   const OsmIds& relationIds, Match match, WebClient& nominatimApiClient, const LookupOptions& options)
+{
+   const auto relations = lookupRelations(relationIds, nominatimApiClient, options);
+
+   // Cities are selected within the same chunks as Nominatim would return them and in the original order,
+   // so cached, concurrently requested and sequentially requested relations produce the same result
+   RelationInfos cities;
+   forEachChunk(relationIds,
+      [&relations, match, &cities](const auto& itBegin, const auto& itEnd)
+      {
+         RelationInfos chunk;
+         for (auto itID = itBegin; itID != itEnd; ++itID)
+            if (const auto it = relations.find(*itID); it != relations.end())
+               chunk.push_back(it->second);
+         SelectCities(chunk, match, cities);
       });
    return cities;
 }
 
-}  // namespace geo::nominatim
\ No newline at end of file
+}  // namespace geo::nominatim
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <vector>
@@ -12,6 +13,8 @@ class WebClient;
 namespace geo::nominatim
 {
 
+class RelationCache;
+
 using OsmId = std::int64_t;         // Type alias for OpenStreetMap (OSM) IDs.
 using OsmIds = std::vector<OsmId>;  // Type alias for a list of OSM IDs.
 
@@ -25,29 +28,58 @@ enum Match
 // Structure to hold information about a geographic relation (e.g., city, town, state).
 struct RelationInfo
 {
-   std::int64_t osmId = 0;  // OSM ID of the relation.
-   std::string name;        // Name of the relation in the native language.
-   std::string country;     // Country name in the native language.
-   double latitude = 0;     // Latitude of the relation's center.
-   double longitude = 0;    // Longitude of the relation's center.
+   std::int64_t osmId = 0;   // OSM ID of the relation.
+   std::string name;         // Name of the relation in the native language.
+   std::string country;      // Country name in the native language.
+   double latitude = 0;      // Latitude of the relation's center.
+   double longitude = 0;     // Longitude of the relation's center.
+   std::string addressType;  // Value of "addresstype" (e.g., "city", "town", "state").
 };
 
 using RelationInfos = std::vector<RelationInfo>;  // Type alias for a list of RelationInfo objects.
 
+// Structure to hold optional settings of lookups.
+struct LookupOptions
+{
+   RelationCache* cache = nullptr;      // Cache of previous lookups; only ids which are not cached are requested.
+   std::size_t maxOngoingRequests = 1;  // Maximum number of chunks requested from the API concurrently.
+};
+
 // Requests the Nominatim Address Lookup API for objects with the given OSM IDs.
 // See https://nominatim.org/release-docs/latest/api/Lookup/
 // @param relationIds: List of OSM IDs to look up.
 // @param nominatimApiClient: WebClient instance to interact with the Nominatim API.
+// @param options: Optional cache and concurrency limit.
 // @return: A list of RelationInfo objects containing details about the requested relations.
-RelationInfos LookupRelationInformation(const OsmIds& relationIds, WebClient& nominatimApiClient);
+RelationInfos LookupRelationInformation(
+   const OsmIds& relationIds, WebClient& nominatimApiClient, const LookupOptions& options = {});
 
 // Requests the Nominatim Address Lookup API for objects with the given OSM IDs,
 // filtering results to include only those with "addresstype" relevant for cities.
 // @param relationIds: List of OSM IDs to look up.
 // @param match: Matching strategy (Best or Any).
 // @param nominatimApiClient: WebClient instance to interact with the Nominatim API.
+// @param options: Optional cache and concurrency limit.
 // @return: A list of RelationInfo objects containing details about the requested cities.
-RelationInfos LookupRelationInformationForCities(const OsmIds& relationIds, Match match, WebClient& nominatimApiClient);
+RelationInfos LookupRelationInformationForCities(
+   const OsmIds& relationIds, Match match, WebClient& nominatimApiClient, const LookupOptions& options = {});
+
+// Parses a response of the Nominatim Address Lookup API.
+// @param response: The JSON response from the Nominatim API.
+// @param relations: Receives relations in the order of the response, new ones are appended.
+// @return: false if the response is not a JSON array (e.g. an error page).
+bool ParseLookupResponse(const std::string& response, RelationInfos& relations);
+
+// Checks that a response of the Nominatim Address Lookup API is a JSON array, i.e. it may be cached.
+// @param response: The JSON response from the Nominatim API.
+// @return: false if the response is not a JSON array (e.g. an error or a truncated response).
+bool IsLookupResponse(const std::string& response);
+
+// Selects relations relevant for cities ("addresstype" city, town or state) from relations of a single lookup.
+// @param chunk: Relations in the order of the lookup.
+// @param match: Matching strategy (Best or Any).
+// @param cities: Selected cities, new ones are appended.
+void SelectCities(const RelationInfos& chunk, Match match, RelationInfos& cities);
 
 }  // namespace geo::nominatim
 
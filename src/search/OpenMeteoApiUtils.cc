@@ -1,6 +1,10 @@
 #include "OpenMeteoApiUtils.h"
 
+#include "../utils/BufferPool.h"
+#include "../utils/JsonArena.h"
 #include "../utils/JsonUtils.h"
+#include "../utils/Metrics.h"
+#include "../utils/Tracing.h"
 #include "../utils/WebClient.h"
 
 #include <absl/log/log.h>
@@ -33,10 +37,23 @@ std::string formatHistoricalWeatherRequest(
    return request;
 }
 
-// Parse Open Meteo API response.
-WeatherInfoVector parseWeatherResponse(const std::string& response)
+// Returns the histogram of time spent on parsing Open Meteo responses
+MetricsRegistry::Histogram& getParseDuration()
 {
-   rapidjson::Document document;
+   static auto& s_parseDuration = MetricsRegistry::GetDefault().GetHistogram(
+      "geo_upstream_parse_seconds", "Time spent on parsing responses of upstream APIs",
+      {{"upstream", "openmeteo"}}, 1e-6);
+   return s_parseDuration;
+}
+
+}  // namespace
+
+WeatherInfoVector ParseWeatherResponse(const std::string& response)
+{
+   ScopedLatency latency(getParseDuration());
+   ScopedSpan span("openmeteo.parse");
+   JsonArena::Lease arena;
+   auto document = arena.CreateDocument();
    document.Parse(response.c_str());
 
    const auto& timeValues = json::Get(document, "daily", "time").GetArray();
@@ -51,11 +68,15 @@ WeatherInfoVector parseWeatherResponse(const std::string& response)
    }
 
    WeatherInfoVector result;
-   result.resize(numValues);
+   result.reserve(numValues);
 
    for (std::size_t i = 0; i < numValues; ++i)
    {
-      WeatherInfo& info = result[i];
+      // Days which are not published yet have null values, they are skipped rather than taken as zero degrees.
+      if (temperatureMaxValues[i].IsNull() || temperatureMinValues[i].IsNull())
+         continue;
+
+      WeatherInfo& info = result.emplace_back();
       info.time = StringToDate(json::GetString(timeValues[i]));
       info.temperatureMax = json::GetDouble(temperatureMaxValues[i]);
       info.temperatureMin = json::GetDouble(temperatureMinValues[i]);
@@ -65,7 +86,21 @@ WeatherInfoVector parseWeatherResponse(const std::string& response)
    return result;
 }
 
-}  // namespace
+bool IsWeatherResponse(const std::string& response)
+{
+   JsonArena::Lease arena;
+   auto document = arena.CreateDocument();
+   document.Parse(response.c_str());
+   if (document.HasParseError() || !json::Has(document, "daily", "time") ||
+      !json::Has(document, "daily", "temperature_2m_max") || !json::Has(document, "daily", "temperature_2m_min"))
+      return false;
+
+   const auto& timeValues = json::Get(document, "daily", "time");
+   const auto& temperatureMaxValues = json::Get(document, "daily", "temperature_2m_max");
+   const auto& temperatureMinValues = json::Get(document, "daily", "temperature_2m_min");
+   return timeValues.IsArray() && temperatureMaxValues.IsArray() && temperatureMinValues.IsArray() &&
+      temperatureMaxValues.Size() == timeValues.Size() && temperatureMinValues.Size() == timeValues.Size();
+}
 
 std::vector<DateRange> CollectHistoricalRanges(
    const DateRange& dateRange, const TimePoint& latestTime, std::uint32_t numYears)
@@ -102,8 +137,17 @@ WeatherInfoVector LoadHistoricalWeather(
    WebClient& client, double latitude, double longitude, const DateRange& dateRange)
 {
    const std::string request = formatHistoricalWeatherRequest(latitude, longitude, dateRange.first, dateRange.second);
-   const std::string response = client.Get(request);
-   return !response.empty() ? parseWeatherResponse(response) : WeatherInfoVector{};
+   std::string response = client.Get(request);
+   auto weather = !response.empty() ? ParseWeatherResponse(response) : WeatherInfoVector{};
+   BufferPool::GetDefault().Release(std::move(response));
+   return weather;
+}
+
+void LoadHistoricalWeatherAsync(WebClient& client, double latitude, double longitude, const DateRange& dateRange,
+   WebClient::ResponseCallback callback)
+{
+   const std::string request = formatHistoricalWeatherRequest(latitude, longitude, dateRange.first, dateRange.second);
+   client.GetAsync(request, std::move(callback));
 }
 
 }  // namespace geo::openmeteo
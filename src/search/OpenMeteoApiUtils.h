@@ -5,6 +5,7 @@
 #include "../utils/WebClient.h"
 
 #include <chrono>
+#include <string>
 #include <vector>
 
 namespace geo::openmeteo
@@ -19,6 +20,16 @@ namespace geo::openmeteo
 std::vector<DateRange> CollectHistoricalRanges(
    const DateRange& dateRange, const TimePoint& latestTime, std::uint32_t numYears);
 
+// Parses a response of Open Meteo Historical API. Days without published temperatures are skipped.
+// @param response: The JSON response from the Open Meteo Historical API.
+// @return: A list of weather information for each day of the response, empty if it is malformed.
+WeatherInfoVector ParseWeatherResponse(const std::string& response);
+
+// Checks that a response of Open Meteo Historical API has the daily temperatures, i.e. it may be cached.
+// @param response: The JSON response from the Open Meteo Historical API.
+// @return: false if the response is not valid JSON (e.g. an error or a truncated response) or is malformed.
+bool IsWeatherResponse(const std::string& response);
+
 // Requests Open Meteo Historical API for given location and date range.
 // @param client: WebClient instance to interact with the Open Meteo Historical API.
 // @param latitude: The latitude of the location.
@@ -28,4 +39,14 @@ std::vector<DateRange> CollectHistoricalRanges(
 WeatherInfoVector LoadHistoricalWeather(
    WebClient& client, double latitude, double longitude, const DateRange& dateRange);
 
+// Starts request to Open Meteo Historical API for given location and date range and returns immediately.
+// @param client: WebClient instance to interact with the Open Meteo Historical API.
+// @param latitude: The latitude of the location.
+// @param longitude: The longitude of the location.
+// @param dateRange: The range of dates to request historical weather for.
+// @param callback: Receives the response (empty on error), which has to be parsed with ParseWeatherResponse.
+//                  It is called on an event loop thread and must not block, so it must not parse the response.
+void LoadHistoricalWeatherAsync(WebClient& client, double latitude, double longitude, const DateRange& dateRange,
+   WebClient::ResponseCallback callback);
+
 }  // namespace geo::openmeteo
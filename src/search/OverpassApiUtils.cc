@@ -1,21 +1,48 @@
 #include "OverpassApiUtils.h"
 
-#include "../utils/JsonUtils.h"
+#include "../utils/BufferPool.h"
+#include "../utils/JsonArena.h"
+#include "../utils/Metrics.h"
+#include "../utils/ResponseStream.h"
+#include "../utils/RpcContext.h"
+#include "../utils/Tracing.h"
 #include "../utils/WebClient.h"
 #include "ProtoTypes.h"
 
-#include <rapidjson/document.h>
+#include <rapidjson/reader.h>
 
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
 #include <format>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <utility>
 
 namespace
 {
 
 using namespace geo;
+using namespace geo::overpass;
+
+// Time and memory limits of a query by the time left until the deadline of the RPC: the first step with a timeout
+// within the time left is taken. The first step is the default of Overpass API, used when the RPC has no deadline.
+struct QueryLimits
+{
+   std::int64_t timeoutS;    // Timeout of the query in seconds
+   std::int64_t maxSizeMiB;  // Memory the query may use in MiB
+};
+constexpr QueryLimits sc_queryLimits[] = {{180, 512}, {60, 512}, {25, 256}, {10, 128}, {5, 64}};
+
+// Overpass API query settings format: output format, timeout in seconds and memory limit in bytes.
+constexpr const char* sz_querySettingsFormat = "[out:json][timeout:{}][maxsize:{}];";
 
 // Overpass API query format to find relations by name or English name.
 constexpr const char* sz_requestByNameFormat =  //
-   "[out:json];"
+   "{1}"
    "("
    "rel[\"name\"=\"{0}\"][\"boundary\"=\"administrative\"];"
    "rel[\"name:en\"=\"{0}\"][\"boundary\"=\"administrative\"];"
@@ -26,8 +53,8 @@ constexpr const char* sz_requestByNameFormat =  //
 
 // Overpass API query format to find relations by coordinates.
 constexpr const char* sz_requestByCoordinatesFormat =
-   "[out:json];"
-   "is_in({},{}) -> .areas;"  // Save "area" entities which contain a point with the given coordinates to .areas set.
+   "{2}"
+   "is_in({0},{1}) -> .areas;"  // Save "area" entities which contain a point with the given coordinates to .areas set.
    "("
    "rel(pivot.areas)[\"boundary\"=\"administrative\"];"
    "rel(pivot.areas)[\"place\"~\"^(city|town|state)$\"];"
@@ -35,121 +62,402 @@ constexpr const char* sz_requestByCoordinatesFormat =
                 // which define the outlines of the found "area" entities to the result set.
    "out ids;";  // Return ids.
 
-}  // namespace
+// Overpass API query format to find hotels and museums of several cities at once.
+// Every city is output as its relation id followed by its nodes, so the response can be split by cities.
+constexpr const char* sz_requestCityDetailsFormat =
+   "{1}"
+   "rel(id:{0});"
+   "foreach("
+   "out ids;"  // Output the current relation as a marker of the city.
+   "map_to_area -> .cityArea;"
+   "("
+   "node[tourism=hotel](area.cityArea);"
+   "node[tourism=museum](area.cityArea);"
+   ");"
+   "out center;"  // Output nodes of the city.
+   ");";
 
-namespace geo::overpass
+// Fields of an element of Overpass API JSON response which are used by the service.
+struct Element
 {
+   std::string type;       // Element type ("node", "way" or "relation")
+   OsmId id = 0;           // OSM ID of the element
+   bool hasId = false;     // True if the element has an id
+   double lat = 0;         // Latitude of a node
+   double lon = 0;         // Longitude of a node
+   std::string tourism;    // Value of "tourism" tag
+   std::string name;       // Value of "name" tag
+   std::string nameEn;     // Value of "name:en" tag
+   double ele = 0;         // Value of "ele" tag (elevation in meters), 0 if it is not a number
 
-GeoProtoTaggedFeatures ExtractCityDetails(const std::string& json)
+   // Resets all the fields, keeping capacity of the strings for the next element
+   void Clear()
+   {
+      type.clear();
+      id = 0;
+      hasId = false;
+      lat = 0;
+      lon = 0;
+      tourism.clear();
+      name.clear();
+      nameEn.clear();
+      ele = 0;
+   }
+};
+
+// SAX handler for Overpass API JSON responses.
+// Collects used fields of every item of the top-level "elements" array and passes the element to a callback,
+// so the response is never stored as a DOM and may be parsed while it is being received.
+template <typename TCallback>
+class ElementsHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, ElementsHandler<TCallback>>
 {
-   if (json.empty())
-      return {};
+public:
+   explicit ElementsHandler(TCallback callback)
+      : m_callback(std::move(callback))
+   {
+   }
 
-   rapidjson::Document document;
-   document.Parse(json.c_str());
-   if (!document.IsObject() || !document.HasMember("elements"))
-      return {};
+   // Returns true if the response has the "elements" array
+   bool HasElements() const { return m_hasElements; }
 
-   GeoProtoTaggedFeatures features;
-   for (const auto& element : document["elements"].GetArray())
+   // Returns true if the response has a "remark", i.e. the query has not been completed
+   bool HasRemark() const { return m_hasRemark; }
+
+   bool StartObject()
+   {
+      ++m_depth;
+      if (m_inElements && m_depth == sc_elementDepth)
+         m_element.Clear();
+      m_inTags = m_inElements && m_depth == sc_elementDepth + 1 && m_key == "tags";
+      return true;
+   }
+
+   bool EndObject(rapidjson::SizeType)
+   {
+      if (m_inElements && m_depth == sc_elementDepth)
+         m_callback(m_element);
+      m_inTags = false;
+      --m_depth;
+      return true;
+   }
+
+   bool StartArray()
+   {
+      ++m_depth;
+      if (m_depth == sc_elementDepth - 1 && m_key == "elements")
+         m_inElements = m_hasElements = true;
+      return true;
+   }
+
+   bool EndArray(rapidjson::SizeType)
    {
+      if (m_depth == sc_elementDepth - 1)
+         m_inElements = false;
+      --m_depth;
+      return true;
+   }
 
-      if (json::GetString(json::Get(element, "type")) != "node")
-         continue;
+   bool Key(const char* str, rapidjson::SizeType length, bool)
+   {
+      m_key.assign(str, length);
+      if (m_depth == 1 && m_key == "remark")
+         m_hasRemark = true;
+      return true;
+   }
 
-      // Check if it has tourism tag with value hotel or museum
-      const auto& tags = json::Get(element, "tags");
-      if (!tags.IsObject() || !tags.HasMember("tourism"))
-         continue;
+   bool String(const char* str, rapidjson::SizeType length, bool)
+   {
+      if (!m_inElements)
+         return true;
 
-      const std::string_view tourismValue = json::GetString(json::Get(tags, "tourism"));
-      if (tourismValue != "hotel" && tourismValue != "museum")
-         continue;
+      if (m_depth == sc_elementDepth && m_key == "type")
+         m_element.type.assign(str, length);
+      else if (m_inTags && m_key == "tourism")
+         m_element.tourism.assign(str, length);
+      else if (m_inTags && m_key == "name")
+         m_element.name.assign(str, length);
+      else if (m_inTags && m_key == "name:en")
+         m_element.nameEn.assign(str, length);
+      else if (m_inTags && m_key == "ele")
+         std::from_chars(str, str + length, m_element.ele);
+      return true;
+   }
 
-      // Create TaggedFeature
-      GeoProtoTaggedFeature feature;
+   bool Int(int i) { return number(i, i); }
+   bool Uint(unsigned u) { return number(u, u); }
+   bool Int64(std::int64_t i) { return number(i, static_cast<double>(i)); }
+   bool Uint64(std::uint64_t u) { return number(static_cast<std::int64_t>(u), static_cast<double>(u)); }
+   bool Double(double d) { return number(static_cast<std::int64_t>(d), d); }
 
-      // Set position
-      const double lat = json::GetDouble(json::Get(element, "lat"));
-      const double lon = json::GetDouble(json::Get(element, "lon"));
-      feature.mutable_position()->set_latitude(lat);
-      feature.mutable_position()->set_longitude(lon);
+private:
+   // Depth of element objects: top-level object, "elements" array, element object
+   static const int sc_elementDepth = 3;
 
-      // Set tourism tag
-      (*feature.mutable_tags())["tourism"] = std::string(tourismValue);
+   // Stores a numeric field of the current element
+   bool number(std::int64_t integer, double value)
+   {
+      if (!m_inElements || m_depth != sc_elementDepth)
+         return true;
 
-      // Set name tag if available
-      if (tags.HasMember("name"))
+      if (m_key == "id")
       {
-         const std::string_view name = json::GetString(json::Get(tags, "name"));
-         if (!name.empty())
-            (*feature.mutable_tags())["name"] = std::string(name);
+         m_element.id = integer;
+         m_element.hasId = true;
       }
+      else if (m_key == "lat")
+         m_element.lat = value;
+      else if (m_key == "lon")
+         m_element.lon = value;
+      return true;
+   }
+
+private:
+   TCallback m_callback;        // Receives every element
+   Element m_element;           // Element being parsed
+   std::string m_key;           // The last parsed key
+   int m_depth = 0;             // Nesting level of objects and arrays
+   bool m_inElements = false;   // True inside the "elements" array
+   bool m_inTags = false;       // True inside "tags" object of an element
+   bool m_hasElements = false;  // See HasElements()
+   bool m_hasRemark = false;    // See HasRemark()
+};
+
+// Parses Overpass API JSON response from a rapidjson input stream and passes every element to the callback.
+// @param stream: rapidjson input stream with the response.
+// @param callback: Function `void(const Element&)` receiving the elements.
+// @return: false if the response is not valid JSON or the query has not been completed.
+template <typename TStream, typename TCallback>
+bool parseElements(TStream& stream, TCallback callback)
+{
+   ElementsHandler<TCallback> handler(std::move(callback));
+   JsonArena::Lease arena;
+   auto reader = arena.CreateReader();
+   if (reader.Parse(stream, handler).IsError())
+      return false;
+   return handler.HasElements() && !handler.HasRemark();
+}
 
-      // Set name:en tag if available
-      if (tags.HasMember("name:en"))
+// Converts a hotel or museum node from Overpass API JSON response to a TaggedFeature object.
+// @param element: Element of the response.
+// @param features: Receives the feature, which is allocated on the arena of the field if it has one.
+// @return: false if the element is not a hotel or museum node.
+bool addTaggedFeature(const Element& element, GeoProtoTaggedFeatures& features)
+{
+   if (element.type != "node")
+      return false;
+
+   // Check if it has tourism tag with value hotel or museum
+   if (element.tourism != "hotel" && element.tourism != "museum")
+      return false;
+
+   GeoProtoTaggedFeature& feature = *features.Add();
+
+   // Set position
+   feature.mutable_position()->set_latitude(element.lat);
+   feature.mutable_position()->set_longitude(element.lon);
+
+   // Set tourism tag
+   (*feature.mutable_tags())["tourism"] = element.tourism;
+
+   // Set name tag if available
+   if (!element.name.empty())
+      (*feature.mutable_tags())["name"] = element.name;
+
+   // Set name:en tag if available
+   if (!element.nameEn.empty())
+      (*feature.mutable_tags())["name:en"] = element.nameEn;
+
+   return true;
+}
+
+// Extracts hotels and museums of several cities from Overpass API JSON response.
+// @param stream: rapidjson input stream with the response.
+// @param arena: Arena to allocate the features on, may be nullptr.
+// @return: TaggedFeature objects by OSM ID of the city relation.
+template <typename TStream>
+std::unordered_map<OsmId, GeoProtoTaggedFeatures> extractCityDetailsByRelation(TStream& stream, GeoProtoArena* arena)
+{
+   // Every city starts with its relation element, followed by its nodes.
+   std::unordered_map<OsmId, GeoProtoTaggedFeatures> details;
+   GeoProtoTaggedFeatures* cityFeatures = nullptr;
+   parseElements(stream,
+      [&details, &cityFeatures, arena](const Element& element)
       {
-         const std::string_view nameEn = json::GetString(json::Get(tags, "name:en"));
-         if (!nameEn.empty())
-            (*feature.mutable_tags())["name:en"] = std::string(nameEn);
-      }
+         if (element.type == "relation")
+         {
+            cityFeatures = &details.try_emplace(element.id, arena).first->second;
+            return;
+         }
 
-      features.emplace_back(std::move(feature));
+         if (cityFeatures)
+            addTaggedFeature(element, *cityFeatures);
+      });
+   return details;
+}
+
+// Returns the histogram of time spent on parsing Overpass responses
+MetricsRegistry::Histogram& getParseDuration()
+{
+   static auto& s_parseDuration = MetricsRegistry::GetDefault().GetHistogram(
+      "geo_upstream_parse_seconds", "Time spent on parsing responses of upstream APIs",
+      {{"upstream", "overpass"}}, 1e-6);
+   return s_parseDuration;
+}
+
+}  // namespace
+
+namespace geo::overpass
+{
+
+std::string FormatQuerySettings()
+{
+   const RpcContext* rpc = RpcContext::GetCurrent();
+   const auto remaining = rpc ? rpc->GetRemaining() : RpcContext::Clock::duration::max();
+   QueryLimits limits = sc_queryLimits[std::size(sc_queryLimits) - 1];
+   for (const auto& step : sc_queryLimits)
+   {
+      if (std::chrono::seconds(step.timeoutS) <= remaining)
+      {
+         limits = step;
+         break;
+      }
    }
 
-   return features;
+   // Less time than the smallest step is left, the query gets what is left
+   if (remaining < std::chrono::seconds(limits.timeoutS))
+      limits.timeoutS = std::max<std::int64_t>(std::chrono::ceil<std::chrono::seconds>(remaining).count(), 1);
+   return std::format(sz_querySettingsFormat, limits.timeoutS, limits.maxSizeMiB * 1024 * 1024);
 }
 
-OsmIds ExtractRelationIds(const std::string& json)
+GeoProtoTaggedFeatures ExtractCityDetails(const std::string& json)
 {
    if (json.empty())
       return {};
 
-   rapidjson::Document document;
-   document.Parse(json.c_str());
-   if (!document.IsObject())
+   ScopedLatency latency(getParseDuration());
+   ScopedSpan span("overpass.parse");
+   GeoProtoTaggedFeatures features;
+   rapidjson::StringStream stream(json.c_str());
+   parseElements(stream,
+      [&features](const Element& element)
+      {
+         addTaggedFeature(element, features);
+      });
+   return features;
+}
+
+std::unordered_map<OsmId, GeoProtoTaggedFeatures> ExtractCityDetailsByRelation(
+   const std::string& json, GeoProtoArena* arena)
+{
+   if (json.empty())
       return {};
 
+   ScopedLatency latency(getParseDuration());
+   ScopedSpan span("overpass.parse");
+   rapidjson::StringStream stream(json.c_str());
+   return extractCityDetailsByRelation(stream, arena);
+}
+
+OsmIds ExtractRelationIds(const std::string& json)
+{
    OsmIds result;
-   for (const auto& e : document["elements"].GetArray())
-   {
-      const auto& id = json::Get(e, "id");
-      if (!id.IsNull() && json::GetString(json::Get(e, "type")) == "relation")
-         result.emplace_back(json::GetInt64(id));
-   }
+   ExtractRelationIds(json, result);
    return result;
 }
 
+bool IsCompleteResponse(const std::string& json)
+{
+   rapidjson::StringStream stream(json.c_str());
+   return parseElements(stream, [](const Element&) {});
+}
+
+bool ExtractRegionFeatures(const std::string& json, RegionFeatures& features)
+{
+   if (json.empty())
+      return false;
+
+   ScopedLatency latency(getParseDuration());
+   ScopedSpan span("overpass.parse");
+   rapidjson::StringStream stream(json.c_str());
+   // Feature nodes come first, then every region followed by the nodes which it contains
+   std::unordered_map<OsmId, std::size_t> indexes;  // Positions of the features in `features` by their node IDs
+   std::optional<OsmId> regionId;                   // Region whose nodes are being read
+   return parseElements(stream,
+      [&features, &indexes, &regionId](const Element& element)
+      {
+         if (element.type == "relation" && element.hasId)
+         {
+            regionId = element.id;
+         }
+         else if (element.type == "node" && !regionId)
+         {
+            if (element.hasId)
+               indexes.emplace(element.id, features.size());
+            features.push_back({element.lat, element.lon, element.ele, {}});
+         }
+         else if (element.type == "node" && element.hasId)
+         {
+            const auto it = indexes.find(element.id);
+            if (it != indexes.end())
+               features[it->second].regionIds.push_back(*regionId);
+         }
+      });
+}
+
+bool ExtractRelationIds(const std::string& json, OsmIds& ids)
+{
+   if (json.empty())
+      return false;
+
+   ScopedLatency latency(getParseDuration());
+   ScopedSpan span("overpass.parse");
+   rapidjson::StringStream stream(json.c_str());
+   return parseElements(stream,
+      [&ids](const Element& element)
+      {
+         if (element.hasId && element.type == "relation")
+            ids.emplace_back(element.id);
+      });
+}
+
 OsmIds LoadRelationIdsByName(WebClient& client, const std::string& name)
 {
-   const std::string request = std::format(sz_requestByNameFormat, name);
-   const std::string response = client.Post(request);
-   return ExtractRelationIds(response);
+   ScopedSpan span("overpass.relation_ids");
+   const std::string request = std::format(sz_requestByNameFormat, name, FormatQuerySettings());
+   std::string response = client.Post(request);
+   auto ids = ExtractRelationIds(response);
+   BufferPool::GetDefault().Release(std::move(response));
+   return ids;
 }
 
 OsmIds LoadRelationIdsByLocation(WebClient& client, double latitude, double longitude)
 {
-   const std::string request = std::format(sz_requestByCoordinatesFormat, latitude, longitude);
-   const std::string response = client.Post(request);
-   return ExtractRelationIds(response);
+   ScopedSpan span("overpass.relation_ids");
+   const std::string request =
+      std::format(sz_requestByCoordinatesFormat, latitude, longitude, FormatQuerySettings());
+   std::string response = client.Post(request);
+   auto ids = ExtractRelationIds(response);
+   BufferPool::GetDefault().Release(std::move(response));
+   return ids;
 }
 
-GeoProtoTaggedFeatures LoadCityDetailsByRelationId(WebClient& client, OsmId relationId)
-{
-   const std::string request = std::format(
-      R"(
-      [out:json];
-      rel(id: {});
-      map_to_area->.cityArea;
-      (
-      node[tourism=hotel](area.cityArea);
-      node[tourism=museum](area.cityArea);
-      );
-      out center;)",
-      relationId);
-
-   const std::string response = client.Post(request);
-   return ExtractCityDetails(response);
+std::unordered_map<OsmId, GeoProtoTaggedFeatures> LoadCityDetailsByRelationIds(
+   WebClient& client, const OsmIds& relationIds, GeoProtoArena* arena)
+{
+   if (relationIds.empty())
+      return {};
+
+   ScopedSpan span("overpass.city_details");
+   std::string ids;
+   for (const auto id : relationIds)
+      ids += (ids.empty() ? "" : ",") + std::to_string(id);
+
+   // The response may be large, so it is parsed while it is being received.
+   const auto stream = client.PostStream(std::format(sz_requestCityDetailsFormat, ids, FormatQuerySettings()));
+   auto details = extractCityDetailsByRelation(*stream, arena);
+   if (!stream->Wait())
+      return {};
+   return details;
 }
 
 }  // namespace geo::overpass
@@ -4,6 +4,7 @@
 
 #include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace geo
@@ -17,16 +18,59 @@ namespace geo::overpass
 using OsmId = std::int64_t;         // Type alias for OpenStreetMap (OSM) IDs.
 using OsmIds = std::vector<OsmId>;  // Type alias for a list of OSM IDs.
 
+// A feature found by a region search (e.g. a peak) and the regions which contain it.
+struct RegionFeature
+{
+   double latitude = 0;   // Latitude of the feature node.
+   double longitude = 0;  // Longitude of the feature node.
+   double elevation = 0;  // Value of "ele" tag in meters, 0 if the node has none.
+   OsmIds regionIds;      // OSM IDs of the relations of the regions which contain the feature.
+};
+using RegionFeatures = std::vector<RegionFeature>;  // Type alias for a list of region features.
+
+// Formats the settings which start every query: JSON output, and the time and memory limits of the query.
+// The limits follow the deadline of the current RPC (see RpcContext), so Overpass API gives up on a query nobody
+// waits for, and schedules a small query sooner. They are rounded to a few steps, which keeps cached responses usable.
+// @return: Settings statement, e.g. "[out:json][timeout:25][maxsize:268435456];".
+std::string FormatQuerySettings();
+
 // Extracts all IDs of entities with type "relation" from a JSON response.
 // @param json: The JSON response from the Overpass API.
 // @return: A list of OSM IDs for the relations found.
 OsmIds ExtractRelationIds(const std::string& json);
 
+// Extracts all IDs of entities with type "relation" from a JSON response and checks that the response is complete.
+// Overpass API reports runtime errors (e.g. timeouts) in the "remark" field of an otherwise valid response.
+// @param json: The JSON response from the Overpass API.
+// @param ids: Receives OSM IDs for the relations found.
+// @return: false if the response is not valid JSON or the query has not been completed.
+bool ExtractRelationIds(const std::string& json, OsmIds& ids);
+
+// Checks that a response is valid JSON of a completed query, i.e. it may be cached.
+// @param json: The JSON response from the Overpass API.
+// @return: false if the response is not valid JSON (e.g. it is truncated) or the query has not been completed.
+bool IsCompleteResponse(const std::string& json);
+
+// Extracts features and the regions which contain them from a JSON response, in which the feature nodes are followed
+// by the relations of their regions, every relation followed by the IDs of the nodes which it contains.
+// @param json: The JSON response from the Overpass API.
+// @param features: Receives the features.
+// @return: false if the response is not valid JSON or the query has not been completed.
+bool ExtractRegionFeatures(const std::string& json, RegionFeatures& features);
+
 // Extracts hotels and museums from Overpass API JSON response.
 // @param json: The JSON response from the Overpass API.
-// @return: Vector of TaggedFeature objects.
+// @return: TaggedFeature objects.
 geo::GeoProtoTaggedFeatures ExtractCityDetails(const std::string& json);
 
+// Extracts hotels and museums of several cities from Overpass API JSON response.
+// Features of every city must follow the element of its relation, see LoadCityDetailsByRelationIds.
+// @param json: The JSON response from the Overpass API.
+// @param arena: Arena to allocate the features on, may be nullptr.
+// @return: TaggedFeature objects by OSM ID of the city relation.
+std::unordered_map<OsmId, geo::GeoProtoTaggedFeatures> ExtractCityDetailsByRelation(
+   const std::string& json, geo::GeoProtoArena* arena = nullptr);
+
 // Finds relation IDs by name using the Overpass API.
 // @param client: WebClient instance to interact with the Overpass API.
 // @param name: The name to search for.
@@ -40,10 +84,12 @@ OsmIds LoadRelationIdsByName(WebClient& client, const std::string& name);
 // @return: A list of OSM IDs for the relations found.
 OsmIds LoadRelationIdsByLocation(WebClient& client, double latitude, double longitude);
 
-// Loads hotels and museums features for a city relation using Overpass API
+// Loads hotels and museums features for several city relations using a single Overpass API query
 // @param client: WebClient instance to interact with the Overpass API.
-// @param relationId: OSM relation ID of the city.
-// @return: Vector of TaggedFeature objects.
-geo::GeoProtoTaggedFeatures LoadCityDetailsByRelationId(WebClient& client, OsmId relationId);
+// @param relationIds: OSM relation IDs of the cities.
+// @param arena: Arena to allocate the features on (e.g. the arena of the response), may be nullptr.
+// @return: TaggedFeature objects by OSM ID of the city relation.
+std::unordered_map<OsmId, geo::GeoProtoTaggedFeatures> LoadCityDetailsByRelationIds(
+   WebClient& client, const OsmIds& relationIds, geo::GeoProtoArena* arena = nullptr);
 
 }  // namespace geo::overpass
@@ -0,0 +1,187 @@
+#include "RegionTileCache.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <iterator>
+#include <tuple>
+
+namespace
+{
+
+// Number of tiles from -90 to 90 degrees of latitude
+std::int32_t getNumRows(double tileSizeDegrees)
+{
+   return static_cast<std::int32_t>(std::ceil(180 / tileSizeDegrees));
+}
+
+// Number of tiles from -180 to 180 degrees of longitude
+std::int32_t getNumColumns(double tileSizeDegrees)
+{
+   return static_cast<std::int32_t>(std::ceil(360 / tileSizeDegrees));
+}
+
+// Returns range of tile indices [first, last] which intersect the segment [min, max]
+// @param min Start of the segment, relative to the start of the grid
+// @param max End of the segment, relative to the start of the grid
+// @param tileSize Side of a tile
+// @param numTiles Number of tiles in the grid along the axis
+std::pair<std::int32_t, std::int32_t> getTileRange(double min, double max, double tileSize, std::int32_t numTiles)
+{
+   const auto first = static_cast<std::int32_t>(std::floor(min / tileSize));
+   // A segment which ends exactly at a tile border does not need the next tile
+   const auto last = std::max(first, static_cast<std::int32_t>(std::ceil(max / tileSize)) - 1);
+   return {std::clamp(first, 0, numTiles - 1), std::clamp(last, 0, numTiles - 1)};
+}
+
+}  // namespace
+
+namespace geo
+{
+
+double RegionTileCache::Statistics::GetHitRatio() const
+{
+   const auto numLookups = numHits + numMisses;
+   return numLookups == 0 ? 0 : static_cast<double>(numHits) / numLookups;
+}
+
+std::size_t RegionTileCache::KeyHash::operator()(const Key& key) const
+{
+   std::size_t hash = std::hash<std::int32_t>{}(key.row);
+   hash = hash * 31 + std::hash<std::int32_t>{}(key.column);
+   hash = hash * 31 + std::hash<std::uint32_t>{}(key.objects);
+   return hash * 31 + std::hash<std::int32_t>{}(key.minPeakHeight);
+}
+
+RegionTileCache::RegionTileCache(const Settings& settings)
+   : m_settings(settings)
+{
+}
+
+std::vector<RegionTileCache::Key> RegionTileCache::GetTiles(
+   const BoundingBox& bbox, std::uint32_t objects, std::int32_t minPeakHeight) const
+{
+   const double size = m_settings.tileSizeDegrees;
+   const auto [firstRow, lastRow] = getTileRange(bbox[0] + 90, bbox[2] + 90, size, getNumRows(size));
+   const auto [firstColumn, lastColumn] = getTileRange(bbox[1] + 180, bbox[3] + 180, size, getNumColumns(size));
+
+   std::vector<Key> tiles;
+   for (auto row = firstRow; row <= lastRow; ++row)
+      for (auto column = firstColumn; column <= lastColumn; ++column)
+         tiles.push_back({row, column, objects, minPeakHeight});
+   return tiles;
+}
+
+BoundingBox RegionTileCache::GetTileBox(const Key& key) const
+{
+   const double size = m_settings.tileSizeDegrees;
+   return {key.row * size - 90, key.column * size - 180, std::min(90., (key.row + 1) * size - 90),
+      std::min(180., (key.column + 1) * size - 180)};
+}
+
+std::vector<std::vector<RegionTileCache::Key>> RegionTileCache::GroupTiles(std::vector<Key> tiles)
+{
+   std::sort(tiles.begin(), tiles.end(),
+      [](const Key& a, const Key& b)
+      {
+         return std::tie(a.row, a.column) < std::tie(b.row, b.column);
+      });
+
+   // A rectangle which grows by runs of the same columns in the following rows
+   struct Rectangle
+   {
+      std::int32_t lastRow = 0;      // The last row of the rectangle
+      std::int32_t firstColumn = 0;  // The first column of the rectangle
+      std::int32_t lastColumn = 0;   // The last column of the rectangle
+      std::size_t group = 0;         // Index of the group of its tiles
+   };
+
+   std::vector<Rectangle> rectangles;
+   std::vector<std::vector<Key>> groups;
+   for (std::size_t begin = 0; begin < tiles.size();)
+   {
+      // A run of adjacent tiles in a row
+      std::size_t end = begin + 1;
+      while (end < tiles.size() && tiles[end].row == tiles[begin].row &&
+             tiles[end].column == tiles[end - 1].column + 1)
+         ++end;
+
+      const auto row = tiles[begin].row;
+      const auto firstColumn = tiles[begin].column;
+      const auto lastColumn = tiles[end - 1].column;
+      auto it = std::find_if(rectangles.begin(), rectangles.end(),
+         [&](const Rectangle& rectangle)
+         {
+            return rectangle.lastRow == row - 1 && rectangle.firstColumn == firstColumn &&
+                   rectangle.lastColumn == lastColumn;
+         });
+      if (it == rectangles.end())
+      {
+         rectangles.push_back({row, firstColumn, lastColumn, groups.size()});
+         groups.emplace_back();
+         it = std::prev(rectangles.end());
+      }
+
+      it->lastRow = row;
+      auto& group = groups[it->group];
+      group.insert(group.end(), tiles.begin() + begin, tiles.begin() + end);
+      begin = end;
+   }
+   return groups;
+}
+
+bool RegionTileCache::Find(const Key& key, Features& features)
+{
+   std::lock_guard lock(m_mutex);
+
+   const auto it = m_index.find(key);
+   if (it == m_index.end())
+   {
+      ++m_numMisses;
+      return false;
+   }
+
+   if (it->second->expiration <= Clock::now())
+   {
+      m_entries.erase(it->second);
+      m_index.erase(it);
+      ++m_numMisses;
+      return false;
+   }
+
+   m_entries.splice(m_entries.begin(), m_entries, it->second);
+   features = it->second->features;
+   ++m_numHits;
+   return true;
+}
+
+void RegionTileCache::Put(const Key& key, Features features)
+{
+   if (m_settings.maxTiles == 0 || m_settings.ttl.count() <= 0)
+      return;
+
+   std::lock_guard lock(m_mutex);
+
+   if (const auto it = m_index.find(key); it != m_index.end())
+   {
+      m_entries.erase(it->second);
+      m_index.erase(it);
+   }
+
+   m_entries.push_front({key, std::move(features), Clock::now() + m_settings.ttl});
+   m_index.emplace(key, m_entries.begin());
+
+   while (m_entries.size() > m_settings.maxTiles)
+   {
+      m_index.erase(m_entries.back().key);
+      m_entries.pop_back();
+   }
+}
+
+RegionTileCache::Statistics RegionTileCache::GetStatistics() const
+{
+   std::lock_guard lock(m_mutex);
+   return {m_numHits, m_numMisses, m_entries.size()};
+}
+
+}  // namespace geo
@@ -0,0 +1,121 @@
+#pragma once
+
+#include "../utils/GeoUtils.h"
+#include "OverpassApiUtils.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace geo
+{
+
+// Thread-safe LRU cache of Overpass region searches.
+// Bounding boxes are snapped to a fixed global grid of square tiles, so searches around close points share tiles.
+// Every tile stores the features of one kind found in it (e.g. peaks higher than a quantized height) together with
+// the regions which contain them. A search combines the features of its tiles and filters them by its exact box and
+// preferences, so it finds the same regions as a query for the box would.
+class RegionTileCache
+{
+public:
+   using Features = std::shared_ptr<const overpass::RegionFeatures>;  // Features of a tile, shared by the searches
+
+   // Cache settings
+   struct Settings
+   {
+      double tileSizeDegrees = 1;   // Side of a grid tile in degrees
+      std::size_t maxTiles = 0;     // Maximum number of cached tiles
+      std::chrono::seconds ttl{0};  // Lifetime of cached tiles
+   };
+
+   // Identifies a tile of the grid together with the search preferences
+   struct Key
+   {
+      std::int32_t row = 0;             // Index of the tile from the South pole
+      std::int32_t column = 0;          // Index of the tile from the antimeridian
+      std::uint32_t objects = 0;        // Kind of features, a single bit of the mask of geographical features
+      std::int32_t minPeakHeight = -1;  // Minimum height of peaks (already quantized), -1 if not set
+
+      bool operator==(const Key&) const = default;
+   };
+
+   // Counters describing cache efficiency
+   struct Statistics
+   {
+      std::uint64_t numHits = 0;    // Number of tiles found in the cache
+      std::uint64_t numMisses = 0;  // Number of tiles which must be requested from Overpass
+      std::size_t numTiles = 0;     // Number of cached tiles
+
+      // Returns share of tiles answered from the cache
+      double GetHitRatio() const;
+   };
+
+public:
+   // Constructor
+   // @param settings Tile size, cache size and lifetime of tiles
+   explicit RegionTileCache(const Settings& settings);
+
+   RegionTileCache(const RegionTileCache&) = delete;
+   RegionTileCache& operator=(const RegionTileCache&) = delete;
+
+   // Returns keys of all the grid tiles which intersect given bounding box
+   // @param bbox Bounding box to cover
+   // @param objects Kind of features, a single bit of the mask of geographical features
+   // @param minPeakHeight Quantized minimum height of peaks, -1 if not set
+   std::vector<Key> GetTiles(const BoundingBox& bbox, std::uint32_t objects, std::int32_t minPeakHeight) const;
+
+   // Returns bounding box of a grid tile
+   BoundingBox GetTileBox(const Key& key) const;
+
+   // Groups tiles of the same search into rectangles of adjacent tiles, so they are requested by a few queries
+   // @param tiles Tiles with equal search preferences, e.g. the missing ones of GetTiles()
+   // @return Groups of tiles ordered by rows and columns, every group covers a rectangle of the grid
+   static std::vector<std::vector<Key>> GroupTiles(std::vector<Key> tiles);
+
+   // Finds a cached tile
+   // @param key Tile and search preferences
+   // @param features Receives the features found in the tile
+   // @return true if the tile is found and not expired
+   bool Find(const Key& key, Features& features);
+
+   // Stores the features found in a tile
+   // @param key Tile and search preferences
+   // @param features Features inside the tile, including its borders
+   void Put(const Key& key, Features features);
+
+   // Returns counters collected since construction
+   Statistics GetStatistics() const;
+
+private:
+   using Clock = std::chrono::steady_clock;
+
+   struct KeyHash
+   {
+      std::size_t operator()(const Key& key) const;
+   };
+
+   struct Entry
+   {
+      Key key;                       // Tile and search preferences
+      Features features;             // Features found in the tile
+      Clock::time_point expiration;  // Time when the entry becomes stale
+   };
+
+   using Entries = std::list<Entry>;  // Most recently used entries first
+
+private:
+   const Settings m_settings;  // Cache settings
+
+   mutable std::mutex m_mutex;                                   // Protects all the fields below
+   Entries m_entries;                                            // Entries in LRU order
+   std::unordered_map<Key, Entries::iterator, KeyHash> m_index;  // Entries by key
+   std::uint64_t m_numHits = 0;                                  // See Statistics::numHits
+   std::uint64_t m_numMisses = 0;                                // See Statistics::numMisses
+};
+
+}  // namespace geo
@@ -0,0 +1,124 @@
+#include "RelationCache.h"
+
+#include <functional>
+
+namespace
+{
+
+// Approximate memory used by the list node and the hash table node of an entry, besides the entry itself
+const std::size_t sc_entryOverheadBytes = 64;
+
+}  // namespace
+
+namespace geo::nominatim
+{
+
+double RelationCache::Statistics::GetHitRatio() const
+{
+   const auto numLookups = numHits + numNegativeHits + numMisses;
+   return numLookups == 0 ? 0 : static_cast<double>(numHits + numNegativeHits) / numLookups;
+}
+
+RelationCache::RelationCache(const Settings& settings)
+   : m_settings(settings)
+{
+}
+
+bool RelationCache::Find(OsmId osmId, std::optional<RelationInfo>& info)
+{
+   Shard& shard = getShard(osmId);
+   std::lock_guard lock(shard.mutex);
+
+   const auto it = shard.index.find(osmId);
+   if (it == shard.index.end())
+   {
+      ++shard.numMisses;
+      return false;
+   }
+
+   if (it->second->expiration <= Clock::now())
+   {
+      erase(shard, it->second);
+      ++shard.numMisses;
+      return false;
+   }
+
+   shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+   info = it->second->info;
+   ++(info ? shard.numHits : shard.numNegativeHits);
+   return true;
+}
+
+void RelationCache::Put(const RelationInfo& info)
+{
+   put(info.osmId, info, m_settings.ttl);
+}
+
+void RelationCache::PutMissing(OsmId osmId)
+{
+   put(osmId, std::nullopt, m_settings.negativeTtl);
+}
+
+RelationCache::Statistics RelationCache::GetStatistics() const
+{
+   Statistics statistics;
+   for (const auto& shard : m_shards)
+   {
+      std::lock_guard lock(shard.mutex);
+      statistics.numHits += shard.numHits;
+      statistics.numNegativeHits += shard.numNegativeHits;
+      statistics.numMisses += shard.numMisses;
+      statistics.numEvictions += shard.numEvictions;
+      statistics.numEntries += shard.index.size();
+      statistics.memoryBytes += shard.memoryBytes;
+   }
+   return statistics;
+}
+
+RelationCache::Shard& RelationCache::getShard(OsmId osmId)
+{
+   return m_shards[std::hash<OsmId>{}(osmId) % sc_numShards];
+}
+
+void RelationCache::put(OsmId osmId, std::optional<RelationInfo> info, std::chrono::seconds ttl)
+{
+   if (ttl.count() <= 0)
+      return;
+
+   Entry entry;
+   entry.osmId = osmId;
+   entry.memoryBytes = sizeof(Entry) + sc_entryOverheadBytes;
+   if (info)
+      entry.memoryBytes += info->name.capacity() + info->country.capacity() + info->addressType.capacity();
+   entry.info = std::move(info);
+   entry.expiration = Clock::now() + ttl;
+
+   const std::size_t maxShardMemoryBytes = m_settings.maxMemoryBytes / sc_numShards;
+   if (entry.memoryBytes > maxShardMemoryBytes)
+      return;
+
+   Shard& shard = getShard(osmId);
+   std::lock_guard lock(shard.mutex);
+
+   if (const auto it = shard.index.find(osmId); it != shard.index.end())
+      erase(shard, it->second);
+
+   shard.memoryBytes += entry.memoryBytes;
+   shard.entries.emplace_front(std::move(entry));
+   shard.index.emplace(osmId, shard.entries.begin());
+
+   while (shard.memoryBytes > maxShardMemoryBytes)
+   {
+      erase(shard, std::prev(shard.entries.end()));
+      ++shard.numEvictions;
+   }
+}
+
+void RelationCache::erase(Shard& shard, Entries::iterator it)
+{
+   shard.memoryBytes -= it->memoryBytes;
+   shard.index.erase(it->osmId);
+   shard.entries.erase(it);
+}
+
+}  // namespace geo::nominatim
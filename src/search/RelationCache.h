@@ -0,0 +1,112 @@
+#pragma once
+
+#include "NominatimApiUtils.h"
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace geo::nominatim
+{
+
+// Thread-safe in-memory LRU cache of Nominatim lookup results keyed by OSM relation id.
+// Ids which Nominatim did not return are cached too (negative entries), so they are not requested again.
+// The cache is split into shards with own locks and LRU lists, so concurrent searches rarely contend.
+class RelationCache
+{
+public:
+   // Cache settings
+   struct Settings
+   {
+      std::size_t maxMemoryBytes = 0;       // Approximate memory limit of all the entries
+      std::chrono::seconds ttl{0};          // Lifetime of found relations
+      std::chrono::seconds negativeTtl{0};  // Lifetime of negative entries
+   };
+
+   // Counters describing cache efficiency
+   struct Statistics
+   {
+      std::uint64_t numHits = 0;          // Number of lookups which found a relation
+      std::uint64_t numNegativeHits = 0;  // Number of lookups which found a negative entry
+      std::uint64_t numMisses = 0;        // Number of lookups which must be sent to Nominatim
+      std::uint64_t numEvictions = 0;     // Number of entries removed because of the memory limit
+      std::size_t numEntries = 0;         // Number of cached entries
+      std::size_t memoryBytes = 0;        // Approximate memory used by the entries
+
+      // Returns share of lookups answered from the cache
+      double GetHitRatio() const;
+   };
+
+public:
+   // Constructor
+   // @param settings Memory limit and lifetime of entries
+   explicit RelationCache(const Settings& settings);
+
+   RelationCache(const RelationCache&) = delete;
+   RelationCache& operator=(const RelationCache&) = delete;
+
+   // Finds a cached entry
+   // @param osmId OSM ID of the relation
+   // @param info Receives cached relation, or is reset if the relation is known to be missing
+   // @return true if the entry is found and not expired
+   bool Find(OsmId osmId, std::optional<RelationInfo>& info);
+
+   // Stores a relation returned by Nominatim
+   // @param info Relation information
+   void Put(const RelationInfo& info);
+
+   // Stores a negative entry for the relation which Nominatim did not return
+   // @param osmId OSM ID of the relation
+   void PutMissing(OsmId osmId);
+
+   // Returns counters collected since construction
+   Statistics GetStatistics() const;
+
+private:
+   static const std::size_t sc_numShards = 16;  // Number of independently locked parts of the cache
+
+   using Clock = std::chrono::steady_clock;
+
+   struct Entry
+   {
+      OsmId osmId = 0;                   // OSM ID of the relation
+      std::optional<RelationInfo> info;  // Relation information, empty for negative entries
+      Clock::time_point expiration;      // Time when the entry becomes stale
+      std::size_t memoryBytes = 0;       // Approximate memory used by the entry
+   };
+
+   using Entries = std::list<Entry>;  // Most recently used entries first
+
+   struct Shard
+   {
+      mutable std::mutex mutex;                            // Protects all the fields below
+      Entries entries;                                     // Entries in LRU order
+      std::unordered_map<OsmId, Entries::iterator> index;  // Entries by OSM ID
+      std::size_t memoryBytes = 0;                         // Approximate memory used by the entries
+      std::uint64_t numHits = 0;                           // See Statistics::numHits
+      std::uint64_t numNegativeHits = 0;                   // See Statistics::numNegativeHits
+      std::uint64_t numMisses = 0;                         // See Statistics::numMisses
+      std::uint64_t numEvictions = 0;                      // See Statistics::numEvictions
+   };
+
+private:
+   // Returns shard which stores given relation
+   Shard& getShard(OsmId osmId);
+
+   // Inserts or replaces an entry and evicts least recently used entries above the memory limit
+   void put(OsmId osmId, std::optional<RelationInfo> info, std::chrono::seconds ttl);
+
+   // Removes an entry from the shard, the shard must be locked
+   static void erase(Shard& shard, Entries::iterator it);
+
+private:
+   const Settings m_settings;                 // Cache settings
+   std::array<Shard, sc_numShards> m_shards;  // Parts of the cache
+};
+
+}  // namespace geo::nominatim
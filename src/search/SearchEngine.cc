@@ -1,17 +1,33 @@
 #include "SearchEngine.h"
 
+#include "../utils/BufferPool.h"
+#include "../utils/ConcurrencyUtils.h"
 #include "../utils/GeoUtils.h"
+#include "../utils/Tracing.h"
 #include "../utils/WebClient.h"
 #include "NominatimApiUtils.h"
+#include "OpenMeteoApiUtils.h"
 #include "OverpassApiUtils.h"
 #include "ProtoTypes.h"
+#include "RegionTileCache.h"
 #include "SearchEngineItf.h"
 
 #include <absl/log/log.h>
 #include <rapidjson/document.h>
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <format>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 namespace
 {
@@ -20,7 +36,6 @@ using namespace geo;
 
 // See documentation at https://wiki.openstreetmap.org/wiki/Overpass_API/Overpass_QL
 
-constexpr const char* sz_requestHeader = "[out:json][timeout:180];";
 constexpr const char* sz_requestFooter = ";out tags;";
 
 constexpr const char* sz_requestRelationsByNodes =
@@ -55,49 +70,63 @@ constexpr const char* sz_nodeSaltLakesDef = "wr[natural=water][water=lake][salt=
 // name, but not such as big as a whole country.
 constexpr const char* sz_regionsTags = "[boundary=administrative][admin_level=4]";
 
+// Overpass API query format which outputs the feature nodes, then every region which contains some of them followed by
+// the IDs of those nodes. Areas of all the nodes are found by a single is_in, and only the few regions are iterated,
+// as is_in per node makes Overpass API look up the areas for every node separately.
+// {0} - statement producing the nodes, {1} - output mode of the nodes, {2} - tags of the regions.
+constexpr const char* sz_requestFeatureRegions = "{0} -> .features;"
+                                                 ".features out {1};"
+                                                 ".features is_in -> .areas;"   // Areas which contain any node.
+                                                 "area.areas{2} -> .regions;"   // Only the areas of the regions.
+                                                 "foreach.regions -> .region("
+                                                 "rel(pivot.region);"           // Relation of the region outline.
+                                                 "out ids;"
+                                                 "node.features(area.region);"  // Nodes which the region contains.
+                                                 "out ids;"
+                                                 ");";
+
+// Kinds of features which cached region searches request and cache separately
+constexpr std::uint32_t sc_regionFeatureKinds[] = {
+   geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_INTERNATIONAL_AIRPORTS,
+   geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_PEAKS,
+   geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_SEA_BEACHES,
+   geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_SALT_LAKES};
+
+// Granularity of minimum peak height in cached region searches, in meters
+const std::int32_t sc_peakHeightBucketMeters = 100;
+
 // Converts Nominatim relation info to a GeoProtoPlace object
-GeoProtoPlace toGeoProtoPlace(const nominatim::RelationInfo& info)
+// @param info Relation info
+// @param location Receives the place
+void toGeoProtoPlace(const nominatim::RelationInfo& info, GeoProtoPlace& location)
 {
-   GeoProtoPlace location;
    location.set_name(info.name);
    location.set_country(info.country);
    location.mutable_center()->set_latitude(info.latitude);
    location.mutable_center()->set_longitude(info.longitude);
-   return location;
 }
 
 // Finds cities using Overpass and Nominatim APIs based on relation IDs
-GeoProtoPlaces findCities(const overpass::OsmIds& relationIds, nominatim::Match match, WebClient& nominatimApiClient,
-   WebClient& overpassApiClient, bool includeDetails)
+// @param cities Receives the found cities, on the arena of the field if it has one
+void findCities(const overpass::OsmIds& relationIds, nominatim::Match match, WebClient& nominatimApiClient,
+   const nominatim::LookupOptions& lookupOptions, WebClient& overpassApiClient, bool includeDetails,
+   GeoProtoPlaces& cities)
 {
    if (relationIds.empty())
-      return {};
+      return;
 
    // Use Nominatim API to load some detailed information for all the found "relation" entities.
    // However, `infos` contains information only for those entities which are considered "cities".
    // There is no way to select cities from all the entities in advance.
-   const auto infos = nominatim::LookupRelationInformationForCities(relationIds, match, nominatimApiClient);
+   const auto infos =
+      nominatim::LookupRelationInformationForCities(relationIds, match, nominatimApiClient, lookupOptions);
    if (infos.empty())
       LOG(ERROR) << std::format("Cannot find cities in Nominatim (checked {} relation ids)", relationIds.size());
    else
       LOG(INFO) << std::format(
          "Found {} cities in Nominatim (checked {} relation ids)", infos.size(), relationIds.size());
 
-   GeoProtoPlaces result;
-   for (const auto& i : infos)
-   {
-      GeoProtoPlace city = toGeoProtoPlace(i);
-      if (includeDetails)
-      {
-         const auto features = overpass::LoadCityDetailsByRelationId(overpassApiClient, i.osmId);
-         for (const auto& feature : features)
-         {
-            *city.add_features() = feature;
-         }
-      }
-      result.emplace_back(std::move(city));
-   }
-   return result;
+   AppendCities(infos, overpassApiClient, includeDetails, cities);
 }
 
 // Formats an Overpass API request string based on region preferences and bounding box
@@ -111,7 +140,9 @@ std::string formatRegionsRequest(const ISearchEngine::RegionPreferences& prefs,
    const std::string boundingBoxStr =
       std::format("{}, {}, {}, {}", boundingBox[0], boundingBox[1], boundingBox[2], boundingBox[3]);
 
-   std::string request = sz_requestHeader;
+   // The settings follow the deadline of the RPC, see overpass::FormatQuerySettings
+   const std::string header = overpass::FormatQuerySettings();
+   std::string request = header;
    if (prefs.objects & geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_INTERNATIONAL_AIRPORTS)
    {
       const auto nodes = std::format(sz_nodeAirportsDef, boundingBoxStr);
@@ -141,7 +172,7 @@ std::string formatRegionsRequest(const ISearchEngine::RegionPreferences& prefs,
       request += std::format(sz_requestRelationsByNodes, nodes, ".nodesL", ".areasL", sz_regionsTags, sz_relSaltLakes);
    }
 
-   if (request == sz_requestHeader)
+   if (request == header)
       return {};
 
    // The result set is an intersection of multiple named sets.
@@ -159,6 +190,57 @@ std::string formatRegionsRequest(const ISearchEngine::RegionPreferences& prefs,
    return request;
 }
 
+// Returns minimum peak height preference in meters, or std::nullopt if it is not set
+std::optional<std::int32_t> getMinPeakHeight(const ISearchEngine::RegionPreferences& prefs)
+{
+   const auto itLength = prefs.properties.find("minPeakHeight");
+   if (itLength == prefs.properties.end())
+      return std::nullopt;
+   return std::atoi(itLength->second.c_str());
+}
+
+// Rounds minimum peak height down to sc_peakHeightBucketMeters, so a cached tile serves all the heights of a bucket
+std::int32_t quantizePeakHeight(std::int32_t heightMeters)
+{
+   const double bucket = std::floor(static_cast<double>(heightMeters) / sc_peakHeightBucketMeters);
+   return static_cast<std::int32_t>(bucket) * sc_peakHeightBucketMeters;
+}
+
+// Formats an Overpass API request for the nodes of one kind of features in a bounding box and the relations of
+// the regions which contain them
+// @param object Kind of features, a single bit of the mask of geographical features
+// @param minPeakHeight Peaks must be higher than this, in meters
+// @param boundingBox Box to search in
+// @return Request string, empty if the kind is unknown
+std::string formatFeatureRegionsRequest(
+   std::uint32_t object, std::int32_t minPeakHeight, const BoundingBox& boundingBox)
+{
+   const std::string boundingBoxStr =
+      std::format("{}, {}, {}, {}", boundingBox[0], boundingBox[1], boundingBox[2], boundingBox[3]);
+
+   std::string nodes;
+   const char* outputMode = "skel";  // Only the position, nodes of airports and lakes have no useful tags
+   switch (object)
+   {
+   case geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_INTERNATIONAL_AIRPORTS:
+      nodes = std::format(sz_nodeAirportsDef, boundingBoxStr);
+      break;
+   case geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_PEAKS:
+      nodes = std::format(sz_nodePeaksDef, boundingBoxStr, minPeakHeight);
+      outputMode = "body";  // Elevation is filtered by the exact height of a search
+      break;
+   case geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_SEA_BEACHES:
+      nodes = std::format(sz_nodeSeaBeachesDef, boundingBoxStr);
+      break;
+   case geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_SALT_LAKES:
+      nodes = std::format(sz_nodeSaltLakesDef, boundingBoxStr);
+      break;
+   default:
+      return {};
+   }
+   return overpass::FormatQuerySettings() + std::format(sz_requestFeatureRegions, nodes, outputMode, sz_regionsTags);
+}
+
 bool isValidBoundingBox(const BoundingBox& bbox)
 {
    static const auto sc_maxDimensionKm = 1000;  // A kind of safety check
@@ -172,48 +254,205 @@ bool isValidBoundingBox(const BoundingBox& bbox)
 namespace geo
 {
 
-SearchEngine::SearchEngine(WebClient& overpassApiClient, WebClient& nominatimApiClient)
+void AppendCities(
+   const nominatim::RelationInfos& infos, WebClient& overpassApiClient, bool includeDetails, GeoProtoPlaces& cities)
+{
+   // Details of all the cities are loaded by a single Overpass API query.
+   // Features are allocated on the same arena as the cities, so they are moved into the cities without copying.
+   std::unordered_map<overpass::OsmId, GeoProtoTaggedFeatures> details;
+   if (includeDetails && !infos.empty())
+   {
+      overpass::OsmIds cityIds;
+      for (const auto& i : infos)
+         cityIds.push_back(i.osmId);
+      details = overpass::LoadCityDetailsByRelationIds(overpassApiClient, cityIds, cities.GetArena());
+   }
+
+   cities.Reserve(cities.size() + static_cast<int>(infos.size()));
+   for (const auto& i : infos)
+   {
+      GeoProtoPlace& city = *cities.Add();
+      toGeoProtoPlace(i, city);
+      if (const auto it = details.find(i.osmId); it != details.end())
+         city.mutable_features()->Swap(&it->second);
+   }
+}
+
+std::string FormatRegionsRequest(const ISearchEngine::RegionPreferences& prefs, const BoundingBox& boundingBox)
+{
+   return formatRegionsRequest(prefs, boundingBox);
+}
+
+SearchEngine::SearchEngine(WebClient& overpassApiClient, WebClient& nominatimApiClient,
+   WebClient& openMeteoApiClient, const Settings& settings)
    : m_overpassApiClient(overpassApiClient)
    , m_nominatimApiClient(nominatimApiClient)
+   , m_openMeteoApiClient(openMeteoApiClient)
+   , m_settings(settings)
 {
 }
 
-GeoProtoPlaces SearchEngine::FindCitiesByName(const std::string& name, bool includeDetails)
+void SearchEngine::FindCitiesByName(const std::string& name, bool includeDetails, GeoProtoPlaces& cities)
 {
    // First, find ids of "relation" entities by name.
    const overpass::OsmIds relationIds = overpass::LoadRelationIdsByName(m_overpassApiClient, name);
-   return findCities(relationIds, nominatim::Match::Any, m_nominatimApiClient, m_overpassApiClient, includeDetails);
+   findCities(relationIds, nominatim::Match::Any, m_nominatimApiClient, getLookupOptions(), m_overpassApiClient,
+      includeDetails, cities);
 }
 
-GeoProtoPlaces SearchEngine::FindCitiesByPosition(double latitude, double longitude, bool includeDetails)
+void SearchEngine::FindCitiesByPosition(
+   double latitude, double longitude, bool includeDetails, GeoProtoPlaces& cities)
 {
    // First, find ids of "relation" entities by a coordinate of a point.
    const overpass::OsmIds relationIds = overpass::LoadRelationIdsByLocation(m_overpassApiClient, latitude, longitude);
-   return findCities(relationIds, nominatim::Match::Best, m_nominatimApiClient, m_overpassApiClient, includeDetails);
+   findCities(relationIds, nominatim::Match::Best, m_nominatimApiClient, getLookupOptions(), m_overpassApiClient,
+      includeDetails, cities);
 }
 
 ISearchEngine::IncrementalSearchHandler SearchEngine::StartFindRegions()
 {
-   const auto processed = std::make_shared<std::set<overpass::OsmId>>();
+   const auto processed = std::make_shared<ProcessedIds>();
    return IncrementalSearchHandler(
-      [this, processed](const BoundingBox& bbox, const RegionPreferences& prefs)
+      [this, processed](const BoundingBox& bbox, const RegionPreferences& prefs, GeoProtoPlaces& regions)
       {
-         GeoProtoPlaces result;
          const nominatim::RelationInfos iterationResult = findRegions(bbox, prefs, *processed);
+         regions.Reserve(regions.size() + static_cast<int>(iterationResult.size()));
          for (const auto& r : iterationResult)
-            result.emplace_back(toGeoProtoPlace(r));
-         return result;
+            toGeoProtoPlace(r, *regions.Add());
       });
 }
 
 WeatherInfoVector SearchEngine::GetWeather(double latitude, double longitude, const DateRange& dateRange)
 {
-   return {};
+   GeoProtoPoint location;
+   location.set_latitude(latitude);
+   location.set_longitude(longitude);
+   // Weather of a single location and arbitrary dates (which may not be published yet) is not snapped to the grid
+   // of the weather store, only the historical aggregation is
+   return std::move(loadWeather({location}, {dateRange}, nullptr).front());
+}
+
+GeoProtoWeathers SearchEngine::GetHistoricalWeather(
+   const GeoProtoPoints& locations, const DateRange& dateRange, std::uint32_t numYears)
+{
+   const auto ranges =
+      openmeteo::CollectHistoricalRanges(dateRange, std::chrono::system_clock::now(), std::max(1u, numYears));
+
+   // Result of a (location, year) pair is stored at index (location index * number of ranges + range index).
+   const std::vector<WeatherInfoVector> loaded = loadWeather(locations, ranges, m_settings.weatherStore);
+
+   // Fold all the years of a location into single set of values.
+   GeoProtoWeathers result;
+   for (std::size_t i = 0; i < locations.size(); ++i)
+   {
+      double minTemperature = std::numeric_limits<double>::max();
+      double maxTemperature = std::numeric_limits<double>::lowest();
+      double sumTemperature = 0;
+      std::size_t numValues = 0;
+      for (std::size_t r = 0; r < ranges.size(); ++r)
+      {
+         for (const auto& info : loaded[i * ranges.size() + r])
+         {
+            minTemperature = std::min(minTemperature, info.temperatureMin);
+            maxTemperature = std::max(maxTemperature, info.temperatureMax);
+            sumTemperature += info.temperatureAverage;
+            ++numValues;
+         }
+      }
+
+      GeoProtoWeather& weather = result.emplace_back();
+      if (numValues == 0)
+      {
+         LOG(ERROR) << std::format("Cannot load historical weather for ({},{})", locations[i].latitude(),
+            locations[i].longitude());
+         continue;
+      }
+      weather.set_min_temperature(minTemperature);
+      weather.set_max_temperature(maxTemperature);
+      weather.set_average_temperature(sumTemperature / numValues);
+   }
+   return result;
+}
+
+std::vector<WeatherInfoVector> SearchEngine::loadWeather(
+   const GeoProtoPoints& locations, const std::vector<DateRange>& ranges, WeatherStore* store)
+{
+   ScopedSpan traceSpan("openmeteo.weather");
+
+   // Span of days of a pair which has to be requested
+   struct Request
+   {
+      std::size_t index = 0;      // Index of the pair
+      double latitude = 0;        // Latitude to request, the center of the grid cell if the store is used
+      double longitude = 0;       // Longitude to request
+      DateRange span;             // Days to request
+      std::string response;       // Received response, empty on error
+   };
+
+   std::vector<WeatherInfoVector> result(locations.size() * ranges.size());
+   std::vector<Request> requests;
+   for (std::size_t i = 0; i < result.size(); ++i)
+   {
+      const auto& location = locations[i / ranges.size()];
+      const auto& range = ranges[i % ranges.size()];
+      if (!store)
+      {
+         requests.push_back({i, location.latitude(), location.longitude(), range});
+         continue;
+      }
+
+      const auto [latitude, longitude] = store->GetCellCenter(location.latitude(), location.longitude());
+      for (const auto& span : store->Find(latitude, longitude, range, result[i]))
+         requests.push_back({i, latitude, longitude, span});
+   }
+
+   // Responses are only stored by event loop threads and parsed here, as callbacks must not block the loop.
+   ForEachConcurrently(requests.size(), m_settings.maxOngoingWeatherRequests,
+      [&](std::size_t index, const std::function<void()>& done)
+      {
+         Request& request = requests[index];
+         openmeteo::LoadHistoricalWeatherAsync(m_openMeteoApiClient, request.latitude, request.longitude,
+            request.span,
+            [&request, &done](std::string response)
+            {
+               request.response = std::move(response);
+               done();
+            });
+      });
+
+   for (auto& request : requests)
+   {
+      if (request.response.empty())
+         continue;
+
+      const auto received = openmeteo::ParseWeatherResponse(request.response);
+      BufferPool::GetDefault().Release(std::move(request.response));
+      if (store)
+         store->Put(request.latitude, request.longitude, received);
+      auto& weather = result[request.index];
+      weather.insert(weather.end(), received.begin(), received.end());
+   }
+
+   // Stored and received days of a pair are merged in order of dates.
+   if (store)
+   {
+      for (auto& weather : result)
+         std::sort(weather.begin(), weather.end(),
+            [](const WeatherInfo& a, const WeatherInfo& b)
+            {
+               return a.time < b.time;
+            });
+
+      const auto statistics = store->GetStatistics();
+      LOG_EVERY_N_SEC(INFO, 60) << std::format("Weather store: hit ratio {:.3f}, {} cells, {} bytes",
+         statistics.GetHitRatio(), statistics.numCells, statistics.memoryBytes);
+   }
+   return result;
 }
 
 // Finds and returns region information within a bounding box, filtering by preferences and tracking processed IDs
 nominatim::RelationInfos SearchEngine::findRegions(
-   const BoundingBox& bbox, const RegionPreferences& prefs, std::set<overpass::OsmId>& processed)
+   const BoundingBox& bbox, const RegionPreferences& prefs, ProcessedIds& processed)
 {
    if (!isValidBoundingBox(bbox))
    {
@@ -221,24 +460,24 @@ nominatim::RelationInfos SearchEngine::findRegions(
       return {};
    }
 
-   const std::string request = formatRegionsRequest(prefs, bbox);
-   if (request.empty())
-      return {};
-
    // Use Overpass API to load "relation" entities for regions found in the passed bounding box,
    // taking into account passed preferences.
-   const std::string response = m_overpassApiClient.Post(request);
-   overpass::OsmIds relationIds = overpass::ExtractRelationIds(response);
+   overpass::OsmIds relationIds = loadRegionIds(bbox, prefs);
    if (relationIds.empty())
       return {};
 
    // Remove ids which have already been processed.
    // This is an optimization for cases when one "relation" entity (i.e. a geographic region)
    // belongs to more than one bounding box, and findRegions() is called in a loop.
+   // Ids are reserved right away, so that concurrent calls for neighbour bounding boxes do not look them up twice.
    overpass::OsmIds relationIdsToProcess;
    std::sort(relationIds.begin(), relationIds.end());
-   std::set_difference(relationIds.begin(), relationIds.end(), processed.begin(), processed.end(),
-      std::back_inserter(relationIdsToProcess));
+   {
+      std::lock_guard lock(processed.mutex);
+      std::set_difference(relationIds.begin(), relationIds.end(), processed.ids.begin(), processed.ids.end(),
+         std::back_inserter(relationIdsToProcess));
+      processed.ids.insert(relationIdsToProcess.begin(), relationIdsToProcess.end());
+   }
 
 #ifndef NDEBUG
    if (relationIds.size() != relationIdsToProcess.size())
@@ -250,19 +489,153 @@ nominatim::RelationInfos SearchEngine::findRegions(
       return {};
 
    // Use Nominatim API to load some detailed information for all the found "relation" entities.
-   const auto infos = nominatim::LookupRelationInformation(relationIdsToProcess, m_nominatimApiClient);
+   const auto infos =
+      nominatim::LookupRelationInformation(relationIdsToProcess, m_nominatimApiClient, getLookupOptions());
    if (infos.empty())
    {
       LOG(ERROR) << std::format(
          "Cannot find regions in Nominatim (checked {} relation ids)", relationIdsToProcess.size());
+
+      // Release reserved ids, so they can be retried with the next bounding box
+      std::lock_guard lock(processed.mutex);
+      for (const auto id : relationIdsToProcess)
+         processed.ids.erase(id);
       return {};
    }
 
    LOG(INFO) << std::format(
       "Found {} regions in Nominatim (checked {} relation ids)", infos.size(), relationIdsToProcess.size());
-   processed.insert(relationIdsToProcess.begin(), relationIdsToProcess.end());
 
    return infos;
 }
 
+nominatim::LookupOptions SearchEngine::getLookupOptions() const
+{
+   return {m_settings.relationCache, m_settings.maxOngoingNominatimRequests};
+}
+
+overpass::OsmIds SearchEngine::loadRegionIds(const BoundingBox& bbox, const RegionPreferences& prefs)
+{
+   ScopedSpan span("overpass.region_ids");
+   if (!m_settings.regionTileCache)
+   {
+      const std::string request = formatRegionsRequest(prefs, bbox);
+      if (request.empty())
+         return {};
+      return overpass::ExtractRelationIds(m_overpassApiClient.Post(request));
+   }
+
+   const bool searchPeaks = prefs.objects & geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_PEAKS;
+   const std::optional<std::int32_t> minPeakHeight = getMinPeakHeight(prefs);
+   if (searchPeaks && !minPeakHeight)
+      return {};  // As with formatRegionsRequest, no region can contain peaks of an unknown height
+
+   // Every kind of features is searched by its own tiles, peaks with the quantized height, so a tile serves all the
+   // searches within the same bucket. Missing tiles are requested by rectangles, one query per rectangle.
+   RegionTileCache& cache = *m_settings.regionTileCache;
+   struct Kind
+   {
+      std::uint32_t object = 0;                      // Kind of features
+      std::vector<RegionTileCache::Features> found;  // Features of the tiles which are found or received
+   };
+   struct Request
+   {
+      std::size_t kind = 0;                     // Index of the kind of features
+      std::vector<RegionTileCache::Key> tiles;  // Rectangle of missing tiles, ordered by rows and columns
+      std::string response;                     // Received response, empty on error
+   };
+   std::vector<Kind> kinds;
+   std::vector<Request> requests;
+   for (const std::uint32_t object : sc_regionFeatureKinds)
+   {
+      if (!(prefs.objects & object))
+         continue;
+
+      const bool isPeaks = object == geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_PEAKS;
+      Kind& kind = kinds.emplace_back();
+      kind.object = object;
+      std::vector<RegionTileCache::Key> missingTiles;
+      for (const auto& tile : cache.GetTiles(bbox, object, isPeaks ? quantizePeakHeight(*minPeakHeight) : -1))
+      {
+         RegionTileCache::Features features;
+         if (cache.Find(tile, features))
+            kind.found.push_back(std::move(features));
+         else
+            missingTiles.push_back(tile);
+      }
+      for (auto& group : RegionTileCache::GroupTiles(std::move(missingTiles)))
+         requests.push_back({kinds.size() - 1, std::move(group), {}});
+   }
+   if (kinds.empty())
+      return {};
+
+   // Responses are only stored by event loop threads and parsed here, as callbacks must not block the loop.
+   ForEachConcurrently(requests.size(), m_settings.maxOngoingOverpassRequests,
+      [&](std::size_t index, const std::function<void()>& done)
+      {
+         const Request& request = requests[index];
+         const BoundingBox first = cache.GetTileBox(request.tiles.front());
+         const BoundingBox last = cache.GetTileBox(request.tiles.back());
+         const BoundingBox box = {first[0], first[1], last[2], last[3]};
+         m_overpassApiClient.PostAsync(
+            formatFeatureRegionsRequest(kinds[request.kind].object, request.tiles.front().minPeakHeight, box),
+            [&requests, index, &done](std::string response)
+            {
+               requests[index].response = std::move(response);
+               done();
+            });
+      });
+
+   for (auto& request : requests)
+   {
+      overpass::RegionFeatures features;
+      const bool isComplete = overpass::ExtractRegionFeatures(request.response, features);
+      BufferPool::GetDefault().Release(std::move(request.response));
+
+      // Features are split back to the tiles of the rectangle, ones on a shared border belong to both tiles.
+      // Failed or incomplete rectangles are not cached, so they are requested again next time.
+      for (const auto& tile : request.tiles)
+      {
+         const BoundingBox tileBox = cache.GetTileBox(tile);
+         auto tileFeatures = std::make_shared<overpass::RegionFeatures>();
+         std::copy_if(features.begin(), features.end(), std::back_inserter(*tileFeatures),
+            [&tileBox](const overpass::RegionFeature& feature)
+            {
+               return IsInBoundingBox(tileBox, feature.latitude, feature.longitude);
+            });
+         if (isComplete)
+            cache.Put(tile, tileFeatures);
+         kinds[request.kind].found.push_back(std::move(tileFeatures));
+      }
+   }
+
+   // A region is found if it contains features of every kind in the exact box, and peaks higher than the exact height
+   std::set<overpass::OsmId> ids;
+   for (std::size_t i = 0; i < kinds.size(); ++i)
+   {
+      const bool isPeaks = kinds[i].object == geoproto::RegionsRequest::Preferences::GEOGRAPHICAL_FEATURE_PEAKS;
+      std::set<overpass::OsmId> kindIds;
+      for (const auto& features : kinds[i].found)
+         for (const auto& feature : *features)
+            if (IsInBoundingBox(bbox, feature.latitude, feature.longitude) &&
+                (!isPeaks || feature.elevation > *minPeakHeight))
+               kindIds.insert(feature.regionIds.begin(), feature.regionIds.end());
+
+      if (i == 0)
+         ids = std::move(kindIds);
+      else
+         std::erase_if(ids,
+            [&kindIds](overpass::OsmId id)
+            {
+               return !kindIds.contains(id);
+            });
+   }
+
+   const auto statistics = cache.GetStatistics();
+   LOG_EVERY_N_SEC(INFO, 60) << std::format("Overpass region tile cache: hit ratio {:.3f}, {} tiles",
+      statistics.GetHitRatio(), statistics.numTiles);
+
+   return {ids.begin(), ids.end()};
+}
+
 }  // namespace geo
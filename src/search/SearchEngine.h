@@ -1,10 +1,14 @@
 #pragma once
 
 #include "../../proto/ProtoTypes.h"
+#include "../utils/GeoUtils.h"
 #include "NominatimApiUtils.h"
 #include "OverpassApiUtils.h"
+#include "RegionTileCache.h"
 #include "SearchEngineItf.h"
+#include "WeatherStore.h"
 
+#include <mutex>
 #include <set>
 #include <string>
 
@@ -13,17 +17,46 @@ namespace geo
 
 class WebClient;
 
+// Appends cities to the result, their details (hotels and museums) are loaded by a single Overpass API query
+// @param infos Cities to append
+// @param overpassApiClient Client used to load the details
+// @param includeDetails Whether to load the details
+// @param cities Receives the cities, on the arena of the field if it has one
+void AppendCities(
+   const nominatim::RelationInfos& infos, WebClient& overpassApiClient, bool includeDetails, GeoProtoPlaces& cities);
+
+// Formats an Overpass API request string based on region preferences and bounding box
+// @param prefs Objects which must be found in the regions
+// @param boundingBox Box to search in
+// @return Request string, empty if no objects are requested
+std::string FormatRegionsRequest(const ISearchEngine::RegionPreferences& prefs, const BoundingBox& boundingBox);
+
 class SearchEngine : public ISearchEngine
 {
 public:
-   // Constructs a SearchEngine with references to Overpass and Nominatim API clients
-   SearchEngine(WebClient& overpassApiClient, WebClient& nominatimApiClient);
+   // Concurrency limits and optional caches shared by all searches
+   struct Settings
+   {
+      std::size_t maxOngoingWeatherRequests = 1;          // Concurrent Open Meteo requests per GetHistoricalWeather
+      std::size_t maxOngoingOverpassRequests = 1;         // Concurrent Overpass requests per region search box
+      std::size_t maxOngoingNominatimRequests = 1;        // Concurrent Nominatim requests per lookup
+      nominatim::RelationCache* relationCache = nullptr;  // Cache of Nominatim lookups, may be nullptr
+      RegionTileCache* regionTileCache = nullptr;         // Cache of Overpass region searches, may be nullptr
+      WeatherStore* weatherStore = nullptr;               // Store of Open Meteo daily temperatures, may be nullptr
+   };
+
+public:
+   // Constructs a SearchEngine with references to Overpass, Nominatim and Open Meteo API clients
+   // @param settings Concurrency limits and caches
+   SearchEngine(WebClient& overpassApiClient, WebClient& nominatimApiClient, WebClient& openMeteoApiClient,
+      const Settings& settings);
 
    // See ISearchEngine::FindCitiesByName for documentation
-   GeoProtoPlaces FindCitiesByName(const std::string& name, bool includeDetails) override;
+   void FindCitiesByName(const std::string& name, bool includeDetails, GeoProtoPlaces& cities) override;
 
    // See ISearchEngine::FindCitiesByPosition for documentation
-   GeoProtoPlaces FindCitiesByPosition(double latitude, double longitude, bool includeDetails) override;
+   void FindCitiesByPosition(
+      double latitude, double longitude, bool includeDetails, GeoProtoPlaces& cities) override;
 
    // See ISearchEngine::StartFindRegions for documentation
    IncrementalSearchHandler StartFindRegions() override;
@@ -31,14 +64,41 @@ public:
    // See ISearchEngine::GetWeather for documentation
    WeatherInfoVector GetWeather(double latitude, double longitude, const DateRange& dateRange) override;
 
+   // See ISearchEngine::GetHistoricalWeather for documentation
+   GeoProtoWeathers GetHistoricalWeather(
+      const GeoProtoPoints& locations, const DateRange& dateRange, std::uint32_t numYears) override;
+
 private:
+   // Relation ids which have already been processed by an incremental search
+   struct ProcessedIds
+   {
+      std::mutex mutex;               // Protects ids, as an incremental search may run concurrently
+      std::set<overpass::OsmId> ids;  // Processed (or being processed) relation ids
+   };
+
    // Finds region information within a bounding box based on preferences
    nominatim::RelationInfos findRegions(
-      const BoundingBox& bbox, const RegionPreferences& prefs, std::set<overpass::OsmId>& processed);
+      const BoundingBox& bbox, const RegionPreferences& prefs, ProcessedIds& processed);
+
+   // Loads ids of regions within a bounding box from Overpass API, using the tile cache if it is set
+   overpass::OsmIds loadRegionIds(const BoundingBox& bbox, const RegionPreferences& prefs);
+
+   // Loads weather of every (location, date range) pair. Days found in the weather store are not requested,
+   // and the missing spans of all the pairs are requested concurrently.
+   // @param store Weather store, nullptr to request the exact locations rather than the centers of their cells
+   // @return Weather of the pairs at index (location index * number of ranges + range index), in order of dates
+   std::vector<WeatherInfoVector> loadWeather(
+      const GeoProtoPoints& locations, const std::vector<DateRange>& ranges, WeatherStore* store);
+
+   // Returns settings of Nominatim lookups
+   nominatim::LookupOptions getLookupOptions() const;
 
 private:
    WebClient& m_overpassApiClient;   // Client for Overpass API requests
    WebClient& m_nominatimApiClient;  // Client for Nominatim API requests
+   WebClient& m_openMeteoApiClient;  // Client for Open Meteo API requests
+
+   const Settings m_settings;  // Concurrency limits and caches
 };
 
 }  // namespace geo
\ No newline at end of file
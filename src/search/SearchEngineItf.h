@@ -23,15 +23,16 @@ public:
    // Searches for cities matching the specified name
    // @param name The city name to search for
    // @param includeDetails If true, includes additional details like features in the response
-   // @return GeoProtoPlaces containing matching cities
-   virtual GeoProtoPlaces FindCitiesByName(const std::string& name, bool includeDetails) = 0;
+   // @param cities Receives matching cities, which are allocated on the arena of the field if it has one
+   virtual void FindCitiesByName(const std::string& name, bool includeDetails, GeoProtoPlaces& cities) = 0;
 
    // Searches for cities at or near the specified geographic coordinates
    // @param latitude The latitude coordinate (-90 to 90)
    // @param longitude The longitude coordinate (-180 to 180)
    // @param includeDetails If true, includes additional details like features in the response
-   // @return GeoProtoPlaces containing cities found at or near the coordinates
-   virtual GeoProtoPlaces FindCitiesByPosition(double latitude, double longitude, bool includeDetails) = 0;
+   // @param cities Receives cities found at or near the coordinates, allocated on the arena of the field if it has one
+   virtual void FindCitiesByPosition(
+      double latitude, double longitude, bool includeDetails, GeoProtoPlaces& cities) = 0;
 
    struct RegionPreferences
    {
@@ -44,12 +45,23 @@ public:
 
    // Initiates an incremental search for regions within bounding boxes
    // @return A function handler that can be called repeatedly with different bounding boxes and preferences
-   //         to find regions incrementally, optimizing for looped searches
-   using IncrementalSearchHandler = std::function<GeoProtoPlaces(const BoundingBox&, const RegionPreferences&)>;
+   //         to find regions incrementally, optimizing for looped searches. Found regions are appended to the passed
+   //         field, on its arena if it has one.
+   //         The handler is thread-safe and may be called concurrently for different bounding boxes.
+   using IncrementalSearchHandler =
+      std::function<void(const BoundingBox&, const RegionPreferences&, GeoProtoPlaces& regions)>;
    virtual IncrementalSearchHandler StartFindRegions() = 0;
 
    // Returns weather for given location.
    virtual WeatherInfoVector GetWeather(double latitude, double longitude, const DateRange& dateRange) = 0;
+
+   // Returns historical weather aggregated over the same dates of N most recent years for every location
+   // @param locations Locations to request weather for
+   // @param dateRange Dates to collect historical weather for (only month and day are used)
+   // @param numYears Number of most recent years to aggregate
+   // @return GeoProtoWeathers with min, max and average temperature, one per location in the same order
+   virtual GeoProtoWeathers GetHistoricalWeather(
+      const GeoProtoPoints& locations, const DateRange& dateRange, std::uint32_t numYears) = 0;
 };
 
 }  // namespace geo
@@ -0,0 +1,186 @@
+#include "WeatherStore.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace
+{
+
+using namespace geo;
+
+// Converts a temperature to the stored representation in tenths of a degree
+std::int16_t toStored(double temperature)
+{
+   const long value = std::lround(temperature * 10);
+   return static_cast<std::int16_t>(std::clamp<long>(value, std::numeric_limits<std::int16_t>::min() + 1,
+      std::numeric_limits<std::int16_t>::max()));
+}
+
+// Returns index of the day in its year, from 0 to 365
+std::size_t getDayOfYear(const std::chrono::sys_days& day, const Date& date)
+{
+   return static_cast<std::size_t>(
+      (day - std::chrono::sys_days{date.year() / std::chrono::January / std::chrono::day{1}}).count());
+}
+
+}  // namespace
+
+namespace geo
+{
+
+double WeatherStore::Statistics::GetHitRatio() const
+{
+   const auto numDays = numStoredDays + numMissingDays;
+   return numDays == 0 ? 0 : static_cast<double>(numStoredDays) / numDays;
+}
+
+std::size_t WeatherStore::KeyHash::operator()(const Key& key) const
+{
+   std::size_t hash = std::hash<std::int32_t>{}(key.row);
+   return hash * 31 + std::hash<std::int32_t>{}(key.column);
+}
+
+WeatherStore::WeatherStore(const Settings& settings)
+   : m_settings(settings)
+{
+}
+
+std::pair<double, double> WeatherStore::GetCellCenter(double latitude, double longitude) const
+{
+   const Key key = getKey(latitude, longitude);
+   const double size = 1.0 / m_settings.cellsPerDegree;
+   return {(key.row + 0.5) * size - 90, (key.column + 0.5) * size - 180};
+}
+
+std::vector<DateRange> WeatherStore::Find(
+   double latitude, double longitude, const DateRange& dateRange, WeatherInfoVector& weather)
+{
+   if (!dateRange.first.ok() || !dateRange.second.ok())
+      return {dateRange};
+
+   const Key key = getKey(latitude, longitude);
+   std::vector<DateRange> missing;
+
+   std::lock_guard lock(m_mutex);
+
+   const Cell* cell = nullptr;
+   if (const auto it = m_index.find(key); it != m_index.end())
+   {
+      m_cells.splice(m_cells.begin(), m_cells, it->second);
+      cell = &*it->second;
+   }
+
+   auto findYear = [cell](const Date& date) -> const Year*
+   {
+      if (!cell)
+         return nullptr;
+      const auto it = cell->years.find(static_cast<int>(date.year()));
+      return it != cell->years.end() ? it->second.get() : nullptr;
+   };
+
+   const Year* year = nullptr;
+   const std::chrono::sys_days firstDay{dateRange.first};
+   const std::chrono::sys_days lastDay{dateRange.second};
+   for (auto day = firstDay; day <= lastDay; day += std::chrono::days{1})
+   {
+      const Date date{day};
+      if (day == firstDay || (date.month() == std::chrono::January && date.day() == std::chrono::day{1}))
+         year = findYear(date);
+
+      const std::size_t dayOfYear = getDayOfYear(day, date);
+      if (year && year->maxima[dayOfYear] != sc_missing)
+      {
+         WeatherInfo& info = weather.emplace_back();
+         info.time = date;
+         info.temperatureMax = year->maxima[dayOfYear] / 10.0;
+         info.temperatureMin = year->minima[dayOfYear] / 10.0;
+         info.temperatureAverage = (info.temperatureMax + info.temperatureMin) / 2.0;
+         ++m_numStoredDays;
+         continue;
+      }
+
+      // Consecutive missing days make a single span, so they are requested together.
+      if (!missing.empty() && std::chrono::sys_days{missing.back().second} + std::chrono::days{1} == day)
+         missing.back().second = date;
+      else
+         missing.emplace_back(date, date);
+      ++m_numMissingDays;
+   }
+   return missing;
+}
+
+void WeatherStore::Put(double latitude, double longitude, const WeatherInfoVector& weather)
+{
+   if (m_settings.maxMemoryBytes == 0 || weather.empty())
+      return;
+
+   const Key key = getKey(latitude, longitude);
+
+   std::lock_guard lock(m_mutex);
+
+   auto it = m_index.find(key);
+   if (it == m_index.end())
+   {
+      m_cells.push_front({key, {}});
+      it = m_index.emplace(key, m_cells.begin()).first;
+   }
+   else
+   {
+      m_cells.splice(m_cells.begin(), m_cells, it->second);
+   }
+
+   Cell& cell = *it->second;
+   m_memoryBytes -= std::min(m_memoryBytes, getMemoryBytes(cell));
+   for (const auto& info : weather)
+   {
+      if (!info.time.ok())
+         continue;
+
+      auto& year = cell.years[static_cast<int>(info.time.year())];
+      if (!year)
+      {
+         year = std::make_unique<Year>();
+         year->maxima.fill(sc_missing);
+         year->minima.fill(sc_missing);
+      }
+
+      const std::size_t dayOfYear = getDayOfYear(std::chrono::sys_days{info.time}, info.time);
+      year->maxima[dayOfYear] = toStored(info.temperatureMax);
+      year->minima[dayOfYear] = toStored(info.temperatureMin);
+   }
+   m_memoryBytes += getMemoryBytes(cell);
+
+   // The cell which has just been stored is never evicted
+   while (m_memoryBytes > m_settings.maxMemoryBytes && m_cells.size() > 1)
+   {
+      m_memoryBytes -= std::min(m_memoryBytes, getMemoryBytes(m_cells.back()));
+      m_index.erase(m_cells.back().key);
+      m_cells.pop_back();
+   }
+}
+
+WeatherStore::Statistics WeatherStore::GetStatistics() const
+{
+   std::lock_guard lock(m_mutex);
+   return {m_numStoredDays, m_numMissingDays, m_cells.size(), m_memoryBytes};
+}
+
+WeatherStore::Key WeatherStore::getKey(double latitude, double longitude) const
+{
+   const auto numRows = 180 * m_settings.cellsPerDegree;
+   const auto numColumns = 360 * m_settings.cellsPerDegree;
+   const auto row = static_cast<std::int32_t>(std::floor((latitude + 90) * m_settings.cellsPerDegree));
+   const auto column = static_cast<std::int32_t>(std::floor((longitude + 180) * m_settings.cellsPerDegree));
+   return {std::clamp(row, 0, numRows - 1), std::clamp(column, 0, numColumns - 1)};
+}
+
+std::size_t WeatherStore::getMemoryBytes(const Cell& cell)
+{
+   // A cell is a list node and a hash map node, a year is a tree node and its columns
+   const std::size_t sc_cellOverhead = 64;
+   const std::size_t sc_yearOverhead = 48;
+   return sizeof(Cell) + sc_cellOverhead + cell.years.size() * (sizeof(Year) + sc_yearOverhead);
+}
+
+}  // namespace geo
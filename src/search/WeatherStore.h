@@ -0,0 +1,130 @@
+#pragma once
+
+#include "../utils/TimeUtils.h"
+#include "../utils/WeatherInfo.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace geo
+{
+
+// Thread-safe in-memory store of daily historical temperatures, which never change once they are published.
+// Locations are snapped to a global grid of cells, and weather of a cell is requested for its center,
+// so all the locations of a cell share the stored days. Every cell keeps a year of days in columns
+// of maximum and minimum temperatures in tenths of a degree. Least recently used cells are evicted
+// above the memory limit.
+class WeatherStore
+{
+public:
+   // Store settings
+   struct Settings
+   {
+      std::int32_t cellsPerDegree = 10;  // Number of grid cells per degree of latitude and longitude
+      std::size_t maxMemoryBytes = 0;    // Approximate memory limit of all the cells
+   };
+
+   // Counters describing store efficiency
+   struct Statistics
+   {
+      std::uint64_t numStoredDays = 0;   // Number of requested days found in the store
+      std::uint64_t numMissingDays = 0;  // Number of requested days which must be requested from Open Meteo
+      std::size_t numCells = 0;          // Number of stored cells
+      std::size_t memoryBytes = 0;       // Approximate memory used by the cells
+
+      // Returns share of days answered from the store
+      double GetHitRatio() const;
+   };
+
+public:
+   // Constructor
+   // @param settings Grid and memory limit
+   explicit WeatherStore(const Settings& settings);
+
+   WeatherStore(const WeatherStore&) = delete;
+   WeatherStore& operator=(const WeatherStore&) = delete;
+
+   // Returns the center of the grid cell which contains the point
+   // @param latitude Latitude of the point
+   // @param longitude Longitude of the point
+   // @return Latitude and longitude of the center
+   std::pair<double, double> GetCellCenter(double latitude, double longitude) const;
+
+   // Finds stored days of a date range
+   // @param latitude Latitude of a point of the cell
+   // @param longitude Longitude of a point of the cell
+   // @param dateRange Dates to find, inclusive
+   // @param weather Receives the stored days in order of dates
+   // @return Spans of the range which are not stored, in order of dates
+   std::vector<DateRange> Find(
+      double latitude, double longitude, const DateRange& dateRange, WeatherInfoVector& weather);
+
+   // Stores days of a cell
+   // @param latitude Latitude of a point of the cell
+   // @param longitude Longitude of a point of the cell
+   // @param weather Days to store
+   void Put(double latitude, double longitude, const WeatherInfoVector& weather);
+
+   // Returns counters collected since construction
+   Statistics GetStatistics() const;
+
+private:
+   static constexpr std::int16_t sc_missing = std::numeric_limits<std::int16_t>::min();  // Day which is not stored
+
+   // Identifies a cell of the grid
+   struct Key
+   {
+      std::int32_t row = 0;     // Index of the cell from the South pole
+      std::int32_t column = 0;  // Index of the cell from the antimeridian
+
+      bool operator==(const Key&) const = default;
+   };
+
+   struct KeyHash
+   {
+      std::size_t operator()(const Key& key) const;
+   };
+
+   // Days of a year, indexed by the day of the year
+   struct Year
+   {
+      std::array<std::int16_t, 366> maxima;  // Maximum temperatures in tenths of a degree
+      std::array<std::int16_t, 366> minima;  // Minimum temperatures in tenths of a degree
+   };
+
+   struct Cell
+   {
+      Key key;                                              // Cell of the grid
+      std::map<std::int32_t, std::unique_ptr<Year>> years;  // Stored years by their numbers
+   };
+
+   using Cells = std::list<Cell>;  // Most recently used cells first
+
+private:
+   // Returns the cell which contains the point
+   Key getKey(double latitude, double longitude) const;
+
+   // Returns approximate memory used by a cell
+   static std::size_t getMemoryBytes(const Cell& cell);
+
+private:
+   const Settings m_settings;  // Store settings
+
+   mutable std::mutex m_mutex;                                 // Protects all the fields below
+   Cells m_cells;                                              // Cells in LRU order
+   std::unordered_map<Key, Cells::iterator, KeyHash> m_index;  // Cells by key
+   std::size_t m_memoryBytes = 0;                              // Approximate memory used by the cells
+   std::uint64_t m_numStoredDays = 0;                          // See Statistics::numStoredDays
+   std::uint64_t m_numMissingDays = 0;                         // See Statistics::numMissingDays
+};
+
+}  // namespace geo
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <google/protobuf/arena.h>
+#include <grpcpp/support/message_allocator.h>
+
+#include <cstddef>
+
+namespace geo
+{
+
+// Allocator of request and response messages of a unary callback RPC.
+// Every RPC gets its own protobuf arena, so everything the search adds to the response is allocated on the arena,
+// and the whole response is freed at once when the RPC is done.
+// Must outlive the server, register it with SetMessageAllocatorFor_<Method>() of the service.
+template <typename TRequest, typename TResponse>
+class ArenaMessageAllocator : public grpc::MessageAllocator<TRequest, TResponse>
+{
+public:
+   // @param initialBlockSize Size of the first memory block of every arena
+   // @param maxBlockSize Maximum size of memory blocks the arenas grow by
+   ArenaMessageAllocator(std::size_t initialBlockSize, std::size_t maxBlockSize)
+   {
+      m_options.start_block_size = initialBlockSize;
+      m_options.max_block_size = maxBlockSize;
+   }
+
+   ArenaMessageAllocator(const ArenaMessageAllocator&) = delete;
+   ArenaMessageAllocator& operator=(const ArenaMessageAllocator&) = delete;
+
+   // Called by gRPC when an RPC starts
+   grpc::MessageHolder<TRequest, TResponse>* AllocateMessages() override { return new Holder(m_options); }
+
+private:
+   // Arena of an RPC with the request and the response allocated on it
+   class Holder : public grpc::MessageHolder<TRequest, TResponse>
+   {
+   public:
+      explicit Holder(const google::protobuf::ArenaOptions& options)
+         : m_arena(options)
+      {
+         this->set_request(google::protobuf::Arena::CreateMessage<TRequest>(&m_arena));
+         this->set_response(google::protobuf::Arena::CreateMessage<TResponse>(&m_arena));
+      }
+
+      // Called by gRPC when the RPC is done. Frees the messages with all the memory of the arena.
+      void Release() override { delete this; }
+
+   private:
+      google::protobuf::Arena m_arena;  // Memory of the request and the response
+   };
+
+private:
+   google::protobuf::ArenaOptions m_options;  // Options of the arenas of all RPCs
+};
+
+}  // namespace geo
@@ -0,0 +1,46 @@
+#include "BufferPool.h"
+
+namespace geo
+{
+
+BufferPool::BufferPool(std::size_t maxBuffers, std::size_t maxBufferCapacity)
+   : m_maxBuffers(maxBuffers)
+   , m_maxBufferCapacity(maxBufferCapacity)
+{
+}
+
+std::string BufferPool::Acquire(std::size_t capacity)
+{
+   std::string buffer;
+   {
+      std::lock_guard lock(m_mutex);
+      if (!m_buffers.empty())
+      {
+         buffer = std::move(m_buffers.back());
+         m_buffers.pop_back();
+      }
+   }
+
+   buffer.reserve(capacity);
+   return buffer;
+}
+
+void BufferPool::Release(std::string buffer)
+{
+   // Small buffers (including moved-from ones) are not worth keeping
+   if (buffer.capacity() < sc_minBufferCapacity || buffer.capacity() > m_maxBufferCapacity)
+      return;
+
+   buffer.clear();
+   std::lock_guard lock(m_mutex);
+   if (m_buffers.size() < m_maxBuffers)
+      m_buffers.emplace_back(std::move(buffer));
+}
+
+BufferPool& BufferPool::GetDefault()
+{
+   static BufferPool s_pool(sc_defaultMaxBuffers, sc_defaultMaxBufferCapacity);
+   return s_pool;
+}
+
+}  // namespace geo
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace geo
+{
+
+// Thread-safe pool of string buffers for HTTP responses.
+// Buffers keep their capacity when they are returned, so responses of usual size are received and parsed
+// without heap allocations once the pool is warmed up.
+class BufferPool
+{
+public:
+   static const std::size_t sc_defaultMaxBuffers = 64;                      // Default number of idle buffers
+   static const std::size_t sc_defaultMaxBufferCapacity = 4 * 1024 * 1024;  // Default maximum capacity of idle buffers
+   static const std::size_t sc_minBufferCapacity = 1024;                    // Smaller buffers are not kept
+
+public:
+   // Constructor
+   // @param maxBuffers Maximum number of idle buffers kept in the pool
+   // @param maxBufferCapacity Buffers with bigger capacity are freed instead of being kept
+   BufferPool(std::size_t maxBuffers, std::size_t maxBufferCapacity);
+
+   BufferPool(const BufferPool&) = delete;
+   BufferPool& operator=(const BufferPool&) = delete;
+
+   // Takes an empty buffer from the pool, or creates a new one
+   // @param capacity Minimum capacity of the buffer
+   std::string Acquire(std::size_t capacity = 0);
+
+   // Returns a buffer to the pool; it is freed if the pool is full or the buffer is too big
+   // @param buffer Buffer which is not used anymore
+   void Release(std::string buffer);
+
+   // Returns the process-wide pool used by WebClient instances
+   static BufferPool& GetDefault();
+
+private:
+   const std::size_t m_maxBuffers;         // Maximum number of idle buffers
+   const std::size_t m_maxBufferCapacity;  // Maximum capacity of an idle buffer
+   std::mutex m_mutex;                     // Protects m_buffers
+   std::vector<std::string> m_buffers;     // Idle buffers
+};
+
+}  // namespace geo
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+
+namespace geo
+{
+
+// Runs asynchronous tasks keeping at most `maxConcurrency` of them in flight, and waits until all are finished.
+// Next task is started from the completion of a previous one, so no thread is blocked per task. Tasks are started
+// by one thread at a time in a loop: a task which finishes while tasks are being started (e.g. synchronously inside
+// `start`) only frees its slot for that loop, so the stack does not grow with the number of tasks.
+// @param numTasks Number of tasks to run
+// @param maxConcurrency Maximum number of tasks in flight (at least one)
+// @param start Function `void(std::size_t index, const std::function<void()>& done)` which starts the task with
+//              given index; the task must call `done` exactly once when it is finished (on any thread)
+template <typename TStart>
+void ForEachConcurrently(std::size_t numTasks, std::size_t maxConcurrency, TStart start)
+{
+   if (numTasks == 0)
+      return;
+
+   std::mutex mutex;
+   std::condition_variable finishedCondition;
+   std::size_t nextTask = 0;
+   std::size_t numFinished = 0;
+   std::size_t numFreeSlots = 0;  // Slots of finished tasks which have not been filled with next tasks yet
+   bool starting = false;         // True while a thread is starting tasks
+
+   std::function<void()> done;
+
+   // Starts next tasks while there are free slots, called with the lock held
+   auto startTasks = [&](std::unique_lock<std::mutex>& lock)
+   {
+      starting = true;
+      while (numFreeSlots > 0)
+      {
+         --numFreeSlots;
+         const auto index = nextTask++;
+         lock.unlock();
+         start(index, done);
+         lock.lock();
+      }
+      starting = false;
+
+      // Notified under the lock, as the waiting thread destroys the state as soon as it wakes up
+      if (numFinished == numTasks)
+         finishedCondition.notify_one();
+   };
+
+   done = [&]
+   {
+      std::unique_lock lock(mutex);
+      ++numFinished;
+      if (nextTask + numFreeSlots < numTasks)
+         ++numFreeSlots;
+      if (starting)
+         return;
+      if (numFreeSlots > 0)
+         startTasks(lock);
+      else if (numFinished == numTasks)
+         finishedCondition.notify_one();
+   };
+
+   std::unique_lock lock(mutex);
+   numFreeSlots = std::min(std::max<std::size_t>(1, maxConcurrency), numTasks);
+   startTasks(lock);
+   finishedCondition.wait(lock,
+      [&]
+      {
+         return numFinished == numTasks && !starting;
+      });
+}
+
+}  // namespace geo
@@ -4,9 +4,47 @@ namespace geo
 {
 
 inline constexpr auto sz_overpassEndpointKey = "overpass-endpoint";
+inline constexpr auto sz_overpassHedgeEndpointsKey = "overpass-hedge-endpoints";
 inline constexpr auto sz_nominatimEndpointKey = "nominatim-endpoint";
 inline constexpr auto sz_openMeteoEndpointKey = "openmeteo-endpoint";
 inline constexpr auto sz_maxBoxWidthKey = "maxBoxWidth";
 inline constexpr auto sz_maxBoxHeightKey = "maxBoxHeight";
+inline constexpr auto sz_webClientThreadsKey = "webClientThreads";
+inline constexpr auto sz_connectionPoolSizeKey = "connectionPoolSize";
+inline constexpr auto sz_connectionIdleTimeoutSecondsKey = "connectionIdleTimeoutSeconds";
+inline constexpr auto sz_executorThreadsKey = "executorThreads";
+inline constexpr auto sz_executorQueueDepthKey = "executorQueueDepth";
+inline constexpr auto sz_maxOngoingRegionTilesKey = "maxOngoingRegionTiles";
+inline constexpr auto sz_maxOngoingWeatherRequestsKey = "maxOngoingWeatherRequests";
+inline constexpr auto sz_relationCacheMaxMemoryMBKey = "relationCacheMaxMemoryMB";
+inline constexpr auto sz_relationCacheTtlSecondsKey = "relationCacheTtlSeconds";
+inline constexpr auto sz_relationCacheNegativeTtlSecondsKey = "relationCacheNegativeTtlSeconds";
+inline constexpr auto sz_maxOngoingOverpassRequestsKey = "maxOngoingOverpassRequests";
+inline constexpr auto sz_maxOngoingNominatimRequestsKey = "maxOngoingNominatimRequests";
+inline constexpr auto sz_regionTileSizeDegreesKey = "regionTileSizeDegrees";
+inline constexpr auto sz_regionTileCacheMaxTilesKey = "regionTileCacheMaxTiles";
+inline constexpr auto sz_regionTileCacheTtlSecondsKey = "regionTileCacheTtlSeconds";
+inline constexpr auto sz_responseArenaInitialBlockKBKey = "responseArenaInitialBlockKB";
+inline constexpr auto sz_responseArenaMaxBlockKBKey = "responseArenaMaxBlockKB";
+inline constexpr auto sz_cityIndexPathKey = "cityIndexPath";
+inline constexpr auto sz_nameIndexPathKey = "nameIndexPath";
+inline constexpr auto sz_responseCachePathKey = "responseCachePath";
+inline constexpr auto sz_responseCacheMaxMBKey = "responseCacheMaxMB";
+inline constexpr auto sz_responseCacheTtlSecondsKey = "responseCacheTtlSeconds";
+inline constexpr auto sz_responseCacheCompactionSecondsKey = "responseCacheCompactionSeconds";
+inline constexpr auto sz_weatherCellsPerDegreeKey = "weatherCellsPerDegree";
+inline constexpr auto sz_weatherStoreMaxMemoryMBKey = "weatherStoreMaxMemoryMB";
+inline constexpr auto sz_metricsPortKey = "metricsPort";
+inline constexpr auto sz_traceSamplingPercentKey = "traceSamplingPercent";
+inline constexpr auto sz_slowTraceThresholdMsKey = "slowTraceThresholdMs";
+inline constexpr auto sz_slowTracePathKey = "slowTracePath";
+inline constexpr auto sz_hedgePercentileKey = "hedgePercentile";
+inline constexpr auto sz_hedgeBudgetPercentKey = "hedgeBudgetPercent";
+inline constexpr auto sz_overpassRequestsPerSecondKey = "overpassRequestsPerSecond";
+inline constexpr auto sz_overpassMaxConcurrencyKey = "overpassMaxConcurrency";
+inline constexpr auto sz_nominatimRequestsPerSecondKey = "nominatimRequestsPerSecond";
+inline constexpr auto sz_nominatimMaxConcurrencyKey = "nominatimMaxConcurrency";
+inline constexpr auto sz_openMeteoRequestsPerSecondKey = "openMeteoRequestsPerSecond";
+inline constexpr auto sz_openMeteoMaxConcurrencyKey = "openMeteoMaxConcurrency";
 
 }
\ No newline at end of file
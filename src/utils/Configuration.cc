@@ -60,4 +60,16 @@ std::int64_t Configuration::GetInt64(const char* name) const
    return json::GetInt64(json::Get(m_config, name));
 }
 
+double Configuration::GetDouble(const char* name) const
+{
+   // Check if the key exists
+   if (!json::Has(m_config, name))
+   {
+      LOG(ERROR) << std::format("Configuration key not found: {}", std::string(name));
+      throw std::runtime_error("Configuration key not found: " + std::string(name));
+   }
+   // Return the double value
+   return json::GetDouble(json::Get(m_config, name));
+}
+
 }  // namespace geo
@@ -19,6 +19,9 @@ public:
    // Retrieves an int64 value from the configuration by key
    std::int64_t GetInt64(const char* name) const;
 
+   // Retrieves a double value from the configuration by key, integers are accepted as well
+   double GetDouble(const char* name) const;
+
 private:
    rapidjson::Document m_config; // RapidJSON document holding the parsed configuration
 };
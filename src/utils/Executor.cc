@@ -0,0 +1,127 @@
+#include "Executor.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <exception>
+#include <format>
+
+namespace
+{
+
+// Executor and worker index of the current thread, used to push nested tasks to the own queue of a worker
+thread_local const geo::Executor* t_executor = nullptr;
+thread_local std::size_t t_workerIndex = 0;
+
+}  // namespace
+
+namespace geo
+{
+
+Executor::Executor(std::size_t numThreads, std::size_t maxQueueDepth)
+   : m_maxQueueDepth(maxQueueDepth)
+{
+   numThreads = std::max<std::size_t>(1, numThreads);
+   for (std::size_t i = 0; i < numThreads; ++i)
+      m_workers.emplace_back(std::make_unique<Worker>());
+
+   // Threads are started only when all the queues exist, because any worker may steal from any other one
+   for (std::size_t i = 0; i < numThreads; ++i)
+      m_workers[i]->thread = std::thread(&Executor::run, this, i);
+}
+
+Executor::~Executor()
+{
+   {
+      std::lock_guard lock(m_wakeMutex);
+      m_stop = true;
+   }
+   m_wakeCondition.notify_all();
+
+   for (auto& worker : m_workers)
+      worker->thread.join();
+}
+
+bool Executor::Submit(Task task)
+{
+   if (m_numQueued.fetch_add(1) >= m_maxQueueDepth)
+   {
+      --m_numQueued;
+      return false;
+   }
+
+   const std::size_t index = t_executor == this ? t_workerIndex : m_nextWorker++ % m_workers.size();
+   {
+      std::lock_guard lock(m_workers[index]->mutex);
+      m_workers[index]->tasks.emplace_back(std::move(task));
+   }
+
+   {
+      // Synchronizes with a worker which has checked m_numQueued but has not started waiting yet
+      std::lock_guard lock(m_wakeMutex);
+   }
+   m_wakeCondition.notify_one();
+   return true;
+}
+
+void Executor::run(std::size_t index)
+{
+   t_executor = this;
+   t_workerIndex = index;
+
+   while (true)
+   {
+      Task task;
+      if (takeTask(index, task))
+      {
+         --m_numQueued;
+         try
+         {
+            task();
+         }
+         catch (const std::exception& e)
+         {
+            LOG(ERROR) << std::format("Executor task failed: {}", e.what());
+         }
+         continue;
+      }
+
+      std::unique_lock lock(m_wakeMutex);
+      if (m_stop && m_numQueued == 0)
+         break;
+      m_wakeCondition.wait(lock,
+         [this]
+         {
+            return m_stop || m_numQueued > 0;
+         });
+   }
+}
+
+bool Executor::takeTask(std::size_t index, Task& task)
+{
+   {
+      Worker& own = *m_workers[index];
+      std::lock_guard lock(own.mutex);
+      if (!own.tasks.empty())
+      {
+         task = std::move(own.tasks.front());
+         own.tasks.pop_front();
+         return true;
+      }
+   }
+
+   for (std::size_t i = 1; i < m_workers.size(); ++i)
+   {
+      Worker& victim = *m_workers[(index + i) % m_workers.size()];
+      std::lock_guard lock(victim.mutex);
+      if (!victim.tasks.empty())
+      {
+         task = std::move(victim.tasks.back());
+         victim.tasks.pop_back();
+         return true;
+      }
+   }
+   return false;
+}
+
+}  // namespace geo
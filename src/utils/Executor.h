@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace geo
+{
+
+// Bounded work-stealing thread pool for RPC work which must not run on gRPC callback threads.
+// Every worker has its own task queue; idle workers steal tasks from the queues of busy ones.
+class Executor
+{
+public:
+   using Task = std::function<void()>;
+
+public:
+   // Constructor starting worker threads
+   // @param numThreads Number of worker threads (at least one thread is always started)
+   // @param maxQueueDepth Maximum number of tasks waiting for execution in all queues
+   Executor(std::size_t numThreads, std::size_t maxQueueDepth);
+
+   // Destructor executes tasks which are already queued and stops worker threads
+   ~Executor();
+
+   Executor(const Executor&) = delete;
+   Executor& operator=(const Executor&) = delete;
+
+   // Schedules a task for execution. Thread-safe.
+   // @param task Task to execute on a worker thread
+   // @return false if the queue is full and the task is rejected
+   bool Submit(Task task);
+
+   // Returns number of tasks waiting for execution
+   std::size_t GetQueueDepth() const { return m_numQueued; }
+
+private:
+   struct Worker
+   {
+      std::mutex mutex;        // Protects tasks
+      std::deque<Task> tasks;  // Own tasks are taken from the front, stolen ones from the back
+      std::thread thread;      // Worker thread
+   };
+
+private:
+   // Thread function of the worker with given index
+   void run(std::size_t index);
+
+   // Takes a task from the own queue of the worker or steals it from another worker
+   // @param index Index of the worker
+   // @param task Receives the task
+   // @return true if a task is taken
+   bool takeTask(std::size_t index, Task& task);
+
+private:
+   const std::size_t m_maxQueueDepth;               // Maximum number of queued tasks
+   std::vector<std::unique_ptr<Worker>> m_workers;  // Workers with their queues
+   std::atomic<std::size_t> m_numQueued{0};         // Number of queued tasks in all queues
+   std::atomic<std::size_t> m_nextWorker{0};        // Round-robin counter for tasks submitted by other threads
+   std::atomic<bool> m_stop{false};                 // Set when workers must exit
+   std::mutex m_wakeMutex;                          // Mutex for m_wakeCondition
+   std::condition_variable m_wakeCondition;         // Wakes idle workers when tasks are submitted
+};
+
+}  // namespace geo
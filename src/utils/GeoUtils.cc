@@ -111,6 +111,11 @@ std::vector<BoundingBox> CreateBoundingBoxes(
    return v;
 }
 
+bool IsInBoundingBox(const BoundingBox& bbox, double latitude, double longitude)
+{
+   return latitude >= bbox[0] && latitude <= bbox[2] && longitude >= bbox[1] && longitude <= bbox[3];
+}
+
 std::pair<double, double> GetBoundingBoxDimensionsKm(const BoundingBox& bbox)
 {
    // Convert degrees to radians
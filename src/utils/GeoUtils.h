@@ -37,6 +37,13 @@ BoundingBox CreateBoundingBox(double latitude, double longitude, std::uint32_t r
 std::vector<BoundingBox> CreateBoundingBoxes(
    double latitude, double longitude, std::uint32_t rangeMeters, std::uint32_t maxBoxWidth, std::uint32_t maxBoxHeight);
 
+// Checks if a point is inside a bounding box, including its borders
+// @param bbox Bounding box as [minLat, minLon, maxLat, maxLon]
+// @param latitude Latitude of the point in degrees
+// @param longitude Longitude of the point in degrees
+// @return true if the point is inside the box
+bool IsInBoundingBox(const BoundingBox& bbox, double latitude, double longitude);
+
 // Calculates the width and height of a bounding box in kilometers
 // @param bbox Bounding box with min/max latitudes and longitudes in degrees
 // @return Pair<double, double> containing width (longitude distance) and height (latitude distance) in kilometers
@@ -0,0 +1,47 @@
+#include "JsonArena.h"
+
+namespace
+{
+
+// Arena of the current thread, created on the first parse
+thread_local std::unique_ptr<geo::JsonArena> t_arena;
+
+}  // namespace
+
+namespace geo
+{
+
+JsonArena::JsonArena()
+   : m_valueBuffer(std::make_unique<char[]>(sc_valueBufferSize))
+   , m_stackBuffer(std::make_unique<char[]>(sc_stackBufferSize))
+   , m_valueAllocator(m_valueBuffer.get(), sc_valueBufferSize)
+   , m_stackAllocator(m_stackBuffer.get(), sc_stackBufferSize)
+{
+}
+
+JsonArena::Lease::Lease()
+{
+   if (!t_arena)
+      t_arena = std::make_unique<JsonArena>();
+
+   if (t_arena->m_leased)
+   {
+      m_ownArena = std::make_unique<JsonArena>();
+      m_arena = m_ownArena.get();
+   }
+   else
+   {
+      m_arena = t_arena.get();
+   }
+   m_arena->m_leased = true;
+}
+
+JsonArena::Lease::~Lease()
+{
+   // Chunks which spilled over to the heap are freed, the preallocated buffers are kept for the next parse
+   m_arena->m_valueAllocator.Clear();
+   m_arena->m_stackAllocator.Clear();
+   m_arena->m_leased = false;
+}
+
+}  // namespace geo
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <rapidjson/document.h>
+#include <rapidjson/reader.h>
+
+#include <cstddef>
+#include <memory>
+
+namespace geo
+{
+
+using JsonAllocator = rapidjson::MemoryPoolAllocator<rapidjson::CrtAllocator>;  // Allocator of arena documents
+using JsonDocument = rapidjson::GenericDocument<rapidjson::UTF8<>, JsonAllocator, JsonAllocator>;  // Arena document
+using JsonReader = rapidjson::GenericReader<rapidjson::UTF8<>, rapidjson::UTF8<>, JsonAllocator>;  // Arena SAX reader
+
+// Per-thread memory for parsing JSON responses.
+// Values and the parse stack are allocated from preallocated buffers, which are reused by the next parse on the same
+// thread, so parsing of a typical response makes no heap allocations. Bigger documents spill over to the heap.
+class JsonArena
+{
+public:
+   static const std::size_t sc_valueBufferSize = 256 * 1024;  // Size of the preallocated buffer for values
+   static const std::size_t sc_stackBufferSize = 16 * 1024;   // Size of the preallocated buffer for the parse stack
+
+   // Exclusive use of the arena of the current thread. The arena is cleared when the lease is destroyed,
+   // so documents allocated from it must be destroyed before. If the arena of the thread is already leased
+   // (nested parsing), the lease uses a temporary arena.
+   class Lease
+   {
+   public:
+      Lease();
+      ~Lease();
+
+      Lease(const Lease&) = delete;
+      Lease& operator=(const Lease&) = delete;
+
+      // Allocator for values of documents
+      JsonAllocator& GetValueAllocator() { return m_arena->m_valueAllocator; }
+
+      // Allocator for the parse stack of documents and SAX readers
+      JsonAllocator& GetStackAllocator() { return m_arena->m_stackAllocator; }
+
+      // Creates a document allocating from the arena
+      JsonDocument CreateDocument()
+      {
+         return JsonDocument(&GetValueAllocator(), sc_stackCapacity, &GetStackAllocator());
+      }
+
+      // Creates a SAX reader allocating its stack from the arena
+      JsonReader CreateReader() { return JsonReader(&GetStackAllocator(), sc_stackCapacity); }
+
+   private:
+      static const std::size_t sc_stackCapacity = 1024;  // Initial capacity of the parse stack
+
+      std::unique_ptr<JsonArena> m_ownArena;  // Temporary arena used for nested parsing
+      JsonArena* m_arena = nullptr;           // Leased arena
+   };
+
+public:
+   JsonArena();
+
+   JsonArena(const JsonArena&) = delete;
+   JsonArena& operator=(const JsonArena&) = delete;
+
+private:
+   std::unique_ptr<char[]> m_valueBuffer;  // Preallocated memory for values
+   std::unique_ptr<char[]> m_stackBuffer;  // Preallocated memory for the parse stack
+   JsonAllocator m_valueAllocator;         // Allocator of values using m_valueBuffer first
+   JsonAllocator m_stackAllocator;         // Allocator of the parse stack using m_stackBuffer first
+   bool m_leased = false;                  // True while the arena is leased
+};
+
+}  // namespace geo
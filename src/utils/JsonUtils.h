@@ -9,13 +9,34 @@
 namespace geo::json
 {
 
+// Traits of rapidjson values and documents with any allocator (e.g. values allocated from a JsonArena).
+// ValueType is the type of nested values of a value or a document.
+template <typename T>
+struct ValueTraits
+{
+   static constexpr bool sc_isJson = false;
+};
+
+template <typename TEncoding, typename TAllocator>
+struct ValueTraits<rapidjson::GenericValue<TEncoding, TAllocator>>
+{
+   static constexpr bool sc_isJson = true;
+   using ValueType = rapidjson::GenericValue<TEncoding, TAllocator>;
+};
+
+template <typename TEncoding, typename TAllocator, typename TStackAllocator>
+struct ValueTraits<rapidjson::GenericDocument<TEncoding, TAllocator, TStackAllocator>>
+{
+   static constexpr bool sc_isJson = true;
+   using ValueType = rapidjson::GenericValue<TEncoding, TAllocator>;
+};
+
 // Base case for the Get function: returns the JSON value itself.
 // Used when no additional keys are provided to traverse the JSON structure.
 template <typename TJsonValue>
-const rapidjson::Value& Get(const TJsonValue& v)
+const typename ValueTraits<TJsonValue>::ValueType& Get(const TJsonValue& v)
 {
-   static_assert(std::is_same_v<TJsonValue, rapidjson::Value> || std::is_same_v<TJsonValue, rapidjson::Document>,
-      "Get function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(ValueTraits<TJsonValue>::sc_isJson, "Get function only supports rapidjson values and documents");
    return v;
 }
 
@@ -25,10 +46,9 @@ const rapidjson::Value& Get(const TJsonValue& v)
 // This overload is enabled only if the key type `T` is `const char*`.
 template <typename TJsonValue, typename T, typename... TArgs,
    typename = typename std::enable_if<std::is_same_v<T, const char*>>::type>
-const rapidjson::Value& Get(const TJsonValue& v, T t, TArgs... args)
+const typename ValueTraits<TJsonValue>::ValueType& Get(const TJsonValue& v, T t, TArgs... args)
 {
-   static_assert(std::is_same_v<TJsonValue, rapidjson::Value> || std::is_same_v<TJsonValue, rapidjson::Document>,
-      "Get function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(ValueTraits<TJsonValue>::sc_isJson, "Get function only supports rapidjson values and documents");
    return Get(v[t], args...);
 }
 
@@ -36,8 +56,7 @@ const rapidjson::Value& Get(const TJsonValue& v, T t, TArgs... args)
 template <typename TJsonValue>
 bool Has(const TJsonValue& v)
 {
-   static_assert(std::is_same_v<TJsonValue, rapidjson::Value> || std::is_same_v<TJsonValue, rapidjson::Document>,
-      "Has function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(ValueTraits<TJsonValue>::sc_isJson, "Has function only supports rapidjson values and documents");
    return !v.IsNull();
 }
 
@@ -48,8 +67,7 @@ template <typename TJsonValue, typename T, typename... TArgs,
    typename = typename std::enable_if<std::is_same_v<T, const char*>>::type>
 bool Has(const TJsonValue& v, T t, TArgs... args)
 {
-   static_assert(std::is_same_v<TJsonValue, rapidjson::Value> || std::is_same_v<TJsonValue, rapidjson::Document>,
-      "Has function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(ValueTraits<TJsonValue>::sc_isJson, "Has function only supports rapidjson values and documents");
    if (!v.IsObject() || !v.HasMember(t))
       return false;
    return Has(v[t], args...);
@@ -61,8 +79,7 @@ bool Has(const TJsonValue& v, T t, TArgs... args)
 template <typename JsonValue>
 std::string_view GetString(const JsonValue& v)
 {
-   static_assert(std::is_same_v<JsonValue, rapidjson::Value> || std::is_same_v<JsonValue, rapidjson::Document>,
-      "GetString function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(ValueTraits<JsonValue>::sc_isJson, "GetString function only supports rapidjson values and documents");
    return v.IsNull() ? "" : v.GetString();
 }
 
@@ -72,8 +89,7 @@ std::string_view GetString(const JsonValue& v)
 template <typename JsonValue>
 double GetDouble(const JsonValue& v)
 {
-   static_assert(std::is_same_v<JsonValue, rapidjson::Value> || std::is_same_v<JsonValue, rapidjson::Document>,
-      "GetDouble function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(ValueTraits<JsonValue>::sc_isJson, "GetDouble function only supports rapidjson values and documents");
    return v.IsNull() ? 0 : v.GetDouble();
 }
 
@@ -83,8 +99,7 @@ double GetDouble(const JsonValue& v)
 template <typename JsonValue>
 std::int64_t GetInt64(const JsonValue& v)
 {
-   static_assert(std::is_same_v<JsonValue, rapidjson::Value> || std::is_same_v<JsonValue, rapidjson::Document>,
-      "GetInt64 function only supports rapidjson::Value and rapidjson::Document");
+   static_assert(ValueTraits<JsonValue>::sc_isJson, "GetInt64 function only supports rapidjson values and documents");
    return v.IsNull() ? 0 : v.GetInt64();
 }
 
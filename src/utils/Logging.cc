@@ -0,0 +1,227 @@
+#include "Logging.h"
+
+#include <absl/log/globals.h>
+#include <absl/log/log_sink_registry.h>
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <iterator>
+
+namespace geo
+{
+
+AsyncLogSink::AsyncLogSink(absl::LogSeverityAtLeast threshold, std::size_t capacity, std::FILE* output)
+   : m_threshold(threshold)
+   , m_stderrThreshold(absl::StderrThreshold())
+   , m_output(output)
+   , m_mask(std::bit_ceil(std::max<std::size_t>(capacity, 2)) - 1)
+   , m_slots(std::make_unique<Slot[]>(m_mask + 1))
+   , m_droppedMessages(MetricsRegistry::GetDefault().GetCounter(
+        "geo_log_dropped_total", "Log messages dropped because the writer fell behind"))
+{
+   for (std::size_t i = 0; i <= m_mask; ++i)
+      m_slots[i].sequence.store(i, std::memory_order_relaxed);
+
+   m_writer = std::thread(&AsyncLogSink::runWriter, this);
+   absl::AddLogSink(this);
+   absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfinity);
+}
+
+AsyncLogSink::~AsyncLogSink()
+{
+   absl::SetStderrThreshold(m_stderrThreshold);
+   absl::RemoveLogSink(this);
+
+   m_stopping.store(true, std::memory_order_relaxed);
+   m_signal.fetch_add(1, std::memory_order_release);
+   m_signal.notify_one();
+   m_writer.join();
+}
+
+void AsyncLogSink::Send(const absl::LogEntry& entry)
+{
+   if (static_cast<int>(entry.log_severity()) < static_cast<int>(m_threshold))
+      return;
+
+   // Reserves a free slot (Vyukov's bounded queue); a message is dropped rather than waiting for a slot
+   std::uint64_t pos = m_enqueuePos.load(std::memory_order_relaxed);
+   Slot* slot = nullptr;
+   while (true)
+   {
+      slot = &m_slots[pos & m_mask];
+      const auto sequence = slot->sequence.load(std::memory_order_acquire);
+      if (sequence == pos)
+      {
+         if (m_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            break;
+      }
+      else if (sequence < pos)
+      {
+         m_numDropped.fetch_add(1, std::memory_order_relaxed);
+         m_droppedMessages.Increment();
+         return;
+      }
+      else
+      {
+         pos = m_enqueuePos.load(std::memory_order_relaxed);
+      }
+   }
+
+   const std::string_view text = entry.text_message_with_prefix_and_newline();
+   if (text.size() <= sc_maxMessageSize)
+   {
+      slot->text.assign(text);
+   }
+   else
+   {
+      slot->text.assign(text.substr(0, sc_maxMessageSize));
+      std::format_to(std::back_inserter(slot->text), "... ({} bytes)\n", text.size());
+   }
+   slot->sequence.store(pos + 1, std::memory_order_release);
+
+   m_signal.fetch_add(1, std::memory_order_release);
+   m_signal.notify_one();
+
+   if (entry.log_severity() == absl::LogSeverity::kFatal)
+      Flush();
+}
+
+void AsyncLogSink::Flush()
+{
+   if (std::this_thread::get_id() == m_writer.get_id())
+      return;
+
+   const auto target = m_enqueuePos.load(std::memory_order_relaxed);
+   for (auto numWritten = m_numWritten.load(std::memory_order_acquire); numWritten < target;
+        numWritten = m_numWritten.load(std::memory_order_acquire))
+      m_numWritten.wait(numWritten, std::memory_order_acquire);
+}
+
+void AsyncLogSink::runWriter()
+{
+   while (true)
+   {
+      const auto signal = m_signal.load(std::memory_order_acquire);
+      if (writeQueued())
+         continue;
+      if (m_stopping.load(std::memory_order_relaxed) &&
+          m_numWritten.load(std::memory_order_relaxed) == m_enqueuePos.load(std::memory_order_relaxed))
+         break;
+      m_signal.wait(signal, std::memory_order_acquire);
+   }
+}
+
+bool AsyncLogSink::writeQueued()
+{
+   auto pos = m_numWritten.load(std::memory_order_relaxed);
+   const auto start = pos;
+   while (true)
+   {
+      Slot& slot = m_slots[pos & m_mask];
+      if (slot.sequence.load(std::memory_order_acquire) != pos + 1)
+         break;
+      std::fwrite(slot.text.data(), 1, slot.text.size(), m_output);
+      slot.sequence.store(pos + m_mask + 1, std::memory_order_release);
+      ++pos;
+   }
+
+   const auto numDropped = m_numDropped.load(std::memory_order_relaxed);
+   if (numDropped != m_numReportedDropped)
+   {
+      const auto message = std::format("{} log messages dropped, the log queue is full\n",
+         numDropped - m_numReportedDropped);
+      std::fwrite(message.data(), 1, message.size(), m_output);
+      m_numReportedDropped = numDropped;
+   }
+   else if (pos == start)
+   {
+      return false;
+   }
+
+   std::fflush(m_output);
+   m_numWritten.store(pos, std::memory_order_release);
+   m_numWritten.notify_all();
+   return true;
+}
+
+LogRateLimiter::LogRateLimiter(std::uint32_t maxPerSecond)
+   : m_maxPerSecond(maxPerSecond)
+   , m_suppressed(MetricsRegistry::GetDefault().GetCounter(
+        "geo_log_suppressed_total", "Log messages suppressed by rate limits of call sites"))
+{
+}
+
+bool LogRateLimiter::Acquire()
+{
+   const auto now = std::chrono::steady_clock::now().time_since_epoch();
+   const auto second = static_cast<std::uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(now).count());
+
+   auto state = m_state.load(std::memory_order_relaxed);
+   while (true)
+   {
+      std::uint64_t next = 0;
+      if (static_cast<std::uint32_t>(state >> 32) != second)
+         next = (static_cast<std::uint64_t>(second) << 32) | 1;
+      else if (static_cast<std::uint32_t>(state) < m_maxPerSecond)
+         next = state + 1;
+      else
+      {
+         m_suppressed.Increment();
+         return false;
+      }
+
+      if (m_state.compare_exchange_weak(state, next, std::memory_order_relaxed))
+         return true;
+   }
+}
+
+LogFields::LogFields(std::string_view event)
+{
+   appendField("event", event);
+}
+
+LogFields& LogFields::AddBody(std::string_view key, std::string_view body)
+{
+   Add(std::format("{}_bytes", key), body.size());
+   if (body.size() <= sc_maxBodySize)
+      appendField(key, body);
+   else
+      appendField(key, std::format("{}...", body.substr(0, sc_maxBodySize)));
+   return *this;
+}
+
+void LogFields::appendField(std::string_view key, std::string_view value)
+{
+   if (!m_text.empty())
+      m_text += ' ';
+   m_text.append(key);
+   m_text += '=';
+
+   const bool needQuotes = value.empty() || value.find_first_of(" \"=\\\n\r\t") != std::string_view::npos;
+   if (!needQuotes)
+   {
+      m_text.append(value);
+      return;
+   }
+
+   m_text += '"';
+   for (const char c : value)
+   {
+      if (c == '\n')
+         m_text += "\\n";
+      else if (c == '\r')
+         m_text += "\\r";
+      else if (c == '\t')
+         m_text += "\\t";
+      else
+      {
+         if (c == '\\' || c == '"')
+            m_text += '\\';
+         m_text += c;
+      }
+   }
+   m_text += '"';
+}
+
+}  // namespace geo
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "Metrics.h"
+
+#include <absl/base/log_severity.h>
+#include <absl/log/log_entry.h>
+#include <absl/log/log_sink.h>
+
+#include <atomic>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Logs a message like LOG(severity), but at most maxPerSecond times per second from this call site.
+// Suppressed messages are not formatted, they are counted in the geo_log_suppressed_total metric.
+// @param maxPerSecond Compile-time constant
+#define GEO_LOG_RATE_LIMITED(severity, maxPerSecond)               \
+   LOG_IF(severity, ([]                                            \
+      {                                                            \
+         static ::geo::LogRateLimiter s_rateLimiter(maxPerSecond); \
+         return s_rateLimiter.Acquire();                           \
+      }()))
+
+namespace geo
+{
+
+// Log sink which takes messages off the calling threads: absl LOG formats a message on the calling thread, the sink
+// copies it into a bounded lock-free ring buffer, and a background thread writes the queued messages in batches.
+// While the sink exists, it replaces the synchronous output of absl to stderr. If the writer falls behind and the
+// buffer is full, messages are dropped rather than blocking an RPC; the number of dropped messages is written
+// once there is room again and counted in the geo_log_dropped_total metric.
+class AsyncLogSink : public absl::LogSink
+{
+public:
+   static const std::size_t sc_defaultCapacity = 4096;  // Messages which may wait for the writer
+   static const std::size_t sc_maxMessageSize = 16384;  // Longer messages are truncated
+
+   // Constructor registering the sink and starting the writer thread
+   // @param threshold Messages of lower severity are ignored
+   // @param capacity Number of messages which may wait for the writer, rounded up to a power of two
+   // @param output File receiving the messages
+   explicit AsyncLogSink(absl::LogSeverityAtLeast threshold = absl::LogSeverityAtLeast::kInfo,
+      std::size_t capacity = sc_defaultCapacity, std::FILE* output = stderr);
+
+   // Destructor unregistering the sink, writing the queued messages and restoring the stderr output of absl
+   ~AsyncLogSink() override;
+
+   AsyncLogSink(const AsyncLogSink&) = delete;
+   AsyncLogSink& operator=(const AsyncLogSink&) = delete;
+
+   // Queues a message; fatal messages are written before returning, since the process is aborted next
+   void Send(const absl::LogEntry& entry) override;
+
+   // Waits until the messages queued before the call are written
+   void Flush() override;
+
+private:
+   // Slot of the ring buffer. Its sequence tells whether the slot is free for the given enqueue position
+   // (sequence == position) or holds the message of the position (sequence == position + 1).
+   struct Slot
+   {
+      std::atomic<std::uint64_t> sequence{0};
+      std::string text;  // Keeps its capacity, so queueing a message rarely allocates
+   };
+
+private:
+   // Writes queued messages until the sink is destroyed
+   void runWriter();
+
+   // Writes the messages queued up to now
+   // @return True if anything is written
+   bool writeQueued();
+
+private:
+   const absl::LogSeverityAtLeast m_threshold;              // Minimal severity of written messages
+   const absl::LogSeverityAtLeast m_stderrThreshold;        // Stderr threshold of absl before the sink is registered
+   std::FILE* const m_output;                               // File receiving the messages
+   const std::size_t m_mask;                                // Capacity of the ring buffer - 1
+   std::unique_ptr<Slot[]> m_slots;                         // Ring buffer of messages
+   alignas(64) std::atomic<std::uint64_t> m_enqueuePos{0};  // Next position reserved by a sending thread
+   alignas(64) std::atomic<std::uint64_t> m_numWritten{0};  // Number of written messages, i.e. next dequeue position
+   std::atomic<std::uint32_t> m_signal{0};                  // Changed to wake up the writer
+   std::atomic<std::uint64_t> m_numDropped{0};              // Number of messages dropped because the buffer was full
+   std::uint64_t m_numReportedDropped = 0;                  // Dropped messages reported by the writer thread
+   std::atomic<bool> m_stopping{false};                     // Set when the sink is destroyed
+   MetricsRegistry::Counter& m_droppedMessages;             // Counts dropped messages
+   std::thread m_writer;                                    // Writes queued messages
+};
+
+// Limits the number of messages logged from a call site, see GEO_LOG_RATE_LIMITED
+class LogRateLimiter
+{
+public:
+   // @param maxPerSecond Number of messages allowed in every second
+   explicit LogRateLimiter(std::uint32_t maxPerSecond);
+
+   // Returns true if a message may be logged now. Lock-free.
+   bool Acquire();
+
+private:
+   const std::uint32_t m_maxPerSecond;      // Number of messages allowed in every second
+   std::atomic<std::uint64_t> m_state{0};   // Current second (high 32 bits) and messages logged in it (low 32 bits)
+   MetricsRegistry::Counter& m_suppressed;  // Counts suppressed messages
+};
+
+// Log message of key=value fields (logfmt), which is easy to filter and parse, e.g.
+// LOG(INFO) << LogFields("http_finished").Add("method", "GET").Add("url", url).AddBody("response", response);
+// gives: event=http_finished method=GET url=https://... response_bytes=12345 response="[{\"place_id\":..."
+class LogFields
+{
+public:
+   static const std::size_t sc_maxBodySize = 512;  // Logged part of a request or response body
+
+   // @param event Name of the logged event
+   explicit LogFields(std::string_view event);
+
+   // Adds a field, quoting the value if it contains spaces, quotes or line breaks
+   // @param key Field name
+   // @param value Value of any type which std::format can format
+   template <typename TValue>
+   LogFields& Add(std::string_view key, const TValue& value)
+   {
+      if constexpr (std::convertible_to<const TValue&, std::string_view>)
+         appendField(key, std::string_view(value));
+      else
+         appendField(key, std::format("{}", value));
+      return *this;
+   }
+
+   // Adds the size of a body (as "<key>_bytes") and its first sc_maxBodySize bytes
+   LogFields& AddBody(std::string_view key, std::string_view body);
+
+   // Returns the formatted fields
+   const std::string& Get() const { return m_text; }
+
+   friend std::ostream& operator<<(std::ostream& stream, const LogFields& fields) { return stream << fields.m_text; }
+
+private:
+   void appendField(std::string_view key, std::string_view value);
+
+private:
+   std::string m_text;  // Formatted fields
+};
+
+}  // namespace geo
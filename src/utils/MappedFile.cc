@@ -0,0 +1,51 @@
+#include "MappedFile.h"
+
+#include <absl/log/log.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <format>
+#include <stdexcept>
+
+namespace geo
+{
+
+MappedFile::MappedFile(const std::string& path)
+{
+   const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+   if (fd < 0)
+   {
+      LOG(ERROR) << std::format("Failed to open file: {}", path);
+      throw std::runtime_error("Failed to open file: " + path);
+   }
+
+   struct stat info = {};
+   if (::fstat(fd, &info) != 0 || info.st_size == 0)
+   {
+      ::close(fd);
+      LOG(ERROR) << std::format("Failed to get size of file or file is empty: {}", path);
+      throw std::runtime_error("Failed to get size of file or file is empty: " + path);
+   }
+
+   // The mapping stays valid after the descriptor is closed.
+   void* data = ::mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+   ::close(fd);
+   if (data == MAP_FAILED)
+   {
+      LOG(ERROR) << std::format("Failed to map file: {}", path);
+      throw std::runtime_error("Failed to map file: " + path);
+   }
+
+   m_data = static_cast<const char*>(data);
+   m_size = static_cast<std::size_t>(info.st_size);
+}
+
+MappedFile::~MappedFile()
+{
+   ::munmap(const_cast<char*>(m_data), m_size);
+}
+
+}  // namespace geo
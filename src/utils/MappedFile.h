@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace geo
+{
+
+// Read-only memory mapping of a whole file.
+// Pages are loaded by the OS on first access and shared by all processes mapping the same file,
+// so big indexes are opened instantly and cost no heap memory.
+class MappedFile
+{
+public:
+   // Maps the file, throws std::runtime_error if it cannot be opened or mapped
+   // @param path Path to the file
+   explicit MappedFile(const std::string& path);
+
+   // Unmaps the file
+   ~MappedFile();
+
+   MappedFile(const MappedFile&) = delete;
+   MappedFile& operator=(const MappedFile&) = delete;
+
+   // Returns pointer to the first byte of the file
+   const char* GetData() const { return m_data; }
+
+   // Returns size of the file in bytes
+   std::size_t GetSize() const { return m_size; }
+
+private:
+   const char* m_data = nullptr;  // Start of the mapping
+   std::size_t m_size = 0;        // Size of the mapping
+};
+
+}  // namespace geo
@@ -0,0 +1,289 @@
+#include "Metrics.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <bit>
+#include <format>
+#include <iterator>
+#include <stdexcept>
+
+namespace
+{
+
+// Returns the shard updated by the calling thread. Threads are assigned to shards round robin
+// when they record their first sample, so concurrent threads rarely share a cache line.
+std::size_t getShardIndex()
+{
+   static std::atomic<std::size_t> s_numThreads{0};
+   thread_local const std::size_t t_shardIndex =
+      s_numThreads.fetch_add(1, std::memory_order_relaxed) % geo::MetricsRegistry::sc_numShards;
+   return t_shardIndex;
+}
+
+// Appends label values in the exposition format, escaping backslashes, quotes and line breaks
+// @param labels Labels of the series
+// @param le Upper bound of a histogram bucket, not added if empty
+// @param output String receiving labels like {upstream="overpass",le="0.5"}
+void appendLabels(const geo::MetricLabels& labels, std::string_view le, std::string& output)
+{
+   if (labels.empty() && le.empty())
+      return;
+
+   output += '{';
+   bool first = true;
+   const auto appendLabel = [&](std::string_view name, std::string_view value)
+   {
+      if (!first)
+         output += ',';
+      first = false;
+      output.append(name);
+      output += "=\"";
+      for (const char c : value)
+      {
+         if (c == '\\' || c == '"')
+            output += '\\';
+         if (c == '\n')
+            output += "\\n";
+         else
+            output += c;
+      }
+      output += '"';
+   };
+   for (const auto& [name, value] : labels)
+      appendLabel(name, value);
+   if (!le.empty())
+      appendLabel("le", le);
+   output += '}';
+}
+
+}  // namespace
+
+namespace geo
+{
+
+void MetricsRegistry::Counter::Increment(std::uint64_t value)
+{
+   m_shards[getShardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+}
+
+std::uint64_t MetricsRegistry::Counter::Get() const
+{
+   std::uint64_t value = 0;
+   for (const auto& shard : m_shards)
+      value += shard.value.load(std::memory_order_relaxed);
+   return value;
+}
+
+void MetricsRegistry::Gauge::Add(std::int64_t value)
+{
+   m_shards[getShardIndex()].value.fetch_add(value, std::memory_order_relaxed);
+}
+
+std::int64_t MetricsRegistry::Gauge::Get() const
+{
+   std::int64_t value = 0;
+   for (const auto& shard : m_shards)
+      value += shard.value.load(std::memory_order_relaxed);
+   return value;
+}
+
+void MetricsRegistry::Histogram::Record(std::uint64_t value)
+{
+   auto& shard = m_shards[getShardIndex()];
+   shard.buckets[GetBucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+   shard.count.fetch_add(1, std::memory_order_relaxed);
+   shard.sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+MetricsRegistry::Histogram::Snapshot MetricsRegistry::Histogram::GetSnapshot() const
+{
+   Snapshot snapshot;
+   snapshot.buckets.resize(sc_numBuckets);
+   for (const auto& shard : m_shards)
+   {
+      for (std::size_t i = 0; i < sc_numBuckets; ++i)
+         snapshot.buckets[i] += shard.buckets[i].load(std::memory_order_relaxed);
+      snapshot.count += shard.count.load(std::memory_order_relaxed);
+      snapshot.sum += shard.sum.load(std::memory_order_relaxed);
+   }
+   return snapshot;
+}
+
+std::size_t MetricsRegistry::Histogram::GetBucketIndex(std::uint64_t value)
+{
+   if (value < (1u << sc_subBucketBits))
+      return static_cast<std::size_t>(value);
+
+   const auto exponent = static_cast<std::uint32_t>(std::bit_width(value) - 1);
+   if (exponent > sc_maxExponent)
+      return sc_numBuckets - 1;
+
+   // The highest bits below the leading one select the bucket within the power of two range
+   const auto subBucket = static_cast<std::size_t>(value >> (exponent - sc_subBucketBits)) - (1u << sc_subBucketBits);
+   return ((exponent - sc_subBucketBits + 1) << sc_subBucketBits) + subBucket;
+}
+
+std::uint64_t MetricsRegistry::Histogram::GetBucketLimit(std::size_t index)
+{
+   if (index < (1u << sc_subBucketBits))
+      return index + 1;
+
+   const auto exponent = static_cast<std::uint32_t>(index >> sc_subBucketBits) + sc_subBucketBits - 1;
+   const auto subBucket = static_cast<std::uint64_t>(index & ((1u << sc_subBucketBits) - 1));
+   return ((1u << sc_subBucketBits) + subBucket + 1) << (exponent - sc_subBucketBits);
+}
+
+std::uint64_t MetricsRegistry::Histogram::Snapshot::GetPercentile(double percentile) const
+{
+   if (count == 0)
+      return 0;
+
+   const auto rank = static_cast<std::uint64_t>(std::clamp(percentile, 0.0, 100.0) / 100 * (count - 1)) + 1;
+   std::uint64_t numSamples = 0;
+   for (std::size_t i = 0; i < buckets.size(); ++i)
+   {
+      numSamples += buckets[i];
+      if (numSamples >= rank)
+         return GetBucketLimit(i) - 1;
+   }
+   return GetBucketLimit(buckets.size() - 1) - 1;
+}
+
+MetricsRegistry::Counter& MetricsRegistry::GetCounter(
+   std::string_view name, std::string_view help, const MetricLabels& labels)
+{
+   std::lock_guard lock(m_mutex);
+   auto& series = getSeries(name, help, labels, Type::Counter, 1);
+   if (!series.counter)
+      series.counter = std::make_unique<Counter>();
+   return *series.counter;
+}
+
+MetricsRegistry::Gauge& MetricsRegistry::GetGauge(
+   std::string_view name, std::string_view help, const MetricLabels& labels)
+{
+   std::lock_guard lock(m_mutex);
+   auto& series = getSeries(name, help, labels, Type::Gauge, 1);
+   if (!series.gauge)
+      series.gauge = std::make_unique<Gauge>();
+   return *series.gauge;
+}
+
+MetricsRegistry::Histogram& MetricsRegistry::GetHistogram(
+   std::string_view name, std::string_view help, const MetricLabels& labels, double unit)
+{
+   std::lock_guard lock(m_mutex);
+   auto& series = getSeries(name, help, labels, Type::Histogram, unit);
+   if (!series.histogram)
+      series.histogram = std::make_unique<Histogram>();
+   return *series.histogram;
+}
+
+MetricsRegistry::Series& MetricsRegistry::getSeries(
+   std::string_view name, std::string_view help, const MetricLabels& labels, Type type, double unit)
+{
+   auto it = m_families.find(name);
+   if (it == m_families.end())
+   {
+      it = m_families.emplace(std::string(name), Family{}).first;
+      it->second.type = type;
+      it->second.help = help;
+      it->second.unit = unit;
+   }
+   else if (it->second.type != type)
+   {
+      LOG(ERROR) << std::format("Metric {} is already registered with another type", name);
+      throw std::runtime_error("Metric type mismatch: " + std::string(name));
+   }
+
+   auto& family = it->second;
+   const auto series = std::find_if(family.series.begin(), family.series.end(),
+      [&](const Series& s)
+      {
+         return s.labels == labels;
+      });
+   if (series != family.series.end())
+      return *series;
+   return family.series.emplace_back(Series{labels});
+}
+
+std::string MetricsRegistry::Format() const
+{
+   std::lock_guard lock(m_mutex);
+
+   std::string output;
+   for (const auto& [name, family] : m_families)
+   {
+      static const char* sc_typeNames[] = {"counter", "gauge", "histogram"};
+      std::format_to(std::back_inserter(output), "# HELP {} {}\n# TYPE {} {}\n", name, family.help, name,
+         sc_typeNames[static_cast<int>(family.type)]);
+
+      for (const auto& series : family.series)
+      {
+         switch (family.type)
+         {
+            case Type::Counter:
+            {
+               output += name;
+               appendLabels(series.labels, {}, output);
+               std::format_to(std::back_inserter(output), " {}\n", series.counter->Get());
+               break;
+            }
+            case Type::Gauge:
+            {
+               output += name;
+               appendLabels(series.labels, {}, output);
+               std::format_to(std::back_inserter(output), " {}\n", series.gauge->Get());
+               break;
+            }
+            case Type::Histogram:
+            {
+               // Cumulative buckets are exported at power of two limits only, which keeps the output short
+               const auto snapshot = series.histogram->GetSnapshot();
+               std::uint64_t numSamples = 0;
+               for (std::size_t i = 0; i + 1 < Histogram::sc_numBuckets; ++i)
+               {
+                  numSamples += snapshot.buckets[i];
+                  const auto limit = Histogram::GetBucketLimit(i);
+                  if (!std::has_single_bit(limit))
+                     continue;
+                  // Samples are integers, so the bucket holds values up to limit - 1
+                  const auto le = std::format("{:.15g}", static_cast<double>(limit - 1) * family.unit);
+                  output += name;
+                  output += "_bucket";
+                  appendLabels(series.labels, le, output);
+                  std::format_to(std::back_inserter(output), " {}\n", numSamples);
+               }
+               // Shards are read one by one while samples are recorded, so the count is taken from the buckets
+               numSamples += snapshot.buckets.back();
+               output += name;
+               output += "_bucket";
+               appendLabels(series.labels, "+Inf", output);
+               std::format_to(std::back_inserter(output), " {}\n", numSamples);
+
+               output += name;
+               output += "_sum";
+               appendLabels(series.labels, {}, output);
+               std::format_to(std::back_inserter(output), " {}\n", static_cast<double>(snapshot.sum) * family.unit);
+
+               output += name;
+               output += "_count";
+               appendLabels(series.labels, {}, output);
+               std::format_to(std::back_inserter(output), " {}\n", numSamples);
+               break;
+            }
+         }
+      }
+   }
+   return output;
+}
+
+MetricsRegistry& MetricsRegistry::GetDefault()
+{
+   // Never destroyed, so threads which outlive static destructors can still record samples
+   static auto* s_registry = new MetricsRegistry();
+   return *s_registry;
+}
+
+}  // namespace geo
@@ -0,0 +1,186 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace geo
+{
+
+using MetricLabels = std::vector<std::pair<std::string, std::string>>;  // Label names and values of a series
+
+// Process-wide registry of counters, gauges and histograms, exported in the Prometheus text format.
+// Series are registered once under a lock, and the returned references are updated without locks: every series
+// is split into cache-line aligned shards, and a thread only updates the shard it is assigned to, with relaxed
+// atomic operations. Recording a sample costs a few nanoseconds; reading sums up the shards.
+class MetricsRegistry
+{
+public:
+   static const std::size_t sc_numShards = 8;  // Number of shards of every series
+
+   // Monotonic counter
+   class Counter
+   {
+   public:
+      void Increment(std::uint64_t value = 1);
+      std::uint64_t Get() const;
+
+   private:
+      struct alignas(64) Shard
+      {
+         std::atomic<std::uint64_t> value{0};
+      };
+      std::array<Shard, sc_numShards> m_shards;  // Per-thread parts of the value
+   };
+
+   // Value which goes up and down, e.g. number of requests in flight
+   class Gauge
+   {
+   public:
+      void Add(std::int64_t value);
+      std::int64_t Get() const;
+
+   private:
+      struct alignas(64) Shard
+      {
+         std::atomic<std::int64_t> value{0};
+      };
+      std::array<Shard, sc_numShards> m_shards;  // Per-thread parts of the value
+   };
+
+   // Log-linear (HDR-style) histogram of non-negative integer samples, e.g. microseconds.
+   // Values up to 8 are counted exactly, every bigger power of two range is split into 8 buckets,
+   // so a value is known within 12.5% in the whole range.
+   class Histogram
+   {
+   public:
+      static const std::uint32_t sc_subBucketBits = 3;  // Every power of two range has 2^3 buckets
+      static const std::uint32_t sc_maxExponent = 40;   // Bigger values (2^41 and more) go to the last bucket
+      static const std::size_t sc_numBuckets = (sc_maxExponent - sc_subBucketBits + 2) << sc_subBucketBits;
+
+      // Samples recorded up to now
+      struct Snapshot
+      {
+         std::vector<std::uint64_t> buckets;  // Number of samples in every bucket
+         std::uint64_t count = 0;             // Number of samples
+         std::uint64_t sum = 0;               // Sum of samples
+
+         // Returns the upper bound of the bucket containing the given percentile (0-100), 0 if there are no samples
+         std::uint64_t GetPercentile(double percentile) const;
+      };
+
+   public:
+      void Record(std::uint64_t value);
+      Snapshot GetSnapshot() const;
+
+      // Returns the index of the bucket containing a value
+      static std::size_t GetBucketIndex(std::uint64_t value);
+
+      // Returns the smallest value above the given bucket
+      static std::uint64_t GetBucketLimit(std::size_t index);
+
+   private:
+      struct alignas(64) Shard
+      {
+         std::array<std::atomic<std::uint64_t>, sc_numBuckets> buckets{};
+         std::atomic<std::uint64_t> count{0};
+         std::atomic<std::uint64_t> sum{0};
+      };
+      std::array<Shard, sc_numShards> m_shards;  // Per-thread parts of the histogram
+   };
+
+public:
+   MetricsRegistry() = default;
+
+   MetricsRegistry(const MetricsRegistry&) = delete;
+   MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+   // Returns the counter with given name and labels, registering it on the first call.
+   // Throws std::runtime_error if the name is already registered with another type.
+   // @param name Metric name, e.g. "geo_rpc_total"
+   // @param help Description of the metric
+   // @param labels Label names and values of the series
+   Counter& GetCounter(std::string_view name, std::string_view help, const MetricLabels& labels = {});
+
+   // Returns the gauge with given name and labels, registering it on the first call
+   Gauge& GetGauge(std::string_view name, std::string_view help, const MetricLabels& labels = {});
+
+   // Returns the histogram with given name and labels, registering it on the first call
+   // @param unit Unit of recorded values in exported ones, e.g. 1e-6 for microseconds exported as seconds
+   Histogram& GetHistogram(
+      std::string_view name, std::string_view help, const MetricLabels& labels = {}, double unit = 1);
+
+   // Returns all the series in the Prometheus text exposition format
+   std::string Format() const;
+
+   // Returns the process-wide registry
+   static MetricsRegistry& GetDefault();
+
+private:
+   enum class Type
+   {
+      Counter,
+      Gauge,
+      Histogram,
+   };
+
+   // Series of a metric with given label values
+   struct Series
+   {
+      MetricLabels labels;
+      std::unique_ptr<Counter> counter;
+      std::unique_ptr<Gauge> gauge;
+      std::unique_ptr<Histogram> histogram;
+   };
+
+   // Metric with all its series
+   struct Family
+   {
+      Type type = Type::Counter;
+      std::string help;
+      double unit = 1;             // Unit of histogram values
+      std::vector<Series> series;  // Series in registration order
+   };
+
+private:
+   // Returns the series with given name and labels, adding an empty one if it is not registered
+   Series& getSeries(std::string_view name, std::string_view help, const MetricLabels& labels, Type type, double unit);
+
+private:
+   mutable std::mutex m_mutex;                             // Protects m_families, not the values of series
+   std::map<std::string, Family, std::less<>> m_families;  // Metrics by name
+};
+
+// Records the time from construction to destruction in a histogram, in microseconds
+class ScopedLatency
+{
+public:
+   explicit ScopedLatency(MetricsRegistry::Histogram& histogram)
+      : m_histogram(histogram)
+   {
+   }
+
+   ~ScopedLatency()
+   {
+      const auto elapsed = std::chrono::steady_clock::now() - m_start;
+      m_histogram.Record(std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count());
+   }
+
+   ScopedLatency(const ScopedLatency&) = delete;
+   ScopedLatency& operator=(const ScopedLatency&) = delete;
+
+private:
+   MetricsRegistry::Histogram& m_histogram;                                                 // Receives the time
+   const std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();  // Construction time
+};
+
+}  // namespace geo
@@ -0,0 +1,140 @@
+#include "MetricsServer.h"
+
+#include <absl/log/log.h>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace
+{
+
+const int sc_pollTimeoutMs = 200;            // Period of checking whether the server is stopped
+const int sc_receiveTimeoutS = 2;            // Connections which do not send a request in time are closed
+const std::size_t sc_maxRequestSize = 8192;  // Longer requests are not read to the end
+
+// Writes the whole buffer to a socket
+// @return false if the connection is broken
+bool sendAll(int fd, std::string_view data)
+{
+   while (!data.empty())
+   {
+      const auto sent = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+      if (sent <= 0)
+         return false;
+      data.remove_prefix(static_cast<std::size_t>(sent));
+   }
+   return true;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+MetricsServer::MetricsServer(const MetricsRegistry& registry, std::uint16_t port)
+   : m_registry(registry)
+{
+   m_listenFd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+   if (m_listenFd < 0)
+   {
+      LOG(ERROR) << "Failed to create metrics server socket";
+      throw std::runtime_error("Failed to create metrics server socket");
+   }
+
+   const int reuseAddress = 1;
+   ::setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &reuseAddress, sizeof(reuseAddress));
+
+   sockaddr_in address = {};
+   address.sin_family = AF_INET;
+   address.sin_addr.s_addr = htonl(INADDR_ANY);
+   address.sin_port = htons(port);
+   if (::bind(m_listenFd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+       ::listen(m_listenFd, SOMAXCONN) != 0)
+   {
+      ::close(m_listenFd);
+      LOG(ERROR) << std::format("Failed to listen on metrics port {}: {}", port, std::strerror(errno));
+      throw std::runtime_error(std::format("Failed to listen on metrics port {}", port));
+   }
+
+   m_thread = std::thread(&MetricsServer::run, this);
+   LOG(INFO) << std::format("Metrics are served on port {}", port);
+}
+
+MetricsServer::~MetricsServer()
+{
+   m_stop = true;
+   m_thread.join();
+   ::close(m_listenFd);
+}
+
+void MetricsServer::run()
+{
+   while (!m_stop)
+   {
+      pollfd listenPoll = {m_listenFd, POLLIN, 0};
+      if (::poll(&listenPoll, 1, sc_pollTimeoutMs) <= 0)
+         continue;
+
+      const int fd = ::accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+      if (fd < 0)
+         continue;
+
+      const timeval timeout = {sc_receiveTimeoutS, 0};
+      ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+      ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+      serve(fd);
+      ::close(fd);
+   }
+}
+
+void MetricsServer::serve(int fd) const
+{
+   // Only the request line matters, headers are read to keep clients from seeing a connection reset
+   std::string request;
+   char buffer[1024];
+   while (request.find("\r\n\r\n") == std::string::npos && request.size() < sc_maxRequestSize)
+   {
+      const auto received = ::recv(fd, buffer, sizeof(buffer), 0);
+      if (received <= 0)
+         return;
+      request.append(buffer, static_cast<std::size_t>(received));
+   }
+
+   const std::string_view line = std::string_view(request).substr(0, request.find("\r\n"));
+   const bool isGet = line.starts_with("GET ");
+   const auto path = isGet ? line.substr(4, line.find(' ', 4) - 4) : std::string_view();
+
+   std::string status = "200 OK";
+   std::string contentType = "text/plain; version=0.0.4; charset=utf-8";
+   std::string body;
+   if (!isGet)
+   {
+      status = "405 Method Not Allowed";
+      contentType = "text/plain";
+   }
+   else if (path == "/metrics" || path.starts_with("/metrics?") || path == "/")
+      body = m_registry.Format();
+   else
+   {
+      status = "404 Not Found";
+      contentType = "text/plain";
+   }
+
+   const std::string header = std::format(
+      "HTTP/1.1 {}\r\nContent-Type: {}\r\nContent-Length: {}\r\nConnection: close\r\n\r\n", status, contentType,
+      body.size());
+   if (sendAll(fd, header))
+      sendAll(fd, body);
+}
+
+}  // namespace geo
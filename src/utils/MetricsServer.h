@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Metrics.h"
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+namespace geo
+{
+
+// Minimal HTTP server exposing a metrics registry to Prometheus: GET /metrics returns all the series
+// in the text exposition format. Scrapes are served one by one on a dedicated thread, so they never compete
+// with RPCs for executor or event loop threads.
+class MetricsServer
+{
+public:
+   // Constructor starting to listen on all interfaces, throws std::runtime_error if the port cannot be bound
+   // @param registry Registry which is exposed, must outlive the server
+   // @param port TCP port of the endpoint
+   MetricsServer(const MetricsRegistry& registry, std::uint16_t port);
+
+   // Destructor stops the server thread
+   ~MetricsServer();
+
+   MetricsServer(const MetricsServer&) = delete;
+   MetricsServer& operator=(const MetricsServer&) = delete;
+
+private:
+   // Body of the server thread, accepts connections until the server is stopped
+   void run();
+
+   // Reads a request from an accepted connection and writes the response
+   // @param fd Socket of the connection, closed by the caller
+   void serve(int fd) const;
+
+private:
+   const MetricsRegistry& m_registry;  // Registry which is exposed
+   int m_listenFd = -1;                // Listening socket
+   std::atomic<bool> m_stop{false};    // Set when the server thread has to exit
+   std::thread m_thread;               // Server thread
+};
+
+}  // namespace geo
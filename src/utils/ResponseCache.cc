@@ -0,0 +1,659 @@
+#include "ResponseCache.h"
+
+#include <absl/log/log.h>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <iterator>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+
+namespace
+{
+
+constexpr char sz_logMagic[8] = {'G', 'E', 'O', 'C', 'A', 'C', 'H', 'E'};     // First bytes of the log file
+constexpr char sz_indexMagic[8] = {'G', 'E', 'O', 'C', 'I', 'D', 'X', '\0'};  // First bytes of the index file
+constexpr std::uint32_t sc_version = 1;                                       // Version of the file layouts
+
+constexpr const char* sz_logFileName = "responses.log";
+constexpr const char* sz_indexFileName = "responses.idx";
+
+constexpr std::uint64_t sc_maxRecordSize = 1ull << 32;  // Records are never bigger, keySize and valueSize are 32-bit
+constexpr std::size_t sc_maxPendingBytes = 256 << 20;   // Responses waiting to be written, further ones are dropped
+
+// FNV-1a hash, which is stable between processes unlike std::hash
+// @param data Data to hash
+// @param hash Hash of the preceding data
+std::uint64_t hashBytes(std::string_view data, std::uint64_t hash = 14695981039346656037ull)
+{
+   for (const char c : data)
+   {
+      hash ^= static_cast<unsigned char>(c);
+      hash *= 1099511628211ull;
+   }
+   return hash;
+}
+
+// Rounds a record size up to the alignment of records
+std::uint64_t alignOffset(std::uint64_t offset)
+{
+   return (offset + 7) / 8 * 8;
+}
+
+// Returns current time in seconds since the epoch, stored in records as it survives restarts
+std::int64_t getUnixTime()
+{
+   return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch())
+      .count();
+}
+
+// Returns a new random generation of the log
+std::uint64_t makeGeneration()
+{
+   std::random_device random;
+   return (std::uint64_t{random()} << 32) | random();
+}
+
+// Reads exactly `size` bytes at `offset`
+// @return false on error or at the end of the file
+bool readAt(int fd, void* data, std::size_t size, std::uint64_t offset)
+{
+   auto* bytes = static_cast<char*>(data);
+   while (size > 0)
+   {
+      const ssize_t result = ::pread(fd, bytes, size, static_cast<off_t>(offset));
+      if (result <= 0)
+         return false;
+      bytes += result;
+      size -= static_cast<std::size_t>(result);
+      offset += static_cast<std::uint64_t>(result);
+   }
+   return true;
+}
+
+// Writes exactly `size` bytes at `offset`
+// @return false on error
+bool writeAt(int fd, const void* data, std::size_t size, std::uint64_t offset)
+{
+   const auto* bytes = static_cast<const char*>(data);
+   while (size > 0)
+   {
+      const ssize_t result = ::pwrite(fd, bytes, size, static_cast<off_t>(offset));
+      if (result <= 0)
+         return false;
+      bytes += result;
+      size -= static_cast<std::size_t>(result);
+      offset += static_cast<std::uint64_t>(result);
+   }
+   return true;
+}
+
+// Copies `size` bytes between files
+// @return false on error
+bool copyRange(int sourceFd, std::uint64_t sourceOffset, int targetFd, std::uint64_t targetOffset, std::uint64_t size)
+{
+   std::string buffer(std::min<std::uint64_t>(size, 1 << 20), '\0');
+   while (size > 0)
+   {
+      const std::size_t chunk = std::min<std::uint64_t>(size, buffer.size());
+      if (!readAt(sourceFd, buffer.data(), chunk, sourceOffset) ||
+         !writeAt(targetFd, buffer.data(), chunk, targetOffset))
+         return false;
+      sourceOffset += chunk;
+      targetOffset += chunk;
+      size -= chunk;
+   }
+   return true;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+double ResponseCache::Statistics::GetHitRatio() const
+{
+   const std::uint64_t numLookups = numHits + numMisses;
+   return numLookups == 0 ? 0 : static_cast<double>(numHits) / static_cast<double>(numLookups);
+}
+
+ResponseCache::LogFile::LogFile(int fd)
+   : fd(fd)
+{
+}
+
+ResponseCache::LogFile::~LogFile()
+{
+   if (fd >= 0)
+      ::close(fd);
+}
+
+ResponseCache::ResponseCache(const Settings& settings)
+   : m_settings(settings)
+   , m_logPath((std::filesystem::path(settings.directory) / sz_logFileName).string())
+   , m_indexPath((std::filesystem::path(settings.directory) / sz_indexFileName).string())
+{
+   std::error_code error;
+   std::filesystem::create_directories(m_settings.directory, error);
+
+   m_log = std::make_shared<LogFile>(::open(m_logPath.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644));
+   const int logFd = m_log->fd;
+   struct stat info = {};
+   if (logFd < 0 || ::fstat(logFd, &info) != 0)
+   {
+      LOG(ERROR) << std::format("Failed to open response cache: {}", m_logPath);
+      throw std::runtime_error("Failed to open response cache: " + m_logPath);
+   }
+
+   LogHeader header{};
+   const bool isValid = readAt(logFd, &header, sizeof(header), 0) &&
+      std::memcmp(header.magic, sz_logMagic, sizeof(sz_logMagic)) == 0 && header.version == sc_version;
+   if (isValid)
+   {
+      m_generation = header.generation;
+      readLog(loadIndex(), static_cast<std::uint64_t>(info.st_size));
+   }
+   else
+   {
+      if (info.st_size != 0)
+         LOG(WARNING) << std::format("Response cache {} has unknown format, it is cleared", m_logPath);
+
+      header = {};
+      std::copy(std::begin(sz_logMagic), std::end(sz_logMagic), header.magic);
+      header.version = sc_version;
+      header.generation = m_generation = makeGeneration();
+      if (::ftruncate(logFd, 0) != 0 || !writeAt(logFd, &header, sizeof(header), 0))
+      {
+         LOG(ERROR) << std::format("Failed to initialize response cache: {}", m_logPath);
+         throw std::runtime_error("Failed to initialize response cache: " + m_logPath);
+      }
+      m_logSize = sizeof(header);
+   }
+
+   LOG(INFO) << std::format("Opened response cache {}: {} responses, {} bytes, {} records not indexed", m_logPath,
+      m_numEntries, m_logSize, m_recent.size());
+
+   m_thread = std::thread(&ResponseCache::run, this);
+   m_writer = std::thread(&ResponseCache::runWriter, this);
+}
+
+ResponseCache::~ResponseCache()
+{
+   // Queued responses are written before the index
+   {
+      std::lock_guard lock(m_writeMutex);
+      m_stopWriter = true;
+   }
+   m_writeReady.notify_one();
+   m_writer.join();
+
+   {
+      std::lock_guard lock(m_mutex);
+      m_stop = true;
+   }
+   m_wakeUp.notify_one();
+   m_thread.join();
+
+   if (!m_recent.empty())
+      writeIndex();
+
+   const auto stats = GetStatistics();
+   LOG(INFO) << std::format("Response cache {}: {} hits, {} misses, hit ratio {:.2f}, {} writes, {} dropped writes, "
+                            "{} invalid responses, {} compactions, {} responses, {} bytes",
+      m_logPath, stats.numHits, stats.numMisses, stats.GetHitRatio(), stats.numWrites, stats.numDroppedWrites,
+      stats.numInvalid, stats.numCompactions, stats.numEntries, stats.logSizeBytes);
+}
+
+bool ResponseCache::Find(const std::string& key, std::string& response)
+{
+   const std::uint64_t keyHash = hashBytes(key);
+
+   IndexEntry entry{};
+   std::shared_ptr<const LogFile> log;
+   {
+      std::lock_guard lock(m_mutex);
+      const IndexEntry* found = findEntry(keyHash);
+      if (!found || found->timestamp + m_settings.ttl.count() < getUnixTime())
+      {
+         ++m_numMisses;
+         return false;
+      }
+      entry = *found;
+      log = m_log;
+   }
+
+   // Indexed records are never modified, so they are read without the lock.
+   // Keys are compared as different keys may have the same hash.
+   RecordHeader header{};
+   std::string storedKey(key.size(), '\0');
+   bool isFound = readAt(log->fd, &header, sizeof(header), entry.offset) && header.keySize == key.size() &&
+      readAt(log->fd, storedKey.data(), storedKey.size(), entry.offset + sizeof(header)) && storedKey == key;
+   if (isFound)
+   {
+      response.resize(header.valueSize);
+      isFound = readAt(log->fd, response.data(), response.size(), entry.offset + sizeof(header) + header.keySize);
+      if (!isFound)
+      {
+         LOG(ERROR) << std::format("Failed to read response cache: {}", m_logPath);
+         response.clear();
+      }
+   }
+
+   std::lock_guard lock(m_mutex);
+   if (isFound)
+      ++m_numHits;
+   else
+      ++m_numMisses;
+   return isFound;
+}
+
+void ResponseCache::Put(const std::string& key, const std::string& response, Validator isValid)
+{
+   if (response.empty() || sizeof(RecordHeader) + key.size() + response.size() >= sc_maxRecordSize)
+      return;
+
+   // The copy is made before the lock, which the writer thread takes after every record
+   PendingWrite write{key, response, std::move(isValid)};
+   {
+      std::lock_guard lock(m_writeMutex);
+      if (m_pendingBytes + key.size() + response.size() > sc_maxPendingBytes)
+      {
+         ++m_numDroppedWrites;
+         return;
+      }
+      m_pendingBytes += key.size() + response.size();
+      m_writes.push_back(std::move(write));
+   }
+   m_writeReady.notify_one();
+}
+
+ResponseCache::Statistics ResponseCache::GetStatistics() const
+{
+   std::uint64_t numDroppedWrites = 0;
+   std::uint64_t numInvalid = 0;
+   {
+      std::lock_guard lock(m_writeMutex);
+      numDroppedWrites = m_numDroppedWrites;
+      numInvalid = m_numInvalid;
+   }
+
+   std::lock_guard lock(m_mutex);
+   return {m_numHits, m_numMisses, m_numWrites, numDroppedWrites, numInvalid, m_numCompactions, m_numEntries,
+      m_logSize};
+}
+
+void ResponseCache::append(const PendingWrite& write)
+{
+   const std::string& key = write.key;
+   const std::string& response = write.response;
+
+   RecordHeader header{};
+   header.keyHash = hashBytes(key);
+   header.checksum = hashBytes(response, hashBytes(key));
+   header.timestamp = getUnixTime();
+   header.keySize = static_cast<std::uint32_t>(key.size());
+   header.valueSize = static_cast<std::uint32_t>(response.size());
+   const std::uint64_t size = alignOffset(sizeof(header) + key.size() + response.size());
+
+   static const char sc_padding[8] = {};
+   iovec parts[] = {
+      {&header, sizeof(header)},
+      {const_cast<char*>(key.data()), key.size()},
+      {const_cast<char*>(response.data()), response.size()},
+      {const_cast<char*>(sc_padding), size - sizeof(header) - key.size() - response.size()},
+   };
+
+   // The record is written past the end of the log without the lock; only this thread appends, so the end moves
+   // meanwhile only if compaction replaces the log, then the record is written to the new one.
+   while (true)
+   {
+      std::shared_ptr<const LogFile> log;
+      std::uint64_t offset = 0;
+      {
+         std::lock_guard lock(m_mutex);
+         log = m_log;
+         offset = m_logSize;
+      }
+
+      const ssize_t written = ::pwritev(log->fd, parts, std::size(parts), static_cast<off_t>(offset));
+
+      std::lock_guard lock(m_mutex);
+      if (log != m_log)
+         continue;
+
+      if (written != static_cast<ssize_t>(size))
+      {
+         // A partially written record is overwritten by the next one, or truncated when the log is opened again.
+         LOG(ERROR) << std::format("Failed to write response cache: {}", m_logPath);
+         return;
+      }
+
+      if (const IndexEntry* previous = findEntry(header.keyHash))
+         m_liveBytes -= previous->size;
+      else
+         ++m_numEntries;
+
+      m_recent[header.keyHash] = {header.keyHash, m_logSize, header.timestamp, size};
+      m_logSize += size;
+      m_liveBytes += size;
+      ++m_numWrites;
+
+      if (m_logSize > m_settings.maxSizeBytes && !m_needCompaction)
+      {
+         m_needCompaction = true;
+         m_wakeUp.notify_one();
+      }
+      return;
+   }
+}
+
+void ResponseCache::readLog(std::uint64_t offset, std::uint64_t size)
+{
+   std::string data;
+   while (offset + sizeof(RecordHeader) <= size)
+   {
+      RecordHeader header{};
+      if (!readAt(m_log->fd, &header, sizeof(header), offset))
+         break;
+
+      const std::uint64_t recordSize = alignOffset(sizeof(header) + header.keySize + header.valueSize);
+      if (offset + recordSize > size)
+         break;
+
+      data.resize(header.keySize + header.valueSize);
+      if (!readAt(m_log->fd, data.data(), data.size(), offset + sizeof(header)))
+         break;
+
+      const std::string_view key(data.data(), header.keySize);
+      const std::string_view value(data.data() + header.keySize, header.valueSize);
+      if (hashBytes(key) != header.keyHash || hashBytes(value, hashBytes(key)) != header.checksum)
+         break;
+
+      if (const IndexEntry* previous = findEntry(header.keyHash))
+         m_liveBytes -= previous->size;
+      else
+         ++m_numEntries;
+      m_recent[header.keyHash] = {header.keyHash, offset, header.timestamp, recordSize};
+      m_liveBytes += recordSize;
+      offset += recordSize;
+   }
+
+   if (offset != size)
+   {
+      LOG(WARNING) << std::format("Response cache {} has a torn record at {}, it is truncated", m_logPath, offset);
+      if (::ftruncate(m_log->fd, static_cast<off_t>(offset)) != 0)
+         LOG(ERROR) << std::format("Failed to truncate response cache: {}", m_logPath);
+   }
+   m_logSize = offset;
+}
+
+std::uint64_t ResponseCache::loadIndex()
+{
+   std::error_code error;
+   if (!std::filesystem::exists(m_indexPath, error))
+      return sizeof(LogHeader);
+
+   try
+   {
+      auto index = std::make_unique<MappedFile>(m_indexPath);
+      const auto* header = reinterpret_cast<const IndexHeader*>(index->GetData());
+      const bool isValid = index->GetSize() >= sizeof(IndexHeader) &&
+         std::memcmp(header->magic, sz_indexMagic, sizeof(sz_indexMagic)) == 0 && header->version == sc_version &&
+         header->generation == m_generation && header->logSize >= sizeof(LogHeader) &&
+         header->numEntries == (index->GetSize() - sizeof(IndexHeader)) / sizeof(IndexEntry);
+
+      // The log may be shorter than the index if the process has been killed before the log reached the disk.
+      struct stat info = {};
+      if (!isValid || ::fstat(m_log->fd, &info) != 0 || header->logSize > static_cast<std::uint64_t>(info.st_size))
+      {
+         LOG(WARNING) << std::format("Response cache index {} does not match the log, the log is read", m_indexPath);
+         return sizeof(LogHeader);
+      }
+
+      m_indexEntries = reinterpret_cast<const IndexEntry*>(index->GetData() + sizeof(IndexHeader));
+      m_numIndexEntries = header->numEntries;
+      m_numEntries = header->numEntries;
+      m_liveBytes = header->liveBytes;
+      m_index = std::move(index);
+      return header->logSize;
+   }
+   catch (const std::runtime_error&)
+   {
+      return sizeof(LogHeader);
+   }
+}
+
+const ResponseCache::IndexEntry* ResponseCache::findEntry(std::uint64_t keyHash) const
+{
+   if (const auto it = m_recent.find(keyHash); it != m_recent.end())
+      return &it->second;
+
+   const IndexEntry* end = m_indexEntries + m_numIndexEntries;
+   const IndexEntry* it = std::lower_bound(m_indexEntries, end, keyHash,
+      [](const IndexEntry& entry, std::uint64_t value)
+      {
+         return entry.keyHash < value;
+      });
+   return it != end && it->keyHash == keyHash ? it : nullptr;
+}
+
+std::vector<ResponseCache::IndexEntry> ResponseCache::collectEntries() const
+{
+   std::vector<IndexEntry> entries;
+   entries.reserve(m_numEntries);
+   for (std::size_t i = 0; i < m_numIndexEntries; ++i)
+   {
+      if (!m_recent.contains(m_indexEntries[i].keyHash))
+         entries.push_back(m_indexEntries[i]);
+   }
+   for (const auto& [keyHash, entry] : m_recent)
+      entries.push_back(entry);
+   return entries;
+}
+
+void ResponseCache::writeIndex()
+{
+   std::vector<IndexEntry> entries = collectEntries();
+   std::sort(entries.begin(), entries.end(),
+      [](const IndexEntry& a, const IndexEntry& b)
+      {
+         return a.keyHash < b.keyHash;
+      });
+
+   IndexHeader header{};
+   std::copy(std::begin(sz_indexMagic), std::end(sz_indexMagic), header.magic);
+   header.version = sc_version;
+   header.generation = m_generation;
+   header.logSize = m_logSize;
+   header.liveBytes = m_liveBytes;
+   header.numEntries = entries.size();
+
+   // The new index replaces the old one atomically, so a crash never leaves a partially written index.
+   const std::string tempPath = m_indexPath + ".tmp";
+   const int fd = ::open(tempPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   const bool isWritten = fd >= 0 && writeAt(fd, &header, sizeof(header), 0) &&
+      writeAt(fd, entries.data(), entries.size() * sizeof(IndexEntry), sizeof(header));
+   if (fd >= 0)
+      ::close(fd);
+   if (!isWritten || std::rename(tempPath.c_str(), m_indexPath.c_str()) != 0)
+   {
+      LOG(ERROR) << std::format("Failed to write response cache index: {}", m_indexPath);
+      std::remove(tempPath.c_str());
+      return;
+   }
+
+   try
+   {
+      auto index = std::make_unique<MappedFile>(m_indexPath);
+      m_indexEntries = reinterpret_cast<const IndexEntry*>(index->GetData() + sizeof(IndexHeader));
+      m_numIndexEntries = entries.size();
+      m_index = std::move(index);
+      m_recent.clear();
+   }
+   catch (const std::runtime_error&)
+   {
+      // The entries are still in m_recent and the previous mapping.
+   }
+}
+
+void ResponseCache::compact()
+{
+   // Records are copied without the lock, so requests are not blocked. Records appended meanwhile are copied
+   // at the end with the lock.
+   std::vector<IndexEntry> entries;
+   std::uint64_t snapshotSize = 0;
+   std::shared_ptr<const LogFile> source;
+   {
+      std::lock_guard lock(m_mutex);
+      entries = collectEntries();
+      snapshotSize = m_logSize;
+      source = m_log;
+   }
+
+   // The latest records which are not expired are kept, up to 3/4 of the limit, so the log does not have to be
+   // compacted again soon.
+   const std::int64_t now = getUnixTime();
+   std::erase_if(entries,
+      [&](const IndexEntry& entry)
+      {
+         return entry.timestamp + m_settings.ttl.count() < now;
+      });
+   std::sort(entries.begin(), entries.end(),
+      [](const IndexEntry& a, const IndexEntry& b)
+      {
+         return a.timestamp > b.timestamp;
+      });
+   std::uint64_t keptSize = sizeof(LogHeader);
+   std::size_t numKept = 0;
+   while (numKept < entries.size() && keptSize + entries[numKept].size <= m_settings.maxSizeBytes / 4 * 3)
+      keptSize += entries[numKept++].size;
+   entries.resize(numKept);
+   std::sort(entries.begin(), entries.end(),
+      [](const IndexEntry& a, const IndexEntry& b)
+      {
+         return a.offset < b.offset;
+      });
+
+   LogHeader header{};
+   std::copy(std::begin(sz_logMagic), std::end(sz_logMagic), header.magic);
+   header.version = sc_version;
+   header.generation = makeGeneration();
+
+   const std::string tempPath = m_logPath + ".tmp";
+   const int fd = ::open(tempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   bool isWritten = fd >= 0 && writeAt(fd, &header, sizeof(header), 0);
+   std::uint64_t size = sizeof(header);
+   for (auto& entry : entries)
+   {
+      if (!isWritten)
+         break;
+      isWritten = copyRange(source->fd, entry.offset, fd, size, entry.size);
+      entry.offset = size;
+      size += entry.size;
+   }
+   std::lock_guard lock(m_mutex);
+   Entries compacted;
+   for (const auto& entry : entries)
+      compacted[entry.keyHash] = entry;
+
+   // Only m_recent may contain records appended after the snapshot.
+   const std::uint64_t tailSize = m_logSize - snapshotSize;
+   isWritten = isWritten && copyRange(m_log->fd, snapshotSize, fd, size, tailSize);
+   for (const auto& [keyHash, entry] : m_recent)
+   {
+      if (entry.offset >= snapshotSize)
+         compacted[keyHash] = {keyHash, entry.offset - snapshotSize + size, entry.timestamp, entry.size};
+   }
+   size += tailSize;
+
+   if (!isWritten || std::rename(tempPath.c_str(), m_logPath.c_str()) != 0)
+   {
+      LOG(ERROR) << std::format("Failed to compact response cache: {}", m_logPath);
+      if (fd >= 0)
+         ::close(fd);
+      std::remove(tempPath.c_str());
+      m_needCompaction = false;  // Tried again when the log grows
+      return;
+   }
+
+   const std::uint64_t previousSize = m_logSize;
+   m_log = std::make_shared<LogFile>(fd);
+   m_generation = header.generation;
+   m_logSize = size;
+   m_liveBytes = size - sizeof(header);
+   m_numEntries = compacted.size();
+   m_index.reset();
+   m_indexEntries = nullptr;
+   m_numIndexEntries = 0;
+   m_recent = std::move(compacted);
+   m_needCompaction = m_logSize > m_settings.maxSizeBytes;  // Many records may have been appended meanwhile
+   ++m_numCompactions;
+   writeIndex();
+
+   LOG(INFO) << std::format("Compacted response cache {} from {} to {} bytes, {} responses", m_logPath, previousSize,
+      m_logSize, m_numEntries);
+}
+
+void ResponseCache::run()
+{
+   std::unique_lock lock(m_mutex);
+   while (!m_stop)
+   {
+      m_wakeUp.wait_for(lock, m_settings.compactionInterval,
+         [this]
+         {
+            return m_stop || m_needCompaction;
+         });
+      if (m_stop)
+         break;
+
+      // Records which have replaced others are garbage, the log is compacted when it is mostly garbage too.
+      if (m_needCompaction || m_liveBytes < (m_logSize - sizeof(LogHeader)) / 2)
+      {
+         lock.unlock();
+         compact();
+         lock.lock();
+      }
+      else if (!m_recent.empty())
+      {
+         writeIndex();
+      }
+   }
+}
+
+void ResponseCache::runWriter()
+{
+   std::unique_lock lock(m_writeMutex);
+   while (true)
+   {
+      m_writeReady.wait(lock,
+         [this]
+         {
+            return m_stopWriter || !m_writes.empty();
+         });
+      if (m_writes.empty())
+         break;
+
+      const PendingWrite write = std::move(m_writes.front());
+      m_writes.pop_front();
+      lock.unlock();
+      const bool isValid = !write.isValid || write.isValid(write.response);
+      if (isValid)
+         append(write);
+      lock.lock();
+      m_pendingBytes -= write.key.size() + write.response.size();
+      if (!isValid)
+         ++m_numInvalid;
+   }
+}
+
+}  // namespace geo
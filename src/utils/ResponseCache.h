@@ -0,0 +1,217 @@
+#pragma once
+
+#include "MappedFile.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace geo
+{
+
+// Thread-safe persistent cache of HTTP responses, shared by WebClient instances, so a restarted process
+// does not send its first requests to the APIs again.
+// Responses are appended to a log file. A sorted index of the log is written next to it and memory-mapped when
+// the cache is opened, so only records appended after the index was written have to be read on start.
+// A background thread rewrites the index from time to time, and compacts the log when it grows above the size
+// limit or consists mostly of replaced records: expired records are dropped, then the oldest ones.
+// Responses are appended by another background thread, and records are read and written without the lock, which
+// only protects the index, so callers on event loop threads are not blocked by the disk.
+class ResponseCache
+{
+public:
+   // Checks that a response is complete and may be stored, e.g. that an API has not answered with an error
+   using Validator = std::function<bool(const std::string& response)>;
+
+   // Cache settings
+   struct Settings
+   {
+      std::string directory;                       // Directory of the cache files, created if it does not exist
+      std::uint64_t maxSizeBytes = 0;              // Size limit of the log, it is compacted when it grows above it
+      std::chrono::seconds ttl{0};                 // Lifetime of cached responses
+      std::chrono::seconds compactionInterval{0};  // How often the index is rewritten and the log is checked
+   };
+
+   // Counters describing cache efficiency
+   struct Statistics
+   {
+      std::uint64_t numHits = 0;           // Number of responses found in the cache
+      std::uint64_t numMisses = 0;         // Number of responses which have to be requested
+      std::uint64_t numWrites = 0;         // Number of responses appended to the log
+      std::uint64_t numDroppedWrites = 0;  // Number of responses not stored as too many were waiting to be written
+      std::uint64_t numInvalid = 0;        // Number of responses not stored as their validator rejected them
+      std::uint64_t numCompactions = 0;    // Number of times the log has been compacted
+      std::size_t numEntries = 0;          // Number of cached responses, including expired ones
+      std::uint64_t logSizeBytes = 0;      // Size of the log file
+
+      // Returns share of responses answered from the cache
+      double GetHitRatio() const;
+   };
+
+public:
+   // Opens the cache files or creates new ones, throws std::runtime_error if the log cannot be opened.
+   // A torn record at the end of the log (e.g. after a crash) is truncated.
+   // @param settings Location, size limit and lifetime of responses
+   explicit ResponseCache(const Settings& settings);
+
+   // Stops the background thread and writes the index, so the next start does not read the log
+   ~ResponseCache();
+
+   ResponseCache(const ResponseCache&) = delete;
+   ResponseCache& operator=(const ResponseCache&) = delete;
+
+   // Finds a cached response
+   // @param key Key of the request, e.g. URL, method and request string
+   // @param response Receives the response
+   // @return true if the response is found and not expired
+   bool Find(const std::string& key, std::string& response);
+
+   // Queues a response to be appended to the log, replacing the response with the same key, and returns at once.
+   // The response is found after the background thread has written it. Empty responses are not stored.
+   // @param key Key of the request
+   // @param response Response to store
+   // @param isValid Called by the background thread before the response is written, so a slow check (e.g. parsing)
+   //                does not block the caller; the response is not stored if it returns false. Not checked if empty.
+   void Put(const std::string& key, const std::string& response, Validator isValid = {});
+
+   // Returns counters collected since construction
+   Statistics GetStatistics() const;
+
+private:
+   // Beginning of the log file
+   struct LogHeader
+   {
+      char magic[8];             // sz_logMagic
+      std::uint32_t version;     // sc_version
+      std::uint32_t reserved;    // Padding, zero
+      std::uint64_t generation;  // Random number which changes when the log is compacted
+   };
+
+   // Beginning of a log record, followed by the key, the response and the padding to 8 bytes
+   struct RecordHeader
+   {
+      std::uint64_t keyHash;    // Hash of the key
+      std::uint64_t checksum;   // Hash of the key and the response, detects torn records
+      std::int64_t timestamp;   // Time when the response has been stored, in seconds since the epoch
+      std::uint32_t keySize;    // Size of the key
+      std::uint32_t valueSize;  // Size of the response
+   };
+
+   // Beginning of the index file, followed by entries sorted by key hashes
+   struct IndexHeader
+   {
+      char magic[8];             // sz_indexMagic
+      std::uint32_t version;     // sc_version
+      std::uint32_t reserved;    // Padding, zero
+      std::uint64_t generation;  // Generation of the log which is indexed
+      std::uint64_t logSize;     // Size of the log when the index has been written, later records are not indexed
+      std::uint64_t liveBytes;   // Size of the indexed records
+      std::uint64_t numEntries;  // Number of entries
+   };
+
+   // Location of the latest record with a key
+   struct IndexEntry
+   {
+      std::uint64_t keyHash;   // Hash of the key
+      std::uint64_t offset;    // Offset of the record in the log
+      std::int64_t timestamp;  // Time when the response has been stored, in seconds since the epoch
+      std::uint64_t size;      // Size of the record with the padding
+   };
+
+   using Entries = std::unordered_map<std::uint64_t, IndexEntry>;  // Entries by key hashes
+
+   // Descriptor of the log file. Readers and the writer hold it while they access the file without the lock,
+   // so it is closed after the last of them when compaction replaces the log.
+   struct LogFile
+   {
+      explicit LogFile(int fd);
+      ~LogFile();
+
+      LogFile(const LogFile&) = delete;
+      LogFile& operator=(const LogFile&) = delete;
+
+      const int fd;  // Descriptor of the file, -1 if it could not be opened
+   };
+
+   // Response waiting to be appended to the log
+   struct PendingWrite
+   {
+      std::string key;       // Key of the request
+      std::string response;  // Response to store
+      Validator isValid;     // Check of the response, may be empty
+   };
+
+private:
+   // Reads records of the log starting at given offset into m_recent, truncates the log at the first invalid record
+   void readLog(std::uint64_t offset, std::uint64_t size);
+
+   // Maps the index file if it matches the log
+   // @return Offset of the first record which is not indexed
+   std::uint64_t loadIndex();
+
+   // Returns location of the latest record with given key hash, or nullptr. The cache must be locked.
+   const IndexEntry* findEntry(std::uint64_t keyHash) const;
+
+   // Returns all the entries of the mapped index and m_recent. The cache must be locked.
+   std::vector<IndexEntry> collectEntries() const;
+
+   // Writes entries of the mapped index and m_recent to the index file and maps it. The cache must be locked.
+   void writeIndex();
+
+   // Appends a record to the log and indexes it. Called by the writer thread only.
+   void append(const PendingWrite& write);
+
+   // Rewrites the log with the latest records which are not expired and fit in the size limit
+   void compact();
+
+   // Body of the background thread
+   void run();
+
+   // Body of the writer thread
+   void runWriter();
+
+private:
+   const Settings m_settings;      // Cache settings
+   const std::string m_logPath;    // Path to the log file
+   const std::string m_indexPath;  // Path to the index file
+
+   mutable std::mutex m_mutex;                  // Protects the fields below up to m_wakeUp
+   std::shared_ptr<const LogFile> m_log;        // Log file, records below m_logSize are never modified
+   std::uint64_t m_generation = 0;              // Generation of the log
+   std::uint64_t m_logSize = 0;                 // Size of the log
+   std::uint64_t m_liveBytes = 0;               // Size of the records which are not replaced by newer ones
+   std::unique_ptr<MappedFile> m_index;         // Mapped index file, may be nullptr
+   const IndexEntry* m_indexEntries = nullptr;  // Entries of the mapped index
+   std::size_t m_numIndexEntries = 0;           // Number of entries of the mapped index
+   Entries m_recent;                            // Records which are not in the mapped index, they override it
+   std::size_t m_numEntries = 0;                // See Statistics::numEntries
+   std::uint64_t m_numHits = 0;                 // See Statistics::numHits
+   std::uint64_t m_numMisses = 0;               // See Statistics::numMisses
+   std::uint64_t m_numWrites = 0;               // See Statistics::numWrites
+   std::uint64_t m_numCompactions = 0;          // See Statistics::numCompactions
+   bool m_needCompaction = false;               // Set when the log grows above the size limit
+   bool m_stop = false;                         // Set when the background thread has to exit
+   std::condition_variable m_wakeUp;            // Wakes up the background thread
+
+   mutable std::mutex m_writeMutex;       // Protects the fields below up to m_writeReady
+   std::deque<PendingWrite> m_writes;     // Responses waiting to be written, in order of Put() calls
+   std::size_t m_pendingBytes = 0;        // Size of the waiting responses and their keys
+   std::uint64_t m_numDroppedWrites = 0;  // See Statistics::numDroppedWrites
+   std::uint64_t m_numInvalid = 0;        // See Statistics::numInvalid
+   bool m_stopWriter = false;             // Set when the writer thread has to exit after writing the queue
+   std::condition_variable m_writeReady;  // Wakes up the writer thread
+
+   std::thread m_thread;  // Background thread writing the index and compacting the log
+   std::thread m_writer;  // Background thread appending responses to the log
+};
+
+}  // namespace geo
@@ -0,0 +1,87 @@
+#include "ResponseStream.h"
+
+#include <utility>
+
+namespace geo
+{
+
+bool ResponseStream::Append(const char* data, std::size_t size, const ResumeCallback& resume)
+{
+   if (size == 0)
+      return true;
+
+   {
+      std::lock_guard lock(m_mutex);
+      if (m_waiting)
+         return true;
+      if (resume && m_bufferedBytes >= sc_maxBufferedBytes)
+      {
+         m_resume = resume;
+         return false;
+      }
+      m_chunks.emplace_back(data, size);
+      m_bufferedBytes += size;
+   }
+   m_changed.notify_one();
+   return true;
+}
+
+void ResponseStream::Finish(bool succeeded)
+{
+   {
+      std::lock_guard lock(m_mutex);
+      m_finished = true;
+      m_succeeded = succeeded;
+   }
+   m_changed.notify_all();
+}
+
+bool ResponseStream::Wait()
+{
+   std::unique_lock lock(m_mutex);
+   m_waiting = true;
+   m_chunks.clear();
+   m_bufferedBytes = 0;
+   if (auto resume = std::exchange(m_resume, nullptr))
+   {
+      lock.unlock();
+      resume();
+      lock.lock();
+   }
+
+   m_changed.wait(lock,
+      [this]
+      {
+         return m_finished;
+      });
+   return m_succeeded;
+}
+
+bool ResponseStream::nextChunk()
+{
+   std::unique_lock lock(m_mutex);
+   m_changed.wait(lock,
+      [this]
+      {
+         return !m_chunks.empty() || m_finished;
+      });
+
+   if (m_chunks.empty())
+      return false;
+
+   m_current = std::move(m_chunks.front());
+   m_chunks.pop_front();
+   m_bufferedBytes -= m_current.size();
+   m_position = 0;
+
+   // The transfer is resumed without holding the lock, like other callbacks
+   if (m_resume && m_bufferedBytes <= sc_resumeBufferedBytes)
+   {
+      const auto resume = std::exchange(m_resume, nullptr);
+      lock.unlock();
+      resume();
+   }
+   return true;
+}
+
+}  // namespace geo
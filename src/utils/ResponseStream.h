@@ -0,0 +1,104 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace geo
+{
+
+// Body of an HTTP response which is consumed while it is being received.
+// An event loop thread appends received chunks, and a single reader thread takes them one character at a time,
+// blocking when it is ahead of the network. Chunks are freed as soon as they are read.
+// When the reader is behind the network, the transfer is paused once sc_maxBufferedBytes are not read yet, and resumed
+// when the reader gets down to sc_resumeBufferedBytes, so a slow reader does not buffer the whole response.
+// The reader side implements the rapidjson input stream concept, so it may be passed to rapidjson::Reader directly.
+class ResponseStream
+{
+public:
+   using Ch = char;  // Character type required by rapidjson streams
+
+   // Function which resumes a paused transfer, called on the reader thread
+   using ResumeCallback = std::function<void()>;
+
+   static constexpr std::size_t sc_maxBufferedBytes = 4 << 20;     // Unread data above which the transfer pauses
+   static constexpr std::size_t sc_resumeBufferedBytes = 1 << 20;  // Unread data below which it is resumed
+
+public:
+   ResponseStream() = default;
+
+   ResponseStream(const ResponseStream&) = delete;
+   ResponseStream& operator=(const ResponseStream&) = delete;
+
+   // Appends received data, unless too much data is not read yet. Called by the transfer, never blocks.
+   // @param data Pointer to the received data
+   // @param size Size of the data
+   // @param resume Function which resumes the transfer, empty if the data must be taken anyway (e.g. from the cache)
+   // @return false if the data is not taken: the transfer must pause and pass it again after `resume` is called
+   bool Append(const char* data, std::size_t size, const ResumeCallback& resume = {});
+
+   // Marks the end of the response. Called by the transfer, never blocks.
+   // @param succeeded false if the transfer failed and the received data is incomplete
+   void Finish(bool succeeded);
+
+   // Waits until the transfer is finished. Called by the reader when it stops reading, the data which is not read
+   // is dropped then, so that a paused transfer is resumed and finishes.
+   // @return true if the whole response has been received
+   bool Wait();
+
+   // Returns the current character without taking it, or '\0' at the end of the response. Blocks for more data.
+   Ch Peek()
+   {
+      if (m_position == m_current.size() && !nextChunk())
+         return '\0';
+      return m_current[m_position];
+   }
+
+   // Takes the current character, or returns '\0' at the end of the response. Blocks for more data.
+   Ch Take()
+   {
+      const Ch c = Peek();
+      if (c != '\0')
+      {
+         ++m_position;
+         ++m_numTaken;
+      }
+      return c;
+   }
+
+   // Returns number of characters taken
+   std::size_t Tell() const { return m_numTaken; }
+
+   // Output stream functions required by the rapidjson stream concept, which are never used for reading
+   Ch* PutBegin() { return nullptr; }
+   void Put(Ch) {}
+   void Flush() {}
+   std::size_t PutEnd(Ch*) { return 0; }
+
+private:
+   // Replaces the current chunk with the next received one, waiting for it if necessary
+   // @return false if there is no more data
+   bool nextChunk();
+
+private:
+   std::string m_current;       // Chunk being read (reader thread only)
+   std::size_t m_position = 0;  // Position of the current character in m_current (reader thread only)
+   std::size_t m_numTaken = 0;  // Number of characters taken (reader thread only)
+
+   std::mutex m_mutex;                 // Protects all the fields below
+   std::condition_variable m_changed;  // Signalled when a chunk is appended or the response is finished
+   std::deque<std::string> m_chunks;   // Received chunks which are not read yet
+   std::size_t m_bufferedBytes = 0;    // Total size of m_chunks
+   ResumeCallback m_resume;            // Resumes the transfer, set while it is paused
+   bool m_waiting = false;             // True when the reader has stopped reading, received data is dropped
+   bool m_finished = false;            // True when the transfer is finished
+   bool m_succeeded = false;           // True if the transfer is finished successfully
+};
+
+using ResponseStreamPtr = std::shared_ptr<ResponseStream>;
+
+}  // namespace geo
@@ -0,0 +1,53 @@
+#include "RpcContext.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace
+{
+
+thread_local geo::RpcContext* t_currentContext = nullptr;  // Context of the calling thread, nullptr if there is none
+
+}  // namespace
+
+namespace geo
+{
+
+RpcContext::Scope::Scope(std::shared_ptr<RpcContext> context)
+   : m_context(std::move(context))
+   , m_previous(t_currentContext)
+{
+   t_currentContext = m_context.get();
+}
+
+RpcContext::Scope::~Scope()
+{
+   t_currentContext = m_previous;
+}
+
+RpcContext::RpcContext(Clock::time_point deadline)
+   : m_deadline(deadline)
+{
+}
+
+RpcContext::RpcContext(std::chrono::system_clock::time_point deadline)
+   : m_deadline(deadline == std::chrono::system_clock::time_point::max()
+                   ? Clock::time_point::max()
+                   : Clock::now() + std::chrono::duration_cast<Clock::duration>(
+                                       deadline - std::chrono::system_clock::now()))
+{
+}
+
+RpcContext::Clock::duration RpcContext::GetRemaining() const
+{
+   if (m_deadline == Clock::time_point::max())
+      return Clock::duration::max();
+   return std::max(m_deadline - Clock::now(), Clock::duration::zero());
+}
+
+RpcContext* RpcContext::GetCurrent()
+{
+   return t_currentContext;
+}
+
+}  // namespace geo
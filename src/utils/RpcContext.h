@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+
+namespace geo
+{
+
+// Deadline and cancellation of an RPC, which the upstream requests made for the RPC follow: their timeouts end at
+// the deadline, and they are aborted when the client cancels the RPC.
+// Like a trace, a context is made current on a thread with RpcContext::Scope; search code runs within the scope,
+// and WebClient carries the context of the thread which starts a transfer over to its completion callback.
+class RpcContext : public std::enable_shared_from_this<RpcContext>
+{
+public:
+   using Clock = std::chrono::steady_clock;
+
+   // Makes a context current on the calling thread until the scope is left, the previous context is restored then
+   class Scope
+   {
+   public:
+      // @param context Context to make current, may be nullptr (the thread does not serve an RPC then)
+      explicit Scope(std::shared_ptr<RpcContext> context);
+      ~Scope();
+
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+
+   private:
+      std::shared_ptr<RpcContext> m_context;  // Context which is current within the scope
+      RpcContext* m_previous = nullptr;       // Context which was current before the scope
+   };
+
+public:
+   // @param deadline Time when the client gives up on the RPC, Clock::time_point::max() if it waits forever
+   explicit RpcContext(Clock::time_point deadline);
+
+   // Constructor converting a deadline of gRPC
+   // @param deadline Deadline of the RPC, std::chrono::system_clock::time_point::max() if it has none
+   explicit RpcContext(std::chrono::system_clock::time_point deadline);
+
+   RpcContext(const RpcContext&) = delete;
+   RpcContext& operator=(const RpcContext&) = delete;
+
+   // Returns the time left until the deadline, zero if it has passed, Clock::duration::max() if there is none
+   Clock::duration GetRemaining() const;
+
+   // Marks the RPC as cancelled by the client. Thread-safe.
+   void Cancel() { m_cancelled.store(true, std::memory_order_relaxed); }
+
+   // Returns true if the RPC is cancelled or its deadline has passed, so nobody waits for its work anymore
+   bool IsCancelled() const { return m_cancelled.load(std::memory_order_relaxed) || Clock::now() >= m_deadline; }
+
+   // Returns the context which is current on the calling thread, nullptr if the thread does not serve an RPC
+   static RpcContext* GetCurrent();
+
+private:
+   const Clock::time_point m_deadline;    // Time when the client gives up on the RPC
+   std::atomic<bool> m_cancelled{false};  // Set when the client cancels the RPC
+};
+
+}  // namespace geo
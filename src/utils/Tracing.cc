@@ -0,0 +1,189 @@
+#include "Tracing.h"
+
+#include <absl/log/log.h>
+
+#include <algorithm>
+#include <format>
+#include <iterator>
+#include <limits>
+#include <set>
+#include <stdexcept>
+
+namespace
+{
+
+thread_local geo::Trace* t_currentTrace = nullptr;  // Trace of the calling thread, nullptr if it is not traced
+
+// Converts a duration to whole microseconds which fit a span
+std::uint32_t toMicroseconds(geo::Trace::Clock::duration duration)
+{
+   const auto us = std::chrono::duration_cast<std::chrono::microseconds>(duration).count();
+   return static_cast<std::uint32_t>(std::clamp<std::int64_t>(us, 0, std::numeric_limits<std::uint32_t>::max()));
+}
+
+// Converts microseconds to milliseconds for output
+double toMilliseconds(std::uint64_t us)
+{
+   return static_cast<double>(us) / 1000;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+Trace::Scope::Scope(std::shared_ptr<Trace> trace)
+   : m_trace(std::move(trace))
+   , m_previous(t_currentTrace)
+{
+   t_currentTrace = m_trace.get();
+}
+
+Trace::Scope::~Scope()
+{
+   t_currentTrace = m_previous;
+}
+
+Trace::Trace(std::string name)
+   : m_name(std::move(name))
+{
+}
+
+void Trace::AddSpan(const char* name, Clock::time_point start, Clock::time_point end)
+{
+   auto& slot = m_slots[m_numSpans.fetch_add(1, std::memory_order_relaxed) % sc_maxSpans];
+
+   // The slot is hidden from readers while it is rewritten
+   slot.name.store(nullptr, std::memory_order_relaxed);
+   slot.startUs.store(toMicroseconds(start - m_start), std::memory_order_relaxed);
+   slot.durationUs.store(toMicroseconds(end - start), std::memory_order_relaxed);
+   slot.name.store(name, std::memory_order_release);
+}
+
+std::vector<Trace::Span> Trace::GetSpans() const
+{
+   std::vector<Span> spans;
+   spans.reserve(std::min<std::size_t>(m_numSpans.load(std::memory_order_relaxed), sc_maxSpans));
+   for (const auto& slot : m_slots)
+   {
+      const char* name = slot.name.load(std::memory_order_acquire);
+      if (!name)
+         continue;
+
+      Span span{name, slot.startUs.load(std::memory_order_relaxed), slot.durationUs.load(std::memory_order_relaxed)};
+      if (slot.name.load(std::memory_order_acquire) == name)
+         spans.push_back(span);
+   }
+
+   std::sort(spans.begin(), spans.end(),
+      [](const Span& a, const Span& b)
+      {
+         return a.startUs < b.startUs;
+      });
+   return spans;
+}
+
+std::string Trace::FormatServerTiming() const
+{
+   // Durations are summed up by name in order of the first span with the name
+   struct Stage
+   {
+      const char* name = nullptr;
+      std::uint64_t durationUs = 0;
+      std::size_t numSpans = 0;
+   };
+   std::vector<Stage> stages;
+   for (const auto& span : GetSpans())
+   {
+      auto it = std::find_if(stages.begin(), stages.end(),
+         [&span](const Stage& stage)
+         {
+            return std::string_view(stage.name) == span.name;
+         });
+      if (it == stages.end())
+         it = stages.insert(stages.end(), Stage{span.name});
+      it->durationUs += span.durationUs;
+      ++it->numSpans;
+   }
+
+   std::string result = std::format("total;dur={:.1f}", toMilliseconds(toMicroseconds(GetElapsed())));
+   for (const auto& stage : stages)
+   {
+      std::format_to(std::back_inserter(result), ", {};dur={:.1f}", stage.name, toMilliseconds(stage.durationUs));
+      if (stage.numSpans > 1)
+         std::format_to(std::back_inserter(result), ";desc=\"{} spans\"", stage.numSpans);
+   }
+   return result;
+}
+
+std::string Trace::Format() const
+{
+   const auto numSpans = m_numSpans.load(std::memory_order_relaxed);
+   std::string result = std::format("{} {:.1f}ms:", m_name, toMilliseconds(toMicroseconds(GetElapsed())));
+   for (const auto& span : GetSpans())
+      std::format_to(std::back_inserter(result), " +{:.1f}ms {} {:.1f}ms;", toMilliseconds(span.startUs), span.name,
+         toMilliseconds(span.durationUs));
+   if (numSpans > sc_maxSpans)
+      std::format_to(std::back_inserter(result), " ({} oldest spans dropped)", numSpans - sc_maxSpans);
+   return result;
+}
+
+Trace* Trace::GetCurrent()
+{
+   return t_currentTrace;
+}
+
+void Trace::AddCurrentSpan(const char* name, Clock::time_point start)
+{
+   if (t_currentTrace)
+      t_currentTrace->AddSpan(name, start, Clock::now());
+}
+
+const char* Trace::Intern(std::string_view name)
+{
+   // Never destroyed, so the names stay valid for traces which are finished during shutdown
+   static std::mutex s_mutex;
+   static auto* s_names = new std::set<std::string, std::less<>>();
+
+   std::lock_guard lock(s_mutex);
+   auto it = s_names->find(name);
+   if (it == s_names->end())
+      it = s_names->emplace(name).first;
+   return it->c_str();
+}
+
+Tracer::Tracer(Settings settings)
+   : m_settings(std::move(settings))
+{
+   if (m_settings.slowTracePath.empty())
+      return;
+
+   m_file.open(m_settings.slowTracePath, std::ios::app);
+   if (!m_file.is_open())
+   {
+      LOG(ERROR) << std::format("Failed to open file of slow traces: {}", m_settings.slowTracePath);
+      throw std::runtime_error("Failed to open file of slow traces: " + m_settings.slowTracePath);
+   }
+}
+
+std::shared_ptr<Trace> Tracer::Start(std::string name, bool requested)
+{
+   const bool sampled = m_settings.samplingPercent > 0 &&
+                        m_numRpcs.fetch_add(1, std::memory_order_relaxed) % 100 < m_settings.samplingPercent;
+   if (!requested && !sampled)
+      return nullptr;
+   return std::make_shared<Trace>(std::move(name));
+}
+
+void Tracer::Finish(const Trace& trace)
+{
+   if (!m_file.is_open() || trace.GetElapsed() < m_settings.slowThreshold)
+      return;
+
+   const std::string line = std::format("{:%FT%TZ} {}\n",
+      std::chrono::floor<std::chrono::milliseconds>(std::chrono::system_clock::now()), trace.Format());
+   std::lock_guard lock(m_mutex);
+   m_file << line << std::flush;
+}
+
+}  // namespace geo
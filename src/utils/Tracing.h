@@ -0,0 +1,172 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace geo
+{
+
+// Timeline of a single traced RPC: named spans of the stages it passes through (search, API requests, parsing).
+// Spans are added from any thread without locks into a fixed ring buffer; when it is full, the oldest spans
+// are overwritten, so a trace never allocates after it is created.
+// A trace is made current on a thread with Trace::Scope; spans are recorded into the current trace, and
+// WebClient carries the trace of the thread which starts a transfer over to its completion callback.
+class Trace : public std::enable_shared_from_this<Trace>
+{
+public:
+   using Clock = std::chrono::steady_clock;
+
+   static constexpr std::size_t sc_maxSpans = 128;  // Capacity of the ring buffer
+
+   // Finished stage of the RPC
+   struct Span
+   {
+      const char* name = nullptr;    // Name of the stage, e.g. "overpass.http"
+      std::uint32_t startUs = 0;     // Start of the stage relative to the start of the trace, in microseconds
+      std::uint32_t durationUs = 0;  // Duration of the stage in microseconds
+   };
+
+   // Makes a trace current on the calling thread until the scope is left, the previous trace is restored then
+   class Scope
+   {
+   public:
+      // @param trace Trace to make current, may be nullptr (the thread is not traced then)
+      explicit Scope(std::shared_ptr<Trace> trace);
+      ~Scope();
+
+      Scope(const Scope&) = delete;
+      Scope& operator=(const Scope&) = delete;
+
+   private:
+      std::shared_ptr<Trace> m_trace;  // Trace which is current within the scope
+      Trace* m_previous = nullptr;     // Trace which was current before the scope
+   };
+
+public:
+   // Constructor starting the trace
+   // @param name Name of the traced RPC, e.g. "GetCities"
+   explicit Trace(std::string name);
+
+   Trace(const Trace&) = delete;
+   Trace& operator=(const Trace&) = delete;
+
+   // Adds a finished span. Thread-safe.
+   // @param name Name of the span, must have static storage duration (see Intern())
+   // @param start Start time of the span
+   // @param end End time of the span
+   void AddSpan(const char* name, Clock::time_point start, Clock::time_point end);
+
+   // Returns spans in order of their start time; spans which are being written concurrently may be skipped
+   std::vector<Span> GetSpans() const;
+
+   // Returns the time since the start of the trace
+   Clock::duration GetElapsed() const { return Clock::now() - m_start; }
+
+   // Returns durations of spans summed up by name in the Server-Timing header format, e.g.
+   // "total;dur=812.4, overpass.http;dur=700.2;desc=\"3 spans\"". Spans of concurrent stages overlap, so their
+   // sum may exceed the total time.
+   std::string FormatServerTiming() const;
+
+   // Returns the whole timeline in a single line, e.g. for a file of slow traces
+   std::string Format() const;
+
+   // Returns the trace which is current on the calling thread, nullptr if the thread is not traced
+   static Trace* GetCurrent();
+
+   // Adds a span which ends now to the current trace of the calling thread, if there is one
+   static void AddCurrentSpan(const char* name, Clock::time_point start);
+
+   // Returns a copy of a dynamic span name with static storage duration. Names are never freed, so this is meant
+   // for a few names known at startup, e.g. names of API clients.
+   static const char* Intern(std::string_view name);
+
+private:
+   // Slot of the ring buffer. The name is published last, so a reader sees complete spans.
+   struct Slot
+   {
+      std::atomic<const char*> name{nullptr};
+      std::atomic<std::uint32_t> startUs{0};
+      std::atomic<std::uint32_t> durationUs{0};
+   };
+
+private:
+   const std::string m_name;                        // Name of the traced RPC
+   const Clock::time_point m_start = Clock::now();  // Start of the trace
+   std::array<Slot, sc_maxSpans> m_slots;           // Ring buffer of spans
+   std::atomic<std::uint32_t> m_numSpans{0};        // Number of spans added, including overwritten ones
+};
+
+// Adds a span from construction to destruction to the current trace of the thread.
+// It costs a single thread-local read if the thread is not traced.
+class ScopedSpan
+{
+public:
+   // @param name Name of the span, must have static storage duration
+   explicit ScopedSpan(const char* name)
+      : m_trace(Trace::GetCurrent())
+      , m_name(name)
+   {
+      if (m_trace)
+         m_start = Trace::Clock::now();
+   }
+
+   ~ScopedSpan()
+   {
+      if (m_trace)
+         m_trace->AddSpan(m_name, m_start, Trace::Clock::now());
+   }
+
+   ScopedSpan(const ScopedSpan&) = delete;
+   ScopedSpan& operator=(const ScopedSpan&) = delete;
+
+private:
+   Trace* m_trace = nullptr;          // Trace receiving the span, nullptr if the thread is not traced
+   const char* m_name = nullptr;      // Name of the span
+   Trace::Clock::time_point m_start;  // Start of the span
+};
+
+// Decides which RPCs are traced and writes traces of slow RPCs to a file
+class Tracer
+{
+public:
+   // Sampling and output settings
+   struct Settings
+   {
+      std::uint32_t samplingPercent = 0;              // Share of RPCs traced without being asked by the client
+      std::chrono::milliseconds slowThreshold{1000};  // Traced RPCs slower than this are written to the file
+      std::string slowTracePath;                      // File receiving slow traces, not written if empty
+   };
+
+public:
+   // Constructor opening the file of slow traces, throws std::runtime_error if it cannot be opened
+   explicit Tracer(Settings settings);
+
+   Tracer(const Tracer&) = delete;
+   Tracer& operator=(const Tracer&) = delete;
+
+   // Starts a trace of an RPC if it is requested by the client or sampled
+   // @param name Name of the RPC
+   // @param requested True if the client asked for a trace
+   // @return Trace of the RPC, or nullptr if it is not traced
+   std::shared_ptr<Trace> Start(std::string name, bool requested);
+
+   // Writes the trace of a finished RPC to the file of slow traces if the RPC is slow
+   void Finish(const Trace& trace);
+
+private:
+   const Settings m_settings;                // Sampling and output settings
+   std::atomic<std::uint64_t> m_numRpcs{0};  // Number of started RPCs, used for sampling
+   std::mutex m_mutex;                       // Protects m_file
+   std::ofstream m_file;                     // File of slow traces
+};
+
+}  // namespace geo
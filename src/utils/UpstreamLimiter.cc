@@ -0,0 +1,266 @@
+#include "UpstreamLimiter.h"
+
+#include "RpcContext.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+namespace
+{
+
+constexpr double sc_throttledDecrease = 0.5;  // Factor of the concurrency limit when the API throttles
+constexpr double sc_slowDecrease = 0.9;       // Factor of the concurrency limit when answers are much slower
+constexpr double sc_latencyWeight = 0.05;     // Weight of a new latency in the moving average of usual latencies
+
+// Returns the key of the queue of a submitted request: the current RPC, or the calling thread outside of an RPC.
+// A queued task holds the context of its RPC (see WebClient), so the address is not reused while the queue exists.
+const void* getQueueKey()
+{
+   thread_local const char t_threadKey = 0;  // Only its address is used
+   if (const geo::RpcContext* rpc = geo::RpcContext::GetCurrent())
+      return rpc;
+   return &t_threadKey;
+}
+
+}  // namespace
+
+namespace geo
+{
+
+UpstreamLimiter::UpstreamLimiter(const std::string& name, Settings settings, WebEventLoopPtr eventLoop)
+   : m_settings(std::move(settings))
+   , m_eventLoop(std::move(eventLoop))
+   , m_tokens(1)
+   , m_refillTime(Clock::now())
+   , m_limitGauge(MetricsRegistry::GetDefault().GetGauge("geo_upstream_concurrency_limit",
+        "Adaptive limit of concurrent requests to upstream APIs", {{"upstream", name}}))
+   , m_queueGauge(MetricsRegistry::GetDefault().GetGauge("geo_upstream_queued_requests",
+        "Requests to upstream APIs waiting for their rate or concurrency limit", {{"upstream", name}}))
+   , m_rejected(MetricsRegistry::GetDefault().GetCounter("geo_upstream_rejected_requests_total",
+        "Requests to upstream APIs rejected because too many requests are waiting", {{"upstream", name}}))
+   , m_throttled(MetricsRegistry::GetDefault().GetCounter("geo_upstream_throttled_total",
+        "Answers of upstream APIs asking to slow down (429, 503, 504) and timeouts", {{"upstream", name}}))
+{
+   std::lock_guard lock(m_mutex);
+   setLimit(m_settings.maxConcurrency);
+}
+
+void UpstreamLimiter::Submit(Task task, CancelCheck isCancelled)
+{
+   if (isCancelled && isCancelled())
+   {
+      task(false);
+      return;
+   }
+
+   bool admitted = false;
+   {
+      std::lock_guard lock(m_mutex);
+      Clock::duration wait{};
+      // A new request does not overtake waiting ones
+      if (m_queueLength == 0 && tryAdmit(Clock::now(), wait))
+      {
+         admitted = true;
+      }
+      else if (m_queueLength < m_settings.maxQueueLength)
+      {
+         const void* key = getQueueKey();
+         auto& queue = m_queues[key];
+         if (queue.empty())
+            m_turns.push_back(key);
+         queue.push_back({std::move(task), std::move(isCancelled)});
+         ++m_queueLength;
+         m_queueGauge.Add(1);
+         if (wait > Clock::duration::zero())
+            scheduleDispatch(wait);
+         return;
+      }
+   }
+
+   if (!admitted)
+      m_rejected.Increment();
+   task(admitted);
+}
+
+void UpstreamLimiter::Release(Outcome outcome, Clock::time_point startTime, std::chrono::seconds retryAfter)
+{
+   {
+      std::lock_guard lock(m_mutex);
+      const auto now = Clock::now();
+      // The limit only grows when requests are held back by it, not when the demand is lower
+      const bool limitReached = m_numRunning + m_queueLength >= m_limit;
+      --m_numRunning;
+
+      if (retryAfter > std::chrono::seconds::zero())
+         m_pausedUntil = std::max(m_pausedUntil, now + retryAfter);
+      if (outcome == Outcome::Throttled)
+         m_throttled.Increment();
+
+      if (m_settings.maxConcurrency > 0)
+      {
+         // Requests started before the last decrease have been sent at the old limit, so a burst of their errors
+         // or slow answers decreases the limit once
+         const bool mayDecrease = startTime >= m_decreaseTime;
+         bool overloaded = outcome == Outcome::Throttled;
+         if (outcome == Outcome::Success)
+         {
+            const double latencyUs = std::chrono::duration<double, std::micro>(now - startTime).count();
+            overloaded = m_usualLatencyUs > 0 && latencyUs > m_usualLatencyUs * m_settings.latencyTolerance;
+            m_usualLatencyUs =
+               m_usualLatencyUs > 0 ? m_usualLatencyUs + (latencyUs - m_usualLatencyUs) * sc_latencyWeight : latencyUs;
+            if (!overloaded && limitReached)
+               setLimit(m_limit + 1 / m_limit);
+         }
+
+         if (overloaded && mayDecrease)
+         {
+            setLimit(m_limit * (outcome == Outcome::Throttled ? sc_throttledDecrease : sc_slowDecrease));
+            m_decreaseTime = now;
+         }
+      }
+   }
+
+   dispatch();
+}
+
+std::uint32_t UpstreamLimiter::GetLimit() const
+{
+   std::lock_guard lock(m_mutex);
+   return static_cast<std::uint32_t>(m_limit);
+}
+
+std::size_t UpstreamLimiter::GetQueueLength() const
+{
+   std::lock_guard lock(m_mutex);
+   return m_queueLength;
+}
+
+bool UpstreamLimiter::tryAdmit(Clock::time_point now, Clock::duration& wait)
+{
+   wait = Clock::duration::zero();
+   if (now < m_pausedUntil)
+   {
+      wait = m_pausedUntil - now;
+      return false;
+   }
+
+   if (m_settings.maxConcurrency > 0 && m_numRunning >= static_cast<std::uint32_t>(m_limit))
+      return false;
+
+   if (m_settings.maxRequestsPerSecond > 0)
+   {
+      // APIs count requests in sliding windows, so no burst is saved up while idle
+      const double rate = m_settings.maxRequestsPerSecond;
+      m_tokens = std::min(1.0, m_tokens + std::chrono::duration<double>(now - m_refillTime).count() * rate);
+      m_refillTime = now;
+      if (m_tokens < 1)
+      {
+         wait = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>((1 - m_tokens) / rate));
+         return false;
+      }
+      m_tokens -= 1;
+   }
+
+   ++m_numRunning;
+   return true;
+}
+
+void UpstreamLimiter::dispatch()
+{
+   std::vector<Task> admitted;
+   std::vector<Task> dropped;
+   {
+      std::lock_guard lock(m_mutex);
+      dropCancelled(dropped);
+      const auto now = Clock::now();
+      Clock::duration wait{};
+      while (m_queueLength > 0 && tryAdmit(now, wait))
+      {
+         // RPCs take turns, so every RPC gets its share of the limits
+         const void* key = m_turns.front();
+         m_turns.pop_front();
+         auto it = m_queues.find(key);
+         admitted.push_back(std::move(it->second.front().task));
+         it->second.pop_front();
+         if (it->second.empty())
+            m_queues.erase(it);
+         else
+            m_turns.push_back(key);
+         --m_queueLength;
+      }
+
+      m_queueGauge.Add(-static_cast<std::int64_t>(admitted.size()));
+      if (m_queueLength > 0 && wait > Clock::duration::zero())
+         scheduleDispatch(wait);
+   }
+
+   // Tasks are called without the lock, so they may submit further requests
+   for (auto& task : dropped)
+      task(false);
+   for (auto& task : admitted)
+      task(true);
+}
+
+void UpstreamLimiter::dropCancelled(std::vector<Task>& dropped)
+{
+   const std::size_t numDropped = dropped.size();
+   for (auto it = m_queues.begin(); it != m_queues.end();)
+   {
+      std::erase_if(it->second,
+         [&dropped](Waiting& waiting)
+         {
+            if (!waiting.isCancelled || !waiting.isCancelled())
+               return false;
+            dropped.push_back(std::move(waiting.task));
+            return true;
+         });
+
+      if (it->second.empty())
+      {
+         std::erase(m_turns, it->first);
+         it = m_queues.erase(it);
+      }
+      else
+      {
+         ++it;
+      }
+   }
+
+   m_queueLength -= dropped.size() - numDropped;
+   m_queueGauge.Add(-static_cast<std::int64_t>(dropped.size() - numDropped));
+}
+
+void UpstreamLimiter::scheduleDispatch(Clock::duration wait)
+{
+   if (m_timerSet)
+      return;
+
+   m_timerSet = true;
+   m_eventLoop->AddTimer(wait,
+      [weak = weak_from_this()]
+      {
+         const auto self = weak.lock();
+         if (!self)
+            return;
+
+         {
+            std::lock_guard lock(self->m_mutex);
+            self->m_timerSet = false;
+         }
+         self->dispatch();
+      });
+}
+
+void UpstreamLimiter::setLimit(double limit)
+{
+   const double maxLimit = m_settings.maxConcurrency;
+   const double minLimit = std::min<double>(std::max<std::uint32_t>(m_settings.minConcurrency, 1), maxLimit);
+   m_limit = std::clamp(limit, minLimit, maxLimit);
+
+   const auto reported = static_cast<std::int64_t>(m_limit);
+   m_limitGauge.Add(reported - m_reportedLimit);
+   m_reportedLimit = reported;
+}
+
+}  // namespace geo
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "Metrics.h"
+#include "WebEventLoop.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace geo
+{
+
+// Limits the load a WebClient puts on an upstream API, to get the highest throughput the API tolerates without being
+// banned. A request is started when it passes two limits:
+// - a token bucket keeping to the rate the API asks clients for, e.g. 1 request per second for public Nominatim.
+//   It holds a single token, so requests are spaced evenly and never exceed the rate within any second;
+// - an adaptive concurrency limit (AIMD): it grows by one request after every limit of usual answers, and is cut
+//   when the API throttles (429, 503, 504 or a timeout) or answers much slower than usual. Retry-After of a
+//   throttling answer pauses all the requests.
+// Other requests wait in a bounded queue, served round robin by the RPC which has submitted them (see RpcContext),
+// so an RPC which sends dozens of lookups does not starve the other ones. The requests of an RPC are submitted from
+// executor and event loop threads alike; requests sent outside of an RPC are served by their submitting thread.
+// Requests which are cancelled while they wait (e.g. their RPC has timed out) are dropped without taking a token or
+// a turn, so an abandoned fan-out does not hold back live RPCs.
+// The limiter must be owned by a shared_ptr, its timers only hold a weak reference.
+class UpstreamLimiter : public std::enable_shared_from_this<UpstreamLimiter>
+{
+public:
+   static constexpr std::size_t sc_defaultMaxQueueLength = 1024;  // Default number of requests which may wait
+
+   // Limits of an upstream API
+   struct Settings
+   {
+      std::uint32_t maxRequestsPerSecond = 0;  // Rate of requests, which are spaced evenly (0: not limited)
+      std::uint32_t maxConcurrency = 0;        // Upper bound and initial value of the concurrency limit
+                                               // (0: concurrency is not limited)
+      std::uint32_t minConcurrency = 1;        // Lower bound of the concurrency limit
+      double latencyTolerance = 4;             // Answers slower than this multiple of the usual latency are
+                                               // taken as overload
+      std::size_t maxQueueLength = sc_defaultMaxQueueLength;  // Requests which may wait, further ones are rejected
+   };
+
+   // Outcome of a finished request, which the concurrency limit learns from
+   enum class Outcome
+   {
+      Success,    // The API has answered
+      Throttled,  // The API has answered with 429, 503 or 504, or the request has timed out
+      Failed,     // Any other error, e.g. 404 or a refused connection, which tells nothing about the load
+      Cancelled,  // The request has been aborted by the client
+   };
+
+   // Starts a request; admitted is false if the queue is full or the request is cancelled, it must fail instead
+   using Task = std::function<void(bool admitted)>;
+
+   // Returns true if a request is not needed anymore, e.g. its RPC is cancelled
+   using CancelCheck = std::function<bool()>;
+
+public:
+   // @param name Name of the API in the "upstream" label of metrics
+   // @param settings Limits of the API
+   // @param eventLoop Event loop whose timers start requests waiting for the rate or a pause
+   UpstreamLimiter(const std::string& name, Settings settings, WebEventLoopPtr eventLoop);
+
+   UpstreamLimiter(const UpstreamLimiter&) = delete;
+   UpstreamLimiter& operator=(const UpstreamLimiter&) = delete;
+
+   // Calls the task at once if the limits allow, otherwise queues it with the other requests of the current RPC.
+   // Thread-safe.
+   // Queued tasks are called on threads which release requests or on event loop threads, so they must not block.
+   // @param task Starts the request
+   // @param isCancelled Checked before the request takes a token, a cancelled request is not admitted (may be empty)
+   void Submit(Task task, CancelCheck isCancelled = {});
+
+   // Reports a finished request which has been admitted, and starts queued requests the limits allow now
+   // @param outcome Outcome of the request
+   // @param startTime Time when the request has been admitted
+   // @param retryAfter Pause asked by the API with Retry-After, zero if there is none
+   void Release(Outcome outcome, std::chrono::steady_clock::time_point startTime, std::chrono::seconds retryAfter);
+
+   // Returns the current concurrency limit, 0 if concurrency is not limited
+   std::uint32_t GetLimit() const;
+
+   // Returns the number of queued requests
+   std::size_t GetQueueLength() const;
+
+private:
+   using Clock = std::chrono::steady_clock;
+
+   // Request waiting for the limits
+   struct Waiting
+   {
+      Task task;                // Starts the request
+      CancelCheck isCancelled;  // Checks if the request is still needed, may be empty
+   };
+
+private:
+   // Takes a request slot and a token if the limits allow. Must be called under the lock.
+   // @param now Current time
+   // @param wait Receives the time until a token is added or the pause ends, zero if a running request must finish
+   // @return true if the request may start
+   bool tryAdmit(Clock::time_point now, Clock::duration& wait);
+
+   // Removes cancelled requests from the queues. Must be called under the lock.
+   // @param dropped Receives the tasks of the removed requests
+   void dropCancelled(std::vector<Task>& dropped);
+
+   // Starts queued requests the limits allow, and sets a timer if they wait for a token or the end of a pause
+   void dispatch();
+
+   // Sets a timer calling dispatch(), unless one is set already. Must be called under the lock.
+   void scheduleDispatch(Clock::duration wait);
+
+   // Changes the concurrency limit within its bounds. Must be called under the lock.
+   void setLimit(double limit);
+
+private:
+   const Settings m_settings;          // Limits of the API
+   const WebEventLoopPtr m_eventLoop;  // Runs the timers
+
+   mutable std::mutex m_mutex;        // Protects the fields below
+   double m_limit = 0;                // Concurrency limit, fractional for the additive increase
+   std::uint32_t m_numRunning = 0;    // Number of admitted requests which are not released yet
+   double m_tokens = 0;               // Tokens in the bucket, a request takes one
+   Clock::time_point m_refillTime;    // Time when tokens have been added last
+   Clock::time_point m_pausedUntil;   // Requests wait until this time after Retry-After
+   Clock::time_point m_decreaseTime;  // Time of the last decrease of the limit
+   double m_usualLatencyUs = 0;       // Moving average of latencies of answers, 0 until the first answer
+   bool m_timerSet = false;           // True if a timer calling dispatch() is pending
+   std::unordered_map<const void*, std::deque<Waiting>> m_queues;  // Waiting requests by RPC or submitting thread
+   std::deque<const void*> m_turns;                                // RPCs with waiting requests, round robin
+   std::size_t m_queueLength = 0;                                  // Number of waiting requests
+
+   MetricsRegistry::Gauge& m_limitGauge;   // Current concurrency limit
+   MetricsRegistry::Gauge& m_queueGauge;   // Number of waiting requests
+   MetricsRegistry::Counter& m_rejected;   // Number of requests rejected because the queue is full
+   MetricsRegistry::Counter& m_throttled;  // Number of answers which throttled the client
+   std::int64_t m_reportedLimit = 0;       // Limit in m_limitGauge
+};
+
+}  // namespace geo
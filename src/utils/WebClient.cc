@@ -1,27 +1,113 @@
 #include "WebClient.h"
 
+#include "Logging.h"
+
 #include <absl/log/log.h>
 #include <curl/curl.h>
 #include <curl/easy.h>
 
+#include <algorithm>
+#include <array>
+#include <deque>
 #include <format>
+#include <mutex>
 #include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace
 {
 
-// Callback function for CURL to write received data into string buffer
+const char* sz_responsesMetric = "geo_upstream_responses_total";
+const char* sz_responsesMetricHelp = "Responses of upstream APIs by HTTP status code, none if nothing is received";
+
+// Callback function for CURL to write received data into response buffer of a transfer.
+// The buffer is presized from Content-Length when the first data arrives, so it does not grow by appends.
 // @param contents Pointer to the delivered data
 // @param size Always 1
 // @param nmemb Size of the data
-// @param userp Pointer to user data (string buffer in our case)
+// @param userp Pointer to user data (transfer in our case)
 // @return Number of bytes actually taken care of
+template <typename TTransfer>
 size_t curlWriteFunction(void* contents, size_t size, size_t nmemb, void* userp)
 {
-   ((std::string*)userp)->append((char*)contents, size * nmemb);
+   auto* transfer = static_cast<TTransfer*>(userp);
+   if (transfer->response.empty())
+   {
+      curl_off_t contentLength = -1;
+      if (curl_easy_getinfo(transfer->curl.get(), CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &contentLength) == CURLE_OK &&
+          contentLength > 0)
+         transfer->response.reserve(static_cast<std::size_t>(contentLength));
+   }
+   transfer->response.append((char*)contents, size * nmemb);
    return size * nmemb;
 }
 
+// Callback function for CURL to pass received data to the reader of a response stream.
+// If the response is cached, it is collected in the response buffer of the transfer as well.
+// @param contents Pointer to the delivered data
+// @param size Always 1
+// @param nmemb Size of the data
+// @param userp Pointer to user data (transfer in our case)
+// @return Number of bytes actually taken care of, or CURL_WRITEFUNC_PAUSE if the reader is too far behind
+template <typename TTransfer>
+size_t curlStreamWriteFunction(void* contents, size_t size, size_t nmemb, void* userp)
+{
+   auto* transfer = static_cast<TTransfer*>(userp);
+   // Only the first instance which answers a hedged request passes data on, the other transfer is aborted
+   if (transfer->hedge && !transfer->hedge->Claim(transfer))
+      return 0;
+   if (!transfer->stream->Append((char*)contents, size * nmemb, transfer->resume))
+      return CURL_WRITEFUNC_PAUSE;
+   if (!transfer->cacheKey.empty())
+      transfer->response.append((char*)contents, size * nmemb);
+   return size * nmemb;
+}
+
+// Callback function for CURL to abort a transfer which is not needed anymore, e.g. a hedged request which has been
+// answered by another instance. cURL calls it about once a second while waiting, and more often while receiving.
+// @param clientp Pointer to user data (transfer in our case)
+// @return Non-zero to abort the transfer
+template <typename TTransfer>
+int curlProgressFunction(void* clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+   return static_cast<const TTransfer*>(clientp)->IsCancelled() ? 1 : 0;
+}
+
+// Tells what a finished transfer says about the load of the API, for the limiter of its requests
+// @param curl CURL handle which has been performed
+// @param result cURL result code of the transfer
+// @param cancelled True if the transfer has been aborted as it is not needed anymore
+geo::UpstreamLimiter::Outcome getOutcome(CURL* curl, CURLcode result, bool cancelled)
+{
+   using Outcome = geo::UpstreamLimiter::Outcome;
+   if (cancelled)
+      return Outcome::Cancelled;
+   if (result == CURLE_OK)
+      return Outcome::Success;
+   if (result == CURLE_OPERATION_TIMEDOUT)
+      return Outcome::Throttled;
+
+   long responseCode = 0;
+   if (result == CURLE_HTTP_RETURNED_ERROR)
+      curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &responseCode);
+   return responseCode == 429 || responseCode == 503 || responseCode == 504 ? Outcome::Throttled : Outcome::Failed;
+}
+
+// Returns the pause asked by the API with the Retry-After header of a response, zero if there is none.
+// Longer pauses are cut, so requests waiting for the API do not outlive their RPCs by far.
+std::chrono::seconds getRetryAfter(CURL* curl)
+{
+   const std::chrono::seconds maxPause{60};
+   curl_off_t retryAfter = 0;
+   if (curl_easy_getinfo(curl, CURLINFO_RETRY_AFTER, &retryAfter) != CURLE_OK || retryAfter <= 0)
+      return std::chrono::seconds::zero();
+   return std::min(std::chrono::seconds(retryAfter), maxPause);
+}
+
 // Template helper function to set CURL options with error handling
 // @param curl CURL handle to set option on
 // @param opt CURL option to set
@@ -57,117 +143,958 @@ bool safeCall(TUnsafe f)
 namespace geo
 {
 
-WebClient::WebClient(std::string url, std::uint64_t writeTimeoutMs)
+class WebClient::HandlePool
+{
+public:
+   HandlePool(std::size_t maxSize, std::chrono::seconds idleTimeout)
+      : m_maxSize(maxSize)
+      , m_idleTimeout(idleTimeout)
+   {
+   }
+
+   ~HandlePool()
+   {
+      for (auto& [curl, releaseTime] : m_idle)
+         curl_easy_cleanup(curl);
+   }
+
+   // Returns the most recently used idle handle (its connection is most likely alive) or a new one
+   CURL* Acquire()
+   {
+      {
+         std::lock_guard lock(m_mutex);
+         dropExpired();
+         if (!m_idle.empty())
+         {
+            CURL* curl = m_idle.back().first;
+            m_idle.pop_back();
+            ++m_numReused;
+            return curl;
+         }
+      }
+      return curl_easy_init();
+   }
+
+   // Puts a handle back to the pool. Options are reset, the handle keeps its buffers and other allocations.
+   // Live connections are kept by the multi handle of the loop thread, not by the easy handle.
+   void Release(CURL* curl)
+   {
+      curl_easy_reset(curl);
+
+      std::lock_guard lock(m_mutex);
+      dropExpired();
+      if (m_idle.size() < m_maxSize)
+      {
+         m_idle.emplace_back(curl, std::chrono::steady_clock::now());
+         return;
+      }
+      curl_easy_cleanup(curl);
+   }
+
+   std::uint64_t GetNumReused() const { return m_numReused; }
+
+private:
+   // Closes handles which have not been used for longer than the idle timeout (the oldest ones are in front)
+   void dropExpired()
+   {
+      const auto now = std::chrono::steady_clock::now();
+      while (!m_idle.empty() && now - m_idle.front().second > m_idleTimeout)
+      {
+         curl_easy_cleanup(m_idle.front().first);
+         m_idle.pop_front();
+      }
+   }
+
+private:
+   const std::size_t m_maxSize;                                              // Maximum number of idle handles
+   const std::chrono::seconds m_idleTimeout;                                 // Idle handles older than this are closed
+   std::mutex m_mutex;                                                       // Protects m_idle
+   std::deque<std::pair<CURL*, std::chrono::steady_clock::time_point>> m_idle;  // Idle handles and their release time
+   std::atomic<std::uint64_t> m_numReused{0};                                // Number of handles taken from the pool
+};
+
+class WebClient::SingleFlight
+{
+public:
+   // Registers a callback waiting for the response to the request with given key
+   // @return true if this is the first request with the key, so it has to be sent
+   bool Join(const std::string& key, ResponseCallback callback)
+   {
+      std::lock_guard lock(m_mutex);
+      auto [it, inserted] = m_waiting.try_emplace(key);
+      it->second.emplace_back(std::move(callback));
+      if (!inserted)
+         ++m_numCoalesced;
+      return inserted;
+   }
+
+   // Passes the response (or empty string on error) to all the callbacks waiting for the request with given key
+   void Complete(const std::string& key, std::string response)
+   {
+      std::vector<ResponseCallback> callbacks;
+      {
+         std::lock_guard lock(m_mutex);
+         auto node = m_waiting.extract(key);
+         if (!node)
+            return;
+         callbacks = std::move(node.mapped());
+      }
+
+      // Callbacks are called without the lock, so a callback may send the same request again
+      for (std::size_t i = 0; i + 1 < callbacks.size(); ++i)
+         callbacks[i](response);
+      callbacks.back()(std::move(response));
+   }
+
+   // Returns true if several callbacks wait for the response to the request with given key
+   bool IsShared(const std::string& key)
+   {
+      std::lock_guard lock(m_mutex);
+      const auto it = m_waiting.find(key);
+      return it != m_waiting.end() && it->second.size() > 1;
+   }
+
+   std::uint64_t GetNumCoalesced() const { return m_numCoalesced; }
+
+private:
+   std::mutex m_mutex;  // Protects m_waiting
+   std::unordered_map<std::string, std::vector<ResponseCallback>> m_waiting;  // Callbacks by request key
+   std::atomic<std::uint64_t> m_numCoalesced{0};  // Number of requests which joined an identical one
+};
+
+class WebClient::Hedging
+{
+public:
+   static constexpr std::size_t sc_numLatencies = 256;           // Recent latencies the delay is computed from
+   static constexpr std::size_t sc_updateInterval = 16;          // The delay is recomputed after this many latencies
+   static constexpr std::int64_t sc_maxBurst = 10;               // Hedges which may be sent at once from saved budget
+   static constexpr std::int64_t sc_minDelayUs = 20'000;         // Lower bound of the delay in microseconds
+   static constexpr std::int64_t sc_initialDelayUs = 1'000'000;  // Delay until enough latencies are known
+
+   explicit Hedging(const Options& options)
+      : m_urls(options.hedgeUrls)
+      , m_percentile(std::min<std::uint32_t>(options.hedgePercentile, 100))
+      , m_budgetPercent(std::min<std::uint32_t>(options.hedgeBudgetPercent, 100))
+   {
+   }
+
+   // Returns the time after which an unanswered request is sent to a secondary instance
+   std::chrono::microseconds GetDelay() const
+   {
+      return std::chrono::microseconds(m_delayUs.load(std::memory_order_relaxed));
+   }
+
+   // Adds a latency of the primary instance and recomputes the delay from time to time
+   void RecordLatency(std::chrono::steady_clock::duration latency)
+   {
+      std::lock_guard lock(m_mutex);
+      m_latencies[m_numLatencies++ % sc_numLatencies] =
+         std::chrono::duration_cast<std::chrono::microseconds>(latency).count();
+      if (m_numLatencies % sc_updateInterval != 0)
+         return;
+
+      std::vector<std::int64_t> window(
+         m_latencies.begin(), m_latencies.begin() + std::min(m_numLatencies, sc_numLatencies));
+      const auto nth = window.begin() + (window.size() - 1) * m_percentile / 100;
+      std::nth_element(window.begin(), nth, window.end());
+      m_delayUs.store(std::max(*nth, sc_minDelayUs), std::memory_order_relaxed);
+   }
+
+   // Earns budget for hedging, called once per request
+   void AddRequest()
+   {
+      // The budget is kept in hundredths of a request
+      auto credits = m_credits.load(std::memory_order_relaxed);
+      while (credits < sc_maxBurst * 100 &&
+             !m_credits.compare_exchange_weak(
+                credits, std::min(credits + m_budgetPercent, sc_maxBurst * 100), std::memory_order_relaxed))
+      {
+      }
+   }
+
+   // Spends budget on sending a request to a secondary instance
+   // @return false if the budget is exhausted
+   bool TryAcquire()
+   {
+      auto credits = m_credits.load(std::memory_order_relaxed);
+      while (credits >= 100)
+      {
+         if (m_credits.compare_exchange_weak(credits, credits - 100, std::memory_order_relaxed))
+            return true;
+      }
+      return false;
+   }
+
+   // Returns the base URL of the secondary instance for the next hedge (round robin)
+   const std::string& GetNextUrl()
+   {
+      return m_urls[m_nextUrl.fetch_add(1, std::memory_order_relaxed) % m_urls.size()];
+   }
+
+private:
+   const std::vector<std::string> m_urls;                    // Base URLs of secondary instances
+   const std::size_t m_percentile;                           // Percentile of latencies used as the delay
+   const std::int64_t m_budgetPercent;                       // Hedged requests per 100 requests
+   std::atomic<std::size_t> m_nextUrl{0};                    // Index of the next secondary instance
+   std::atomic<std::int64_t> m_delayUs{sc_initialDelayUs};   // Current delay in microseconds
+   std::atomic<std::int64_t> m_credits{0};                   // Saved budget in hundredths of a request
+   std::mutex m_mutex;                                       // Protects m_latencies
+   std::array<std::int64_t, sc_numLatencies> m_latencies{};  // Recent latencies in microseconds (ring buffer)
+   std::size_t m_numLatencies = 0;                           // Number of latencies added
+};
+
+struct WebClient::HedgedRequest
+{
+   const char* method = "";       // HTTP method name
+   std::string request;           // Request string or POST data
+   std::string cacheKey;          // Key of the response in the response cache, empty if it is not cached
+   std::string flightKey;         // Key of the request which other requests may join, empty if it is not coalesced
+   ResponseCallback callback;     // Callback receiving the response (not used by streamed requests)
+   ResponseStreamPtr stream;      // Stream receiving the response of streamed requests
+   std::shared_ptr<Trace> trace;  // Trace of the RPC which sent the request, continued by the hedge
+   std::shared_ptr<RpcContext> rpc;  // RPC which sent the request, its deadline and cancellation apply to the hedge
+   const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+   std::atomic<const void*> winner{nullptr};  // Transfer whose response is used, the request itself if all failed
+   std::mutex mutex;                          // Protects the fields below
+   std::size_t numPending = 0;                // Number of transfers which have not failed
+   bool hedgeSent = false;                    // True if the request has been sent to a secondary instance
+
+   // Chooses a transfer whose response is used, unless another transfer has answered first
+   // @return true if the transfer is (or has already been) chosen
+   bool Claim(const void* transfer)
+   {
+      const void* expected = nullptr;
+      return winner.compare_exchange_strong(expected, transfer) || expected == transfer;
+   }
+
+   // Marks the request as failed, unless a transfer has answered meanwhile
+   bool Fail() { return Claim(this); }
+
+   // Returns true if the request is answered or has failed
+   bool IsDone() const { return winner.load() != nullptr; }
+
+   // Returns true if another transfer has answered the request, or it has failed
+   bool IsLost(const void* transfer) const
+   {
+      const void* current = winner.load();
+      return current && current != transfer;
+   }
+};
+
+struct WebClient::Transfer
+{
+   const char* method = "";       // HTTP method name (for logging)
+   std::string url;               // Base URL of the instance (for logging)
+   std::string request;           // Request string or POST data, must outlive the transfer
+   std::string response;          // Buffer where response is stored (taken from BufferPool)
+   ResponseStreamPtr stream;      // Stream where response is passed instead of the buffer, if set
+   ResponseStream::ResumeCallback resume;  // Resumes the transfer paused because the reader of the stream is behind
+   CurlPtr curl;                  // Configured CURL handle
+   ResponseCallback callback;     // Callback receiving the response (not used by streamed or hedged transfers)
+   std::string cacheKey;          // Key of the response in the response cache, empty if it is not cached
+   std::shared_ptr<Trace> trace;  // Trace of the RPC which started the transfer, nullptr if it is not traced
+   std::shared_ptr<RpcContext> rpc;  // RPC which started the transfer, nullptr if it is not made for an RPC
+   std::string flightKey;            // Key of the request which other requests may join, empty if it is not coalesced
+   SingleFlightPtr singleFlight;     // Requests which have joined the transfer, set if it is coalesced
+   HedgedRequestPtr hedge;        // Hedged request which the transfer belongs to, nullptr if it is not hedged
+   bool isHedge = false;          // True if the transfer is sent to a secondary instance
+   bool rejected = false;         // True if the transfer is not sent because too many requests wait for the limits
+   bool dropped = false;          // True if the transfer is not sent because it was cancelled waiting for the limits
+   bool sent = false;             // True if the transfer has been scheduled on the event loop
+
+   // Returns the response buffer to the pool, unless it has been passed to the callback
+   ~Transfer() { BufferPool::GetDefault().Release(std::move(response)); }
+
+   // Returns true if the transfer is not needed anymore and is aborted: another instance has answered the hedged
+   // request, or the RPC is cancelled or timed out and no other request waits for the coalesced response
+   bool IsCancelled() const
+   {
+      if (hedge && hedge->IsLost(this))
+         return true;
+      return rpc && rpc->IsCancelled() && !(singleFlight && singleFlight->IsShared(flightKey));
+   }
+};
+
+WebClient::WebClient(std::string url)
+   : WebClient(std::move(url), Options{})
+{
+}
+
+WebClient::WebClient(std::string url, Options options)
    : m_url(std::move(url))
-   , m_writeTimeoutMs(writeTimeoutMs)
+   , m_options(std::move(options))
+   , m_handlePool(std::make_shared<HandlePool>(m_options.connectionPoolSize, m_options.connectionIdleTimeout))
+   , m_singleFlight(std::make_shared<SingleFlight>())
+   , m_hedging(m_options.hedgeUrls.empty() ? nullptr : std::make_unique<Hedging>(m_options))
+   , m_requestDuration(MetricsRegistry::GetDefault().GetHistogram("geo_upstream_request_duration_seconds",
+        "Latency of requests to upstream APIs, including waiting for an event loop thread", {{"upstream", getName()}},
+        1e-6))
+   , m_receivedBytes(MetricsRegistry::GetDefault().GetCounter(
+        "geo_upstream_received_bytes_total", "Size of response bodies received from upstream APIs",
+        {{"upstream", getName()}}))
+   , m_transfersInFlight(MetricsRegistry::GetDefault().GetGauge(
+        "geo_upstream_requests_in_flight", "Requests to upstream APIs which are not finished yet",
+        {{"upstream", getName()}}))
+   , m_okResponses(MetricsRegistry::GetDefault().GetCounter(
+        sz_responsesMetric, sz_responsesMetricHelp, {{"upstream", getName()}, {"code", "200"}}))
+   , m_hedges(MetricsRegistry::GetDefault().GetCounter("geo_upstream_hedged_requests_total",
+        "Requests sent to a secondary instance of an upstream API", {{"upstream", getName()}}))
+   , m_hedgeWins(MetricsRegistry::GetDefault().GetCounter("geo_upstream_hedge_wins_total",
+        "Hedged requests answered by a secondary instance first", {{"upstream", getName()}}))
+   , m_spanName(Trace::Intern(getName() + ".http"))
+   , m_queueSpanName(Trace::Intern(getName() + ".queue"))
 {
+   if (!m_options.eventLoop)
+      m_options.eventLoop = WebEventLoop::GetDefault();
+   if (m_options.limits.maxRequestsPerSecond > 0 || m_options.limits.maxConcurrency > 0)
+      m_limiter = std::make_shared<UpstreamLimiter>(getName(), m_options.limits, m_options.eventLoop);
+}
+
+WebClient::~WebClient()
+{
+   const auto stats = GetStatistics();
+   LOG(INFO) << std::format("Connections to {}: {} requests, {} new connections, {} reused connections, "
+                            "{} reused handles, {} coalesced requests, {} cached responses",
+      m_url, stats.numRequests, stats.numNewConnections, stats.numReusedConnections, stats.numReusedHandles,
+      stats.numCoalescedRequests, stats.numCachedResponses);
 }
 
 std::string WebClient::Get(const std::string& request)
+{
+   return GetAsync(request).get();
+}
+
+std::string WebClient::Post(const std::string& data)
+{
+   return PostAsync(data).get();
+}
+
+void WebClient::GetAsync(const std::string& request, ResponseCallback callback)
 {
    if (request.empty())
    {
       LOG(ERROR) << "Empty request passed.";
-      return "";
+      callback("");
+      return;
+   }
+
+   std::string cacheKey = getCacheKey("GET", request);
+   if (std::string response; findCached(cacheKey, response))
+   {
+      callback(std::move(response));
+      return;
+   }
+
+   std::string flightKey;
+   if (joinInFlight("GET", request, callback, flightKey))
+      return;
+
+   if (m_hedging)
+   {
+      startHedged("GET", request, std::move(cacheKey), std::move(flightKey), std::move(callback), nullptr);
+      return;
    }
 
-   std::string response;
-   auto curl = createCurl(m_url + "?" + request, m_writeTimeoutMs, &response);
-   if (!curl)
+   auto transfer = std::make_shared<Transfer>();
+   transfer->method = "GET";
+   transfer->url = m_url;
+   transfer->request = request;
+   transfer->cacheKey = std::move(cacheKey);
+   transfer->flightKey = std::move(flightKey);
+   transfer->callback = std::move(callback);
+   transfer->response = BufferPool::GetDefault().Acquire();
+   transfer->curl = createCurl(m_url + "?" + request, *transfer);
+   if (!transfer->curl)
    {
       LOG(ERROR) << "Cannot create cURL instance. Data is not sent.";
-      return "";
+      transfer->callback("");
+      return;
    }
 
-#ifdef NDEBUG
-   LOG(INFO) << std::format("Starting HTTP GET request to {}", m_url);
-#else
-   LOG(INFO) << std::format("Starting HTTP GET request to {}, request:\n{}", m_url, request);
-#endif
+   start(std::move(transfer));
+}
 
-   if (!perform(curl))
+void WebClient::PostAsync(const std::string& data, ResponseCallback callback)
+{
+   if (data.empty())
    {
-      LOG(INFO) << std::format("HTTP GET request to {} finished with error (request = {})", m_url, request);
-      return "";
+      LOG(ERROR) << "Empty data passed.";
+      callback("");
+      return;
    }
 
-#ifdef NDEBUG
-   LOG(INFO) << std::format("HTTP GET request to {} finished", m_url);
-#else
-   LOG(INFO) << std::format("HTTP GET request to {} finished, response:\n{}", m_url, response);
-#endif
-   return response;
+   std::string cacheKey = getCacheKey("POST", data);
+   if (std::string response; findCached(cacheKey, response))
+   {
+      callback(std::move(response));
+      return;
+   }
+
+   std::string flightKey;
+   if (joinInFlight("POST", data, callback, flightKey))
+      return;
+
+   if (m_hedging)
+   {
+      startHedged("POST", data, std::move(cacheKey), std::move(flightKey), std::move(callback), nullptr);
+      return;
+   }
+
+   auto transfer = std::make_shared<Transfer>();
+   transfer->method = "POST";
+   transfer->url = m_url;
+   transfer->request = data;
+   transfer->cacheKey = std::move(cacheKey);
+   transfer->flightKey = std::move(flightKey);
+   transfer->callback = std::move(callback);
+   transfer->response = BufferPool::GetDefault().Acquire();
+   transfer->curl = createCurl(m_url, *transfer);
+   if (!transfer->curl)
+   {
+      LOG(ERROR) << "Cannot create cURL instance. Data is not sent.";
+      transfer->callback("");
+      return;
+   }
+
+   if (!safeCall(
+          [&]
+          {
+             setCurlOpt(transfer->curl, CURLOPT_POST, 1L);
+             setCurlOpt(transfer->curl, CURLOPT_POSTFIELDS, transfer->request.c_str());
+          }))
+   {
+      transfer->callback("");
+      return;
+   }
+
+   start(std::move(transfer));
 }
 
-std::string WebClient::Post(const std::string& data)
+ResponseStreamPtr WebClient::PostStream(const std::string& data)
 {
+   auto stream = std::make_shared<ResponseStream>();
    if (data.empty())
    {
       LOG(ERROR) << "Empty data passed.";
-      return "";
+      stream->Finish(false);
+      return stream;
+   }
+
+   // A cached response is passed to the stream at once. Otherwise the stream is collected to be cached.
+   std::string cacheKey = getCacheKey("POST", data);
+   if (std::string response; findCached(cacheKey, response))
+   {
+      stream->Append(response.data(), response.size());
+      stream->Finish(true);
+      BufferPool::GetDefault().Release(std::move(response));
+      return stream;
    }
 
-   std::string response;
-   auto curl = createCurl(m_url, m_writeTimeoutMs, &response);
-   if (!curl)
+   if (m_hedging)
+   {
+      startHedged("POST", data, std::move(cacheKey), {}, nullptr, stream);
+      return stream;
+   }
+
+   auto transfer = std::make_shared<Transfer>();
+   transfer->method = "POST";
+   transfer->url = m_url;
+   transfer->request = data;
+   transfer->stream = stream;
+   transfer->cacheKey = std::move(cacheKey);
+   if (!transfer->cacheKey.empty())
+      transfer->response = BufferPool::GetDefault().Acquire();
+   transfer->curl = createCurl(m_url, *transfer);
+   if (!transfer->curl)
    {
       LOG(ERROR) << "Cannot create cURL instance. Data is not sent.";
-      return "";
+      stream->Finish(false);
+      return stream;
    }
 
    if (!safeCall(
           [&]
           {
-             setCurlOpt(curl, CURLOPT_POST, 1L);
-             setCurlOpt(curl, CURLOPT_POSTFIELDS, data.c_str());
+             setCurlOpt(transfer->curl, CURLOPT_POST, 1L);
+             setCurlOpt(transfer->curl, CURLOPT_POSTFIELDS, transfer->request.c_str());
           }))
    {
-      return "";
+      stream->Finish(false);
+      return stream;
    }
 
+   start(std::move(transfer));
+   return stream;
+}
+
+std::future<std::string> WebClient::GetAsync(const std::string& request)
+{
+   auto promise = std::make_shared<std::promise<std::string>>();
+   auto future = promise->get_future();
+   GetAsync(request,
+      [promise](std::string response)
+      {
+         promise->set_value(std::move(response));
+      });
+   return future;
+}
+
+std::future<std::string> WebClient::PostAsync(const std::string& data)
+{
+   auto promise = std::make_shared<std::promise<std::string>>();
+   auto future = promise->get_future();
+   PostAsync(data,
+      [promise](std::string response)
+      {
+         promise->set_value(std::move(response));
+      });
+   return future;
+}
+
+std::string WebClient::getCacheKey(const char* method, const std::string& request) const
+{
+   if (!m_options.responseCache)
+      return {};
+   return std::format("{} {} {}", m_url, method, request);
+}
+
+bool WebClient::findCached(const std::string& cacheKey, std::string& response)
+{
+   if (cacheKey.empty())
+      return false;
+
+   response = BufferPool::GetDefault().Acquire();
+   if (!m_options.responseCache->Find(cacheKey, response))
+   {
+      BufferPool::GetDefault().Release(std::move(response));
+      return false;
+   }
+
+   ++m_numCachedResponses;
+   GEO_LOG_RATE_LIMITED(INFO, 10) << LogFields("http_cached").Add("upstream", getName()).Add("url", m_url);
+   return true;
+}
+
+bool WebClient::joinInFlight(
+   const char* method, const std::string& request, ResponseCallback& callback, std::string& flightKey)
+{
+   if (!m_options.coalesceRequests)
+      return false;
+
+   // A joined callback is called by the transfer of another request, so it takes its own trace and RPC along
+   Trace* trace = Trace::GetCurrent();
+   RpcContext* rpc = RpcContext::GetCurrent();
+   if (trace || rpc)
+   {
+      callback = [trace = trace ? trace->shared_from_this() : nullptr, rpc = rpc ? rpc->shared_from_this() : nullptr,
+                    callback = std::move(callback)](std::string response)
+      {
+         Trace::Scope scope(trace);
+         RpcContext::Scope rpcScope(rpc);
+         callback(std::move(response));
+      };
+   }
+
+   std::string key = std::format("{} {}", method, request);
+   if (!m_singleFlight->Join(key, std::move(callback)))
+   {
+      GEO_LOG_RATE_LIMITED(INFO, 10)
+         << LogFields("http_joined").Add("upstream", getName()).Add("method", method).Add("url", m_url);
+      return true;
+   }
+
+   flightKey = key;
+   callback = [singleFlight = m_singleFlight, key = std::move(key)](std::string response)
+   {
+      singleFlight->Complete(key, std::move(response));
+   };
+   return false;
+}
+
+void WebClient::start(TransferPtr transfer)
+{
 #ifdef NDEBUG
-   LOG(INFO) << std::format("Starting HTTP POST request to {}", m_url);
+   GEO_LOG_RATE_LIMITED(INFO, 10)
+      << LogFields("http_started").Add("upstream", getName()).Add("method", transfer->method).Add("url", transfer->url);
 #else
-   LOG(INFO) << std::format("Starting HTTP POST request to {}, data:\n{}", m_url, data);
+   GEO_LOG_RATE_LIMITED(INFO, 10) << LogFields("http_started")
+                                        .Add("upstream", getName())
+                                        .Add("method", transfer->method)
+                                        .Add("url", transfer->url)
+                                        .AddBody("request", transfer->request);
 #endif
 
-   if (!perform(curl))
+   m_transfersInFlight.Add(1);
+   if (Trace* trace = Trace::GetCurrent())
+      transfer->trace = trace->shared_from_this();
+   if (RpcContext* rpc = RpcContext::GetCurrent())
+      transfer->rpc = rpc->shared_from_this();
+   if (!transfer->flightKey.empty())
+      transfer->singleFlight = m_singleFlight;
+
+   // Hedges are bounded by their budget, and are sent to other instances than the limited one
+   if (!m_limiter || transfer->isHedge)
+   {
+      send(std::move(transfer));
+      return;
+   }
+
+   // The cancellation check holds a weak reference, so a dropped task releases the transfer
+   auto isCancelled = [weak = std::weak_ptr<Transfer>(transfer)]
+   {
+      const auto transfer = weak.lock();
+      return !transfer || transfer->IsCancelled();
+   };
+   m_limiter->Submit(
+      [this, transfer = std::move(transfer), queueTime = std::chrono::steady_clock::now()](bool admitted)
+      {
+         const auto now = std::chrono::steady_clock::now();
+         if (transfer->trace)
+            transfer->trace->AddSpan(m_queueSpanName, queueTime, now);
+         if (admitted)
+         {
+            send(transfer);
+            return;
+         }
+
+         // Requests of cancelled RPCs are dropped by the limiter without taking a slot, so they are not released
+         if (transfer->IsCancelled())
+         {
+            transfer->dropped = true;
+            finish(transfer, CURLE_ABORTED_BY_CALLBACK, now);
+            return;
+         }
+         transfer->rejected = true;
+         finish(transfer, CURLE_OK, now);
+      },
+      std::move(isCancelled));
+}
+
+void WebClient::send(TransferPtr transfer)
+{
+   if (transfer->IsCancelled())
+   {
+      finish(transfer, CURLE_ABORTED_BY_CALLBACK, std::chrono::steady_clock::now());
+      return;
+   }
+
+   // A transfer which other requests may join keeps its own timeout, the deadline of its RPC is checked by the
+   // progress callback, as long as no other request waits for the response
+   const auto remaining = transfer->rpc ? transfer->rpc->GetRemaining() : RpcContext::Clock::duration::max();
+   const bool limitedByRpc = remaining != RpcContext::Clock::duration::max() && transfer->flightKey.empty();
+   safeCall(
+      [&]
+      {
+         if (limitedByRpc)
+         {
+            // cURL takes a zero timeout as none
+            const long remainingMs = std::max<long>(std::chrono::ceil<std::chrono::milliseconds>(remaining).count(), 1);
+            setCurlOpt(transfer->curl, CURLOPT_TIMEOUT_MS, std::min<long>(m_options.writeTimeoutMs, remainingMs));
+         }
+         if (transfer->hedge || transfer->rpc)
+         {
+            setCurlOpt(transfer->curl, CURLOPT_XFERINFOFUNCTION, curlProgressFunction<Transfer>);
+            setCurlOpt(transfer->curl, CURLOPT_XFERINFODATA, transfer.get());
+            setCurlOpt(transfer->curl, CURLOPT_NOPROGRESS, 0L);
+         }
+      });
+
+   transfer->sent = true;
+   CURL* curl = transfer->curl.get();
+   m_options.eventLoop->Add(curl,
+      [this, transfer = std::move(transfer), startTime = std::chrono::steady_clock::now()](CURLcode result)
+      {
+         finish(transfer, result, startTime);
+      });
+}
+
+void WebClient::finish(const TransferPtr& transfer, CURLcode result, std::chrono::steady_clock::time_point startTime)
+{
+   // Aborted transfers are not needed anymore, so they are not reported as errors
+   const bool cancelled = transfer->IsCancelled();
+   if (transfer->sent)
+   {
+      updateStatistics(transfer->curl);
+      recordMetrics(transfer->curl, startTime);
+   }
+   else
+   {
+      m_transfersInFlight.Add(-1);
+   }
+
+   if (transfer->rejected)
    {
-      LOG(INFO) << std::format("HTTP POST request to {} finished with error (data = {})", m_url, data);
-      return "";
+      GEO_LOG_RATE_LIMITED(ERROR, 10) << LogFields("http_rejected")
+                                            .Add("upstream", getName())
+                                            .Add("method", transfer->method)
+                                            .Add("url", transfer->url)
+                                            .Add("reason", "too many requests wait for the limits of the API");
+   }
+   else if (m_limiter && !transfer->isHedge && !transfer->dropped)
+   {
+      // The next waiting request is started before the response is processed
+      m_limiter->Release(
+         getOutcome(transfer->curl.get(), result, cancelled), startTime, getRetryAfter(transfer->curl.get()));
+   }
+
+   // The callback continues the traced RPC, e.g. parses the response or starts the next request
+   Trace::Scope scope(transfer->trace);
+   RpcContext::Scope rpcScope(transfer->rpc);
+   if (transfer->trace && transfer->sent)
+      transfer->trace->AddSpan(m_spanName, startTime, Trace::Clock::now());
+   const bool succeeded = !cancelled && transfer->sent && checkResult(transfer->curl, result);
+   if (!succeeded && !cancelled && !transfer->rejected)
+      GEO_LOG_RATE_LIMITED(INFO, 10) << LogFields("http_failed")
+                                           .Add("upstream", getName())
+                                           .Add("method", transfer->method)
+                                           .Add("url", transfer->url)
+                                           .AddBody("request", transfer->request);
+
+   if (succeeded && !transfer->cacheKey.empty())
+      m_options.responseCache->Put(transfer->cacheKey, transfer->response, m_options.isCacheable);
+
+   if (transfer->hedge)
+   {
+      if (succeeded)
+         GEO_LOG_RATE_LIMITED(INFO, 10) << LogFields("http_finished")
+                                              .Add("upstream", getName())
+                                              .Add("method", transfer->method)
+                                              .Add("url", transfer->url)
+                                              .Add("hedge", transfer->isHedge);
+      finishAttempt(transfer->hedge, transfer.get(), succeeded);
+      return;
+   }
+
+   if (transfer->stream)
+   {
+      if (succeeded)
+         GEO_LOG_RATE_LIMITED(INFO, 10) << LogFields("http_finished")
+                                              .Add("upstream", getName())
+                                              .Add("method", transfer->method)
+                                              .Add("url", transfer->url)
+                                              .Add("streamed", true);
+      transfer->stream->Finish(succeeded);
+      return;
+   }
+
+   if (!succeeded)
+   {
+      transfer->callback("");
+      return;
    }
 
 #ifdef NDEBUG
-   LOG(INFO) << std::format("HTTP POST request to {} finished", m_url);
+   GEO_LOG_RATE_LIMITED(INFO, 10) << LogFields("http_finished")
+                                        .Add("upstream", getName())
+                                        .Add("method", transfer->method)
+                                        .Add("url", transfer->url)
+                                        .Add("response_bytes", transfer->response.size());
 #else
-   LOG(INFO) << std::format("HTTP POST request to {} finished, response:\n{}", m_url, response);
+   GEO_LOG_RATE_LIMITED(INFO, 10) << LogFields("http_finished")
+                                        .Add("upstream", getName())
+                                        .Add("method", transfer->method)
+                                        .Add("url", transfer->url)
+                                        .AddBody("response", transfer->response);
 #endif
-   return response;
+   transfer->callback(std::move(transfer->response));
 }
 
-// Creates and configures a CURL instance with specified URL, timeout, and response buffer
-WebClient::CurlPtr WebClient::createCurl(
-   const std::string& url, std::uint64_t writeTimeoutMs, std::string* responseBuffer)
+void WebClient::startHedged(const char* method, const std::string& request, std::string cacheKey,
+   std::string flightKey, ResponseCallback callback, ResponseStreamPtr stream)
 {
-   auto curl = CurlPtr(curl_easy_init(),
-      [](auto p)
+   auto hedge = std::make_shared<HedgedRequest>();
+   hedge->method = method;
+   hedge->request = request;
+   hedge->cacheKey = std::move(cacheKey);
+   hedge->flightKey = std::move(flightKey);
+   hedge->callback = std::move(callback);
+   hedge->stream = std::move(stream);
+   hedge->numPending = 1;
+   if (Trace* trace = Trace::GetCurrent())
+      hedge->trace = trace->shared_from_this();
+   if (RpcContext* rpc = RpcContext::GetCurrent())
+      hedge->rpc = rpc->shared_from_this();
+
+   m_hedging->AddRequest();
+   sendAttempt(hedge, m_url, false);
+
+   // An answered request may be followed by destruction of the client, so the timer checks the request first
+   m_options.eventLoop->AddTimer(m_hedging->GetDelay(),
+      [this, hedge]
       {
-         curl_easy_cleanup(p);
+         if (!hedge->IsDone())
+            sendHedge(hedge);
       });
-   if (!curl)
+}
+
+void WebClient::sendAttempt(const HedgedRequestPtr& hedge, const std::string& url, bool isHedge)
+{
+   auto transfer = std::make_shared<Transfer>();
+   transfer->method = hedge->method;
+   transfer->url = url;
+   transfer->request = hedge->request;
+   transfer->stream = hedge->stream;
+   transfer->cacheKey = hedge->cacheKey;
+   transfer->flightKey = hedge->flightKey;
+   transfer->hedge = hedge;
+   transfer->isHedge = isHedge;
+   if (!transfer->stream || !transfer->cacheKey.empty())
+      transfer->response = BufferPool::GetDefault().Acquire();
+
+   const bool isGet = std::string_view(transfer->method) == "GET";
+   transfer->curl = createCurl(isGet ? url + "?" + transfer->request : url, *transfer);
+   if (!transfer->curl)
+   {
+      LOG(ERROR) << "Cannot create cURL instance. Data is not sent.";
+      finishAttempt(hedge, nullptr, false);
+      return;
+   }
+
+   if (!isGet && !safeCall(
+                    [&]
+                    {
+                       setCurlOpt(transfer->curl, CURLOPT_POST, 1L);
+                       setCurlOpt(transfer->curl, CURLOPT_POSTFIELDS, transfer->request.c_str());
+                    }))
+   {
+      finishAttempt(hedge, nullptr, false);
+      return;
+   }
+
+   start(std::move(transfer));
+}
+
+void WebClient::sendHedge(const HedgedRequestPtr& hedge)
+{
+   {
+      std::lock_guard lock(hedge->mutex);
+      if (hedge->IsDone() || hedge->hedgeSent || isAbandoned(*hedge) || !m_hedging->TryAcquire())
+         return;
+      hedge->hedgeSent = true;
+      ++hedge->numPending;
+   }
+
+   // Timers are called on an event loop thread, so the trace and the deadline of the RPC are restored
+   Trace::Scope scope(hedge->trace);
+   RpcContext::Scope rpcScope(hedge->rpc);
+   m_hedges.Increment();
+   sendAttempt(hedge, m_hedging->GetNextUrl(), true);
+}
+
+bool WebClient::isAbandoned(const HedgedRequest& hedge) const
+{
+   return hedge.rpc && hedge.rpc->IsCancelled() &&
+      !(!hedge.flightKey.empty() && m_singleFlight->IsShared(hedge.flightKey));
+}
+
+void WebClient::finishAttempt(const HedgedRequestPtr& hedge, Transfer* transfer, bool succeeded)
+{
+   // The primary instance is learned from its answers and from the time it has been aborted after,
+   // so slow answers are not missing from the latencies
+   if (transfer && !transfer->isHedge && (succeeded || hedge->IsLost(transfer)))
+      m_hedging->RecordLatency(std::chrono::steady_clock::now() - hedge->startTime);
+
+   if (succeeded && hedge->Claim(transfer))
+   {
+      if (transfer->isHedge)
+         m_hedgeWins.Increment();
+      if (hedge->stream)
+         hedge->stream->Finish(true);
+      else
+         hedge->callback(std::move(transfer->response));
+      return;
+   }
+
+   // A stream which has received a part of the response cannot be continued by another instance
+   const bool streamBroken = transfer && hedge->stream && hedge->winner.load() == transfer;
+   if (!streamBroken)
+   {
+      bool sendNext = false;
+      {
+         std::lock_guard lock(hedge->mutex);
+         --hedge->numPending;
+         if (hedge->IsDone())
+            return;
+
+         // A failed request is sent to a secondary instance at once, if it has not been sent there yet
+         if (!hedge->hedgeSent && !isAbandoned(*hedge) && m_hedging->TryAcquire())
+         {
+            hedge->hedgeSent = true;
+            ++hedge->numPending;
+            sendNext = true;
+         }
+         else if (hedge->numPending > 0 || !hedge->Fail())
+         {
+            return;
+         }
+      }
+
+      if (sendNext)
+      {
+         m_hedges.Increment();
+         sendAttempt(hedge, m_hedging->GetNextUrl(), true);
+         return;
+      }
+   }
+
+   if (hedge->stream)
+      hedge->stream->Finish(false);
+   else
+      hedge->callback("");
+}
+
+WebClient::Statistics WebClient::GetStatistics() const
+{
+   return {m_numRequests, m_numNewConnections, m_numReusedConnections, m_handlePool->GetNumReused(),
+      m_singleFlight->GetNumCoalesced(), m_numCachedResponses};
+}
+
+// Takes a pooled CURL instance and configures it with specified URL, timeout, and response buffer
+WebClient::CurlPtr WebClient::createCurl(const std::string& url, Transfer& transfer)
+{
+   CURL* handle = m_handlePool->Acquire();
+   if (!handle)
       return nullptr;
 
+   auto curl = CurlPtr(handle,
+      [pool = m_handlePool](auto p)
+      {
+         pool->Release(p);
+      });
+
+   // The reader of a stream resumes the paused transfer through the event loop, as only its thread may do it
+   if (transfer.stream)
+   {
+      transfer.resume = [eventLoop = m_options.eventLoop, handle]
+      {
+         eventLoop->Resume(handle);
+      };
+   }
+
    if (!safeCall(
           [&]
           {
              setCurlOpt(curl, CURLOPT_URL, url.c_str());
              setCurlOpt(curl, CURLOPT_SSL_VERIFYPEER, 0L);  // Disable SSL peer verification
              setCurlOpt(curl, CURLOPT_SSL_VERIFYHOST, 0L);  // Disable SSL host verification
-             setCurlOpt(curl, CURLOPT_TIMEOUT_MS, writeTimeoutMs);
-             setCurlOpt(curl, CURLOPT_WRITEFUNCTION, curlWriteFunction);
-             setCurlOpt(curl, CURLOPT_WRITEDATA, responseBuffer);
+             setCurlOpt(curl, CURLOPT_TIMEOUT_MS, m_options.writeTimeoutMs);
+             if (transfer.stream)
+             {
+                setCurlOpt(curl, CURLOPT_WRITEFUNCTION, curlStreamWriteFunction<Transfer>);
+                setCurlOpt(curl, CURLOPT_WRITEDATA, &transfer);
+             }
+             else
+             {
+                setCurlOpt(curl, CURLOPT_WRITEFUNCTION, curlWriteFunction<Transfer>);
+                setCurlOpt(curl, CURLOPT_WRITEDATA, &transfer);
+             }
              setCurlOpt(curl, CURLOPT_FAILONERROR, 1L);  // Fail on HTTP errors (4xx, 5xx)
              setCurlOpt(curl, CURLOPT_USERAGENT, "geo-service/0.1");
+             setCurlOpt(curl, CURLOPT_NOSIGNAL, 1L);  // Required when transfers are performed by several threads
+             setCurlOpt(curl, CURLOPT_SHARE, m_options.eventLoop->GetShare());  // Shared DNS and TLS sessions
+             setCurlOpt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+             setCurlOpt(curl, CURLOPT_MAXAGE_CONN, static_cast<long>(m_options.connectionIdleTimeout.count()));
           }))
    {
       return nullptr;
@@ -176,20 +1103,54 @@ WebClient::CurlPtr WebClient::createCurl(
    return curl;
 }
 
-// Executes CURL request and handles potential errors
-bool WebClient::perform(const CurlPtr& curl)
+void WebClient::updateStatistics(const CurlPtr& curl)
+{
+   long numConnects = 0;
+   curl_easy_getinfo(curl.get(), CURLINFO_NUM_CONNECTS, &numConnects);
+
+   ++m_numRequests;
+   m_numNewConnections += numConnects;
+   if (numConnects == 0)
+      ++m_numReusedConnections;
+}
+
+void WebClient::recordMetrics(const CurlPtr& curl, std::chrono::steady_clock::time_point startTime)
+{
+   m_transfersInFlight.Add(-1);
+   m_requestDuration.Record(
+      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count());
+
+   curl_off_t receivedBytes = 0;
+   if (curl_easy_getinfo(curl.get(), CURLINFO_SIZE_DOWNLOAD_T, &receivedBytes) == CURLE_OK && receivedBytes > 0)
+      m_receivedBytes.Increment(static_cast<std::uint64_t>(receivedBytes));
+
+   // Series of other status codes are looked up when they occur, it takes a lock but they are rare
+   long responseCode = 0;
+   curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &responseCode);
+   if (responseCode == 200)
+   {
+      m_okResponses.Increment();
+      return;
+   }
+   MetricsRegistry::GetDefault()
+      .GetCounter(sz_responsesMetric, sz_responsesMetricHelp,
+         {{"upstream", getName()}, {"code", responseCode != 0 ? std::to_string(responseCode) : "none"}})
+      .Increment();
+}
+
+// Checks result of a finished CURL request and logs potential errors
+bool WebClient::checkResult(const CurlPtr& curl, CURLcode result)
 {
-   const auto res = curl_easy_perform(curl.get());
-   if (res == CURLE_HTTP_RETURNED_ERROR)
+   if (result == CURLE_HTTP_RETURNED_ERROR)
    {
       long httpErrorCode = 0;
       curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &httpErrorCode);
-      LOG(ERROR) << std::format("HTTP error code: {}", httpErrorCode);
+      GEO_LOG_RATE_LIMITED(ERROR, 10) << std::format("HTTP error code: {}", httpErrorCode);
       return false;
    }
-   else if (res != CURLE_OK)
+   else if (result != CURLE_OK)
    {
-      LOG(ERROR) << std::format("cURL error: {}", curl_easy_strerror(res));
+      GEO_LOG_RATE_LIMITED(ERROR, 10) << std::format("cURL error: {}", curl_easy_strerror(result));
       return false;
    }
    return true;
@@ -1,9 +1,24 @@
 #pragma once
 
+#include "BufferPool.h"
+#include "Metrics.h"
+#include "ResponseCache.h"
+#include "ResponseStream.h"
+#include "RpcContext.h"
+#include "Tracing.h"
+#include "UpstreamLimiter.h"
+#include "WebEventLoop.h"
+
 #include <curl/curl.h>
 
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
 #include <memory>
 #include <string>
+#include <vector>
 
 namespace geo
 {
@@ -11,43 +26,241 @@ namespace geo
 class WebClient
 {
 public:
-   static const int sc_defaultTimeoutMs = 180'000;  // Default timeout in milliseconds (180 seconds)
+   static constexpr int sc_defaultTimeoutMs = 180'000;          // Default timeout in milliseconds (180 seconds)
+   static constexpr int sc_defaultConnectionPoolSize = 16;      // Default number of idle CURL handles kept for reuse
+   static constexpr int sc_defaultConnectionIdleTimeoutS = 60;  // Default idle timeout of pooled handles in seconds
+
+   // Callback receiving the server response, or empty string on error.
+   // It is called on an event loop thread and must not block.
+   // The response buffer may be returned to BufferPool::GetDefault() when it is not needed anymore.
+   using ResponseCallback = std::function<void(std::string response)>;
+
+   // Settings of a WebClient instance
+   struct Options
+   {
+      std::uint64_t writeTimeoutMs = sc_defaultTimeoutMs;  // Timeout value for write operations in milliseconds
+      std::size_t connectionPoolSize = sc_defaultConnectionPoolSize;  // Maximum number of idle handles kept for reuse
+      std::chrono::seconds connectionIdleTimeout{sc_defaultConnectionIdleTimeoutS};  // Idle handles and connections
+                                                                                      // older than this are closed
+      WebEventLoopPtr eventLoop;     // Event loop which performs transfers (default: WebEventLoop::GetDefault())
+      bool coalesceRequests = true;  // Identical concurrent requests share a single transfer and its response
+      ResponseCache* responseCache = nullptr;  // Persistent cache of successful responses (not used if nullptr)
+      ResponseCache::Validator isCacheable;    // Checks a successful response before it is cached, e.g. that the
+                                               // query has been completed (every response is cached if empty)
+      std::string name;  // Name of the API in the "upstream" label of metrics (default: the base URL)
+      std::vector<std::string> hedgeUrls;     // Base URLs of other instances of the API which receive a request
+                                              // if the primary one is slow or fails (not hedged if empty)
+      std::uint32_t hedgePercentile = 95;     // A request is hedged when it is not answered within this
+                                              // percentile of recent latencies of the primary instance
+      std::uint32_t hedgeBudgetPercent = 10;  // Hedged requests per 100 requests, at most 100 (doubled load)
+      UpstreamLimiter::Settings limits;       // Rate and adaptive concurrency limits of requests to the primary
+                                              // instance (not limited by default)
+   };
+
+   // Counters describing how well connections are reused
+   struct Statistics
+   {
+      std::uint64_t numRequests = 0;           // Number of finished transfers
+      std::uint64_t numNewConnections = 0;     // Number of connections which had to be established
+      std::uint64_t numReusedConnections = 0;  // Number of transfers which reused a live connection of their
+                                               // loop thread, i.e. number of TCP and TLS handshakes avoided
+      std::uint64_t numReusedHandles = 0;      // Number of transfers which reused a pooled CURL handle
+      std::uint64_t numCoalescedRequests = 0;  // Number of requests which joined an identical one in flight
+      std::uint64_t numCachedResponses = 0;    // Number of requests answered by the response cache
+   };
 
 public:
-   // Constructor taking base URL and optional write timeout in milliseconds
+   // Constructor taking base URL, default settings are used
+   // @param address The base URL for web requests
+   explicit WebClient(std::string address);
+
+   // Constructor taking base URL and settings
    // @param address The base URL for web requests
-   // @param writeTimeoutMs Timeout value for write operations in milliseconds (default: sc_defaultTimeoutMs)
-   WebClient(std::string address, std::uint64_t writeTimeoutMs = sc_defaultTimeoutMs);
+   // @param options Timeout, connection pool and event loop settings
+   WebClient(std::string address, Options options);
+
+   // Destructor. All transfers started by this client must be finished before it is destroyed.
+   ~WebClient();
+
+   WebClient(const WebClient&) = delete;
+   WebClient& operator=(const WebClient&) = delete;
 
    // Performs HTTP GET request with provided request string and returns response
+   // Blocks the calling thread, so it must not be called from an event loop thread.
    // @param request The request string to append to the base URL
    // @return The server response as string, or empty string on error
    std::string Get(const std::string& request);
 
    // Performs HTTP POST request with provided data and returns response
+   // Blocks the calling thread, so it must not be called from an event loop thread.
    // @param data The data to send in the POST request body
    // @return The server response as string, or empty string on error
    std::string Post(const std::string& data);
 
+   // Starts HTTP GET request with provided request string and returns immediately
+   // @param request The request string to append to the base URL
+   // @param callback Callback receiving the server response
+   void GetAsync(const std::string& request, ResponseCallback callback);
+
+   // Starts HTTP POST request with provided data and returns immediately
+   // @param data The data to send in the POST request body
+   // @param callback Callback receiving the server response
+   void PostAsync(const std::string& data, ResponseCallback callback);
+
+   // Starts HTTP GET request with provided request string
+   // @param request The request string to append to the base URL
+   // @return Future with the server response as string, or empty string on error
+   std::future<std::string> GetAsync(const std::string& request);
+
+   // Starts HTTP POST request with provided data
+   // @param data The data to send in the POST request body
+   // @return Future with the server response as string, or empty string on error
+   std::future<std::string> PostAsync(const std::string& data);
+
+   // Starts HTTP POST request with provided data; the response is consumed while it is being received.
+   // Streamed requests are never coalesced, as every stream has a single reader.
+   // @param data The data to send in the POST request body
+   // @return Stream with the response body; ResponseStream::Wait() tells whether the whole response is received
+   ResponseStreamPtr PostStream(const std::string& data);
+
+   // Returns connection reuse and caching counters collected since construction
+   Statistics GetStatistics() const;
+
+   // Returns the base URL of this client
+   const std::string& GetUrl() const { return m_url; }
+
 private:
    using CurlPtr = std::shared_ptr<CURL>;  // Type alias for shared pointer to CURL handle
 
+   class HandlePool;  // Idle keep-alive CURL handles of this endpoint
+   using HandlePoolPtr = std::shared_ptr<HandlePool>;
+
+   struct Transfer;  // State of a single transfer which must stay alive until it is finished
+   using TransferPtr = std::shared_ptr<Transfer>;
+
+   class SingleFlight;  // Callbacks waiting for identical requests in flight
+   using SingleFlightPtr = std::shared_ptr<SingleFlight>;
+
+   class Hedging;  // Delay and budget of hedged requests
+
+   struct HedgedRequest;  // Request which may be sent to several instances, answered by the first response
+   using HedgedRequestPtr = std::shared_ptr<HedgedRequest>;
+
 private:
-   // Creates and configures a CURL instance with given parameters
+   // Takes a CURL instance from the pool (or creates a new one) and configures it with given parameters
    // @param url The complete URL for the request
-   // @param writeTimeoutMs Timeout value for write operations in milliseconds
-   // @param responseBuffer Pointer to string where response will be stored
-   // @return Configured CURL handle wrapped in shared_ptr, or nullptr on error
-   static CurlPtr createCurl(const std::string& url, std::uint64_t writeTimeoutMs, std::string* responseBuffer);
+   // @param transfer Transfer which receives the response into its buffer or stream
+   // @return Configured CURL handle wrapped in shared_ptr which returns it to the pool, or nullptr on error
+   CurlPtr createCurl(const std::string& url, Transfer& transfer);
 
-   // Executes the CURL request and returns success status
-   // @param curl Configured CURL handle to perform
+   // Checks the result of a finished CURL request
+   // @param curl CURL handle which has been performed
+   // @param result cURL result code of the transfer
    // @return true if request succeeded, false otherwise
-   static bool perform(const CurlPtr& curl);
+   static bool checkResult(const CurlPtr& curl, CURLcode result);
+
+   // Returns the key of a request in the response cache, or empty string if responses are not cached
+   // @param method HTTP method name
+   // @param request Request string or POST data
+   std::string getCacheKey(const char* method, const std::string& request) const;
+
+   // Finds the response to a request in the response cache
+   // @param cacheKey Key of the request in the response cache, may be empty
+   // @param response Receives the cached response
+   // @return true if the response is found
+   bool findCached(const std::string& cacheKey, std::string& response);
+
+   // Joins an identical request which is already in flight, if request coalescing is enabled
+   // @param method HTTP method name
+   // @param request Request string or POST data
+   // @param callback Callback of the request. If the request has to be sent, it is replaced with a callback
+   //                 which passes the response to all the joined requests.
+   // @param flightKey Receives the key of the request which other requests may join, empty if it is not coalesced
+   // @return true if the callback has joined a request in flight and nothing has to be sent
+   bool joinInFlight(
+      const char* method, const std::string& request, ResponseCallback& callback, std::string& flightKey);
+
+   // Schedules a configured transfer on the event loop when the limits of the API allow
+   // @param transfer Transfer with configured CURL handle
+   void start(TransferPtr transfer);
+
+   // Schedules a transfer admitted by the limits on the event loop, with a timeout which ends at the deadline
+   // of its RPC. A transfer of an RPC which nobody waits for anymore is finished without being sent.
+   // @param transfer Transfer with configured CURL handle
+   void send(TransferPtr transfer);
+
+   // Passes the result of a finished or rejected transfer on
+   // @param transfer Finished transfer
+   // @param result cURL result code of the transfer
+   // @param startTime Time when the transfer was scheduled on the event loop
+   void finish(const TransferPtr& transfer, CURLcode result, std::chrono::steady_clock::time_point startTime);
+
+   // Sends a request to the primary instance, and to a secondary one if the primary does not answer
+   // within the hedge delay or fails. The instance which answers first is used, the other transfer is aborted.
+   // @param method HTTP method name
+   // @param request Request string or POST data
+   // @param cacheKey Key of the request in the response cache, may be empty
+   // @param flightKey Key of the request which other requests may join, may be empty
+   // @param callback Callback receiving the response (not used if the stream is set)
+   // @param stream Stream receiving the response of the instance which starts answering first, may be nullptr
+   void startHedged(const char* method, const std::string& request, std::string cacheKey, std::string flightKey,
+      ResponseCallback callback, ResponseStreamPtr stream);
+
+   // Sends a hedged request to an instance
+   // @param hedge Hedged request
+   // @param url Base URL of the instance
+   // @param isHedge True if the instance is a secondary one
+   void sendAttempt(const HedgedRequestPtr& hedge, const std::string& url, bool isHedge);
+
+   // Sends a hedged request to a secondary instance when the hedge delay has passed, if the budget allows
+   void sendHedge(const HedgedRequestPtr& hedge);
+
+   // Returns true if the RPC of a hedged request is cancelled and no other request waits for its response,
+   // so a hedge would be dropped at once after taking the budget
+   bool isAbandoned(const HedgedRequest& hedge) const;
+
+   // Passes the first successful response of a hedged request on, or sends the request to a secondary instance
+   // if the transfer has failed
+   // @param hedge Hedged request
+   // @param transfer Finished transfer, nullptr if it could not be started
+   // @param succeeded True if the transfer has succeeded
+   void finishAttempt(const HedgedRequestPtr& hedge, Transfer* transfer, bool succeeded);
+
+   // Updates connection reuse counters after a transfer is finished
+   // @param curl CURL handle which has been performed
+   void updateStatistics(const CurlPtr& curl);
+
+   // Records latency, received bytes and HTTP status of a finished transfer in the metrics registry
+   // @param curl CURL handle which has been performed
+   // @param startTime Time when the transfer was scheduled
+   void recordMetrics(const CurlPtr& curl, std::chrono::steady_clock::time_point startTime);
+
+   // Returns the name of the API in metrics
+   const std::string& getName() const { return m_options.name.empty() ? m_url : m_options.name; }
 
 private:
-   std::string m_url;               // Base URL for web requests
-   std::uint64_t m_writeTimeoutMs;  // Timeout value for write operations in milliseconds
+   std::string m_url;                           // Base URL for web requests
+   Options m_options;                           // Client settings
+   HandlePoolPtr m_handlePool;                  // Idle CURL handles kept for reuse
+   SingleFlightPtr m_singleFlight;              // Requests in flight, shared by identical concurrent requests
+   std::unique_ptr<Hedging> m_hedging;          // Hedging policy, nullptr if there are no secondary instances
+   std::shared_ptr<UpstreamLimiter> m_limiter;  // Limits of requests to the primary instance, nullptr if not limited
+
+   std::atomic<std::uint64_t> m_numRequests{0};           // See Statistics::numRequests
+   std::atomic<std::uint64_t> m_numNewConnections{0};     // See Statistics::numNewConnections
+   std::atomic<std::uint64_t> m_numReusedConnections{0};  // See Statistics::numReusedConnections
+   std::atomic<std::uint64_t> m_numCachedResponses{0};    // See Statistics::numCachedResponses
+
+   // Metrics of the API, shared by the clients with the same name
+   MetricsRegistry::Histogram& m_requestDuration;  // Time from scheduling a transfer to its completion
+   MetricsRegistry::Counter& m_receivedBytes;      // Size of received response bodies
+   MetricsRegistry::Gauge& m_transfersInFlight;    // Number of transfers scheduled or in flight
+   MetricsRegistry::Counter& m_okResponses;        // Number of responses with HTTP status 200
+   MetricsRegistry::Counter& m_hedges;             // Number of requests sent to secondary instances
+   MetricsRegistry::Counter& m_hedgeWins;          // Number of hedged requests answered by a secondary instance
+
+   const char* m_spanName = nullptr;       // Name of transfer spans in traces, e.g. "overpass.http"
+   const char* m_queueSpanName = nullptr;  // Name of spans waiting for the limits, e.g. "overpass.queue"
 };
 
 }  // namespace geo
@@ -0,0 +1,303 @@
+#include "WebEventLoop.h"
+
+#include <absl/log/log.h>
+#include <curl/multi.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <format>
+#include <map>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace
+{
+
+// Maximum time a loop thread sleeps in curl_multi_poll() when there is no activity
+const int sc_pollTimeoutMs = 1000;
+
+// cURL global initialization is not thread-safe, so it is done once before any loop thread is started
+void initializeCurlOnce()
+{
+   static std::once_flag s_flag;
+   std::call_once(s_flag,
+      []
+      {
+         const auto res = curl_global_init(CURL_GLOBAL_DEFAULT);
+         if (res != CURLE_OK)
+            throw std::runtime_error(std::format("cURL error: {0}", curl_easy_strerror(res)));
+      });
+}
+
+}  // namespace
+
+namespace geo
+{
+
+class WebEventLoop::Worker
+{
+public:
+   Worker()
+      : m_multi(curl_multi_init())
+   {
+      if (!m_multi)
+         throw std::runtime_error("Cannot create cURL multi handle");
+      m_thread = std::thread(&Worker::run, this);
+   }
+
+   ~Worker()
+   {
+      m_stop = true;
+      curl_multi_wakeup(m_multi);
+      m_thread.join();
+
+      // Complete everything which is left, so that owners of the transfers are not waiting forever
+      for (auto& [curl, completion] : m_active)
+      {
+         curl_multi_remove_handle(m_multi, curl);
+         completion(CURLE_ABORTED_BY_CALLBACK);
+      }
+      for (auto& [curl, completion] : m_pending)
+         completion(CURLE_ABORTED_BY_CALLBACK);
+
+      curl_multi_cleanup(m_multi);
+   }
+
+   void Add(CURL* curl, Completion completion)
+   {
+      {
+         std::lock_guard lock(m_mutex);
+         m_pending.emplace_back(curl, std::move(completion));
+      }
+      ++m_numTransfers;
+      curl_multi_wakeup(m_multi);
+   }
+
+   void AddTimer(std::chrono::steady_clock::time_point time, std::function<void()> callback)
+   {
+      {
+         std::lock_guard lock(m_mutex);
+         m_timers.emplace(time, std::move(callback));
+      }
+      curl_multi_wakeup(m_multi);
+   }
+
+   void Resume(CURL* curl)
+   {
+      {
+         std::lock_guard lock(m_mutex);
+         m_resumed.push_back(curl);
+      }
+      curl_multi_wakeup(m_multi);
+   }
+
+   std::size_t GetNumTransfers() const { return m_numTransfers; }
+
+private:
+   // Thread function: moves new transfers into the multi handle, performs them and dispatches completions
+   void run()
+   {
+      while (!m_stop)
+      {
+         addPending();
+         resumePaused();
+
+         int numRunning = 0;
+         const auto res = curl_multi_perform(m_multi, &numRunning);
+         if (res != CURLM_OK)
+            LOG(ERROR) << std::format("cURL multi error: {}", curl_multi_strerror(res));
+
+         processFinished();
+
+         const int timeoutMs = runTimers();
+         curl_multi_poll(m_multi, nullptr, 0, timeoutMs, nullptr);
+      }
+   }
+
+   // Adds transfers scheduled by other threads to the multi handle
+   void addPending()
+   {
+      std::vector<std::pair<CURL*, Completion>> pending;
+      {
+         std::lock_guard lock(m_mutex);
+         pending.swap(m_pending);
+      }
+
+      for (auto& [curl, completion] : pending)
+      {
+         const auto res = curl_multi_add_handle(m_multi, curl);
+         if (res != CURLM_OK)
+         {
+            LOG(ERROR) << std::format("cURL multi error: {}", curl_multi_strerror(res));
+            --m_numTransfers;
+            completion(CURLE_FAILED_INIT);
+            continue;
+         }
+         m_active.emplace(curl, std::move(completion));
+      }
+   }
+
+   // Resumes paused transfers of this thread, handles of other threads and finished transfers are skipped
+   void resumePaused()
+   {
+      std::vector<CURL*> resumed;
+      {
+         std::lock_guard lock(m_mutex);
+         resumed.swap(m_resumed);
+      }
+
+      // Data held back by a paused transfer may be passed to its write function right away
+      for (CURL* curl : resumed)
+      {
+         if (m_active.contains(curl))
+            curl_easy_pause(curl, CURLPAUSE_CONT);
+      }
+   }
+
+   // Removes finished transfers from the multi handle and invokes their completions
+   void processFinished()
+   {
+      int numMessages = 0;
+      while (CURLMsg* message = curl_multi_info_read(m_multi, &numMessages))
+      {
+         if (message->msg != CURLMSG_DONE)
+            continue;
+
+         CURL* curl = message->easy_handle;
+         const CURLcode result = message->data.result;
+         curl_multi_remove_handle(m_multi, curl);
+
+         auto it = m_active.find(curl);
+         if (it == m_active.end())
+            continue;
+
+         // Completion may schedule new transfers or destroy the easy handle, so it is detached from the map first
+         Completion completion = std::move(it->second);
+         m_active.erase(it);
+         --m_numTransfers;
+         completion(result);
+      }
+   }
+
+   // Calls the timers which are due
+   // @return Time until the next timer in milliseconds, at most sc_pollTimeoutMs
+   int runTimers()
+   {
+      std::vector<std::function<void()>> due;
+      int timeoutMs = sc_pollTimeoutMs;
+      {
+         std::lock_guard lock(m_mutex);
+         const auto now = std::chrono::steady_clock::now();
+         while (!m_timers.empty() && m_timers.begin()->first <= now)
+         {
+            due.push_back(std::move(m_timers.begin()->second));
+            m_timers.erase(m_timers.begin());
+         }
+         if (!m_timers.empty())
+         {
+            const auto untilNext =
+               std::chrono::ceil<std::chrono::milliseconds>(m_timers.begin()->first - now).count();
+            timeoutMs = static_cast<int>(std::min<std::int64_t>(untilNext, sc_pollTimeoutMs));
+         }
+      }
+
+      // Timers are called without the lock, so they may add transfers and timers
+      for (auto& callback : due)
+         callback();
+      return timeoutMs;
+   }
+
+private:
+   using Timers = std::multimap<std::chrono::steady_clock::time_point, std::function<void()>>;
+
+   CURLM* m_multi;                                       // Multi handle owned by this thread
+   std::mutex m_mutex;                                   // Protects m_pending, m_resumed and m_timers
+   std::vector<std::pair<CURL*, Completion>> m_pending;  // Transfers scheduled but not yet added to m_multi
+   std::vector<CURL*> m_resumed;                         // Paused transfers to resume, of any loop thread
+   Timers m_timers;                                      // Callbacks by the time they are due
+   std::unordered_map<CURL*, Completion> m_active;       // Transfers in m_multi (accessed by the loop thread only)
+   std::atomic<std::size_t> m_numTransfers{0};           // Number of pending and active transfers
+   std::atomic<bool> m_stop{false};                      // Set when the thread must exit
+   std::thread m_thread;                                 // Loop thread
+};
+
+WebEventLoop::WebEventLoop(std::size_t numThreads)
+{
+   initializeCurlOnce();
+
+   m_share = curl_share_init();
+   if (!m_share)
+      throw std::runtime_error("Cannot create cURL share handle");
+   curl_share_setopt(m_share, CURLSHOPT_LOCKFUNC, &WebEventLoop::lockShare);
+   curl_share_setopt(m_share, CURLSHOPT_UNLOCKFUNC, &WebEventLoop::unlockShare);
+   curl_share_setopt(m_share, CURLSHOPT_USERDATA, this);
+   curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+   curl_share_setopt(m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+
+   for (std::size_t i = 0; i < std::max<std::size_t>(1, numThreads); ++i)
+      m_workers.emplace_back(std::make_unique<Worker>());
+}
+
+WebEventLoop::~WebEventLoop()
+{
+   // Easy handles of unfinished transfers are released by the workers, and only then the share handle can be freed
+   m_workers.clear();
+   if (curl_share_cleanup(m_share) != CURLSHE_OK)
+      LOG(ERROR) << "cURL share handle is still in use";
+}
+
+void WebEventLoop::Add(CURL* curl, Completion completion)
+{
+   selectWorker().Add(curl, std::move(completion));
+}
+
+void WebEventLoop::AddTimer(std::chrono::steady_clock::duration delay, std::function<void()> callback)
+{
+   selectWorker().AddTimer(std::chrono::steady_clock::now() + delay, std::move(callback));
+}
+
+void WebEventLoop::Resume(CURL* curl)
+{
+   // Only the thread performing the transfer may resume it, and it is not known here, so all threads are asked
+   for (const auto& w : m_workers)
+      w->Resume(curl);
+}
+
+std::size_t WebEventLoop::GetNumTransfers() const
+{
+   std::size_t result = 0;
+   for (const auto& w : m_workers)
+      result += w->GetNumTransfers();
+   return result;
+}
+
+void WebEventLoop::lockShare(CURL*, curl_lock_data data, curl_lock_access, void* userp)
+{
+   static_cast<WebEventLoop*>(userp)->m_shareMutexes[data].lock();
+}
+
+void WebEventLoop::unlockShare(CURL*, curl_lock_data data, void* userp)
+{
+   static_cast<WebEventLoop*>(userp)->m_shareMutexes[data].unlock();
+}
+
+WebEventLoop::Worker& WebEventLoop::selectWorker()
+{
+   const auto it = std::min_element(m_workers.begin(), m_workers.end(),
+      [](const auto& w1, const auto& w2)
+      {
+         return w1->GetNumTransfers() < w2->GetNumTransfers();
+      });
+   return **it;
+}
+
+WebEventLoopPtr WebEventLoop::GetDefault()
+{
+   static const auto s_eventLoop = std::make_shared<WebEventLoop>();
+   return s_eventLoop;
+}
+
+}  // namespace geo
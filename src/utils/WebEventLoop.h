@@ -0,0 +1,85 @@
+#pragma once
+
+#include <curl/curl.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace geo
+{
+
+// Event loop which drives cURL transfers asynchronously using the cURL multi interface.
+// Each loop thread owns its own multi handle, so a few threads can keep hundreds of transfers in flight.
+// Every multi handle keeps its own cache of live connections, since cURL cannot share a connection cache between
+// multi handles performed on different threads. DNS cache and TLS sessions are shared by all the loop threads through
+// a single CURLSH object, so a connection opened by another thread resumes the TLS session without a full handshake.
+class WebEventLoop
+{
+public:
+   // Callback invoked on a loop thread when a transfer is finished.
+   // It must not block, otherwise it stalls all the other transfers of the same loop thread.
+   // @param result cURL result code of the finished transfer
+   using Completion = std::function<void(CURLcode result)>;
+
+public:
+   // Constructor starting the loop threads
+   // @param numThreads Number of loop threads (at least one thread is always started)
+   explicit WebEventLoop(std::size_t numThreads = 1);
+
+   // Destructor stops the loop threads; unfinished transfers are completed with CURLE_ABORTED_BY_CALLBACK
+   ~WebEventLoop();
+
+   WebEventLoop(const WebEventLoop&) = delete;
+   WebEventLoop& operator=(const WebEventLoop&) = delete;
+
+   // Schedules a configured easy handle for execution on the least loaded loop thread. Thread-safe.
+   // @param curl Easy handle which must stay alive until the completion is called
+   // @param completion Callback invoked when the transfer is finished
+   void Add(CURL* curl, Completion completion);
+
+   // Calls a function on a loop thread after a delay. Thread-safe.
+   // Timers which have not fired when the loop is destroyed are dropped.
+   // @param delay Time after which the callback is called
+   // @param callback Function which must not block, like completions
+   void AddTimer(std::chrono::steady_clock::duration delay, std::function<void()> callback);
+
+   // Resumes a transfer whose write function has paused it (CURL_WRITEFUNC_PAUSE) on the loop thread performing it.
+   // Thread-safe. A handle which is not performed anymore is ignored.
+   // @param curl Easy handle of the paused transfer
+   void Resume(CURL* curl);
+
+   // Returns number of transfers which are currently scheduled or in flight on all loop threads
+   std::size_t GetNumTransfers() const;
+
+   // Returns the share handle which must be set (CURLOPT_SHARE) to every easy handle performed by this loop.
+   // It is safe to use from any thread.
+   CURLSH* GetShare() const { return m_share; }
+
+   // Returns the process-wide event loop used by WebClient instances created without an explicit one
+   static std::shared_ptr<WebEventLoop> GetDefault();
+
+private:
+   class Worker;  // A single loop thread with its own multi handle
+
+   // Returns the loop thread with the fewest transfers
+   Worker& selectWorker();
+
+   // cURL callbacks which lock and unlock shared data of the share handle
+   static void lockShare(CURL* curl, curl_lock_data data, curl_lock_access access, void* userp);
+   static void unlockShare(CURL* curl, curl_lock_data data, void* userp);
+
+private:
+   std::array<std::mutex, CURL_LOCK_DATA_LAST> m_shareMutexes;  // One mutex per kind of shared data
+   CURLSH* m_share = nullptr;                                    // DNS cache and TLS sessions
+   std::vector<std::unique_ptr<Worker>> m_workers;               // Loop threads
+};
+
+using WebEventLoopPtr = std::shared_ptr<WebEventLoop>;
+
+}  // namespace geo
@@ -11,6 +11,7 @@ import geo_pb2
 
 import logging
 import os
+from datetime import datetime
 
 LOGGER = logging.getLogger("main")
 LOGGER.addHandler(logging.StreamHandler())
@@ -40,6 +41,20 @@ class Client(object):
         request = geo_pb2.CitiesRequest(position=geo_pb2.Point(latitude=latitude, longitude=longitude))
         return self.stub.GetCities(request)
 
+    def get_regions_stream(self, latitude: float, longitude: float, distance_km: int, mask: int, properties: dict):
+        request = geo_pb2.RegionsRequest(position=geo_pb2.Point(latitude=latitude, longitude=longitude),
+                                         distance_km=distance_km,
+                                         prefs=geo_pb2.RegionsRequest.Preferences(mask=mask, properties=properties))
+        return self.stub.GetRegionsStream(request)
+
+    def get_weather(self, locations: list, from_date: datetime, to_date: datetime, num_years: int):
+        request = geo_pb2.WeatherRequest(locations=[geo_pb2.Point(latitude=latitude, longitude=longitude)
+                                                    for latitude, longitude in locations],
+                                         num_years=num_years)
+        request.from_date.FromDatetime(from_date)
+        request.to_date.FromDatetime(to_date)
+        return self.stub.GetWeather(request)
+
 def main():
     client = Client()
 
@@ -62,5 +77,31 @@ def main():
     LOGGER.info("Response:")
     LOGGER.info(response)
 
+    # GetRegionsStream
+    request_params = {
+        "latitude": 46.5,
+        "longitude": 8.0,
+        "distance_km": 100,
+        "mask": geo_pb2.RegionsRequest.Preferences.GEOGRAPHICAL_FEATURE_INTERNATIONAL_AIRPORTS |
+                geo_pb2.RegionsRequest.Preferences.GEOGRAPHICAL_FEATURE_PEAKS,
+        "properties": {"minPeakHeight": "2500"}
+    }
+    LOGGER.info(f"GetRegionsStream: {request_params}")
+    for response in client.get_regions_stream(**request_params):
+        LOGGER.info("Response:")
+        LOGGER.info(response)
+
+    # GetWeather
+    request_params = {
+        "locations": [(55.991893, 37.214390)],
+        "from_date": datetime(2026, 6, 1),
+        "to_date": datetime(2026, 6, 10),
+        "num_years": 3
+    }
+    LOGGER.info(f"GetWeather: {request_params}")
+    response = client.get_weather(**request_params)
+    LOGGER.info("Response:")
+    LOGGER.info(response)
+
 if __name__ == '__main__':
     main()
@@ -0,0 +1,312 @@
+"""
+Local mock of the Overpass, Nominatim and Open Meteo APIs for offline load tests.
+
+Responses are generated from the requests, so the service gets consistent answers: relation ids found by Overpass
+are known to Nominatim, and weather has a value for every requested day. Every upstream has its own latency
+distribution, error rate and payload size:
+
+    python3 tests/mock_server.py --port 8080 \\
+        --overpass-latency lognormal:300:3000 --overpass-error-rate 0.01 --overpass-payload 20 \\
+        --nominatim-latency uniform:50:150 --openmeteo-latency fixed:80
+    ./geo --config tests/mock-config.json
+    ./build/tools/geo_load --rpcs GetCities,GetRegions,GetWeather --qps 50 --duration 60
+
+Latency distributions are "fixed:MS", "uniform:MIN_MS:MAX_MS" and "lognormal:MEDIAN_MS:P99_MS".
+Failed requests are answered with --error-status (e.g. 429 with Retry-After, or 504). With --NAME-rate-limit,
+requests over the rate of an API are answered with 429 and Retry-After like public instances do, e.g.
+--nominatim-rate-limit 1 checks that the service keeps to the usage policy of Nominatim.
+
+Requests to other paths are answered with an empty Overpass response after --delay-ms. It is used to check
+that the asynchronous WebClient keeps many transfers in flight with only a few event loop threads, e.g.:
+
+    python3 tests/mock_server.py --port 8080 --delay-ms 1000
+    ./geo --config geo-config.json --debug --url http://127.0.0.1:8080/ --requests 500
+
+With 500 requests and a 1 second delay the whole batch should finish in about one second.
+"""
+
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, unquote_plus, urlsplit
+import argparse
+import datetime
+import json
+import math
+import random
+import re
+import threading
+import time
+import zlib
+
+OVERPASS_PATH = "/api/interpreter"
+NOMINATIM_PATH = "/lookup"
+OPENMETEO_PATH = "/v1/archive"
+
+SYLLABLES = ["ber", "lin", "mar", "ka", "sto", "ri", "vel", "na", "dor", "hei", "burg", "tal", "sen", "ro", "ma"]
+
+
+class Latency:
+    """Latency distribution parsed from "fixed:MS", "uniform:MIN_MS:MAX_MS" or "lognormal:MEDIAN_MS:P99_MS"."""
+
+    def __init__(self, spec):
+        parts = spec.split(":")
+        self.kind = parts[0]
+        values = [float(value) / 1000.0 for value in parts[1:]]
+        if self.kind == "fixed" and len(values) == 1:
+            self.value = values[0]
+        elif self.kind == "uniform" and len(values) == 2:
+            self.low, self.high = values
+        elif self.kind == "lognormal" and len(values) == 2 and 0 < values[0] <= values[1]:
+            # P99 of a log-normal distribution is median * exp(2.326 * sigma)
+            self.mu = math.log(values[0])
+            self.sigma = math.log(values[1] / values[0]) / 2.326
+        else:
+            raise argparse.ArgumentTypeError("invalid latency distribution: " + spec)
+
+    def sample(self, rng):
+        if self.kind == "fixed":
+            return self.value
+        if self.kind == "uniform":
+            return rng.uniform(self.low, self.high)
+        return rng.lognormvariate(self.mu, self.sigma)
+
+
+class Upstream:
+    """Behavior of a mocked API."""
+
+    def __init__(self, latency, error_rate, payload, rate_limit=0.0):
+        self.latency = latency
+        self.error_rate = error_rate
+        self.payload = payload
+        self.rate_limit = rate_limit
+        self.recent = []
+        self.lock = threading.Lock()
+
+    def throttled(self):
+        """Returns True if the request exceeds the rate limit within the last second."""
+        if self.rate_limit <= 0:
+            return False
+        now = time.monotonic()
+        with self.lock:
+            self.recent = [started for started in self.recent if now - started < 1.0]
+            if len(self.recent) >= self.rate_limit:
+                return True
+            self.recent.append(now)
+            return False
+
+
+def make_rng(*keys):
+    # Equal requests get equal responses
+    return random.Random(zlib.crc32(repr(keys).encode()))
+
+
+def make_name(rng):
+    return "".join(rng.choice(SYLLABLES) for _ in range(rng.randint(2, 4))).capitalize()
+
+
+def overpass_document(elements):
+    return {"version": 0.6, "generator": "Overpass API (mock)", "osm3s": {}, "elements": elements}
+
+
+def feature_regions(query):
+    """Answers the per-tile region searches: features of one kind, then every region followed by the IDs of the nodes
+    it contains. Features are generated by a fixed grid of cells, so the same features are found whichever boxes cover
+    them."""
+    box = re.search(r"\((-?[0-9.e]+), (-?[0-9.e]+), (-?[0-9.e]+), (-?[0-9.e]+)\)", query)
+    min_lat, min_lon, max_lat, max_lon = (float(value) for value in box.groups())
+    kind = next(name for name in ("aerodrome", "peak", "beach", "salt") if name in query)
+    min_height = re.search(r"number\(t\[\"ele\"\]\) > (-?[0-9]+)", query)
+    cell = 0.5
+    elements = []
+    region_nodes = {}
+    for row in range(math.floor(min_lat / cell), math.floor(max_lat / cell) + 1):
+        for column in range(math.floor(min_lon / cell), math.floor(max_lon / cell) + 1):
+            cell_rng = make_rng(kind, row, column)
+            for _ in range(cell_rng.randint(0, 2)):
+                lat = (row + cell_rng.random()) * cell
+                lon = (column + cell_rng.random()) * cell
+                ele = cell_rng.randint(0, 4000)
+                node = {"type": "node", "id": cell_rng.randint(10 ** 8, 10 ** 10), "lat": lat, "lon": lon}
+                if kind == "peak":
+                    node["tags"] = {"natural": "peak", "name": make_name(cell_rng), "ele": str(ele)}
+                if not (min_lat <= lat <= max_lat and min_lon <= lon <= max_lon):
+                    continue
+                if min_height and ele <= int(min_height.group(1)):
+                    continue
+                elements.append(node)
+                # Regions are 3 degree cells, so they span several tiles
+                region = (math.floor(lat / 3), math.floor(lon / 3))
+                region_nodes.setdefault(10000 + zlib.crc32(repr(region).encode()) % 17000000, []).append(node["id"])
+    for region_id, node_ids in region_nodes.items():
+        elements.append({"type": "relation", "id": region_id})
+        elements.extend({"type": "node", "id": node_id} for node_id in node_ids)
+    return overpass_document(elements)
+
+
+def overpass_response(query, payload):
+    """Answers the queries of OverpassApiUtils.cc and SearchEngine.cc, see the request formats there."""
+    rng = make_rng(query)
+    ids = re.search(r"rel\(id:([0-9,]+)\)", query)
+    if ids:
+        # City details: every city relation is followed by its hotels and museums
+        elements = []
+        for osm_id in ids.group(1).split(","):
+            city_rng = make_rng(osm_id)
+            lat, lon = city_rng.uniform(-60, 70), city_rng.uniform(-180, 180)
+            elements.append({"type": "relation", "id": int(osm_id)})
+            for _ in range(payload):
+                elements.append({"type": "node", "id": city_rng.randint(10 ** 8, 10 ** 10),
+                                 "lat": lat + city_rng.uniform(-0.1, 0.1), "lon": lon + city_rng.uniform(-0.1, 0.1),
+                                 "tags": {"tourism": city_rng.choice(["hotel", "museum"]),
+                                          "name": make_name(city_rng)}})
+        return overpass_document(elements)
+
+    if "foreach.regions" in query:
+        return feature_regions(query)
+
+    if "out tags" in query:
+        # Region search: administrative regions with tags
+        return overpass_document([{"type": "relation", "id": rng.randint(10000, 17000000),
+                                   "tags": {"boundary": "administrative", "admin_level": "4",
+                                            "name": make_name(rng)}}
+                                  for _ in range(rng.randint(0, payload))])
+
+    # Cities by name or position: a few relation ids
+    return overpass_document([{"type": "relation", "id": rng.randint(10000, 17000000)}
+                              for _ in range(rng.randint(1, 5))])
+
+
+def nominatim_response(params):
+    """Answers lookups of NominatimApiUtils.cc, every relation is found and is a city, a town or a state."""
+    items = []
+    for value in params.get("osm_ids", [""])[0].split(","):
+        if not value.startswith("R") or not value[1:].isdigit():
+            continue
+        osm_id = int(value[1:])
+        rng = make_rng(value[1:])
+        address_type = ["city", "town", "state"][osm_id % 3]
+        name, country = make_name(rng), make_name(rng)
+        items.append({"place_id": osm_id * 7, "osm_type": "relation", "osm_id": osm_id,
+                      "lat": "%.7f" % rng.uniform(-60, 70), "lon": "%.7f" % rng.uniform(-180, 180),
+                      "class": "boundary", "type": "administrative", "addresstype": address_type, "name": name,
+                      "display_name": name + ", " + country,
+                      "address": {address_type: name, "country": country, "country_code": country[:2].lower()}})
+    return items
+
+
+def openmeteo_response(params):
+    """Answers requests of OpenMeteoApiUtils.cc with a value for every requested day."""
+    latitude = float(params["latitude"][0])
+    longitude = float(params["longitude"][0])
+    start = datetime.date.fromisoformat(params["start_date"][0])
+    end = datetime.date.fromisoformat(params["end_date"][0])
+    rng = make_rng(round(latitude, 2), round(longitude, 2), str(start), str(end))
+    days = [start + datetime.timedelta(days=i) for i in range((end - start).days + 1)]
+    maxima = [round(20 - abs(latitude) / 4 + rng.uniform(0, 8), 1) for _ in days]
+    return {"latitude": latitude, "longitude": longitude, "generationtime_ms": 0.1, "utc_offset_seconds": 0,
+            "timezone": "GMT", "elevation": 100.0,
+            "daily_units": {"time": "iso8601", "temperature_2m_max": "°C", "temperature_2m_min": "°C"},
+            "daily": {"time": [day.isoformat() for day in days], "temperature_2m_max": maxima,
+                      "temperature_2m_min": [round(value - rng.uniform(4, 12), 1) for value in maxima]}}
+
+
+class MockHandler(BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+    delay_seconds = 0.0
+    error_status = 503
+    upstreams = {}
+    rng = random.Random()
+    rng_lock = threading.Lock()
+    body = b'{"elements":[]}'
+
+    def _reply(self, status, body, headers=()):
+        self.send_response(status)
+        self.send_header("Content-Type", "application/json")
+        self.send_header("Content-Length", str(len(body)))
+        for name, value in headers:
+            self.send_header(name, value)
+        self.end_headers()
+        self.wfile.write(body)
+
+    def _answer(self, path, params, query):
+        upstream = self.upstreams.get(path)
+        if upstream is None:
+            time.sleep(self.delay_seconds)
+            self._reply(200, self.body)
+            return
+
+        if upstream.throttled():
+            self._reply(429, b'{"error":"rate limit exceeded"}', [("Retry-After", "1")])
+            return
+
+        with self.rng_lock:
+            delay = upstream.latency.sample(self.rng)
+            failed = self.rng.random() < upstream.error_rate
+        time.sleep(delay)
+        if failed:
+            self._reply(self.error_status, b'{"error":"mock failure"}', [("Retry-After", "1")])
+            return
+
+        try:
+            if path == OVERPASS_PATH:
+                document = overpass_response(query, upstream.payload)
+            elif path == NOMINATIM_PATH:
+                document = nominatim_response(params)
+            else:
+                document = openmeteo_response(params)
+        except (KeyError, ValueError):
+            self._reply(400, b'{"error":"bad request"}')
+            return
+        self._reply(200, json.dumps(document, ensure_ascii=False).encode())
+
+    def do_GET(self):
+        url = urlsplit(self.path)
+        self._answer(url.path, parse_qs(url.query), "")
+
+    def do_POST(self):
+        url = urlsplit(self.path)
+        body = self.rfile.read(int(self.headers.get("Content-Length", 0))).decode()
+        # Overpass accepts both a raw query and a form with the "data" field
+        query = unquote_plus(body[5:]) if body.startswith("data=") else body
+        self._answer(url.path, parse_qs(url.query), query)
+
+    def log_message(self, format, *args):
+        pass
+
+
+class MockServer(ThreadingHTTPServer):
+    request_queue_size = 1024
+    daemon_threads = True
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Mock of Overpass, Nominatim and Open Meteo APIs")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--delay-ms", type=int, default=1000, help="Delay of requests to other paths")
+    parser.add_argument("--error-status", type=int, default=503, help="HTTP status of failed requests")
+    parser.add_argument("--seed", type=int, default=None, help="Seed of latencies and failures")
+    latencies = {"overpass": "lognormal:300:3000", "nominatim": "uniform:50:150", "openmeteo": "lognormal:80:400"}
+    for name, latency in latencies.items():
+        parser.add_argument(f"--{name}-latency", type=Latency, default=Latency(latency),
+                            help=f"Latency distribution (default {latency})")
+        parser.add_argument(f"--{name}-error-rate", type=float, default=0.0, help="Share of failed requests")
+        parser.add_argument(f"--{name}-rate-limit", type=float, default=0.0,
+                            help="Requests per second answered, further ones get 429 (0: not limited)")
+    parser.add_argument("--overpass-payload", type=int, default=20,
+                        help="Hotels and museums per city, and maximum number of regions per region search")
+    args = parser.parse_args()
+
+    MockHandler.delay_seconds = args.delay_ms / 1000.0
+    MockHandler.error_status = args.error_status
+    MockHandler.rng = random.Random(args.seed)
+    MockHandler.upstreams = {
+        OVERPASS_PATH: Upstream(args.overpass_latency, args.overpass_error_rate, args.overpass_payload,
+                                args.overpass_rate_limit),
+        NOMINATIM_PATH: Upstream(args.nominatim_latency, args.nominatim_error_rate, 0, args.nominatim_rate_limit),
+        OPENMETEO_PATH: Upstream(args.openmeteo_latency, args.openmeteo_error_rate, 0, args.openmeteo_rate_limit),
+    }
+    server = MockServer(("127.0.0.1", args.port), MockHandler)
+    server.serve_forever()
+
+
+if __name__ == '__main__':
+    main()
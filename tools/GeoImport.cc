@@ -0,0 +1,356 @@
+// Offline importer of OpenStreetMap boundaries into the local indexes of the geo service.
+//
+// Input is a GeoJSON FeatureCollection of Polygon and MultiPolygon features with OSM tags in "properties",
+// e.g. exported by `osmium export -a type,id` or by Overpass turbo from a query like
+//    rel[boundary=administrative][admin_level~"^(2|4)$"]; rel[place~"^(city|town|state)$"];
+// Features with place=city|town|state, or admin_level=4 (as a state), go to the city index and to the name index.
+// Features with admin_level=2 are countries: they are not indexed, but give country names to the places inside.
+//
+// Usage:
+//    geo_import --input=boundaries.geojson --cities=cities.idx --names=names.idx
+// Any of the outputs may be omitted.
+
+#include "search/CityIndexBuilder.h"
+#include "search/NameIndexBuilder.h"
+#include "utils/JsonUtils.h"
+
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/log/globals.h>
+#include <absl/log/initialize.h>
+#include <absl/log/log.h>
+#include <rapidjson/document.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <format>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+ABSL_FLAG(std::string, input, "", "GeoJSON file with OSM boundaries");
+ABSL_FLAG(std::string, cities, "", "Output city index file for FindCitiesByPosition (cityIndexPath setting)");
+ABSL_FLAG(std::string, names, "", "Output name index file for FindCitiesByName (nameIndexPath setting)");
+
+namespace
+{
+
+using namespace geo;
+
+using Ring = CityIndexBuilder::Ring;
+using Rings = std::vector<Ring>;
+
+// Place read from the input
+struct InputPlace
+{
+   CityIndexBuilder::Place place;   // Place with its boundary
+   std::vector<std::string> names;  // Values of "name:*" tags
+};
+
+// Country boundary used to assign country names to places
+struct Country
+{
+   std::string name;      // Name in the native language
+   Rings rings;           // Outer rings and holes of all the polygons
+   double minLat = 90;    // Minimum latitude of the rings
+   double minLon = 180;   // Minimum longitude of the rings
+   double maxLat = -90;   // Maximum latitude of the rings
+   double maxLon = -180;  // Maximum longitude of the rings
+};
+
+// Returns a tag value as a string, numbers are converted to strings (e.g. admin_level exported as a number)
+template <typename TJsonValue>
+std::string getTag(const TJsonValue& properties, const char* name)
+{
+   if (!properties.IsObject() || !properties.HasMember(name))
+      return {};
+
+   const auto& value = properties[name];
+   if (value.IsString())
+      return std::string(json::GetString(value));
+   if (value.IsInt64())
+      return std::to_string(value.GetInt64());
+   return {};
+}
+
+// Returns values of all the "name:*" tags (e.g. "name:en", "name:de")
+template <typename TJsonValue>
+std::vector<std::string> getLocalizedNames(const TJsonValue& properties)
+{
+   std::vector<std::string> names;
+   if (!properties.IsObject())
+      return names;
+
+   for (auto it = properties.MemberBegin(); it != properties.MemberEnd(); ++it)
+   {
+      if (it->value.IsString() && json::GetString(it->name).starts_with("name:"))
+         names.emplace_back(json::GetString(it->value));
+   }
+   return names;
+}
+
+// Extracts OSM ID of a relation from a feature.
+// Supported forms are "r123" and "relation/123" ids, numeric ids with "@type": "relation",
+// and negative osm2pgsql ids of relations.
+// @return OSM ID, or nothing if the feature is not a relation
+template <typename TJsonValue>
+std::optional<std::int64_t> getRelationId(const TJsonValue& feature)
+{
+   const auto& properties = json::Get(feature, "properties");
+   std::string id = getTag(properties, "@id");
+   if (id.empty())
+      id = getTag(properties, "osm_id");
+   if (id.empty() && json::Has(feature, "id"))
+      id = getTag(feature, "id");
+
+   std::string type = getTag(properties, "@type");
+   const auto digits = id.find_first_of("-0123456789");
+   if (digits == std::string::npos)
+      return std::nullopt;
+   if (digits > 0)
+      type = id.substr(0, digits);
+
+   if (!type.empty() && type != "r" && type != "relation" && type != "relation/")
+      return std::nullopt;
+
+   const std::int64_t value = std::strtoll(id.c_str() + digits, nullptr, 10);
+   return value != 0 ? std::optional(std::abs(value)) : std::nullopt;
+}
+
+// Reads rings of a Polygon or MultiPolygon geometry, GeoJSON positions are [longitude, latitude]
+template <typename TJsonValue>
+Rings getRings(const TJsonValue& geometry)
+{
+   Rings rings;
+   auto readPolygon = [&rings](const auto& polygon)
+   {
+      for (const auto& ring : polygon.GetArray())
+      {
+         Ring& points = rings.emplace_back();
+         for (const auto& position : ring.GetArray())
+         {
+            if (position.IsArray() && position.Size() >= 2 && position[0u].IsNumber() && position[1u].IsNumber())
+               points.push_back({position[1u].GetDouble(), position[0u].GetDouble()});
+         }
+      }
+   };
+
+   const std::string type(json::GetString(json::Get(geometry, "type")));
+   const auto& coordinates = json::Get(geometry, "coordinates");
+   if (!coordinates.IsArray())
+      return rings;
+
+   if (type == "Polygon")
+   {
+      readPolygon(coordinates);
+   }
+   else if (type == "MultiPolygon")
+   {
+      for (const auto& polygon : coordinates.GetArray())
+         readPolygon(polygon);
+   }
+   return rings;
+}
+
+// Returns signed area and centroid of a ring in the plane of degrees
+std::pair<double, CityIndexBuilder::Point> getAreaAndCentroid(const Ring& ring)
+{
+   double area = 0, lat = 0, lon = 0;
+   for (std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+   {
+      const double cross = ring[j].longitude * ring[i].latitude - ring[i].longitude * ring[j].latitude;
+      area += cross;
+      lat += (ring[j].latitude + ring[i].latitude) * cross;
+      lon += (ring[j].longitude + ring[i].longitude) * cross;
+   }
+   area /= 2;
+   if (area == 0)
+      return {0, ring.front()};
+   return {area, {lat / (6 * area), lon / (6 * area)}};
+}
+
+// Returns the center of a place: the centroid of its biggest ring (the outer ring of the main polygon)
+CityIndexBuilder::Point getCenter(const Rings& rings)
+{
+   double maxArea = -1;
+   CityIndexBuilder::Point center;
+   for (const auto& ring : rings)
+   {
+      if (ring.size() < 3)
+         continue;
+      const auto [area, centroid] = getAreaAndCentroid(ring);
+      if (std::abs(area) > maxArea)
+      {
+         maxArea = std::abs(area);
+         center = centroid;
+      }
+   }
+   return center;
+}
+
+// Checks if the point is inside the boundary (even-odd rule over all the rings)
+bool isInside(const Country& country, const CityIndexBuilder::Point& point)
+{
+   if (point.latitude < country.minLat || point.latitude > country.maxLat || point.longitude < country.minLon ||
+      point.longitude > country.maxLon)
+      return false;
+
+   bool inside = false;
+   for (const auto& ring : country.rings)
+   {
+      for (std::size_t i = 0, j = ring.size() - 1; i < ring.size(); j = i++)
+      {
+         if ((ring[i].latitude > point.latitude) != (ring[j].latitude > point.latitude) &&
+            point.longitude < ring[i].longitude + (point.latitude - ring[i].latitude) *
+                  (ring[j].longitude - ring[i].longitude) / (ring[j].latitude - ring[i].latitude))
+            inside = !inside;
+      }
+   }
+   return inside;
+}
+
+// Reads the whole file, throws std::runtime_error if it cannot be read
+std::string readFile(const std::string& path)
+{
+   std::ifstream file(path, std::ios::binary);
+   if (!file.is_open())
+      throw std::runtime_error("Failed to open input file: " + path);
+
+   std::stringstream buffer;
+   buffer << file.rdbuf();
+   return buffer.str();
+}
+
+void importBoundaries(const std::string& inputPath, const std::string& citiesPath, const std::string& namesPath)
+{
+   // The input may be huge, so it is parsed in place.
+   std::string content = readFile(inputPath);
+   rapidjson::Document document;
+   document.ParseInsitu(content.data());
+   if (document.HasParseError() || !json::Get(document, "features").IsArray())
+      throw std::runtime_error("Input is not a GeoJSON FeatureCollection: " + inputPath);
+
+   std::vector<InputPlace> places;
+   std::vector<Country> countries;
+   std::size_t numSkipped = 0;
+   for (const auto& feature : json::Get(document, "features").GetArray())
+   {
+      const auto& properties = json::Get(feature, "properties");
+      const std::string name = getTag(properties, "name");
+      const std::string place = getTag(properties, "place");
+      const std::string adminLevel = getTag(properties, "admin_level");
+      Rings rings = getRings(json::Get(feature, "geometry"));
+      if (name.empty() || rings.empty())
+      {
+         ++numSkipped;
+         continue;
+      }
+
+      if (adminLevel == "2" && place.empty())
+      {
+         Country& country = countries.emplace_back(Country{name, std::move(rings)});
+         for (const auto& ring : country.rings)
+         {
+            for (const auto& point : ring)
+            {
+               country.minLat = std::min(country.minLat, point.latitude);
+               country.minLon = std::min(country.minLon, point.longitude);
+               country.maxLat = std::max(country.maxLat, point.latitude);
+               country.maxLon = std::max(country.maxLon, point.longitude);
+            }
+         }
+         continue;
+      }
+
+      CityIndex::PlaceType type;
+      if (place == "city")
+         type = CityIndex::City;
+      else if (place == "town")
+         type = CityIndex::Town;
+      else if (place == "state" || (place.empty() && adminLevel == "4"))
+         type = CityIndex::State;
+      else
+      {
+         ++numSkipped;
+         continue;
+      }
+
+      const auto osmId = getRelationId(feature);
+      if (!osmId)
+      {
+         ++numSkipped;
+         continue;
+      }
+
+      const auto center = getCenter(rings);
+      CityIndexBuilder::Place city{
+         *osmId, type, name, getTag(properties, "is_in:country"), center.latitude, center.longitude, std::move(rings)};
+      places.push_back({std::move(city), getLocalizedNames(properties)});
+   }
+
+   LOG(INFO) << std::format("Read {} places and {} countries, skipped {} features", places.size(),
+      countries.size(), numSkipped);
+
+   CityIndexBuilder cities;
+   NameIndexBuilder names;
+   for (auto& [place, localizedNames] : places)
+   {
+      for (const auto& country : countries)
+      {
+         if (isInside(country, {place.latitude, place.longitude}))
+         {
+            place.country = country.name;
+            break;
+         }
+      }
+
+      if (!namesPath.empty() &&
+         !names.Add({place.osmId, place.type, place.name, place.country, place.latitude, place.longitude,
+            std::move(localizedNames)}))
+         LOG(WARNING) << std::format("Place with OSM ID {} has invalid center", place.osmId);
+
+      const std::int64_t osmId = place.osmId;
+      if (!citiesPath.empty() && !cities.Add(std::move(place)))
+         LOG(WARNING) << std::format("Place with OSM ID {} has invalid boundary", osmId);
+   }
+
+   if (!citiesPath.empty())
+      cities.Write(citiesPath);
+   if (!namesPath.empty())
+      names.Write(namesPath);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+   absl::ParseCommandLine(argc, argv);
+   absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
+   absl::InitializeLog();
+
+   const std::string inputPath = absl::GetFlag(FLAGS_input);
+   const std::string citiesPath = absl::GetFlag(FLAGS_cities);
+   const std::string namesPath = absl::GetFlag(FLAGS_names);
+   if (inputPath.empty() || (citiesPath.empty() && namesPath.empty()))
+   {
+      LOG(ERROR) << "Usage: geo_import --input=boundaries.geojson [--cities=cities.idx] [--names=names.idx]";
+      return -1;
+   }
+
+   try
+   {
+      importBoundaries(inputPath, citiesPath, namesPath);
+   }
+   catch (const std::exception& e)
+   {
+      LOG(ERROR) << e.what();
+      return -1;
+   }
+   return 0;
+}
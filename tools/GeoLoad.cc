@@ -0,0 +1,379 @@
+// Load generator of the geo service.
+//
+// Sends GetCities, GetRegions, GetRegionsStream and GetWeather RPCs at a fixed rate (open loop) and reports
+// latency percentiles and throughput of every RPC. Latency is measured from the time an RPC is scheduled,
+// so a slow server is not hidden by the generator waiting for it (coordinated omission).
+// RPCs are sent round-robin over the requested methods and the sample places of README.
+//
+// Usage, with the upstream APIs mocked by tests/mock_server.py:
+//    geo --config tests/mock-config.json
+//    geo_load --server=127.0.0.1:50051 --rpcs=GetCities,GetRegions,GetRegionsStream,GetWeather --qps=50 --duration=60
+
+#include "geo.grpc.pb.h"
+#include "geo.pb.h"
+
+#include <absl/flags/flag.h>
+#include <absl/flags/parse.h>
+#include <absl/log/globals.h>
+#include <absl/log/initialize.h>
+#include <absl/log/log.h>
+#include <absl/strings/str_split.h>
+#include <grpcpp/create_channel.h>
+#include <grpcpp/security/credentials.h>
+#include <grpcpp/support/channel_arguments.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+ABSL_FLAG(std::string, server, "127.0.0.1:50051", "Address of the geo service");
+ABSL_FLAG(std::string, rpcs, "GetCities,GetRegions,GetRegionsStream,GetWeather",
+   "Comma-separated RPCs to send round-robin");
+ABSL_FLAG(double, qps, 10, "Target rate of RPCs per second");
+ABSL_FLAG(std::uint32_t, duration, 30, "Duration of sending in seconds");
+ABSL_FLAG(std::uint32_t, maxInFlight, 1000, "RPCs which would exceed this number in flight are not sent");
+ABSL_FLAG(std::uint32_t, channels, 4, "Number of channels (HTTP/2 connections) to spread RPCs over");
+ABSL_FLAG(std::uint32_t, timeout, 60, "Deadline of every RPC in seconds");
+ABSL_FLAG(std::uint32_t, distanceKm, 100, "Half width of the box of GetRegions and GetRegionsStream");
+ABSL_FLAG(std::uint32_t, mask, 3, "Bitmask of features of GetRegions and GetRegionsStream");
+ABSL_FLAG(std::uint32_t, numYears, 3, "Number of years of GetWeather");
+
+namespace
+{
+
+using Clock = std::chrono::steady_clock;
+
+// Place used in requests
+struct Sample
+{
+   const char* name;  // Name of the place
+   double latitude;   // Latitude of the place
+   double longitude;  // Longitude of the place
+};
+
+constexpr std::array sc_samples = {Sample{"Guatemala", 14.594582, -90.517661},
+   Sample{"Zelenograd", 55.991893, 37.214390}, Sample{"Toledo", 39.858014, -4.029030},
+   Sample{"Pyongyang", 39.019368, 125.754257}, Sample{"Phnom Penh", 11.552898, 104.865913},
+   Sample{"Cairo", 30.050755, 31.246909}, Sample{"Kolkata", 22.563887, 88.345477},
+   Sample{"Kiev", 50.450441, 30.523550}, Sample{"Denver", 39.739253, -104.989117},
+   Sample{"Tarragona", 41.116525, 1.257839}, Sample{"Yerevan", 40.1777112, 44.5126233}};
+
+enum class Rpc
+{
+   GetCities,
+   GetRegions,
+   GetRegionsStream,
+   GetWeather
+};
+
+constexpr std::array<const char*, 4> sc_rpcNames = {"GetCities", "GetRegions", "GetRegionsStream", "GetWeather"};
+
+// Latencies and outcomes of RPCs, filled by gRPC callback threads
+class Recorder
+{
+public:
+   // Results of a method
+   struct Results
+   {
+      std::vector<std::int64_t> latencies;  // Latencies of successful RPCs in microseconds
+      std::uint64_t numErrors = 0;          // Number of failed RPCs
+      std::uint64_t numSkipped = 0;         // Number of RPCs not sent because of maxInFlight
+   };
+
+   // Records a completed RPC
+   // @param rpc Method of the RPC
+   // @param scheduled Time when the RPC was scheduled to be sent
+   // @param ok Whether the RPC succeeded
+   void Record(Rpc rpc, Clock::time_point scheduled, bool ok)
+   {
+      const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - scheduled);
+      std::lock_guard lock(m_mutex);
+      Results& results = m_results[static_cast<std::size_t>(rpc)];
+      if (ok)
+         results.latencies.push_back(latency.count());
+      else
+         ++results.numErrors;
+   }
+
+   // Records an RPC which is not sent
+   void RecordSkipped(Rpc rpc)
+   {
+      std::lock_guard lock(m_mutex);
+      ++m_results[static_cast<std::size_t>(rpc)].numSkipped;
+   }
+
+   // Logs percentiles and throughput of every method
+   // @param elapsed Time from the first RPC until the last one completed
+   void Report(Clock::duration elapsed)
+   {
+      std::lock_guard lock(m_mutex);
+      const double seconds = std::chrono::duration<double>(elapsed).count();
+      LOG(INFO) << std::format("{:<18}{:>8}{:>8}{:>8}{:>10}{:>10}{:>10}{:>10}{:>10}", "RPC", "ok", "errors",
+         "skipped", "rps", "p50 ms", "p99 ms", "p999 ms", "max ms");
+      for (std::size_t i = 0; i < m_results.size(); ++i)
+      {
+         auto& results = m_results[i];
+         if (results.latencies.empty() && results.numErrors == 0 && results.numSkipped == 0)
+            continue;
+
+         std::sort(results.latencies.begin(), results.latencies.end());
+         LOG(INFO) << std::format("{:<18}{:>8}{:>8}{:>8}{:>10.1f}{:>10.1f}{:>10.1f}{:>10.1f}{:>10.1f}", sc_rpcNames[i],
+            results.latencies.size(), results.numErrors, results.numSkipped, results.latencies.size() / seconds,
+            getPercentile(results.latencies, 0.5), getPercentile(results.latencies, 0.99),
+            getPercentile(results.latencies, 0.999), getPercentile(results.latencies, 1));
+      }
+   }
+
+private:
+   // Returns a percentile of sorted latencies in milliseconds
+   static double getPercentile(const std::vector<std::int64_t>& latencies, double fraction)
+   {
+      if (latencies.empty())
+         return 0;
+      const auto rank = static_cast<std::size_t>(std::ceil(fraction * latencies.size()));
+      return latencies[std::clamp<std::size_t>(rank, 1, latencies.size()) - 1] / 1000.0;
+   }
+
+private:
+   std::mutex m_mutex;                // Protects the results
+   std::array<Results, 4> m_results;  // Results by methods
+};
+
+// Shared state of all RPCs
+struct Context
+{
+   std::vector<std::unique_ptr<geoproto::Geo::Stub>> stubs;  // Stubs of all the channels
+   Recorder recorder;                                        // Results of the RPCs
+   std::atomic<std::uint32_t> numInFlight{0};                // Number of sent RPCs which are not completed
+   std::chrono::seconds timeout{0};                          // Deadline of RPCs
+};
+
+// Unary RPC with its messages, deleted when it completes
+template <typename TRequest, typename TResponse>
+struct UnaryCall
+{
+   grpc::ClientContext context;  // Context of the RPC
+   TRequest request;             // Request message
+   TResponse response;           // Response message
+};
+
+// Sends a unary RPC and records its outcome
+// @param start Function `void(ClientContext*, const TRequest*, TResponse*, std::function<void(grpc::Status)>)`
+//              starting the RPC
+template <typename TRequest, typename TResponse, typename TStart>
+void sendUnary(Context& context, Rpc rpc, Clock::time_point scheduled, TRequest request, TStart start)
+{
+   auto* call = new UnaryCall<TRequest, TResponse>;
+   call->request = std::move(request);
+   call->context.set_deadline(std::chrono::system_clock::now() + context.timeout);
+   start(&call->context, &call->request, &call->response,
+      [&context, call, rpc, scheduled](grpc::Status status)
+      {
+         context.recorder.Record(rpc, scheduled, status.ok());
+         delete call;
+         --context.numInFlight;
+      });
+}
+
+// Server-streaming RPC, records its outcome and deletes itself when the whole stream is received
+class StreamCall : public grpc::ClientReadReactor<geoproto::RegionsResponse>
+{
+public:
+   StreamCall(Context& context, Clock::time_point scheduled, geoproto::RegionsRequest request)
+      : m_context(context)
+      , m_scheduled(scheduled)
+      , m_request(std::move(request))
+   {
+   }
+
+   // Starts the RPC
+   // @param stub Stub to send the RPC with
+   void Start(geoproto::Geo::Stub& stub)
+   {
+      m_clientContext.set_deadline(std::chrono::system_clock::now() + m_context.timeout);
+      stub.async()->GetRegionsStream(&m_clientContext, &m_request, this);
+      StartRead(&m_response);
+      StartCall();
+   }
+
+   void OnReadDone(bool ok) override
+   {
+      if (ok)
+         StartRead(&m_response);
+   }
+
+   void OnDone(const grpc::Status& status) override
+   {
+      m_context.recorder.Record(Rpc::GetRegionsStream, m_scheduled, status.ok());
+      --m_context.numInFlight;
+      delete this;
+   }
+
+private:
+   Context& m_context;                    // Shared state of all RPCs
+   const Clock::time_point m_scheduled;   // Time when the RPC was scheduled to be sent
+   grpc::ClientContext m_clientContext;   // Context of the RPC
+   geoproto::RegionsRequest m_request;    // Request message
+   geoproto::RegionsResponse m_response;  // The last received message
+};
+
+geoproto::RegionsRequest makeRegionsRequest(const Sample& sample)
+{
+   geoproto::RegionsRequest request;
+   request.mutable_position()->set_latitude(sample.latitude);
+   request.mutable_position()->set_longitude(sample.longitude);
+   request.set_distance_km(absl::GetFlag(FLAGS_distanceKm));
+   request.mutable_prefs()->set_mask(absl::GetFlag(FLAGS_mask));
+   (*request.mutable_prefs()->mutable_properties())["minPeakHeight"] = "1000";
+   return request;
+}
+
+// Requests weather of the sample and the next one for 10 days starting a month later
+geoproto::WeatherRequest makeWeatherRequest(std::size_t index)
+{
+   const auto now = std::chrono::system_clock::now();
+   const auto from = std::chrono::duration_cast<std::chrono::seconds>((now + std::chrono::days{30}).time_since_epoch());
+   const auto to = from + std::chrono::days{10};
+
+   geoproto::WeatherRequest request;
+   for (std::size_t i = index; i < index + 2; ++i)
+   {
+      auto& location = *request.add_locations();
+      location.set_latitude(sc_samples[i % sc_samples.size()].latitude);
+      location.set_longitude(sc_samples[i % sc_samples.size()].longitude);
+   }
+   request.mutable_from_date()->set_seconds(from.count());
+   request.mutable_to_date()->set_seconds(to.count());
+   request.set_num_years(absl::GetFlag(FLAGS_numYears));
+   return request;
+}
+
+// Sends the RPC number `index`
+void send(Context& context, Rpc rpc, std::size_t index, Clock::time_point scheduled)
+{
+   geoproto::Geo::Stub& stub = *context.stubs[index % context.stubs.size()];
+   const Sample& sample = sc_samples[index % sc_samples.size()];
+   switch (rpc)
+   {
+   case Rpc::GetCities:
+   {
+      // Searches by position and by name alternate
+      geoproto::CitiesRequest request;
+      if (index / sc_samples.size() % 2 == 0)
+      {
+         request.mutable_position()->set_latitude(sample.latitude);
+         request.mutable_position()->set_longitude(sample.longitude);
+      }
+      else
+         request.set_name(sample.name);
+      sendUnary<geoproto::CitiesRequest, geoproto::CitiesResponse>(context, rpc, scheduled, std::move(request),
+         [&stub](auto* clientContext, auto* request, auto* response, auto callback)
+         {
+            stub.async()->GetCities(clientContext, request, response, std::move(callback));
+         });
+      break;
+   }
+   case Rpc::GetRegions:
+      sendUnary<geoproto::RegionsRequest, geoproto::RegionsResponse>(context, rpc, scheduled,
+         makeRegionsRequest(sample),
+         [&stub](auto* clientContext, auto* request, auto* response, auto callback)
+         {
+            stub.async()->GetRegions(clientContext, request, response, std::move(callback));
+         });
+      break;
+   case Rpc::GetRegionsStream:
+      (new StreamCall(context, scheduled, makeRegionsRequest(sample)))->Start(stub);
+      break;
+   case Rpc::GetWeather:
+      sendUnary<geoproto::WeatherRequest, geoproto::WeatherResponse>(context, rpc, scheduled,
+         makeWeatherRequest(index),
+         [&stub](auto* clientContext, auto* request, auto* response, auto callback)
+         {
+            stub.async()->GetWeather(clientContext, request, response, std::move(callback));
+         });
+      break;
+   }
+}
+
+// Parses names of RPCs, returns an empty list if any of them is unknown
+std::vector<Rpc> parseRpcs(const std::string& value)
+{
+   std::vector<Rpc> rpcs;
+   for (const auto name : absl::StrSplit(value, ',', absl::SkipEmpty()))
+   {
+      const auto it = std::find(sc_rpcNames.begin(), sc_rpcNames.end(), name);
+      if (it == sc_rpcNames.end())
+      {
+         LOG(ERROR) << std::format("Unknown RPC: {}", std::string(name));
+         return {};
+      }
+      rpcs.push_back(static_cast<Rpc>(it - sc_rpcNames.begin()));
+   }
+   return rpcs;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+   absl::ParseCommandLine(argc, argv);
+   absl::SetStderrThreshold(absl::LogSeverityAtLeast::kInfo);
+   absl::InitializeLog();
+
+   const std::vector<Rpc> rpcs = parseRpcs(absl::GetFlag(FLAGS_rpcs));
+   const double qps = absl::GetFlag(FLAGS_qps);
+   if (rpcs.empty() || qps <= 0)
+   {
+      LOG(ERROR) << "Usage: geo_load --server=127.0.0.1:50051 --rpcs=GetCities,GetWeather --qps=10 --duration=30";
+      return -1;
+   }
+
+   Context context;
+   context.timeout = std::chrono::seconds{absl::GetFlag(FLAGS_timeout)};
+   for (std::uint32_t i = 0; i < std::max(1u, absl::GetFlag(FLAGS_channels)); ++i)
+   {
+      // Every channel has its own connection
+      grpc::ChannelArguments arguments;
+      arguments.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+      context.stubs.push_back(geoproto::Geo::NewStub(grpc::CreateCustomChannel(
+         absl::GetFlag(FLAGS_server), grpc::InsecureChannelCredentials(), arguments)));
+   }
+
+   const std::uint32_t maxInFlight = absl::GetFlag(FLAGS_maxInFlight);
+   const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1 / qps));
+   const auto numRpcs = static_cast<std::size_t>(qps * absl::GetFlag(FLAGS_duration));
+   LOG(INFO) << std::format("Sending {} RPCs at {} per second to {}", numRpcs, qps, absl::GetFlag(FLAGS_server));
+
+   // RPCs are scheduled at fixed times; if sending falls behind, late RPCs are sent at once.
+   const auto start = Clock::now();
+   for (std::size_t i = 0; i < numRpcs; ++i)
+   {
+      const auto scheduled = start + period * i;
+      std::this_thread::sleep_until(scheduled);
+
+      const Rpc rpc = rpcs[i % rpcs.size()];
+      if (context.numInFlight >= maxInFlight)
+      {
+         context.recorder.RecordSkipped(rpc);
+         continue;
+      }
+      ++context.numInFlight;
+      send(context, rpc, i / rpcs.size(), scheduled);
+   }
+
+   while (context.numInFlight > 0)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+   context.recorder.Report(Clock::now() - start);
+   return 0;
+}